@@ -28,12 +28,18 @@ void arp_init();
 
 void arp_print();
 
-void arp_in(buf_t *buf, uint8_t *src_mac);
+size_t arp_table_size();
 
-void arp_out(buf_t *buf, uint8_t *ip);
+size_t arp_pending_size();
 
-void arp_req(uint8_t *target_ip);
+size_t arp_buf_pool_free();
 
-void arp_resp(uint8_t *target_ip, uint8_t *target_mac);
+void arp_in(netif_t *netif, buf_t *buf, uint8_t *src_mac);
+
+void arp_out(netif_t *netif, buf_t *buf, uint8_t *ip);
+
+void arp_req(netif_t *netif, uint8_t *target_ip);
+
+void arp_resp(netif_t *netif, uint8_t *target_ip, uint8_t *target_mac);
 
 #endif
\ No newline at end of file
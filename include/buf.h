@@ -9,11 +9,15 @@ typedef struct buf //协议栈的通用数据包buffer, 可以在头部装卸数
 {
   size_t len;                   // 包中有效数据大小
   uint8_t *data;                // 包的数据起始地址
+  uint8_t *head;                // 可用存储的起始地址，通常为payload，也可指向外部存储如驱动的映射环形队列
+  uint8_t *end;                 // 可用存储的结束地址
   uint8_t payload[BUF_MAX_LEN]; // 最大负载数据量
 } buf_t;
 
 int buf_init(buf_t *buf, size_t len);
 
+void buf_attach(buf_t *buf, uint8_t *data, size_t len, uint8_t *head, uint8_t *end);
+
 int buf_add_header(buf_t *buf, size_t len);
 
 int buf_remove_header(buf_t *buf, size_t len);
@@ -29,16 +29,49 @@
         0x44, 0xe5, 0x17, 0xf9, 0xf1, 0xe6 \
     } //自定义网卡mac地址
 #endif
+#define NET_IF_MASK          \
+    {                        \
+        255, 255, 255, 0     \
+    } //网卡默认子网掩码
+#define NET_IF_MAX_NUM 4 //最多支持的网卡数量
 
 
 #define ETHERNET_MAX_TRANSPORT_UNIT 1500 //以太网最大传输单元
+#define ETHERNET_POLL_BUDGET 64          //每个网卡每次轮询最多处理的帧数
+
+#define PACKET_BLOCK_SIZE (1 << 18)  //AF_PACKET环形队列块大小，必须为页大小的整数倍
+#define PACKET_RX_BLOCK_NUM 64       //AF_PACKET接收环形队列块数
+#define PACKET_TX_BLOCK_NUM 2        //AF_PACKET发送环形队列块数
+#define PACKET_FRAME_SIZE 2048       //AF_PACKET环形队列帧大小，需容纳最大帧与帧头
+#define PACKET_BLOCK_TIMEOUT_MS 1    //AF_PACKET接收块未满时交给用户的超时毫秒数
+
+#define XDP_FRAME_NUM 4096   //AF_XDP UMEM帧数，一半用于接收，一半用于发送
+#define XDP_FRAME_SIZE 2048  //AF_XDP UMEM帧大小，必须为2的幂且不小于2048
+#define XDP_RING_SIZE 2048   //AF_XDP各环形队列大小，必须为2的幂
+#define XDP_BATCH 64         //AF_XDP每次批量收取与回收的描述符数
+
+#define TAP_QUEUE_NUM 4 //TAP设备的队列数，内核按流把收到的帧分配到各队列
+
+#define WIRE_MAX_NUM 16        //进程内最多的虚拟链路数
+#define WIRE_QUEUE_SIZE 1024   //虚拟链路每个方向在途的帧数，满时丢弃新帧，必须为2的幂
+#define WIRE_FRAME_SIZE 1536   //虚拟链路最大帧长，需容纳以太网头部与最大传输单元
+#define WIRE_HOLD_NS 1000000   //乱序扣下的帧之后没有帧时，超过原送达时间此纳秒数后送出
 
 #define ARP_TIMEOUT_SEC (60 * 5) //arp表过期时间
 #define ARP_MIN_INTERVAL 1       //向相同地址发送arp请求的最小间隔
+#define ARP_PENDING_MAX 16       //每个地址最多缓存的待发送包数，必须为2的幂
+#define ARP_BUF_POOL_SIZE 16     //待发送包缓冲池容量，必须为2的幂
 
 #define IP_DEFALUT_TTL 64 //IP默认TTL
 
 #define BUF_MAX_LEN (2 * UINT16_MAX + UINT8_MAX) //buf最大长度
 
+#define SHARD_MAX_NUM 64                   //最多的分片工作线程数
+#define SHARD_RING_SIZE 1024               //分片收发环形队列容量，必须为2的幂
+#define SHARD_RETA_SIZE 128                //RSS重定向表大小，必须为2的幂
+#define SHARD_BURST 32                     //分发线程每个网卡每次轮询最多收取的帧数
+#define SHARD_IDLE_NS 100000               //分片线程空闲时的休眠纳秒数
+#define SHARD_STACK_SIZE (64 * 1024 * 1024) //分片线程栈大小，需容纳线程局部的协议栈状态
+
 #define MAP_MAX_LEN (16 * BUF_MAX_LEN) //map最大长度
 #endif
\ No newline at end of file
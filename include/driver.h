@@ -7,12 +7,62 @@
 #define PCAP_BUF_SIZE 1024
 #endif
 
-int driver_open();
+typedef struct driver_ops //驱动操作表，每种网卡后端实现一份
+{
+  const char *name;                            // 驱动名
+  int (*open)(netif_t *netif);                 // 打开网卡，成功为0，失败为-1
+  int (*recv)(netif_t *netif, buf_t *buf);     // 接收数据包，返回长度，未收到为0，错误为-1
+  int (*send)(netif_t *netif, buf_t *buf);     // 发送数据包，成功为0，失败为-1
+  void (*close)(netif_t *netif);               // 关闭网卡
+} driver_ops_t;
 
-int driver_recv(buf_t *buf);
+extern const driver_ops_t driver_pcap_ops;
 
-int driver_send(buf_t *buf);
+#ifdef __linux__
+extern const driver_ops_t driver_packet_ops;
+extern const driver_ops_t driver_xdp_ops;
+extern const driver_ops_t driver_tap_ops;
+extern const driver_ops_t driver_wire_ops;
 
-void driver_close();
+typedef struct driver_wire_config //虚拟链路一个方向的参数，由发送端施加在发出的帧上
+{
+  uint64_t latency_ns;      // 单向传播延迟
+  uint64_t bandwidth;       // 每秒比特数，帧按长度排队串行发出，0为不限
+  double loss;              // 丢帧概率
+  double reorder;           // 乱序概率：帧被扣下，在下一帧之后送达
+  uint64_t seed;            // 随机数种子，相同的种子与相同的发送序列得到相同的丢帧与乱序
+} driver_wire_config_t;
+
+typedef struct driver_wire_stats //虚拟链路一端的计数
+{
+  uint64_t tx_frames;       // 交给链路的帧数
+  uint64_t rx_frames;       // 收到的帧数
+  uint64_t lost;            // 按丢帧概率丢弃的帧数
+  uint64_t overflow;        // 在途帧数满而丢弃的帧数
+  uint64_t reordered;       // 被扣下乱序的帧数
+} driver_wire_stats_t;
+
+int driver_wire_config(const char *name, const driver_wire_config_t *config);
+
+int driver_wire_stats(netif_t *netif, driver_wire_stats_t *stats);
+#endif
+
+const driver_ops_t *driver_find_ops(const char *name);
+
+static inline int driver_open(netif_t *netif) {
+  return netif->ops->open(netif);
+}
+
+static inline int driver_recv(netif_t *netif, buf_t *buf) {
+  return netif->ops->recv(netif, buf);
+}
+
+static inline int driver_send(netif_t *netif, buf_t *buf) {
+  return netif->ops->send(netif, buf);
+}
+
+static inline void driver_close(netif_t *netif) {
+  netif->ops->close(netif);
+}
 
 #endif
\ No newline at end of file
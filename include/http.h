@@ -2,8 +2,67 @@
 #define HTTP_H
 
 #include <stdint.h>
+#include "http_parser.h"
 
 #define XHTTP_DOC_DIR               "../htmldocs"
+#define HTTP_METRICS_PATH           "/metrics" //内置的指标路由，优先于同名文件
+#define HTTP_HEALTH_PATH            "/healthz" //内置的健康检查路由
+#ifndef HTTP_CONN_MAX
+#define HTTP_CONN_MAX               4096       //同时处理的连接数，超出时新连接留在接受队列中
+#endif
+#ifndef HTTP_ACCEPT_BACKLOG
+#define HTTP_ACCEPT_BACKLOG         128        //接受队列长度，队列满时新连接得到503后关闭
+#endif
+#define HTTP_REQUEST_MAX            1024       //请求头最大长度
+#define HTTP_OUT_SIZE               1460       //每个连接的响应头与文件块缓冲大小
+#define HTTP_KEEPALIVE_MAX          100        //每个持久连接最多处理的请求数，之后的响应带Connection: close
+#ifndef HTTP_KEEPALIVE_TIMEOUT
+#define HTTP_KEEPALIVE_TIMEOUT      5          //等待下一个请求的秒数，超时关闭连接
+#endif
+
+/*
+ * 路由：路径精确匹配或前缀匹配到处理函数，注册时插入每个线程一份的字典树，
+ * 查找时按路径逐字节走一遍，精确匹配优先，否则取最长的前缀。
+ * http_server_open注册静态文件("/"前缀)、指标与健康检查，之后注册的同名路由替换它们
+ */
+
+#define HTTP_ROUTE_EXACT  0 //只匹配相同的路径
+#define HTTP_ROUTE_PREFIX 1 //匹配以此开头的路径
+
+typedef struct http_conn http_conn_t;
+
+typedef struct http_request //交给处理函数的请求，片段指向接收缓存，只在处理函数内有效
+{
+  http_slice_t path;              // 不含查询参数
+  http_slice_t query;             // ?之后的查询参数
+  const http_parser_t *parser;    // 方法、版本与全部头部
+  http_slice_t range;             // Range
+  http_slice_t if_range;          // If-Range
+  http_slice_t if_none_match;     // If-None-Match
+  http_slice_t if_modified_since; // If-Modified-Since
+  http_slice_t accept_encoding;   // Accept-Encoding
+} http_request_t;
+
+/**
+ * @brief 处理函数，在返回前调用http_respond或http_respond_stream给出响应
+ *
+ */
+typedef void (*http_handler_t)(http_conn_t *conn, const http_request_t *req, void *arg);
+
+/**
+ * @brief 流式响应体的生产函数，每次对端窗口有空间时被调用，写入不超过size字节；
+ *        返回0表示响应体结束。buf为NULL表示连接在结束前被释放，只需释放arg
+ *
+ */
+typedef size_t (*http_stream_t)(void *arg, char *buf, size_t size);
+
+int http_route(const char *path, int prefix, http_handler_t handler, void *arg);
+
+void http_respond(http_conn_t *conn, const char *status, const char *content_type, const char *content, size_t size,
+                  char *owned);
+
+void http_respond_stream(http_conn_t *conn, const char *status, const char *content_type, http_stream_t stream,
+                         void *arg);
 
 int http_server_open(uint16_t port);
 
@@ -0,0 +1,70 @@
+#ifndef HTTP_CACHE_H
+#define HTTP_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * 静态文件缓存：每个线程一份，按文件路径散列。文件第一次被请求时整个读入内存，
+ * 之后的请求只做一次查找，响应头也在第一次使用时生成并保存在缓存项中，
+ * 发送时直接从缓存项写入tcp发送缓存，不再打开文件、读文件或格式化响应头。
+ * 每HTTP_CACHE_CHECK秒至多stat一次，修改时间或大小变化时重新加载。
+ * 正在发送的连接持有引用，失效的缓存项在最后一个引用释放时才被释放。
+ * 加载与检查文件时一并查看同目录下的预压缩版本(文件名加.br、.gz)，不旧于文件的记在缓存项中
+ */
+
+#define HTTP_CACHE_BUCKETS   256               //散列桶数，必须为2的幂
+#ifndef HTTP_CACHE_FILE_MAX
+#define HTTP_CACHE_FILE_MAX  (1 << 20)         //超过此大小的文件不缓存，映射后交给tcp发送
+#endif
+#define HTTP_CACHE_SIZE      (32 << 20)        //每个线程缓存的文件总大小上限
+#define HTTP_CACHE_HEAD_SIZE 384               //缓存的响应头最大长度
+#ifndef HTTP_CACHE_CHECK
+#define HTTP_CACHE_CHECK     1                 //两次检查文件是否修改的最小间隔秒数
+#endif
+
+typedef enum http_encoding //预压缩版本的内容编码，按优先顺序
+{
+  HTTP_ENCODING_BR,
+  HTTP_ENCODING_GZIP,
+  HTTP_ENCODING_NUM,
+} http_encoding_t;
+
+extern const char *const http_encoding_name[HTTP_ENCODING_NUM];   // Content-Encoding中的名称
+extern const char *const http_encoding_suffix[HTTP_ENCODING_NUM]; // 文件名后缀
+
+typedef struct http_cache_entry //一个缓存的文件
+{
+  struct http_cache_entry *next;        // 散列桶中的下一项
+  char *path;                           // 文件路径
+  char *body;                           // 文件内容
+  size_t body_len;
+  time_t mtime;                         // 加载时文件的修改时间
+  time_t checked;                       // 上次检查文件的时间
+  unsigned encodings;                   // 存在的预压缩版本，按http_encoding_t的位
+  int refs;                             // 缓存本身与正在发送的连接持有的引用数
+  char head[2][HTTP_CACHE_HEAD_SIZE];   // 关闭连接与保持连接两种响应头，由http服务器填写
+  size_t head_len[2];                   // 响应头长度，0为尚未生成
+} http_cache_entry_t;
+
+typedef struct http_cache_stats //当前线程的缓存统计
+{
+  uint64_t hits;              // 命中次数
+  uint64_t misses;            // 未命中(含文件不存在与不可缓存)次数
+  uint64_t reloads;           // 文件修改后重新加载的次数
+  size_t entries;             // 缓存的文件数
+  size_t bytes;               // 缓存的文件总大小
+} http_cache_stats_t;
+
+http_cache_entry_t *http_cache_get(const char *path);
+
+void http_cache_put(http_cache_entry_t *entry);
+
+void http_cache_clear();
+
+const http_cache_stats_t *http_cache_stats();
+
+unsigned http_cache_encodings(const char *path, time_t mtime);
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef HTTP_LOAD_H
+#define HTTP_LOAD_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "net.h"
+#include "latency.h"
+
+/**
+ * http压测客户端：经本协议栈的tcp主动打开一批连接，在每个连接上保持连接地反复发送GET，
+ * 统计响应状态与延迟分位数，可以在另一个进程中对main的http服务器压测，不依赖外部工具。
+ * 限速时按目标速率排出每个请求的计划发送时间，延迟从计划时间算起，
+ * 服务器变慢时排队的时间也计入延迟，不会因为客户端跟着变慢而低估(coordinated omission)。
+ * 不限速时每个连接收到响应后立即发送下一个请求，延迟从实际发送时算起。
+ * 状态每个线程一份，由http_load_run在主循环中推进，不等待网络
+ */
+
+#define HTTP_LOAD_CONN_MAX  4096 //最多的并发连接数
+#define HTTP_LOAD_TIMEOUT   2    //握手或响应超过此秒数没有进展时关闭连接并计为超时，之后重新连接
+#define HTTP_LOAD_HEAD_MAX  4096 //响应头最大长度，超过时按错误响应处理
+
+typedef struct http_load_config //压测参数
+{
+  uint8_t ip[NET_IP_LEN];     // 服务器ip
+  uint16_t port;              // 服务器端口
+  const char *path;           // 请求的路径
+  size_t connections;         // 并发连接数
+  double rate;                // 所有连接合计每秒请求数，0为不限速
+  double duration;            // 发送请求的秒数，0为不限时
+  uint64_t requests;          // 请求总数，0为不限数量；duration与requests至少一个不为0
+} http_load_config_t;
+
+typedef struct http_load_stats //压测结果
+{
+  uint64_t sent;              // 发出的请求数
+  uint64_t completed;         // 完整收到的响应数
+  uint64_t status_2xx;        // 其中2xx与3xx的响应数
+  uint64_t status_other;      // 其中其他状态的响应数
+  uint64_t bytes;             // 收到的响应头与响应体的字节数
+  uint64_t connects;          // 完成握手的连接数
+  uint64_t connect_errors;    // 被拒绝或没有端口的连接数
+  uint64_t timeouts;          // 握手或响应超时的次数
+  uint64_t errors;            // 格式错误的响应与响应中途关闭的连接数
+  double seconds;             // 从开始到结束的秒数
+  latency_hist_t latency;     // 每个响应的延迟，单位为周期
+} http_load_stats_t;
+
+int http_load_start(const http_load_config_t *config);
+
+int http_load_run(void);
+
+void http_load_stop(void);
+
+const http_load_stats_t *http_load_stats(void);
+
+void http_load_report(FILE *f);
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef HTTP_PARSER_H
+#define HTTP_PARSER_H
+
+#include <stddef.h>
+
+/**
+ * 增量的http请求解析器：直接在tcp接收缓存上解析，不复制也不修改数据。
+ * 请求头不完整时调用者保存已查找过的位置，下一段数据到达后从该位置继续查找请求头结尾，
+ * 找到后一次解析出方法、路径、版本与各头部，结果都是指向缓存的片段，在缓存被消费之前有效，
+ * 解析结果可以放在栈上，不分配内存。
+ * 查找控制字符(行尾与非法字节)时每次比较16字节(SSE2)，其他平台逐字节比较
+ */
+
+#define HTTP_PARSER_HEADERS_MAX 32 //最多解析的头部数，更多时按请求头过大处理
+
+#define HTTP_PARSE_INCOMPLETE 0    //请求头尚未完整到达
+#define HTTP_PARSE_BAD        -1   //请求格式错误
+#define HTTP_PARSE_TOO_LARGE  -2   //请求头超过长度上限或头部过多
+
+typedef struct http_slice //缓存中的一段，不以'\0'结尾
+{
+  const char *data;
+  size_t len;
+} http_slice_t;
+
+typedef struct http_header //一个头部
+{
+  http_slice_t name;
+  http_slice_t value;         // 去掉了前后的空白
+} http_header_t;
+
+typedef struct http_parser //一个请求的解析结果
+{
+  http_slice_t method;
+  http_slice_t path;
+  int minor_version;          // HTTP/1.x中的x
+  size_t num_headers;
+  http_header_t headers[HTTP_PARSER_HEADERS_MAX];
+} http_parser_t;
+
+int http_parse_request(http_parser_t *parser, const char *buf, size_t len, size_t *scan, size_t max);
+
+int http_slice_is(http_slice_t s, const char *str);
+
+int http_slice_is_nocase(http_slice_t s, const char *str);
+
+int http_slice_has_token(http_slice_t s, const char *token);
+
+const char *http_slice_find(http_slice_t s, const char *str);
+
+#endif
@@ -24,9 +24,9 @@ typedef enum icmp_code {
   ICMP_CODE_PORT_UNREACH = 3      // 端口不可达
 } icmp_code_t;
 
-void icmp_in(buf_t *buf, uint8_t *src_ip);
+void icmp_in(netif_t *netif, buf_t *buf, uint8_t *src_ip);
 
-void icmp_unreachable(buf_t *recv_buf, uint8_t *src_ip, icmp_code_t code);
+void icmp_unreachable(netif_t *netif, buf_t *recv_buf, uint8_t *src_ip, icmp_code_t code);
 
 void icmp_init();
 
@@ -24,11 +24,12 @@ typedef struct ip_hdr {
 #define IP_VERSION_4 4             //ipv4
 #define IP_MORE_FRAGMENT (1 << 13) //ip分片mf位
 #define IP_DO_NOT_FRAGMENT (1 << 14) //ip分片df位
+#define IP_FRAGMENT_OFFSET_MASK 0x1fff //ip分片偏移所在的位
 #define IP_OUT_TTL IP_DEFALUT_TTL  //ip包默认生存时间
 
-void ip_in(buf_t *buf, uint8_t *src_mac);
+void ip_in(netif_t *netif, buf_t *buf, uint8_t *src_mac);
 
-void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol);
+void ip_out(netif_t *netif, buf_t *buf, uint8_t *ip, net_protocol_t protocol);
 
 void ip_init();
 
@@ -0,0 +1,83 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdio.h>
+#include "utils.h"
+
+/**
+ * 每条处理路径的延迟直方图。以NET_LATENCY编译时，ethernet_in入口(驱动刚交付帧)记下起点，
+ * 之后各层边界打点，回复交给driver_send时把各点相对起点的周期数记入当前线程的直方图；
+ * 直方图只由所属线程写入，无锁，读取时汇总所有线程。未定义NET_LATENCY时打点宏为空，没有任何开销。
+ * 直方图为对数线性分桶，每个2的幂区间再均分为2^LATENCY_SUB_BITS个桶，相对误差不超过1/16
+ */
+
+#define LATENCY_SUB_BITS 4                //每个2的幂区间内的线性桶数的位数
+#define LATENCY_MAX_BITS 44               //可记录的最大周期数的位数，更大的值记入最后一个桶
+#define LATENCY_BUCKETS ((LATENCY_MAX_BITS - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS)
+
+typedef enum latency_path { //处理路径，由处理该帧的协议层标记
+  LATENCY_PATH_NONE = -1,
+  LATENCY_PATH_ICMP_ECHO,
+  LATENCY_PATH_UDP_ECHO,
+  LATENCY_PATH_TCP_DATA,
+  LATENCY_PATH_HTTP_REQUEST, // 从取出连接到响应写完，不以单帧计
+  LATENCY_PATH_NUM,
+} latency_path_t;
+
+typedef enum latency_stage { //打点位置，均相对ethernet_in入口
+  LATENCY_IP_IN,
+  LATENCY_TRANSPORT_IN,      // icmp_in、udp_in、tcp_in
+  LATENCY_HANDLER,           // 调用应用处理程序前
+  LATENCY_IP_OUT,
+  LATENCY_DRIVER_SEND,
+  LATENCY_STAGE_NUM,
+} latency_stage_t;
+
+typedef struct latency_hist //对数线性直方图，单位为周期
+{
+  uint64_t count;
+  uint64_t max;
+  uint64_t bucket[LATENCY_BUCKETS];
+} latency_hist_t;
+
+void latency_hist_record(latency_hist_t *hist, uint64_t value);
+
+uint64_t latency_hist_quantile(const latency_hist_t *hist, double q);
+
+void latency_rx();
+
+void latency_mark(latency_stage_t stage);
+
+void latency_path(latency_path_t path);
+
+void latency_tx();
+
+void latency_record(latency_path_t path, latency_stage_t stage, uint64_t cycles);
+
+size_t latency_snapshot(latency_hist_t *out, latency_path_t path, latency_stage_t stage);
+
+const char *latency_path_name(latency_path_t path);
+
+const char *latency_stage_name(latency_stage_t stage);
+
+double latency_ns_per_cycle();
+
+void latency_dump(FILE *f);
+
+#ifdef NET_LATENCY
+#define LATENCY_RX() latency_rx()
+#define LATENCY_MARK(stage) latency_mark(LATENCY_##stage)
+#define LATENCY_PATH(path) latency_path(LATENCY_PATH_##path)
+#define LATENCY_TX() latency_tx()
+#define LATENCY_SPAN_BEGIN(var) uint64_t var = cycles_now()
+#define LATENCY_SPAN_END(path, stage, var) latency_record(LATENCY_PATH_##path, LATENCY_##stage, cycles_now() - (var))
+#else
+#define LATENCY_RX() ((void) 0)
+#define LATENCY_MARK(stage) ((void) 0)
+#define LATENCY_PATH(path) ((void) 0)
+#define LATENCY_TX() ((void) 0)
+#define LATENCY_SPAN_BEGIN(var)
+#define LATENCY_SPAN_END(path, stage, var) ((void) 0)
+#endif
+
+#endif
@@ -0,0 +1,215 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "debug_macros.h"
+
+/**
+ * 分级日志，级别在编译时确定，低于NET_LOG_LEVEL的日志点在编译时去除，只留在sizeof中做类型检查，
+ * 不产生任何指令，参数(如iptos)也不会被求值。
+ *   Err         NET_LOG_LEVEL_ERR
+ *   Log、Ok     NET_LOG_LEVEL_INFO
+ *   Dbg         NET_LOG_LEVEL_DBG
+ * 默认输出到标准输出；定义NET_LOG_RING时写入每个线程各自的二进制环形缓冲，
+ * 只保存格式串地址与原始参数，不做格式化，由log_dump导出后用log_decode离线解码。
+ * 定义NET_LOG_DISABLE等价于NET_LOG_LEVEL为NET_LOG_LEVEL_NONE。Assert与panic不受影响。
+ */
+
+#define NET_LOG_LEVEL_NONE 0
+#define NET_LOG_LEVEL_ERR 1
+#define NET_LOG_LEVEL_INFO 2
+#define NET_LOG_LEVEL_DBG 3
+
+#ifdef NET_LOG_DISABLE
+#undef NET_LOG_LEVEL
+#define NET_LOG_LEVEL NET_LOG_LEVEL_NONE
+#endif
+
+#ifndef NET_LOG_LEVEL
+#define NET_LOG_LEVEL NET_LOG_LEVEL_DBG
+#endif
+
+#define LOG_RING_SIZE 4096     //每个线程环形缓冲的记录数，必须为2的幂，写满后覆盖最旧的记录
+#define LOG_ARG_MAX 12         //每条记录最多保存的参数个数
+#define LOG_STR_MAX 64         //每条记录中字符串参数共用的空间
+#define LOG_DUMP_MAGIC 0x474f4c54454e //导出文件的魔数"NETLOG"
+
+typedef enum log_arg_type {
+  LOG_ARG_INT,
+  LOG_ARG_UINT,
+  LOG_ARG_DOUBLE,
+  LOG_ARG_PTR,
+  LOG_ARG_STR,  // 写入时复制到记录中
+  LOG_ARG_IP,   // ip地址，解码时按%s格式化
+  LOG_ARG_MAC,  // mac地址，解码时按%s格式化
+} log_arg_type_t;
+
+typedef struct log_arg //一个日志参数
+{
+  uint32_t type;
+  uint32_t len;           // 字符串长度
+  union {
+    int64_t i;
+    uint64_t u;
+    double d;
+    const void *p;
+    const char *s;        // 写入记录后为字符串在记录中的偏移
+    uint8_t addr[8];
+  };
+} log_arg_t;
+
+typedef struct log_site //一个日志点，静态分配
+{
+  int level;
+  int line;
+  const char *file;
+  const char *fmt;
+} log_site_t;
+
+typedef struct log_ip {
+  uint8_t addr[4];
+} log_ip_t;
+
+typedef struct log_mac {
+  uint8_t addr[6];
+} log_mac_t;
+
+static inline log_arg_t log_arg_int(long long v) {
+  log_arg_t arg = {.type = LOG_ARG_INT, .i = v};
+  return arg;
+}
+
+static inline log_arg_t log_arg_uint(unsigned long long v) {
+  log_arg_t arg = {.type = LOG_ARG_UINT, .u = v};
+  return arg;
+}
+
+static inline log_arg_t log_arg_double(double v) {
+  log_arg_t arg = {.type = LOG_ARG_DOUBLE, .d = v};
+  return arg;
+}
+
+static inline log_arg_t log_arg_ptr(const void *v) {
+  log_arg_t arg = {.type = LOG_ARG_PTR, .p = v};
+  return arg;
+}
+
+static inline log_arg_t log_arg_str(const char *v) {
+  log_arg_t arg = {.type = LOG_ARG_STR, .s = v};
+  return arg;
+}
+
+static inline log_arg_t log_arg_ip(log_ip_t v) {
+  log_arg_t arg = {.type = LOG_ARG_IP};
+  for (int i = 0; i < 4; i++) arg.addr[i] = v.addr[i];
+  return arg;
+}
+
+static inline log_arg_t log_arg_mac(log_mac_t v) {
+  log_arg_t arg = {.type = LOG_ARG_MAC};
+  for (int i = 0; i < 6; i++) arg.addr[i] = v.addr[i];
+  return arg;
+}
+
+static inline log_ip_t log_ip(const void *ip) {
+  log_ip_t v;
+  for (int i = 0; i < 4; i++) v.addr[i] = ((const uint8_t *) ip)[i];
+  return v;
+}
+
+static inline log_mac_t log_mac(const void *mac) {
+  log_mac_t v;
+  for (int i = 0; i < 6; i++) v.addr[i] = ((const uint8_t *) mac)[i];
+  return v;
+}
+
+#define LOG_ARG(x) _Generic((x),                                                  \
+    _Bool: log_arg_uint, char: log_arg_int, signed char: log_arg_int,            \
+    short: log_arg_int, int: log_arg_int, long: log_arg_int, long long: log_arg_int, \
+    unsigned char: log_arg_uint, unsigned short: log_arg_uint, unsigned int: log_arg_uint, \
+    unsigned long: log_arg_uint, unsigned long long: log_arg_uint,               \
+    float: log_arg_double, double: log_arg_double,                               \
+    char *: log_arg_str, const char *: log_arg_str,                              \
+    log_ip_t: log_arg_ip, log_mac_t: log_arg_mac,                                \
+    default: log_arg_ptr)(x)
+
+// 把参数逐个转换为log_arg_t，每项前带逗号。位域参数需先强制转换为整数类型
+#define LOG_NARGS(...) LOG_NARGS_(_, ##__VA_ARGS__, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define LOG_NARGS_(_, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, n, ...) n
+#define LOG_CAT(a, b) LOG_CAT_(a, b)
+#define LOG_CAT_(a, b) a##b
+#define LOG_MAP(...) LOG_CAT(LOG_MAP_, LOG_NARGS(__VA_ARGS__))(__VA_ARGS__)
+#define LOG_MAP_0()
+#define LOG_MAP_1(a) , LOG_ARG(a)
+#define LOG_MAP_2(a, ...) , LOG_ARG(a) LOG_MAP_1(__VA_ARGS__)
+#define LOG_MAP_3(a, ...) , LOG_ARG(a) LOG_MAP_2(__VA_ARGS__)
+#define LOG_MAP_4(a, ...) , LOG_ARG(a) LOG_MAP_3(__VA_ARGS__)
+#define LOG_MAP_5(a, ...) , LOG_ARG(a) LOG_MAP_4(__VA_ARGS__)
+#define LOG_MAP_6(a, ...) , LOG_ARG(a) LOG_MAP_5(__VA_ARGS__)
+#define LOG_MAP_7(a, ...) , LOG_ARG(a) LOG_MAP_6(__VA_ARGS__)
+#define LOG_MAP_8(a, ...) , LOG_ARG(a) LOG_MAP_7(__VA_ARGS__)
+#define LOG_MAP_9(a, ...) , LOG_ARG(a) LOG_MAP_8(__VA_ARGS__)
+#define LOG_MAP_10(a, ...) , LOG_ARG(a) LOG_MAP_9(__VA_ARGS__)
+#define LOG_MAP_11(a, ...) , LOG_ARG(a) LOG_MAP_10(__VA_ARGS__)
+#define LOG_MAP_12(a, ...) , LOG_ARG(a) LOG_MAP_11(__VA_ARGS__)
+
+// 写入环形缓冲，首个元素占位，避免无参数时初始化列表为空
+#define LOG_RING_WRITE(lvl, fmt, ...) do {                                       \
+    static const log_site_t log_site_ = {lvl, __LINE__, __FILE__, fmt};          \
+    log_arg_t log_args_[] = {{0} LOG_MAP(__VA_ARGS__)};                          \
+    log_ring_write(&log_site_, log_args_ + 1, LOG_NARGS(__VA_ARGS__));           \
+  } while (0)
+
+void log_ring_write(const log_site_t *site, const log_arg_t *args, size_t n);
+
+// 被过滤的日志点放在sizeof中，参数不求值也不产生指令，但仍算作被使用
+static inline int log_unused(int n, ...) {
+  return n;
+}
+#define LOG_UNUSED(...) ((void) sizeof(log_unused(0, ##__VA_ARGS__)))
+
+int log_dump(FILE *f);
+
+long log_decode(FILE *in, FILE *out);
+
+#ifdef NET_LOG_RING
+#define LOG_IP(ip) log_ip(ip)      //ip地址参数，环形缓冲只保存4字节，由解码器格式化
+#define LOG_MAC(mac) log_mac(mac)  //mac地址参数，环形缓冲只保存6字节，由解码器格式化
+#else
+#define LOG_IP(ip) iptos(ip)
+#define LOG_MAC(mac) mactos(mac)
+#endif
+
+// 文本输出沿用debug_macros的定义，只替换被过滤或改写到环形缓冲的宏
+#if defined(NET_LOG_RING) || NET_LOG_LEVEL < NET_LOG_LEVEL_ERR
+#undef Err
+#if NET_LOG_LEVEL >= NET_LOG_LEVEL_ERR
+#define Err(fmt, ...) LOG_RING_WRITE(NET_LOG_LEVEL_ERR, fmt, ##__VA_ARGS__)
+#else
+#define Err(...) LOG_UNUSED(__VA_ARGS__)
+#endif
+#endif
+
+#if defined(NET_LOG_RING) || NET_LOG_LEVEL < NET_LOG_LEVEL_INFO
+#undef Log
+#undef Ok
+#if NET_LOG_LEVEL >= NET_LOG_LEVEL_INFO
+#define Log(fmt, ...) LOG_RING_WRITE(NET_LOG_LEVEL_INFO, fmt, ##__VA_ARGS__)
+#define Ok(fmt, ...) LOG_RING_WRITE(NET_LOG_LEVEL_INFO, fmt, ##__VA_ARGS__)
+#else
+#define Log(...) LOG_UNUSED(__VA_ARGS__)
+#define Ok(...) LOG_UNUSED(__VA_ARGS__)
+#endif
+#endif
+
+#if defined(NET_LOG_RING) || NET_LOG_LEVEL < NET_LOG_LEVEL_DBG
+#undef Dbg
+#if NET_LOG_LEVEL >= NET_LOG_LEVEL_DBG
+#define Dbg(fmt, ...) LOG_RING_WRITE(NET_LOG_LEVEL_DBG, fmt, ##__VA_ARGS__)
+#else
+#define Dbg(...) LOG_UNUSED(__VA_ARGS__)
+#endif
+#endif
+
+#endif
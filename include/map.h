@@ -16,8 +16,10 @@ typedef struct map //协议栈的通用泛型map，即键值对的容器，支
   size_t value_len;                  //值的长度
   size_t size;                       //当前大小
   size_t max_size;                   //最大容量
+  size_t top;                        //曾使用过的位置上界，其后的位置都为空，查找只需扫描到此处
   time_t timeout;                    //超时时间，0为永不超时
   map_constuctor_t value_constuctor; //形如memcpy的值构造函数，用于拷贝非平凡数据结构到容器中，如buf_copy
+  map_entry_handler_t expire_handler; //超时的键值对被清理或其位置被复用前调用，用于释放值持有的资源
   uint8_t data[MAP_MAX_LEN];         //数据
 } map_t;
 
@@ -34,4 +36,8 @@ void map_delete(map_t *map, const void *key);
 
 void map_foreach(map_t *map, map_entry_handler_t handler);
 
+void map_on_expire(map_t *map, map_entry_handler_t handler);
+
+void map_expire(map_t *map);
+
 #endif
\ No newline at end of file
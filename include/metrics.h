@@ -0,0 +1,12 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+
+#define METRICS_BUF_SIZE (16 * 1024) //渲染一次指标所需的缓冲大小
+
+size_t metrics_render(char *buf, size_t size);
+
+size_t metrics_printf(char *buf, size_t size, size_t len, const char *fmt, ...);
+
+#endif
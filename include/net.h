@@ -16,21 +16,43 @@ typedef enum net_protocol {
   NET_PROTOCOL_TCP = 6,
 } net_protocol_t;
 
-typedef void (*net_handler_t)(buf_t *buf, uint8_t *src);
-
 #define NET_MAC_LEN 6 //mac地址长度
 #define NET_IP_LEN 4  //ip地址长度
+#define NET_IF_NAME_LEN 64 //网卡名最大长度
+
+struct driver_ops;
+
+typedef struct netif //网卡，协议栈各层以此为上下文
+{
+  char name[NET_IF_NAME_LEN];     // 网卡名，为空则由驱动自动选取
+  uint8_t mac[NET_MAC_LEN];       // 网卡mac地址
+  uint8_t ip[NET_IP_LEN];         // 网卡ip地址
+  uint8_t mask[NET_IP_LEN];       // 子网掩码，用于路由选择
+  uint16_t mtu;                   // 最大传输单元
+  const struct driver_ops *ops;   // 驱动操作表
+  void *priv;                     // 驱动私有数据
+  uint64_t rx_packets;            // 收到的帧数
+  uint64_t tx_packets;            // 发送成功的帧数
+  buf_t rxbuf, txbuf;             // 网卡接收和发送缓冲区，一个buf足够单线程使用
+} netif_t;
+
+typedef void (*net_handler_t)(netif_t *netif, buf_t *buf, uint8_t *src);
 
-extern uint8_t net_if_mac[NET_MAC_LEN];
 extern uint8_t net_broadcast_mac[NET_MAC_LEN];
-extern uint8_t net_if_ip[NET_IP_LEN];
-extern buf_t rxbuf, txbuf; //一个buf足够单线程使用
+
+netif_t *netif_add(const char *name, const uint8_t *ip, const uint8_t *mac, const struct driver_ops *ops);
+
+netif_t *netif_get(size_t index);
+
+netif_t *netif_route(const uint8_t *ip);
 
 int net_init();
 
-void net_poll();
+void net_stack_init();
+
+size_t net_poll();
 
-int net_in(buf_t *buf, uint16_t protocol, uint8_t *src);
+int net_in(netif_t *netif, buf_t *buf, uint16_t protocol, uint8_t *src);
 
 void net_add_protocol(uint16_t protocol, net_handler_t handler);
 
@@ -0,0 +1,64 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include "net.h"
+
+/**
+ * 飞行记录仪：每个线程一个预分配的环形缓冲，保存最近收发的RECORDER_SIZE个帧的前RECORDER_SNAPLEN字节，
+ * 以及丢弃原因与tcp连接等元数据。网卡收发缓冲在协议栈中被复用，只记指针的话导出时内容已被覆盖，
+ * 因此每帧复制有界的前缀到预分配的槽位，不做分配也不加锁。
+ * 收到信号、崩溃或tcp复位时导出为pcapng，可直接用wireshark打开，元数据在每帧的注释中。
+ * 未调用recorder_open时各记录点只有一次分支判断
+ */
+
+#define RECORDER_SIZE 1024      //每个线程保存的帧数，必须为2的幂
+#define RECORDER_SNAPLEN 128    //每帧保存的最大字节数
+#define RECORDER_DUMP_MAX 16    //tcp复位触发的导出次数上限，避免复位风暴写满磁盘
+#define RECORDER_PATH_LEN 256   //导出文件路径最大长度
+
+typedef enum recorder_dir {
+  RECORDER_IN = 1,  // 与pcapng epb_flags的方向取值一致
+  RECORDER_OUT = 2,
+} recorder_dir_t;
+
+extern int recorder_enabled;
+
+int recorder_open(const char *path);
+
+void recorder_record(netif_t *netif, const buf_t *buf, recorder_dir_t dir);
+
+void recorder_set_drop(int reason);
+
+void recorder_set_key(recorder_dir_t dir, const uint8_t *ip, uint16_t remote_port, uint16_t local_port);
+
+int recorder_dump(const char *path);
+
+void recorder_trigger(const char *reason);
+
+void recorder_crash(int sig);
+
+//ethernet_in入口记录收到的帧
+static inline void recorder_rx(netif_t *netif, const buf_t *buf) {
+  if (recorder_enabled)
+    recorder_record(netif, buf, RECORDER_IN);
+}
+
+//交给驱动前记录发出的帧
+static inline void recorder_tx(netif_t *netif, const buf_t *buf) {
+  if (recorder_enabled)
+    recorder_record(netif, buf, RECORDER_OUT);
+}
+
+//当前收到的帧被丢弃，reason为net_stats_counter_t
+static inline void recorder_drop(int reason) {
+  if (recorder_enabled)
+    recorder_set_drop(reason);
+}
+
+//当前收到的帧或下一个发出的帧所属的tcp连接
+static inline void recorder_key(recorder_dir_t dir, const uint8_t *ip, uint16_t remote_port, uint16_t local_port) {
+  if (recorder_enabled)
+    recorder_set_key(dir, ip, remote_port, local_port);
+}
+
+#endif
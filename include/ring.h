@@ -0,0 +1,42 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+
+#define RING_CACHE_LINE 64 //缓存行大小，生产者与消费者下标分处不同缓存行，避免伪共享
+
+typedef struct ring //有界无锁指针环形队列，支持单生产者或多生产者、单消费者
+{
+  size_t size;                                     // 容量，必须为2的幂
+  void **slots;                                    // 元素槽
+  alignas(RING_CACHE_LINE) atomic_size_t reserve;  // 生产者已预留到的位置，仅多生产者使用
+  atomic_size_t head;                              // 生产者已发布到的位置，消费者可见
+  alignas(RING_CACHE_LINE) atomic_size_t tail;     // 消费者下一读取位置
+} ring_t;
+
+int ring_init(ring_t *ring, size_t size);
+
+void ring_free(ring_t *ring);
+
+ring_t *ring_new(size_t size);
+
+void ring_delete(ring_t *ring);
+
+size_t ring_enqueue_burst(ring_t *ring, void *const *items, size_t n);
+
+size_t ring_mp_enqueue_burst(ring_t *ring, void *const *items, size_t n);
+
+size_t ring_dequeue_burst(ring_t *ring, void **items, size_t n);
+
+int ring_enqueue(ring_t *ring, void *item);
+
+int ring_mp_enqueue(ring_t *ring, void *item);
+
+void *ring_dequeue(ring_t *ring);
+
+size_t ring_count(ring_t *ring);
+
+#endif
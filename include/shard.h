@@ -0,0 +1,20 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include "net.h"
+
+#define SHARD_ALL ((size_t) -1) //需要复制给所有分片的帧，如arp响应
+
+typedef void (*shard_hook_t)(void);
+
+uint32_t shard_toeplitz(const uint8_t *data, size_t len);
+
+size_t shard_steer(const uint8_t *frame, size_t len);
+
+int shard_start(size_t num, shard_hook_t setup, shard_hook_t poll);
+
+size_t shard_poll();
+
+void shard_stop();
+
+#endif
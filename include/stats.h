@@ -0,0 +1,105 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include "utils.h"
+#include "recorder.h"
+
+/**
+ * 协议栈各层的计数器，每个线程一份，只有所属线程写入，不加锁也不使用原子指令；
+ * 读取方用net_stats_snapshot汇总，读到的是近似一致的快照。
+ * 计数器以X宏列出，名字即dump输出中的键。同一层的丢弃计数器必须相邻，
+ * metrics按相邻的计数器输出同一个指标的TYPE行
+ */
+#define NET_STATS_COUNTERS(X)                                        \
+  X(ETH_RX_PACKETS, "eth.rx_packets")                                \
+  X(ETH_RX_BYTES, "eth.rx_bytes")                                    \
+  X(ETH_TX_PACKETS, "eth.tx_packets")                                \
+  X(ETH_TX_BYTES, "eth.tx_bytes")                                    \
+  X(ETH_TX_ERRORS, "eth.tx_errors")                                  \
+  X(ETH_DROP_NOT_MINE, "eth.drop.not_mine")                          \
+  X(ETH_DROP_BAD_TYPE, "eth.drop.bad_type")                          \
+  X(ETH_DROP_NO_HANDLER, "eth.drop.no_handler")                      \
+  X(ARP_RX_PACKETS, "arp.rx_packets")                                \
+  X(ARP_TX_REQUESTS, "arp.tx_requests")                              \
+  X(ARP_TX_REPLIES, "arp.tx_replies")                                \
+  X(ARP_DROP_TOO_SHORT, "arp.drop.too_short")                        \
+  X(ARP_DROP_BAD_FORMAT, "arp.drop.bad_format")                      \
+  X(ARP_DROP_NOT_MINE, "arp.drop.not_mine")                          \
+  X(ARP_DROP_PENDING_FULL, "arp.drop.pending_full")                  \
+  X(ARP_DROP_PENDING_TIMEOUT, "arp.drop.pending_timeout")            \
+  X(ARP_HITS, "arp.hits")                                            \
+  X(ARP_MISSES, "arp.misses")                                        \
+  X(IP_RX_PACKETS, "ip.rx_packets")                                  \
+  X(IP_RX_BYTES, "ip.rx_bytes")                                      \
+  X(IP_TX_PACKETS, "ip.tx_packets")                                  \
+  X(IP_TX_BYTES, "ip.tx_bytes")                                      \
+  X(IP_RX_FRAGMENTS, "ip.rx_fragments")                              \
+  X(IP_TX_FRAGMENTS, "ip.tx_fragments")                              \
+  X(IP_DROP_TOO_SHORT, "ip.drop.too_short")                          \
+  X(IP_DROP_BAD_VERSION, "ip.drop.bad_version")                      \
+  X(IP_DROP_BAD_HDR_LEN, "ip.drop.bad_hdr_len")                      \
+  X(IP_DROP_DF_TOO_LARGE, "ip.drop.df_too_large")                    \
+  X(IP_DROP_NOT_MINE, "ip.drop.not_mine")                            \
+  X(IP_DROP_BAD_CHECKSUM, "ip.drop.bad_checksum")                    \
+  X(IP_DROP_NO_HANDLER, "ip.drop.no_handler")                        \
+  X(ICMP_RX_PACKETS, "icmp.rx_packets")                              \
+  X(ICMP_TX_ECHO_REPLIES, "icmp.tx_echo_replies")                    \
+  X(ICMP_TX_UNREACH, "icmp.tx_unreach")                              \
+  X(ICMP_DROP_TOO_SHORT, "icmp.drop.too_short")                      \
+  X(UDP_RX_PACKETS, "udp.rx_packets")                                \
+  X(UDP_RX_BYTES, "udp.rx_bytes")                                    \
+  X(UDP_TX_PACKETS, "udp.tx_packets")                                \
+  X(UDP_TX_BYTES, "udp.tx_bytes")                                    \
+  X(UDP_DROP_TOO_SHORT, "udp.drop.too_short")                        \
+  X(UDP_DROP_BAD_CHECKSUM, "udp.drop.bad_checksum")                  \
+  X(UDP_DROP_NO_HANDLER, "udp.drop.no_handler")                      \
+  X(TCP_RX_SEGMENTS, "tcp.rx_segments")                              \
+  X(TCP_RX_BYTES, "tcp.rx_bytes")                                    \
+  X(TCP_TX_SEGMENTS, "tcp.tx_segments")                              \
+  X(TCP_TX_BYTES, "tcp.tx_bytes")                                    \
+  X(TCP_DROP_TOO_SHORT, "tcp.drop.too_short")                        \
+  X(TCP_DROP_BAD_CHECKSUM, "tcp.drop.bad_checksum")                  \
+  X(TCP_DROP_NO_HANDLER, "tcp.drop.no_handler")                      \
+  X(TCP_DROP_RX_FULL, "tcp.drop.rx_full")                            \
+  X(TCP_RX_RETRANSMITS, "tcp.rx_retransmits")                        \
+  X(TCP_RX_RESETS, "tcp.rx_resets")                                  \
+  X(TCP_TX_RESETS, "tcp.tx_resets")                                  \
+  X(TCP_CONN_OPENED, "tcp.conn_opened")
+
+typedef enum net_stats_counter {
+#define NET_STATS_ENUM(id, name) NET_STATS_##id,
+  NET_STATS_COUNTERS(NET_STATS_ENUM)
+#undef NET_STATS_ENUM
+  NET_STATS_NUM,
+} net_stats_counter_t;
+
+typedef struct net_stats //一组计数器
+{
+  uint64_t counter[NET_STATS_NUM];
+} net_stats_t;
+
+extern NET_THREAD_LOCAL net_stats_t *net_stats_self;
+
+net_stats_t *net_stats_attach();
+
+//当前线程的计数器，首次使用时分配
+static inline net_stats_t *net_stats_local() {
+  net_stats_t *stats = net_stats_self;
+  return stats ? stats : net_stats_attach();
+}
+
+#define NET_STATS_INC(id) (net_stats_local()->counter[NET_STATS_##id]++)
+#define NET_STATS_ADD(id, n) (net_stats_local()->counter[NET_STATS_##id] += (n))
+//丢弃当前收到的帧，同时在飞行记录仪中标记原因
+#define NET_STATS_DROP(id) (NET_STATS_INC(id), recorder_drop(NET_STATS_##id))
+
+const char *net_stats_name(net_stats_counter_t counter);
+
+size_t net_stats_snapshot(net_stats_t *out, int thread);
+
+void net_stats_diff(net_stats_t *out, const net_stats_t *now, const net_stats_t *before);
+
+void net_stats_dump(FILE *f, const net_stats_t *stats, int all);
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef TCP_H
 #define TCP_H
 
+#include <sys/types.h>
 #include "net.h"
 
 #pragma pack(1)
@@ -47,6 +48,9 @@ typedef struct tcp_hdr {
   uint16_t urgent_pointer16;
 } tcp_hdr_t;
 
+#define TCP_MSS (ETHERNET_MAX_TRANSPORT_UNIT - 20 - sizeof(tcp_hdr_t)) //每个报文段最多的数据，ip头部20字节
+#define TCP_EPHEMERAL_MIN 49152 //主动打开时本地端口的最小值，从此往上轮流使用
+
 typedef struct tcp_peso_hdr {
   uint8_t src_ip[4];    // 源IP地址
   uint8_t dst_ip[4];    // 目的IP地址
@@ -72,6 +76,7 @@ typedef enum tcp_state {
   TCP_FIN_WAIT_2,
   TCP_CLOSING,
   TCP_TIME_WAIT,
+  TCP_STATE_NUM, // 状态数
 } tcp_state_t;
 
 typedef struct tcp_key {
@@ -87,8 +92,10 @@ typedef enum connect_state {
   TCP_CONN_CONNECTED,
   // 收到数据
   TCP_CONN_DATA_RECV,
-  // 关闭连接
+  // 关闭连接，连接释放前调用，之后指针失效；主动打开的连接握手失败时也会调用
   TCP_CONN_CLOSED,
+  // 对端确认了数据，发送缓存有了空间
+  TCP_CONN_WRITABLE,
 } connect_state_t;
 
 typedef void (*tcp_handler_t)(struct tcp_connect *connect, connect_state_t state);
@@ -102,10 +109,24 @@ typedef struct tcp_connect {
   uint16_t remote_mss;
   uint16_t remote_win;
   tcp_handler_t *handler;
+  netif_t *netif; // 连接所在的网卡
   buf_t *rx_buf; // 接收缓存
   buf_t *tx_buf; // 发送缓存
+  const uint8_t *tx_map; // tcp_connect_sendfile映射的文件中最早未确认的字节，排在tx_buf之后发送
+  size_t tx_map_len;     // 映射中未确认的字节数，为0时映射已解除，可以继续写入
+  void *tx_map_base;     // 映射的起始地址与长度，供解除映射
+  size_t tx_map_size;
+  void *app;     // 应用私有数据，连接建立时为NULL
+  uint32_t generation; // 建立连接时分配的代号，释放后为0；槽位被新连接复用时代号不同
+  int active;          // 由tcp_connect主动打开，释放时注销本地端口
 } tcp_connect_t;
 
+typedef struct tcp_handle //连接的句柄，连接释放后不再能解析出连接，不会指向复用同一槽位的新连接
+{
+  tcp_connect_t *connect;
+  uint32_t generation;
+} tcp_handle_t;
+
 static const tcp_connect_t CONNECT_LISTEN = {
     .state = TCP_LISTEN,
 };
@@ -118,11 +139,31 @@ void tcp_close(uint16_t port);
 
 void tcp_connect_close(tcp_connect_t *connect);
 
+tcp_connect_t *tcp_connect(const uint8_t *ip, uint16_t port, tcp_handler_t handler);
+
+tcp_handle_t tcp_connect_handle(tcp_connect_t *connect);
+
+tcp_connect_t *tcp_handle_get(tcp_handle_t handle);
+
 size_t tcp_connect_write(tcp_connect_t *connect, const uint8_t *data, size_t len);
 
 size_t tcp_connect_read(tcp_connect_t *connect, uint8_t *data, size_t len);
 
-void tcp_in(buf_t *buf, uint8_t *src_ip);
+const uint8_t *tcp_connect_peek(tcp_connect_t *connect, size_t *len);
+
+void tcp_connect_consume(tcp_connect_t *connect, size_t len);
+
+size_t tcp_connect_flush(tcp_connect_t *connect);
+
+size_t tcp_connect_unsent(tcp_connect_t *connect);
+
+int tcp_connect_sendfile(tcp_connect_t *connect, int fd, off_t offset, size_t len);
+
+void tcp_in(netif_t *netif, buf_t *buf, uint8_t *src_ip);
+
+const char *tcp_state_name(tcp_state_t state);
+
+size_t tcp_connect_count(size_t count[TCP_STATE_NUM], size_t *capacity);
 
 // #define TCP_BUF_SIZE_TX (1024 * 4)
 // #define TCP_BUF_SIZE_RX (1024 * 4)
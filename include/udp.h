@@ -20,15 +20,15 @@ typedef struct udp_peso_hdr {
 } udp_peso_hdr_t;
 #pragma pack()
 
-typedef void (*udp_handler_t)(uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port);
+typedef void (*udp_handler_t)(netif_t *netif, uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port);
 
 void udp_init();
 
-void udp_in(buf_t *buf, uint8_t *src_ip);
+void udp_in(netif_t *netif, buf_t *buf, uint8_t *src_ip);
 
-void udp_out(buf_t *buf, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port);
+void udp_out(netif_t *netif, buf_t *buf, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port);
 
-void udp_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port);
+void udp_send(netif_t *netif, uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port);
 
 int udp_open(uint16_t port, udp_handler_t handler);
 
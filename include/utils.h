@@ -1,11 +1,49 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <stddef.h>
 #include <stdint.h>
+#include <stdatomic.h>
 #include <time.h>
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#ifndef _MSC_VER
+#define NET_THREAD_LOCAL _Thread_local //协议栈状态，分片模式下每个线程各有一份
+#else
+#define NET_THREAD_LOCAL
+#endif
+
+typedef struct thread_block //每个线程一个的块挂在全局链表上的链接，块在进程结束前不释放，其他线程可随时遍历
+{
+  struct thread_block *next;
+  uint32_t thread;                // 线程序号，按挂入链表的顺序分配
+} thread_block_t;
+
+typedef struct thread_block_list //每个线程一个的块组成的无锁链表，只增不减
+{
+  _Atomic(thread_block_t *) head;
+  atomic_uint num;
+} thread_block_list_t;
+
+#define thread_block_of(link, type, member) ((type *) ((char *) (link) - offsetof(type, member))) //由链接取得所在的块
+
+void *thread_block_attach(thread_block_list_t *list, size_t size, size_t offset);
+
 uint16_t checksum16(uint16_t *data, size_t len);
 
+void checksum16_complete(uint8_t *data, size_t len, size_t offset);
+
+uint16_t checksum16_copy(uint8_t *dst, const uint8_t *src, size_t len);
+
+//反码相加两个16位部分和
+static inline uint16_t checksum16_add(uint16_t a, uint16_t b) {
+  uint32_t sum = (uint32_t) a + b;
+  return (uint16_t) ((sum & 0xffff) + (sum >> 16));
+}
+
 #define constswap16(x) ((((x)&0xFF) << 8) | (((x) >> 8) & 0xFF)) //为16位数据交换大小端
 
 //为16位数据交换大小端
@@ -22,6 +60,25 @@ static inline uint32_t swap32(uint32_t x) {
       (((x >> 24) & 0xFF) << 0);
 }
 
+//读取处理器周期计数器，用于测量每个包的开销
+static inline uint64_t cycles_now() {
+#if defined(_MSC_VER)
+  return __rdtsc();
+#elif defined(__x86_64__) || defined(__i386__)
+  uint32_t lo, hi;
+  __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+  return (uint64_t) hi << 32 | lo;
+#elif defined(__aarch64__)
+  uint64_t cnt;
+  __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(cnt));
+  return cnt;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
 static inline uint32_t min32(uint32_t a, uint32_t b) {
   return a < b ? a : b;
 }
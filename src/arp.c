@@ -3,8 +3,9 @@
 #include "net.h"
 #include "arp.h"
 #include "ethernet.h"
-#include "debug_macros.h"
-#include "queue.h"
+#include "log.h"
+#include "ring.h"
+#include "stats.h"
 
 /**
  * @brief 初始的arp包
@@ -15,21 +16,71 @@ static const arp_pkt_t arp_init_pkt = {
     .pro_type16 = constswap16(NET_PROTOCOL_IP),
     .hw_len = NET_MAC_LEN,
     .pro_len = NET_IP_LEN,
-    .sender_ip = NET_IF_IP,
-    .sender_mac = NET_IF_MAC,
     .target_mac = {0}};
 
 /**
  * @brief arp地址转换表，<ip,mac>的容器
  * 
  */
-map_t arp_table;
+NET_THREAD_LOCAL map_t arp_table;
 
 /**
- * @brief arp buffer，<ip,buf_t>的容器, map_t(queue_t)
+ * @brief arp buffer，<ip,buf_t>的容器, map_t(ring_t *)，每个待解析地址一个有界环形队列，
+ *        ARP_MIN_INTERVAL内没有等到响应的地址连同队列一起清理，之后的包重新发送请求
  * 
  */
-map_t arp_buf;
+NET_THREAD_LOCAL map_t arp_buf;
+
+/**
+ * @brief 空闲的待发送包缓冲池，避免每个待发送包都分配一次
+ * 
+ */
+static NET_THREAD_LOCAL ring_t arp_buf_pool;
+
+/**
+ * @brief 从缓冲池取一个缓冲并复制数据包，缓冲池为空时分配
+ * 
+ * @param buf 要复制的数据包
+ * @return buf_t* 复制出的数据包，分配失败为NULL
+ */
+static buf_t *arp_buf_alloc(buf_t *buf) {
+  buf_t *copy = ring_dequeue(&arp_buf_pool);
+  if (!copy && !(copy = malloc(sizeof(buf_t)))) {
+    Err("arp: cannot allocate a pending buffer, drop this packet");
+    NET_STATS_INC(ARP_DROP_PENDING_FULL);
+    return NULL;
+  }
+  buf_copy(copy, buf, 0);
+  return copy;
+}
+
+/**
+ * @brief 把缓冲归还缓冲池，缓冲池满时释放
+ * 
+ * @param buf 要归还的缓冲
+ */
+static void arp_buf_release(buf_t *buf) {
+  if (ring_enqueue(&arp_buf_pool, buf) != 0)
+    free(buf);
+}
+
+/**
+ * @brief 清理一个没有等到arp响应的地址，丢弃其待发送包，缓冲归还缓冲池
+ * 
+ * @param ip 待解析的ip地址
+ * @param value 待发送包的环形队列指针
+ * @param timestamp 发送请求的时间
+ */
+static void arp_pending_expire(void *ip, void *value, time_t *timestamp) {
+  ring_t *ring = *(ring_t **) value;
+  buf_t *queued_bufs[ARP_PENDING_MAX];
+  size_t n = ring_dequeue_burst(ring, (void **) queued_bufs, ARP_PENDING_MAX);
+  Log("arp: no reply from %s, drop %zu pending packets", LOG_IP(ip), n);
+  NET_STATS_ADD(ARP_DROP_PENDING_TIMEOUT, n);
+  for (size_t i = 0; i < n; i++)
+    arp_buf_release(queued_bufs[i]);
+  ring_delete(ring);
+}
 
 /**
  * @brief 打印一条arp表项
@@ -39,74 +90,115 @@ map_t arp_buf;
  * @param timestamp 表项的更新时间
  */
 void arp_entry_print(void *ip, void *mac, time_t *timestamp) {
-  Log("%s | %s | %s", iptos(ip), mactos(mac), timetos(*timestamp));
+  Log("%s | %s | %s", LOG_IP(ip), LOG_MAC(mac), timetos(*timestamp));
 }
 
 /**
- * @brief 打印整个arp表
+ * @brief 打印整个arp表，日志级别低于NET_LOG_LEVEL_INFO时不遍历
  * 
  */
 void arp_print() {
+#if NET_LOG_LEVEL >= NET_LOG_LEVEL_INFO
   Log("===ARP TABLE BEGIN===");
   map_foreach(&arp_table, arp_entry_print);
   Log("===ARP TABLE  END ===");
+#endif
+}
+
+/**
+ * @brief 当前线程arp表中的表项数
+ * 
+ * @return size_t 表项数，包括已超时但尚未清理的表项
+ */
+size_t arp_table_size() {
+  return map_size(&arp_table);
+}
+
+/**
+ * @brief 当前线程正在等待arp响应的地址数，先清理已超时的地址
+ * 
+ * @return size_t 地址数
+ */
+size_t arp_pending_size() {
+  map_expire(&arp_buf);
+  return map_size(&arp_buf);
+}
+
+/**
+ * @brief 当前线程待发送包缓冲池中空闲的缓冲数，容量为ARP_BUF_POOL_SIZE
+ * 
+ * @return size_t 缓冲数
+ */
+size_t arp_buf_pool_free() {
+  return ring_count(&arp_buf_pool);
 }
 
 /**
  * @brief 发送一个arp请求
  * 
+ * @param netif 发送请求的网卡
  * @param target_ip 想要知道的目标的ip地址
  */
-void arp_req(uint8_t *target_ip) {
+void arp_req(netif_t *netif, uint8_t *target_ip) {
+  buf_t *txbuf = &netif->txbuf;
   // init txbuf
-  buf_init(&txbuf, sizeof(arp_pkt_t) + ARP_PADDING_SIZE);
-  arp_pkt_t *p = (arp_pkt_t *) txbuf.data;
+  buf_init(txbuf, sizeof(arp_pkt_t) + ARP_PADDING_SIZE);
+  arp_pkt_t *p = (arp_pkt_t *) txbuf->data;
   // fill in padding
-  memset(txbuf.data + sizeof(arp_pkt_t), 0, ARP_PADDING_SIZE);
+  memset(txbuf->data + sizeof(arp_pkt_t), 0, ARP_PADDING_SIZE);
   // fill in default data
   memcpy(p, &arp_init_pkt, sizeof(arp_pkt_t));
-  // fill in target ip
+  // fill in sender ip, sender mac, target ip
+  memcpy(p->sender_ip, netif->ip, NET_IP_LEN);
+  memcpy(p->sender_mac, netif->mac, NET_MAC_LEN);
   memcpy(p->target_ip, target_ip, NET_IP_LEN);
   // call ethernet layer
   p->opcode16 = constswap16(ARP_REQUEST);
-  ethernet_out(&txbuf, net_broadcast_mac, NET_PROTOCOL_ARP);
+  NET_STATS_INC(ARP_TX_REQUESTS);
+  ethernet_out(netif, txbuf, net_broadcast_mac, NET_PROTOCOL_ARP);
 }
 
 /**
  * @brief 发送一个arp响应
  * 
+ * @param netif 发送响应的网卡
  * @param target_ip 目标ip地址
  * @param target_mac 目标mac地址
  */
-void arp_resp(uint8_t *target_ip, uint8_t *target_mac) {
+void arp_resp(netif_t *netif, uint8_t *target_ip, uint8_t *target_mac) {
+  buf_t *txbuf = &netif->txbuf;
   // init txbuf
-  buf_init(&txbuf, sizeof(arp_pkt_t) + ARP_PADDING_SIZE);
-  arp_pkt_t *p = (arp_pkt_t *) txbuf.data;
+  buf_init(txbuf, sizeof(arp_pkt_t) + ARP_PADDING_SIZE);
+  arp_pkt_t *p = (arp_pkt_t *) txbuf->data;
   // fill in padding
-  memset(txbuf.data + sizeof(arp_pkt_t), 0, ARP_PADDING_SIZE);
+  memset(txbuf->data + sizeof(arp_pkt_t), 0, ARP_PADDING_SIZE);
   // fill in default data
   memcpy(p, &arp_init_pkt, sizeof(arp_pkt_t));
   // fill in target ip, target mac, sender ip, sender mac
   memcpy(p->target_ip, target_ip, NET_IP_LEN);
   memcpy(p->target_mac, target_mac, NET_MAC_LEN);
-  memcpy(p->sender_ip, net_if_ip, NET_IP_LEN);
-  memcpy(p->sender_mac, net_if_mac, NET_MAC_LEN);
+  memcpy(p->sender_ip, netif->ip, NET_IP_LEN);
+  memcpy(p->sender_mac, netif->mac, NET_MAC_LEN);
   p->opcode16 = constswap16(ARP_REPLY);
+  NET_STATS_INC(ARP_TX_REPLIES);
   // call ethernet layer
-  ethernet_out(&txbuf, target_mac, NET_PROTOCOL_ARP);
+  ethernet_out(netif, txbuf, target_mac, NET_PROTOCOL_ARP);
 }
 
 /**
  * @brief 处理一个收到的数据包
  * 
+ * @param netif 收到数据包的网卡
  * @param buf 要处理的数据包
  * @param src_mac 源mac地址
  */
-void arp_in(buf_t *buf, uint8_t *src_mac) {
-  Dbg("arp: in from %s", mactos(src_mac));
+void arp_in(netif_t *netif, buf_t *buf, uint8_t *src_mac) {
+  Dbg("arp: in from %s", LOG_MAC(src_mac));
+  NET_STATS_INC(ARP_RX_PACKETS);
   // check package length
   if (buf->len < sizeof(arp_pkt_t)) {
     Log("arp: invalid package length");
+    NET_STATS_DROP(ARP_DROP_TOO_SHORT);
     return;
   }
   // check package
@@ -115,78 +207,93 @@ void arp_in(buf_t *buf, uint8_t *src_mac) {
       p->hw_len == NET_MAC_LEN && p->pro_len == NET_IP_LEN) {
     // handle arp reply
     Log("arp in: arp package from mac %s; sender ip=%s, sender mac=%s, target ip=%s, target mac=%s, hw_type=%d, opcode=%d",
-        mactos(src_mac), iptos(p->sender_ip), mactos(p->sender_mac), iptos(p->target_ip),
-        mactos(p->target_mac), swap16(p->hw_type16), swap16(p->opcode16));
-    if (p->opcode16 == constswap16(ARP_REPLY) && memcmp(p->target_ip, net_if_ip, NET_IP_LEN) == 0 &&
-        memcmp(p->target_mac, net_if_mac, NET_MAC_LEN) == 0) {
+        LOG_MAC(src_mac), LOG_IP(p->sender_ip), LOG_MAC(p->sender_mac), LOG_IP(p->target_ip),
+        LOG_MAC(p->target_mac), swap16(p->hw_type16), swap16(p->opcode16));
+    if (p->opcode16 == constswap16(ARP_REPLY) && memcmp(p->target_ip, netif->ip, NET_IP_LEN) == 0 &&
+        memcmp(p->target_mac, netif->mac, NET_MAC_LEN) == 0) {
       Log("arp in: this is a arp reply");
       map_set(&arp_table, p->sender_ip, p->sender_mac);
       arp_print();
       // flush pending buffer
-      queue_t *pending_queue = (queue_t *) map_get(&arp_buf, p->sender_ip);
+      ring_t **pending_queue = (ring_t **) map_get(&arp_buf, p->sender_ip);
       if (pending_queue) {
         Log("arp in: re-send the pending packet");
-        buf_t *queued_buf;
-        while ((queued_buf = queue_pop(pending_queue)) != NULL)
-          ethernet_out(queued_buf, p->sender_mac, NET_PROTOCOL_IP);
+        ring_t *ring = *pending_queue;
+        buf_t *queued_bufs[ARP_PENDING_MAX];
+        size_t n = ring_dequeue_burst(ring, (void **) queued_bufs, ARP_PENDING_MAX);
+        for (size_t i = 0; i < n; i++) {
+          ethernet_out(netif, queued_bufs[i], p->sender_mac, NET_PROTOCOL_IP);
+          arp_buf_release(queued_bufs[i]);
+        }
         // remove this item in pending buffer
         map_delete(&arp_buf, p->sender_ip);
-        // items in this queue was constructed by malloc, so can free them
-        // but queue struct is map data, cannot free
-        queue_free_data(pending_queue, true);
+        ring_delete(ring);
       }
     } else {
       // handle arp request
-      if (p->opcode16 == constswap16(ARP_REQUEST) && memcmp(p->target_ip, net_if_ip, NET_IP_LEN) == 0) {
-        Log("arp in: this is a arp request, from ip=%s, mac=%s", iptos(p->sender_ip), mactos(p->sender_mac));
+      if (p->opcode16 == constswap16(ARP_REQUEST) && memcmp(p->target_ip, netif->ip, NET_IP_LEN) == 0) {
+        Log("arp in: this is a arp request, from ip=%s, mac=%s", LOG_IP(p->sender_ip), LOG_MAC(p->sender_mac));
         // update arp table
         map_set(&arp_table, p->sender_ip, p->sender_mac);
         // send reply
-        arp_resp(p->sender_ip, p->sender_mac);
+        arp_resp(netif, p->sender_ip, p->sender_mac);
+      } else {
+        NET_STATS_DROP(ARP_DROP_NOT_MINE);
       }
     }
   } else {
-    Log("arp in: invalid package! pro_type=%x, target ip=%s, target mac=%s", swap16(p->pro_type16), iptos(p->target_ip),
-        mactos(p->target_mac));
+    NET_STATS_DROP(ARP_DROP_BAD_FORMAT);
+    Log("arp in: invalid package! pro_type=%x, target ip=%s, target mac=%s", swap16(p->pro_type16), LOG_IP(p->target_ip),
+        LOG_MAC(p->target_mac));
   }
 }
 
 /**
  * @brief 处理一个要发送的数据包
  * 
+ * @param netif 发送数据包的网卡
  * @param buf 要处理的数据包
  * @param ip 目标ip地址
  */
-void arp_out(buf_t *buf, uint8_t *ip) {
-  if (ip[0] == 0) Err("arp: out to %s", iptos(ip));
+void arp_out(netif_t *netif, buf_t *buf, uint8_t *ip) {
+  if (ip[0] == 0) Err("arp: out to %s", LOG_IP(ip));
   else
-    Dbg("arp: out to %s", iptos(ip));
+    Dbg("arp: out to %s", LOG_IP(ip));
   // find mac in arp table
   uint8_t *mac = (uint8_t *) map_get(&arp_table, ip);
   if (!mac) {
-    arp_print();
-    Log("arp: %s not found, see if there is a pending request...", iptos(ip));
-    queue_t *pending_queue = (queue_t *) map_get(&arp_buf, ip);
+    Log("arp: %s not found, see if there is a pending request...", LOG_IP(ip));
+    NET_STATS_INC(ARP_MISSES);
+    map_expire(&arp_buf);
+    ring_t **pending_queue = (ring_t **) map_get(&arp_buf, ip);
     if (pending_queue) {
       Log("arp: a pending request queue found, push this request to queue");
-      buf_t *copy = malloc(sizeof(buf_t));
-      buf_copy(copy, buf, 0);
-      queue_push(pending_queue, copy);
+      buf_t *copy = arp_buf_alloc(buf);
+      if (copy && ring_enqueue(*pending_queue, copy) != 0) {
+        Log("arp: pending queue of %s is full, drop this packet", LOG_IP(ip));
+        NET_STATS_INC(ARP_DROP_PENDING_FULL);
+        arp_buf_release(copy);
+      }
     } else {
-      Log("arp: %s was added to arp buffer, and a request was sent", iptos(ip));
+      Log("arp: %s was added to arp buffer, and a request was sent", LOG_IP(ip));
       // add to pending buffer
-      buf_t *copy = malloc(sizeof(buf_t));
-      buf_copy(copy, buf, 0);
-      queue_t *q = queue_new(copy);
-      map_set(&arp_buf, ip, q);
-      // queue indexes was copied to map data, free the queue struct
-      free(q);
-      // not found, send a request
-      arp_req(ip);
+      ring_t *ring = ring_new(ARP_PENDING_MAX);
+      if (!ring || map_set(&arp_buf, ip, &ring) != 0) {
+        Err("arp: cannot add %s to arp buffer, drop this packet", LOG_IP(ip));
+        NET_STATS_INC(ARP_DROP_PENDING_FULL);
+        if (ring) ring_delete(ring);
+        return;
+      }
+      buf_t *copy = arp_buf_alloc(buf);
+      if (copy)
+        ring_enqueue(ring, copy);
+      // not found, send a request even if this packet could not be queued
+      arp_req(netif, ip);
     }
   } else {
     // found, send the packet
-    ethernet_out(buf, mac, NET_PROTOCOL_IP);
+    NET_STATS_INC(ARP_HITS);
+    ethernet_out(netif, buf, mac, NET_PROTOCOL_IP);
   }
 }
 
@@ -196,8 +303,12 @@ void arp_out(buf_t *buf, uint8_t *ip) {
  */
 void arp_init() {
   map_init(&arp_table, NET_IP_LEN, NET_MAC_LEN, 0, ARP_TIMEOUT_SEC, NULL);
-  map_init(&arp_buf, NET_IP_LEN, sizeof(queue_t), 0, 0, queue_copy);
+  map_init(&arp_buf, NET_IP_LEN, sizeof(ring_t *), 0, ARP_MIN_INTERVAL, NULL);
+  map_on_expire(&arp_buf, arp_pending_expire);
+  ring_init(&arp_buf_pool, ARP_BUF_POOL_SIZE);
   net_add_protocol(NET_PROTOCOL_ARP, arp_in);
-  // send a gratuitous arp packet
-  arp_req(net_if_ip);
+  // send a gratuitous arp packet on every interface
+  netif_t *netif;
+  for (size_t i = 0; (netif = netif_get(i)) != NULL; i++)
+    arp_req(netif, netif->ip);
 }
\ No newline at end of file
@@ -1,5 +1,5 @@
 #include "buf.h"
-#include "debug_macros.h"
+#include "log.h"
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
@@ -23,9 +23,27 @@ int buf_init(buf_t *buf, size_t len) {
 
   buf->len = len;
   buf->data = buf->payload + BUF_MAX_LEN / 2 - len;
+  buf->head = buf->payload;
+  buf->end = buf->payload + BUF_MAX_LEN;
   return 0;
 }
 
+/**
+ * @brief 让buffer直接使用外部存储中的数据包，不拷贝，用于原地处理驱动映射内存中的帧
+ * 
+ * @param buf 要设置的buffer
+ * @param data 数据包起始地址
+ * @param len 数据包长度
+ * @param head 外部存储中可用于添加协议头的起始地址
+ * @param end 外部存储中可用于添加填充的结束地址
+ */
+void buf_attach(buf_t *buf, uint8_t *data, size_t len, uint8_t *head, uint8_t *end) {
+  buf->len = len;
+  buf->data = data;
+  buf->head = head;
+  buf->end = end;
+}
+
 /**
  * @brief 为buffer在头部增加一段长度，用于添加协议头
  * 
@@ -34,7 +52,7 @@ int buf_init(buf_t *buf, size_t len) {
  * @return int 成功为0，失败为-1
  */
 int buf_add_header(buf_t *buf, size_t len) {
-  if (buf->data - len < buf->payload) {
+  if ((size_t) (buf->data - buf->head) < len) {
     Err("Error in buf_add_header:%zu+%zu", buf->len, len);
     return -1;
   }
@@ -68,7 +86,7 @@ int buf_remove_header(buf_t *buf, size_t len) {
  * @return int 成功为0，失败为-1
  */
 int buf_add_padding(buf_t *buf, size_t len) {
-  if (buf->data + buf->len + len >= buf->payload + BUF_MAX_LEN) {
+  if (buf->data + buf->len + len >= buf->end) {
     Err("Error in buf_add_padding:%zu+%zu", buf->len, len);
     return -1;
   }
@@ -103,12 +121,15 @@ int buf_remove_padding(buf_t *buf, size_t len) {
 void buf_copy(void *pdst, const void *psrc, size_t len) {
   buf_t *dst = pdst;
   const buf_t *src = psrc;
-  assert(src->data >= src->payload);
+  assert(src->data >= src->head);
   assert(src->len <= BUF_MAX_LEN);
-  assert(src->data + src->len < src->payload + BUF_MAX_LEN);
+  assert(src->data + src->len < src->end);
+  // 只拷贝有效数据；源为内部存储时保持相同偏移，外部存储时按buf_init放置
+  dst->head = dst->payload;
+  dst->end = dst->payload + BUF_MAX_LEN;
   dst->len = src->len;
-  dst->data = dst->payload + (src->data - src->payload);
-  memcpy(dst->payload, src->payload, BUF_MAX_LEN);
+  dst->data = dst->payload + (src->head == src->payload ? src->data - src->payload : BUF_MAX_LEN / 2 - src->len);
+  memcpy(dst->data, src->data, src->len);
 }
 
 #pragma GCC diagnostic pop
@@ -1,6 +1,6 @@
 #include <pcap.h>
 #include "driver.h"
-#include "debug_macros.h"
+#include "log.h"
 
 #ifdef _WIN32
 
@@ -28,7 +28,6 @@ BOOL LoadNpcapDlls() {
 
 #endif
 
-pcap_t *pcap;
 char pcap_errbuf[PCAP_ERRBUF_SIZE];
 
 /**
@@ -76,7 +75,7 @@ int driver_find(uint8_t *ip, char *if_name, uint8_t *mask) {
 
   for (d = alldevs, i = 0; i < max_if; d = d->next, i++);
   if (max_match == 32) {
-    Err("Error, interface %s have the same ip %s with me.", d->name, iptos(net_if_ip));
+    Err("Error, interface %s have the same ip %s with me.", d->name, LOG_IP(ip));
     return -1;
   }
   for (a = d->addresses; a; a = a->next)
@@ -90,9 +89,10 @@ int driver_find(uint8_t *ip, char *if_name, uint8_t *mask) {
 /**
  * @brief 打开网卡
  * 
+ * @param netif 要打开的网卡，未指定网卡名时根据ip自动选取
  * @return int 成功为0，失败为-1
  */
-int driver_open() {
+static int driver_pcap_open(netif_t *netif) {
 #ifdef _WIN32
   /* Load Npcap and its functions. */
   if (!LoadNpcapDlls()) {
@@ -103,17 +103,26 @@ int driver_open() {
 
   char if_name[PCAP_BUF_SIZE];
   uint32_t mask;
-  if (driver_find(net_if_ip, if_name, (uint8_t *) &mask) < 0) {
-    Err("Error in driver find.");
-    return -1;
+  pcap_t *pcap;
+  if (netif->name[0]) {
+    strcpy(if_name, netif->name);
+    memcpy(&mask, netif->mask, NET_IP_LEN);
+  } else {
+    if (driver_find(netif->ip, if_name, (uint8_t *) &mask) < 0) {
+      Err("Error in driver find.");
+      return -1;
+    }
+    strncpy(netif->name, if_name, NET_IF_NAME_LEN - 1);
+    memcpy(netif->mask, &mask, NET_IP_LEN);
   }
-  Log("Using interface %s, my IP is %s, my MAC is %s", if_name, iptos(net_if_ip), mactos(net_if_mac));
+  Log("Using interface %s, my IP is %s, my MAC is %s", if_name, LOG_IP(netif->ip), LOG_MAC(netif->mac));
 
   // 混杂模式打开网卡
   if ((pcap = pcap_open_live(if_name, 65536, 1, 10, pcap_errbuf)) == NULL) {
     Err("Error in pcap_open_live.\n%s.", pcap_errbuf);
     return -1;
   }
+  netif->priv = pcap;
   // 设置非阻塞模式
   if (pcap_setnonblock(pcap, 1, pcap_errbuf) < 0) {
     Err("Error in pcap_setnonblock. %s.", pcap_errbuf);
@@ -121,7 +130,7 @@ int driver_open() {
   }
   char filter_exp[PCAP_BUF_SIZE];
   struct bpf_program fp;
-  uint8_t mac_addr[6] = NET_IF_MAC;
+  uint8_t *mac_addr = netif->mac;
   sprintf(filter_exp, //过滤数据包
           "(ether dst %02x:%02x:%02x:%02x:%02x:%02x or ether broadcast) and (not ether src %02x:%02x:%02x:%02x:%02x:%02x)",
           mac_addr[0], mac_addr[1], mac_addr[2], mac_addr[3], mac_addr[4], mac_addr[5],
@@ -140,19 +149,21 @@ int driver_open() {
 /**
  * @brief 试图从网卡接收数据包
  * 
+ * @param netif 网卡
  * @param buf 收到的数据包
  * @return int 数据包的长度，未收到为0，错误为-1
  */
-int driver_recv(buf_t *buf) {
+static int driver_pcap_recv(netif_t *netif, buf_t *buf) {
+  pcap_t *pcap = netif->priv;
   struct pcap_pkthdr *pkt_hdr;
   const uint8_t *pkt_data;
   int ret = pcap_next_ex(pcap, &pkt_hdr, &pkt_data);
   if (ret == 0)
     return 0;
   else if (ret == 1) {
-    memcpy(buf->data, pkt_data, pkt_hdr->len);
-    buf->len = pkt_hdr->len;
-    return pkt_hdr->len;
+    buf_init(buf, pkt_hdr->caplen);
+    memcpy(buf->data, pkt_data, pkt_hdr->caplen);
+    return pkt_hdr->caplen;
   }
   Err("Error in driver_recv: %s.", pcap_geterr(pcap));
   return -1;
@@ -161,10 +172,12 @@ int driver_recv(buf_t *buf) {
 /**
  * @brief 使用网卡发送一个数据包
  * 
+ * @param netif 网卡
  * @param buf 要发送的数据包
  * @return int 成功为0，失败为-1
  */
-int driver_send(buf_t *buf) {
+static int driver_pcap_send(netif_t *netif, buf_t *buf) {
+  pcap_t *pcap = netif->priv;
   if (pcap_sendpacket(pcap, buf->data, buf->len) == -1) {
     Err("Error in driver_send: %s.", pcap_geterr(pcap));
     return -1;
@@ -176,7 +189,48 @@ int driver_send(buf_t *buf) {
 /**
  * @brief 关闭网卡
  * 
+ * @param netif 网卡
+ */
+static void driver_pcap_close(netif_t *netif) {
+  pcap_close(netif->priv);
+  netif->priv = NULL;
+}
+
+/**
+ * @brief pcap驱动操作表
+ * 
+ */
+const driver_ops_t driver_pcap_ops = {
+    .name = "pcap",
+    .open = driver_pcap_open,
+    .recv = driver_pcap_recv,
+    .send = driver_pcap_send,
+    .close = driver_pcap_close,
+};
+
+/**
+ * @brief 所有可用的驱动
+ * 
+ */
+static const driver_ops_t *driver_all_ops[] = {
+    &driver_pcap_ops,
+#ifdef __linux__
+    &driver_packet_ops,
+    &driver_xdp_ops,
+    &driver_tap_ops,
+    &driver_wire_ops,
+#endif
+};
+
+/**
+ * @brief 根据驱动名查找驱动操作表
+ * 
+ * @param name 驱动名
+ * @return const driver_ops_t* 驱动操作表，找不到为NULL
  */
-void driver_close() {
-  pcap_close(pcap);
+const driver_ops_t *driver_find_ops(const char *name) {
+  for (size_t i = 0; i < sizeof(driver_all_ops) / sizeof(driver_all_ops[0]); i++)
+    if (strcmp(driver_all_ops[i]->name, name) == 0)
+      return driver_all_ops[i];
+  return NULL;
 }
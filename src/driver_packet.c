@@ -0,0 +1,253 @@
+#ifdef __linux__
+
+#include <errno.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include "driver.h"
+#include "ethernet.h"
+#include "ip.h"
+#include "log.h"
+
+typedef struct driver_packet //AF_PACKET驱动的私有数据
+{
+  int fd;                         // AF_PACKET套接字
+  uint8_t *map;                   // 接收与发送环形队列的映射内存
+  size_t map_len;                 // 映射内存长度
+  uint8_t *rx_ring;               // 接收环形队列
+  uint8_t *tx_ring;               // 发送环形队列
+  size_t rx_block;                // 当前读取的块
+  bool rx_hold;                   // 当前块是否已交给用户，需在读完后归还内核
+  uint32_t rx_left;               // 当前块中剩余未读取的帧数
+  struct tpacket3_hdr *rx_pkt;    // 当前块中下一个待读取的帧
+  size_t tx_frame;                // 下一个可用的发送帧
+  size_t tx_frame_num;            // 发送帧总数
+} driver_packet_t;
+
+/**
+ * @brief 初始化环形队列请求
+ *
+ * @param req 要初始化的请求
+ * @param block_num 块数
+ * @param timeout_ms 块超时毫秒数，发送队列为0
+ */
+static void driver_packet_req(struct tpacket_req3 *req, unsigned int block_num, unsigned int timeout_ms) {
+  memset(req, 0, sizeof(struct tpacket_req3));
+  req->tp_block_size = PACKET_BLOCK_SIZE;
+  req->tp_block_nr = block_num;
+  req->tp_frame_size = PACKET_FRAME_SIZE;
+  req->tp_frame_nr = PACKET_BLOCK_SIZE / PACKET_FRAME_SIZE * block_num;
+  req->tp_retire_blk_tov = timeout_ms;
+}
+
+/**
+ * @brief 补全本机其他进程经虚拟网卡发来、校验和卸载尚未完成的tcp/udp包的校验和
+ *
+ * @param frame 以太网帧
+ * @param len 帧长度
+ */
+static void driver_packet_csum(uint8_t *frame, size_t len) {
+  ether_hdr_t *eth = (ether_hdr_t *) frame;
+  ip_hdr_t *ip = (ip_hdr_t *) (frame + sizeof(ether_hdr_t));
+  if (eth->protocol16 != constswap16(NET_PROTOCOL_IP) || len < sizeof(ether_hdr_t) + sizeof(ip_hdr_t))
+    return;
+  size_t hdr_len = ip->hdr_len * IP_HDR_LEN_PER_BYTE;
+  size_t total_len = swap16(ip->total_len16);
+  if (total_len > len - sizeof(ether_hdr_t) || total_len < hdr_len)
+    return;
+  if (ip->protocol == NET_PROTOCOL_TCP && total_len - hdr_len >= 20)
+    checksum16_complete((uint8_t *) ip + hdr_len, total_len - hdr_len, 16);
+  else if (ip->protocol == NET_PROTOCOL_UDP && total_len - hdr_len >= 8)
+    checksum16_complete((uint8_t *) ip + hdr_len, total_len - hdr_len, 6);
+}
+
+/**
+ * @brief 关闭网卡
+ *
+ * @param netif 网卡
+ */
+static void driver_packet_close(netif_t *netif) {
+  driver_packet_t *packet = netif->priv;
+  if (!packet)
+    return;
+  if (packet->map)
+    munmap(packet->map, packet->map_len);
+  if (packet->fd >= 0)
+    close(packet->fd);
+  free(packet);
+  netif->priv = NULL;
+}
+
+/**
+ * @brief 打开网卡，建立TPACKET_V3接收环形队列与发送环形队列并映射到用户空间
+ *
+ * @param netif 要打开的网卡，必须指定网卡名
+ * @return int 成功为0，失败为-1
+ */
+static int driver_packet_open(netif_t *netif) {
+  if (!netif->name[0]) {
+    Err("packet: interface name is required");
+    return -1;
+  }
+  int ifindex = if_nametoindex(netif->name);
+  if (!ifindex) {
+    Err("packet: no such interface %s", netif->name);
+    return -1;
+  }
+  driver_packet_t *packet = calloc(1, sizeof(driver_packet_t));
+  if (!packet)
+    return -1;
+  netif->priv = packet;
+  packet->fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+  if (packet->fd < 0) {
+    Err("packet: socket: %s", strerror(errno));
+    driver_packet_close(netif);
+    return -1;
+  }
+  int version = TPACKET_V3;
+  struct tpacket_req3 rx_req, tx_req;
+  driver_packet_req(&rx_req, PACKET_RX_BLOCK_NUM, PACKET_BLOCK_TIMEOUT_MS);
+  driver_packet_req(&tx_req, PACKET_TX_BLOCK_NUM, 0);
+  if (setsockopt(packet->fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0 ||
+      setsockopt(packet->fd, SOL_PACKET, PACKET_RX_RING, &rx_req, sizeof(rx_req)) < 0 ||
+      setsockopt(packet->fd, SOL_PACKET, PACKET_TX_RING, &tx_req, sizeof(tx_req)) < 0) {
+    Err("packet: setup ring: %s", strerror(errno));
+    driver_packet_close(netif);
+    return -1;
+  }
+#ifdef PACKET_QDISC_BYPASS
+  int one = 1;
+  setsockopt(packet->fd, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof(one));
+#endif
+  size_t rx_len = (size_t) rx_req.tp_block_size * rx_req.tp_block_nr;
+  size_t tx_len = (size_t) tx_req.tp_block_size * tx_req.tp_block_nr;
+  packet->map_len = rx_len + tx_len;
+  packet->map = mmap(NULL, packet->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, packet->fd, 0);
+  if (packet->map == MAP_FAILED) {
+    Err("packet: mmap: %s", strerror(errno));
+    packet->map = NULL;
+    driver_packet_close(netif);
+    return -1;
+  }
+  packet->rx_ring = packet->map;
+  packet->tx_ring = packet->map + rx_len;
+  packet->tx_frame_num = tx_req.tp_frame_nr;
+
+  struct sockaddr_ll addr = {
+      .sll_family = AF_PACKET,
+      .sll_protocol = htons(ETH_P_ALL),
+      .sll_ifindex = ifindex,
+  };
+  if (bind(packet->fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+    Err("packet: bind %s: %s", netif->name, strerror(errno));
+    driver_packet_close(netif);
+    return -1;
+  }
+  // 与pcap驱动一致，以混杂模式接收
+  struct packet_mreq mreq = {.mr_ifindex = ifindex, .mr_type = PACKET_MR_PROMISC};
+  if (setsockopt(packet->fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0)
+    Log("packet: cannot set %s promiscuous: %s", netif->name, strerror(errno));
+  Log("Using interface %s (AF_PACKET), my IP is %s, my MAC is %s", netif->name, LOG_IP(netif->ip),
+      LOG_MAC(netif->mac));
+  return 0;
+}
+
+/**
+ * @brief 从接收环形队列取下一帧，帧数据不拷贝，在映射内存中原地处理。
+ *        一个块中的帧按顺序读取，读完整个块后才归还内核
+ *
+ * @param netif 网卡
+ * @param buf 指向映射内存中帧数据的buffer，在下一次接收前有效
+ * @return int 数据包的长度，未收到为0
+ */
+static int driver_packet_recv(netif_t *netif, buf_t *buf) {
+  driver_packet_t *packet = netif->priv;
+  while (1) {
+    struct tpacket_block_desc *block =
+        (struct tpacket_block_desc *) (packet->rx_ring + packet->rx_block * PACKET_BLOCK_SIZE);
+    if (!packet->rx_left) {
+      if (packet->rx_hold) {
+        // 当前块已处理完，归还内核并前进到下一块
+        __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+        packet->rx_hold = false;
+        packet->rx_block = (packet->rx_block + 1) % PACKET_RX_BLOCK_NUM;
+        continue;
+      }
+      if (!(__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER))
+        return 0;
+      packet->rx_hold = true;
+      packet->rx_left = block->hdr.bh1.num_pkts;
+      packet->rx_pkt = (struct tpacket3_hdr *) ((uint8_t *) block + block->hdr.bh1.offset_to_first_pkt);
+      continue;
+    }
+    struct tpacket3_hdr *hdr = packet->rx_pkt;
+    uint8_t *frame_end = hdr->tp_next_offset ? (uint8_t *) hdr + hdr->tp_next_offset
+                                             : (uint8_t *) block + PACKET_BLOCK_SIZE;
+    packet->rx_left--;
+    packet->rx_pkt = (struct tpacket3_hdr *) frame_end;
+    struct sockaddr_ll *addr = (struct sockaddr_ll *) ((uint8_t *) hdr + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+    if (addr->sll_pkttype == PACKET_OUTGOING)
+      continue;
+    uint8_t *data = (uint8_t *) hdr + hdr->tp_mac;
+    if (hdr->tp_status & TP_STATUS_CSUMNOTREADY)
+      driver_packet_csum(data, hdr->tp_snaplen);
+    // 协议栈只会在已去除的头部范围内重新添加协议头，因此头部空间从帧起始处算起
+    buf_attach(buf, data, hdr->tp_snaplen, data, frame_end);
+    return hdr->tp_snaplen;
+  }
+}
+
+/**
+ * @brief 把数据包写入发送环形队列并通知内核发送
+ *
+ * @param netif 网卡
+ * @param buf 要发送的数据包
+ * @return int 成功为0，失败为-1
+ */
+static int driver_packet_send(netif_t *netif, buf_t *buf) {
+  driver_packet_t *packet = netif->priv;
+  struct tpacket3_hdr *hdr = (struct tpacket3_hdr *) (packet->tx_ring + packet->tx_frame * PACKET_FRAME_SIZE);
+  size_t data_offset = TPACKET3_HDRLEN - sizeof(struct sockaddr_ll);
+  if (buf->len > PACKET_FRAME_SIZE - data_offset) {
+    Err("packet: frame too large (%zu)", buf->len);
+    return -1;
+  }
+  if (__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) != TP_STATUS_AVAILABLE) {
+    // 发送队列已满，先让内核发送已提交的帧
+    sendto(packet->fd, NULL, 0, 0, NULL, 0);
+    if (__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) != TP_STATUS_AVAILABLE) {
+      Err("packet: tx ring full, drop");
+      return -1;
+    }
+  }
+  memcpy((uint8_t *) hdr + data_offset, buf->data, buf->len);
+  hdr->tp_len = buf->len;
+  hdr->tp_snaplen = buf->len;
+  hdr->tp_next_offset = 0;
+  __atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+  packet->tx_frame = (packet->tx_frame + 1) % packet->tx_frame_num;
+  if (sendto(packet->fd, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0 && errno != EAGAIN && errno != ENOBUFS) {
+    Err("packet: send: %s", strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief AF_PACKET驱动操作表，使用TPACKET_V3映射环形队列收发
+ *
+ */
+const driver_ops_t driver_packet_ops = {
+    .name = "packet",
+    .open = driver_packet_open,
+    .recv = driver_packet_recv,
+    .send = driver_packet_send,
+    .close = driver_packet_close,
+};
+
+#endif
@@ -0,0 +1,179 @@
+#ifdef __linux__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <net/if.h>
+#include <linux/if_tun.h>
+#include <linux/virtio_net.h>
+#include "driver.h"
+#include "log.h"
+
+typedef struct driver_tap //TAP驱动的私有数据
+{
+  int fds[TAP_QUEUE_NUM];   // 每个队列一个文件描述符
+  size_t next_queue;        // 下一个轮询的接收队列
+} driver_tap_t;
+
+/**
+ * @brief 关闭网卡
+ *
+ * @param netif 网卡
+ */
+static void driver_tap_close(netif_t *netif) {
+  driver_tap_t *tap = netif->priv;
+  if (!tap)
+    return;
+  for (size_t i = 0; i < TAP_QUEUE_NUM; i++)
+    if (tap->fds[i] >= 0)
+      close(tap->fds[i]);
+  free(tap);
+  netif->priv = NULL;
+}
+
+/**
+ * @brief 打开TAP设备的一个队列，启用vnet头部与校验和卸载
+ *
+ * @param name 设备名，为空时由内核分配并写回
+ * @return int 文件描述符，失败为-1
+ */
+static int driver_tap_open_queue(char *name) {
+  int fd = open("/dev/net/tun", O_RDWR | O_NONBLOCK);
+  if (fd < 0)
+    return -1;
+  struct ifreq ifr;
+  memset(&ifr, 0, sizeof(ifr));
+  ifr.ifr_flags = IFF_TAP | IFF_NO_PI | IFF_VNET_HDR | IFF_MULTI_QUEUE;
+  strncpy(ifr.ifr_name, name, IFNAMSIZ - 1);
+  int hdr_len = sizeof(struct virtio_net_hdr);
+  // 只接受校验和未完成的包，不接受GSO大包，协议栈不支持分段卸载
+  if (ioctl(fd, TUNSETIFF, &ifr) < 0 || ioctl(fd, TUNSETVNETHDRSZ, &hdr_len) < 0 ||
+      ioctl(fd, TUNSETOFFLOAD, TUN_F_CSUM) < 0) {
+    close(fd);
+    return -1;
+  }
+  strncpy(name, ifr.ifr_name, IFNAMSIZ - 1);
+  return fd;
+}
+
+/**
+ * @brief 打开网卡：创建或连接TAP设备的所有队列，并启用设备。
+ *        设备可预先以 ip tuntap add mode tap multi_queue vnet_hdr user xxx 创建，从而无需root运行
+ *
+ * @param netif 要打开的网卡，网卡名为空时由内核分配
+ * @return int 成功为0，失败为-1
+ */
+static int driver_tap_open(netif_t *netif) {
+  driver_tap_t *tap = calloc(1, sizeof(driver_tap_t));
+  if (!tap)
+    return -1;
+  for (size_t i = 0; i < TAP_QUEUE_NUM; i++)
+    tap->fds[i] = -1;
+  netif->priv = tap;
+  char name[IFNAMSIZ] = {0};
+  strncpy(name, netif->name, IFNAMSIZ - 1);
+  for (size_t i = 0; i < TAP_QUEUE_NUM; i++) {
+    tap->fds[i] = driver_tap_open_queue(name);
+    if (tap->fds[i] < 0) {
+      Err("tap: open %s queue %zu: %s", name[0] ? name : "(new)", i, strerror(errno));
+      driver_tap_close(netif);
+      return -1;
+    }
+  }
+  strncpy(netif->name, name, NET_IF_NAME_LEN - 1);
+
+  // 启用设备，已启用或无权限时不影响使用
+  int sock = socket(AF_INET, SOCK_DGRAM, 0);
+  if (sock >= 0) {
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, name, IFNAMSIZ - 1);
+    if (ioctl(sock, SIOCGIFFLAGS, &ifr) == 0 && !(ifr.ifr_flags & IFF_UP)) {
+      ifr.ifr_flags |= IFF_UP;
+      if (ioctl(sock, SIOCSIFFLAGS, &ifr) < 0)
+        Log("tap: cannot bring %s up: %s", name, strerror(errno));
+    }
+    close(sock);
+  }
+  Log("Using interface %s (TAP, %d queues), my IP is %s, my MAC is %s", netif->name, TAP_QUEUE_NUM,
+      LOG_IP(netif->ip), LOG_MAC(netif->mac));
+  return 0;
+}
+
+/**
+ * @brief 轮流从各队列读取一帧。readv把vnet头部与帧分散读入，帧直接落在buf中
+ *
+ * @param netif 网卡
+ * @param buf 收到的数据包
+ * @return int 数据包的长度，未收到为0，错误为-1
+ */
+static int driver_tap_recv(netif_t *netif, buf_t *buf) {
+  driver_tap_t *tap = netif->priv;
+  struct virtio_net_hdr hdr;
+  buf_init(buf, 0);
+  struct iovec iov[2] = {
+      {.iov_base = &hdr, .iov_len = sizeof(hdr)},
+      {.iov_base = buf->data, .iov_len = BUF_MAX_LEN / 2 - 1},
+  };
+  for (size_t i = 0; i < TAP_QUEUE_NUM; i++) {
+    int fd = tap->fds[tap->next_queue];
+    tap->next_queue = (tap->next_queue + 1) % TAP_QUEUE_NUM;
+    ssize_t len = readv(fd, iov, 2);
+    if (len < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        continue;
+      Err("tap: read: %s", strerror(errno));
+      return -1;
+    }
+    if ((size_t) len < sizeof(hdr))
+      continue;
+    buf->len = len - sizeof(hdr);
+    if (hdr.gso_type != VIRTIO_NET_HDR_GSO_NONE) {
+      Err("tap: unexpected gso packet, drop");
+      continue;
+    }
+    // 本机发出的包校验和可能尚未完成，按vnet头部给出的位置补全
+    if ((hdr.flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) && hdr.csum_start + hdr.csum_offset + 2 <= buf->len)
+      checksum16_complete(buf->data + hdr.csum_start, buf->len - hdr.csum_start, hdr.csum_offset);
+    return buf->len;
+  }
+  return 0;
+}
+
+/**
+ * @brief 发送一帧，writev把空的vnet头部与帧聚合写出，无需拷贝
+ *
+ * @param netif 网卡
+ * @param buf 要发送的数据包
+ * @return int 成功为0，失败为-1
+ */
+static int driver_tap_send(netif_t *netif, buf_t *buf) {
+  driver_tap_t *tap = netif->priv;
+  struct virtio_net_hdr hdr = {.gso_type = VIRTIO_NET_HDR_GSO_NONE};
+  struct iovec iov[2] = {
+      {.iov_base = &hdr, .iov_len = sizeof(hdr)},
+      {.iov_base = buf->data, .iov_len = buf->len},
+  };
+  if (writev(tap->fds[0], iov, 2) < 0) {
+    Err("tap: write: %s", strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief TAP驱动操作表，无需pcap与混杂模式
+ *
+ */
+const driver_ops_t driver_tap_ops = {
+    .name = "tap",
+    .open = driver_tap_open,
+    .recv = driver_tap_recv,
+    .send = driver_tap_send,
+    .close = driver_tap_close,
+};
+
+#endif
@@ -0,0 +1,364 @@
+#ifdef __linux__
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "driver.h"
+#include "ring.h"
+#include "log.h"
+
+/**
+ * 虚拟链路：打开同一链路名的两块网卡成为链路的两端，一端发出的帧经延迟、带宽、丢帧与乱序后在另一端收到。
+ * 两端可以是同一进程中各自运行协议栈的两个线程，链路名以/开头时链路放在POSIX共享内存中，两端可以在两个进程中。
+ * 每个方向是一个单生产者单消费者的帧队列，帧带有送达时间，接收端只取出已到送达时间的队首帧，
+ * 发送端的带宽排队使送达时间单调不减，所以队首未到时后面的帧也未到。
+ * 每端只能由一个线程收发，与其他驱动相同
+ */
+
+typedef struct wire_frame //在途的帧
+{
+  uint64_t deliver_ns;      // 送达时间
+  uint32_t len;             // 帧长
+  uint8_t data[WIRE_FRAME_SIZE];
+} wire_frame_t;
+
+typedef struct wire_queue //链路一个方向的帧队列
+{
+  alignas(RING_CACHE_LINE) atomic_size_t head;  // 发送端下一写入位置
+  alignas(RING_CACHE_LINE) atomic_size_t tail;  // 接收端下一读取位置
+  wire_frame_t frames[WIRE_QUEUE_SIZE];
+} wire_queue_t;
+
+typedef struct wire_link //链路，两端共享
+{
+  atomic_uint ends;                 // 已打开的端，第i位为第i端
+  wire_queue_t queues[2];           // 第i个队列为第i端发出的帧
+} wire_link_t;
+
+typedef struct wire_entry //进程内的链路名表项
+{
+  char name[NET_IF_NAME_LEN];       // 链路名
+  wire_link_t *link;                // 进程内的链路，两端都关闭后释放
+  driver_wire_config_t config;      // 此链路的参数
+  int configured;                   // 是否设置过参数，未设置时使用默认参数
+} wire_entry_t;
+
+typedef struct driver_wire //虚拟链路驱动的私有数据，即链路的一端
+{
+  wire_link_t *link;                // 链路
+  unsigned end;                     // 本端编号，0或1
+  int shared;                       // 链路是否在共享内存中
+  driver_wire_config_t config;      // 本端发出的帧使用的参数
+  uint64_t busy_ns;                 // 带宽排队：本端最后一帧发完的时间
+  uint64_t rng;                     // 丢帧与乱序的随机数状态
+  wire_frame_t held;                // 被扣下乱序的帧
+  int holding;                      // 是否有被扣下的帧
+  driver_wire_stats_t stats;        // 计数
+} driver_wire_t;
+
+static pthread_mutex_t wire_lock = PTHREAD_MUTEX_INITIALIZER;
+static wire_entry_t wire_table[WIRE_MAX_NUM];
+static driver_wire_config_t wire_default; //未单独设置参数的链路使用的参数
+
+static uint64_t wire_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * @brief xorshift64*，返回[0,1)之间的随机数
+ *
+ */
+static double wire_random(driver_wire_t *wire) {
+  wire->rng ^= wire->rng >> 12;
+  wire->rng ^= wire->rng << 25;
+  wire->rng ^= wire->rng >> 27;
+  return (double) ((wire->rng * 0x2545f4914f6cdd1dull) >> 11) / (double) (1ull << 53);
+}
+
+/**
+ * @brief 查找链路名表项，调用时持有wire_lock
+ *
+ * @param name 链路名
+ * @param create 找不到时是否新建
+ * @return wire_entry_t* 表项，找不到或表满为NULL
+ */
+static wire_entry_t *wire_entry(const char *name, int create) {
+  wire_entry_t *free_entry = NULL;
+  for (size_t i = 0; i < WIRE_MAX_NUM; i++) {
+    if (wire_table[i].name[0] && strcmp(wire_table[i].name, name) == 0)
+      return &wire_table[i];
+    if (!wire_table[i].name[0] && !free_entry)
+      free_entry = &wire_table[i];
+  }
+  if (!create || !free_entry)
+    return NULL;
+  strncpy(free_entry->name, name, NET_IF_NAME_LEN - 1);
+  return free_entry;
+}
+
+/**
+ * @brief 设置链路的参数，在打开链路的网卡之前调用，两端各自按参数处理发出的帧
+ *
+ * @param name 链路名，为NULL时设置所有未单独设置的链路的默认参数
+ * @param config 参数
+ * @return int 成功为0，失败为-1
+ */
+int driver_wire_config(const char *name, const driver_wire_config_t *config) {
+  if (config->loss < 0 || config->loss > 1 || config->reorder < 0 || config->reorder > 1)
+    return -1;
+  pthread_mutex_lock(&wire_lock);
+  wire_entry_t *entry = name ? wire_entry(name, 1) : NULL;
+  if (name && !entry) {
+    pthread_mutex_unlock(&wire_lock);
+    return -1;
+  }
+  if (entry) {
+    entry->config = *config;
+    entry->configured = 1;
+  } else {
+    wire_default = *config;
+  }
+  pthread_mutex_unlock(&wire_lock);
+  return 0;
+}
+
+/**
+ * @brief 读取网卡所在一端的计数
+ *
+ * @param netif 使用虚拟链路驱动的网卡
+ * @param stats 出口参数，计数
+ * @return int 成功为0，不是虚拟链路为-1
+ */
+int driver_wire_stats(netif_t *netif, driver_wire_stats_t *stats) {
+  if (netif->ops != &driver_wire_ops || !netif->priv)
+    return -1;
+  *stats = ((driver_wire_t *) netif->priv)->stats;
+  return 0;
+}
+
+/**
+ * @brief 映射共享内存中的链路，不存在时创建，新建的共享内存全为0
+ *
+ * @param name 以/开头的链路名
+ * @return wire_link_t* 链路，失败为NULL
+ */
+static wire_link_t *wire_map(const char *name) {
+  int fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+  if (fd < 0)
+    return NULL;
+  wire_link_t *link = NULL;
+  if (ftruncate(fd, sizeof(wire_link_t)) == 0) {
+    link = mmap(NULL, sizeof(wire_link_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (link == MAP_FAILED)
+      link = NULL;
+  }
+  close(fd);
+  return link;
+}
+
+/**
+ * @brief 占用链路空闲的一端
+ *
+ * @return int 端的编号，两端都被占用为-1
+ */
+static int wire_claim(wire_link_t *link) {
+  for (unsigned end = 0; end < 2; end++)
+    if (!(atomic_fetch_or(&link->ends, 1u << end) & (1u << end)))
+      return end;
+  return -1;
+}
+
+/**
+ * @brief 把帧放入本端发出的队列
+ *
+ * @return int 成功为0，队列满为-1
+ */
+static int wire_push(driver_wire_t *wire, const uint8_t *data, uint32_t len, uint64_t deliver_ns) {
+  wire_queue_t *queue = &wire->link->queues[wire->end];
+  size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+  if (head - atomic_load_explicit(&queue->tail, memory_order_acquire) == WIRE_QUEUE_SIZE) {
+    wire->stats.overflow++;
+    return -1;
+  }
+  wire_frame_t *frame = &queue->frames[head & (WIRE_QUEUE_SIZE - 1)];
+  frame->deliver_ns = deliver_ns;
+  frame->len = len;
+  memcpy(frame->data, data, len);
+  atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+  return 0;
+}
+
+/**
+ * @brief 被扣下的帧之后迟迟没有帧时，不再等待，立即送出
+ *
+ */
+static void wire_release_held(driver_wire_t *wire, uint64_t now) {
+  if (wire->holding && wire->held.deliver_ns + WIRE_HOLD_NS <= now) {
+    wire->holding = 0;
+    wire_push(wire, wire->held.data, wire->held.len, wire->held.deliver_ns);
+  }
+}
+
+/**
+ * @brief 释放本端，两端都释放后进程内的链路被释放，共享内存被删除
+ *
+ */
+static void wire_release(driver_wire_t *wire, const char *name) {
+  unsigned left = atomic_fetch_and(&wire->link->ends, ~(1u << wire->end)) & ~(1u << wire->end);
+  if (wire->shared) {
+    munmap(wire->link, sizeof(wire_link_t));
+    if (!left)
+      shm_unlink(name);
+    return;
+  }
+  wire_entry_t *entry = wire_entry(name, 0);
+  if (!left && entry && entry->link == wire->link) {
+    free(entry->link);
+    entry->link = NULL;
+  }
+}
+
+/**
+ * @brief 关闭网卡，先送出被扣下的帧
+ *
+ * @param netif 网卡
+ */
+static void driver_wire_close(netif_t *netif) {
+  driver_wire_t *wire = netif->priv;
+  if (!wire)
+    return;
+  if (wire->holding)
+    wire_push(wire, wire->held.data, wire->held.len, wire->held.deliver_ns);
+  pthread_mutex_lock(&wire_lock);
+  wire_release(wire, netif->name);
+  pthread_mutex_unlock(&wire_lock);
+  free(wire);
+  netif->priv = NULL;
+}
+
+/**
+ * @brief 打开网卡：以网卡名为链路名，占用链路空闲的一端，链路不存在时创建
+ *
+ * @param netif 要打开的网卡，网卡名为空时使用wire0
+ * @return int 成功为0，链路名表满或两端都已打开为-1
+ */
+static int driver_wire_open(netif_t *netif) {
+  if (!netif->name[0])
+    strcpy(netif->name, "wire0");
+  driver_wire_t *wire = calloc(1, sizeof(driver_wire_t));
+  if (!wire)
+    return -1;
+  wire->shared = netif->name[0] == '/';
+  pthread_mutex_lock(&wire_lock);
+  wire_entry_t *entry = wire_entry(netif->name, !wire->shared);
+  wire->config = entry && entry->configured ? entry->config : wire_default;
+  if (wire->shared) {
+    wire->link = wire_map(netif->name);
+  } else if (entry) {
+    if (!entry->link && (entry->link = aligned_alloc(RING_CACHE_LINE, sizeof(wire_link_t))))
+      memset(entry->link, 0, sizeof(wire_link_t));
+    wire->link = entry->link;
+  }
+  int end = wire->link ? wire_claim(wire->link) : -1;
+  if (end < 0) {
+    if (wire->shared && wire->link)
+      munmap(wire->link, sizeof(wire_link_t));
+    pthread_mutex_unlock(&wire_lock);
+    Err("Error, wire %s is busy or cannot be created.", netif->name);
+    free(wire);
+    return -1;
+  }
+  pthread_mutex_unlock(&wire_lock);
+  wire->end = end;
+  // 两端的随机数序列不同，种子为0时也不能为0
+  wire->rng = (wire->config.seed + 1) * 0x9e3779b97f4a7c15ull ^ (end + 1);
+  netif->priv = wire;
+  Log("Using wire %s end %d, my IP is %s, my MAC is %s", netif->name, end, LOG_IP(netif->ip), LOG_MAC(netif->mac));
+  return 0;
+}
+
+/**
+ * @brief 试图从链路接收一帧
+ *
+ * @param netif 网卡
+ * @param buf 收到的帧
+ * @return int 帧长，队首的帧未到送达时间为0
+ */
+static int driver_wire_recv(netif_t *netif, buf_t *buf) {
+  driver_wire_t *wire = netif->priv;
+  uint64_t now = wire_now();
+  wire_release_held(wire, now);
+  wire_queue_t *queue = &wire->link->queues[!wire->end];
+  size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+  if (tail == atomic_load_explicit(&queue->head, memory_order_acquire))
+    return 0;
+  wire_frame_t *frame = &queue->frames[tail & (WIRE_QUEUE_SIZE - 1)];
+  if (frame->deliver_ns > now)
+    return 0;
+  uint32_t len = frame->len;
+  buf_init(buf, len);
+  memcpy(buf->data, frame->data, len);
+  atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+  wire->stats.rx_frames++;
+  return len;
+}
+
+/**
+ * @brief 向链路发出一帧：按概率丢弃，按带宽排队，加上传播延迟；按概率扣下，在下一帧之后送出
+ *
+ * @param netif 网卡
+ * @param buf 要发送的帧
+ * @return int 成功为0，帧过长为-1；丢弃与队列满都算发出，与真实链路一样由上层处理
+ */
+static int driver_wire_send(netif_t *netif, buf_t *buf) {
+  driver_wire_t *wire = netif->priv;
+  if (buf->len > WIRE_FRAME_SIZE) {
+    Err("Error, frame of %zu bytes is too long for wire %s.", buf->len, netif->name);
+    return -1;
+  }
+  uint64_t now = wire_now();
+  wire->stats.tx_frames++;
+  if (wire->config.loss && wire_random(wire) < wire->config.loss) {
+    wire->stats.lost++;
+    return 0;
+  }
+  if (wire->busy_ns < now)
+    wire->busy_ns = now;
+  if (wire->config.bandwidth)
+    wire->busy_ns += (uint64_t) buf->len * 8 * 1000000000ull / wire->config.bandwidth;
+  uint64_t deliver_ns = wire->busy_ns + wire->config.latency_ns;
+  if (!wire->holding && wire->config.reorder && wire_random(wire) < wire->config.reorder) {
+    wire->holding = 1;
+    wire->held.deliver_ns = deliver_ns;
+    wire->held.len = buf->len;
+    memcpy(wire->held.data, buf->data, buf->len);
+    wire->stats.reordered++;
+    return 0;
+  }
+  wire_push(wire, buf->data, buf->len, deliver_ns);
+  if (wire->holding) {
+    wire->holding = 0;
+    wire_push(wire, wire->held.data, wire->held.len, deliver_ns);
+  }
+  return 0;
+}
+
+/**
+ * @brief 虚拟链路驱动操作表
+ *
+ */
+const driver_ops_t driver_wire_ops = {
+    .name = "wire",
+    .open = driver_wire_open,
+    .recv = driver_wire_recv,
+    .send = driver_wire_send,
+    .close = driver_wire_close,
+};
+
+#endif
@@ -0,0 +1,381 @@
+#ifdef __linux__
+
+#include <errno.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <net/if.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include "driver.h"
+#include "log.h"
+
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+
+typedef struct xdp_ring //映射到用户空间的AF_XDP环形队列
+{
+  uint32_t *producer;   // 生产者下标
+  uint32_t *consumer;   // 消费者下标
+  void *desc;           // 描述符数组，收发队列为xdp_desc，填充与完成队列为uint64_t地址
+  uint32_t mask;        // 队列大小减一
+  void *map;            // 映射内存
+  size_t map_len;       // 映射内存长度
+} xdp_ring_t;
+
+typedef struct driver_xdp //AF_XDP驱动的私有数据
+{
+  int fd;                         // AF_XDP套接字
+  int map_fd;                     // XSKMAP
+  int prog_fd;                    // 把帧重定向到套接字的XDP程序
+  int link_fd;                    // XDP程序与网卡的连接，关闭即卸载
+  uint8_t *umem;                  // UMEM，所有帧的存储，收到的帧直接作为buf_t的外部存储
+  xdp_ring_t fill, comp, rx, tx;  // 填充、完成、接收、发送队列
+  struct xdp_desc rx_desc[XDP_BATCH]; // 批量收取的接收描述符
+  uint32_t rx_num;                // 批量中的描述符数
+  uint32_t rx_next;               // 批量中下一个交给协议栈的描述符
+  uint64_t fill_pending[XDP_BATCH]; // 已处理完、等待归还填充队列的帧
+  uint32_t fill_num;              // 等待归还的帧数
+  uint64_t tx_free[XDP_FRAME_NUM / 2]; // 空闲的发送帧
+  uint32_t tx_free_num;           // 空闲的发送帧数
+} driver_xdp_t;
+
+/**
+ * @brief bpf系统调用
+ *
+ */
+static int driver_xdp_bpf(int cmd, union bpf_attr *attr) {
+  return syscall(__NR_bpf, cmd, attr, sizeof(union bpf_attr));
+}
+
+/**
+ * @brief 创建XSKMAP并加载XDP程序：按接收队列号把帧重定向到对应套接字，没有套接字时交给内核协议栈
+ *
+ * @param xdp 驱动私有数据
+ * @return int 成功为0，失败为-1
+ */
+static int driver_xdp_load_prog(driver_xdp_t *xdp) {
+  union bpf_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.map_type = BPF_MAP_TYPE_XSKMAP;
+  attr.key_size = sizeof(uint32_t);
+  attr.value_size = sizeof(uint32_t);
+  attr.max_entries = 64;
+  xdp->map_fd = driver_xdp_bpf(BPF_MAP_CREATE, &attr);
+  if (xdp->map_fd < 0) {
+    Err("xdp: create xskmap: %s", strerror(errno));
+    return -1;
+  }
+  struct bpf_insn prog[] = {
+      // r2 = ctx->rx_queue_index
+      {.code = BPF_LDX | BPF_MEM | BPF_W, .dst_reg = BPF_REG_2, .src_reg = BPF_REG_1,
+       .off = offsetof(struct xdp_md, rx_queue_index)},
+      // r1 = xskmap
+      {.code = BPF_LD | BPF_DW | BPF_IMM, .dst_reg = BPF_REG_1, .src_reg = BPF_PSEUDO_MAP_FD, .imm = xdp->map_fd},
+      {0},
+      // r3 = XDP_PASS，队列上没有套接字时的默认动作
+      {.code = BPF_ALU64 | BPF_MOV | BPF_K, .dst_reg = BPF_REG_3, .imm = XDP_PASS},
+      // return bpf_redirect_map(r1, r2, r3)
+      {.code = BPF_JMP | BPF_CALL, .imm = BPF_FUNC_redirect_map},
+      {.code = BPF_JMP | BPF_EXIT},
+  };
+  static const char license[] = "GPL";
+  memset(&attr, 0, sizeof(attr));
+  attr.prog_type = BPF_PROG_TYPE_XDP;
+  attr.insns = (uint64_t) (uintptr_t) prog;
+  attr.insn_cnt = sizeof(prog) / sizeof(prog[0]);
+  attr.license = (uint64_t) (uintptr_t) license;
+  xdp->prog_fd = driver_xdp_bpf(BPF_PROG_LOAD, &attr);
+  if (xdp->prog_fd < 0) {
+    Err("xdp: load program: %s", strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief 映射一个环形队列
+ *
+ * @param fd AF_XDP套接字
+ * @param ring 要映射的队列
+ * @param off 队列的偏移信息
+ * @param pgoff 队列的映射偏移
+ * @param desc_size 描述符大小
+ * @return int 成功为0，失败为-1
+ */
+static int driver_xdp_map_ring(int fd, xdp_ring_t *ring, struct xdp_ring_offset *off, off_t pgoff,
+                               size_t desc_size) {
+  ring->map_len = off->desc + XDP_RING_SIZE * desc_size;
+  ring->map = mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, pgoff);
+  if (ring->map == MAP_FAILED) {
+    ring->map = NULL;
+    Err("xdp: mmap ring: %s", strerror(errno));
+    return -1;
+  }
+  ring->producer = (uint32_t *) ((uint8_t *) ring->map + off->producer);
+  ring->consumer = (uint32_t *) ((uint8_t *) ring->map + off->consumer);
+  ring->desc = (uint8_t *) ring->map + off->desc;
+  ring->mask = XDP_RING_SIZE - 1;
+  return 0;
+}
+
+/**
+ * @brief 把帧地址放入填充队列，交给内核用于接收
+ *
+ * @param xdp 驱动私有数据
+ * @param addrs 帧地址
+ * @param n 帧数
+ */
+static void driver_xdp_fill(driver_xdp_t *xdp, const uint64_t *addrs, uint32_t n) {
+  uint32_t prod = *xdp->fill.producer;
+  uint64_t *ring = xdp->fill.desc;
+  // 填充队列与接收帧数相同，不会溢出
+  for (uint32_t i = 0; i < n; i++)
+    ring[(prod + i) & xdp->fill.mask] = addrs[i];
+  __atomic_store_n(xdp->fill.producer, prod + n, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief 回收发送完成的帧
+ *
+ * @param xdp 驱动私有数据
+ */
+static void driver_xdp_complete(driver_xdp_t *xdp) {
+  uint32_t cons = *xdp->comp.consumer;
+  uint32_t prod = __atomic_load_n(xdp->comp.producer, __ATOMIC_ACQUIRE);
+  uint64_t *ring = xdp->comp.desc;
+  for (; cons != prod; cons++)
+    xdp->tx_free[xdp->tx_free_num++] = ring[cons & xdp->comp.mask];
+  __atomic_store_n(xdp->comp.consumer, cons, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief 关闭网卡，卸载XDP程序并释放UMEM
+ *
+ * @param netif 网卡
+ */
+static void driver_xdp_close(netif_t *netif) {
+  driver_xdp_t *xdp = netif->priv;
+  if (!xdp)
+    return;
+  xdp_ring_t *rings[] = {&xdp->fill, &xdp->comp, &xdp->rx, &xdp->tx};
+  for (size_t i = 0; i < sizeof(rings) / sizeof(rings[0]); i++)
+    if (rings[i]->map)
+      munmap(rings[i]->map, rings[i]->map_len);
+  int fds[] = {xdp->link_fd, xdp->prog_fd, xdp->map_fd, xdp->fd};
+  for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++)
+    if (fds[i] >= 0)
+      close(fds[i]);
+  if (xdp->umem)
+    munmap(xdp->umem, (size_t) XDP_FRAME_NUM * XDP_FRAME_SIZE);
+  free(xdp);
+  netif->priv = NULL;
+}
+
+/**
+ * @brief 打开网卡：注册UMEM，建立四个环形队列，以通用(SKB)模式挂载XDP程序
+ *
+ * @param netif 要打开的网卡，必须指定网卡名，使用0号接收队列
+ * @return int 成功为0，失败为-1
+ */
+static int driver_xdp_open(netif_t *netif) {
+  if (!netif->name[0]) {
+    Err("xdp: interface name is required");
+    return -1;
+  }
+  int ifindex = if_nametoindex(netif->name);
+  if (!ifindex) {
+    Err("xdp: no such interface %s", netif->name);
+    return -1;
+  }
+  driver_xdp_t *xdp = calloc(1, sizeof(driver_xdp_t));
+  if (!xdp)
+    return -1;
+  xdp->fd = xdp->map_fd = xdp->prog_fd = xdp->link_fd = -1;
+  netif->priv = xdp;
+
+  size_t umem_len = (size_t) XDP_FRAME_NUM * XDP_FRAME_SIZE;
+  xdp->umem = mmap(NULL, umem_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (xdp->umem == MAP_FAILED) {
+    xdp->umem = NULL;
+    goto fail;
+  }
+  xdp->fd = socket(AF_XDP, SOCK_RAW, 0);
+  if (xdp->fd < 0)
+    goto fail;
+  struct xdp_umem_reg umem_reg = {
+      .addr = (uint64_t) (uintptr_t) xdp->umem,
+      .len = umem_len,
+      .chunk_size = XDP_FRAME_SIZE,
+      .headroom = 0,
+  };
+  int ring_size = XDP_RING_SIZE;
+  if (setsockopt(xdp->fd, SOL_XDP, XDP_UMEM_REG, &umem_reg, sizeof(umem_reg)) < 0 ||
+      setsockopt(xdp->fd, SOL_XDP, XDP_UMEM_FILL_RING, &ring_size, sizeof(ring_size)) < 0 ||
+      setsockopt(xdp->fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &ring_size, sizeof(ring_size)) < 0 ||
+      setsockopt(xdp->fd, SOL_XDP, XDP_RX_RING, &ring_size, sizeof(ring_size)) < 0 ||
+      setsockopt(xdp->fd, SOL_XDP, XDP_TX_RING, &ring_size, sizeof(ring_size)) < 0)
+    goto fail;
+  struct xdp_mmap_offsets off;
+  socklen_t optlen = sizeof(off);
+  if (getsockopt(xdp->fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) < 0)
+    goto fail;
+  if (driver_xdp_map_ring(xdp->fd, &xdp->fill, &off.fr, XDP_UMEM_PGOFF_FILL_RING, sizeof(uint64_t)) < 0 ||
+      driver_xdp_map_ring(xdp->fd, &xdp->comp, &off.cr, XDP_UMEM_PGOFF_COMPLETION_RING, sizeof(uint64_t)) < 0 ||
+      driver_xdp_map_ring(xdp->fd, &xdp->rx, &off.rx, XDP_PGOFF_RX_RING, sizeof(struct xdp_desc)) < 0 ||
+      driver_xdp_map_ring(xdp->fd, &xdp->tx, &off.tx, XDP_PGOFF_TX_RING, sizeof(struct xdp_desc)) < 0) {
+    driver_xdp_close(netif);
+    return -1;
+  }
+
+  // 前一半帧交给内核接收，后一半用于发送
+  for (uint32_t i = 0; i < XDP_FRAME_NUM / 2; i += XDP_BATCH) {
+    uint64_t addrs[XDP_BATCH];
+    for (uint32_t j = 0; j < XDP_BATCH; j++)
+      addrs[j] = (uint64_t) (i + j) * XDP_FRAME_SIZE;
+    driver_xdp_fill(xdp, addrs, XDP_BATCH);
+  }
+  for (uint32_t i = 0; i < XDP_FRAME_NUM / 2; i++)
+    xdp->tx_free[xdp->tx_free_num++] = (uint64_t) (XDP_FRAME_NUM / 2 + i) * XDP_FRAME_SIZE;
+
+  // 通用模式只支持拷贝，原生驱动支持时内核仍然把帧写入UMEM，协议栈侧同样无需拷贝
+  struct sockaddr_xdp addr = {
+      .sxdp_family = AF_XDP,
+      .sxdp_ifindex = ifindex,
+      .sxdp_queue_id = 0,
+      .sxdp_flags = XDP_COPY,
+  };
+  if (bind(xdp->fd, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+    goto fail;
+  if (driver_xdp_load_prog(xdp) < 0) {
+    driver_xdp_close(netif);
+    return -1;
+  }
+  union bpf_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  uint32_t key = 0, value = xdp->fd;
+  attr.map_fd = xdp->map_fd;
+  attr.key = (uint64_t) (uintptr_t) &key;
+  attr.value = (uint64_t) (uintptr_t) &value;
+  if (driver_xdp_bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0)
+    goto fail;
+  memset(&attr, 0, sizeof(attr));
+  attr.link_create.prog_fd = xdp->prog_fd;
+  attr.link_create.target_ifindex = ifindex;
+  attr.link_create.attach_type = BPF_XDP;
+  attr.link_create.flags = XDP_FLAGS_SKB_MODE;
+  xdp->link_fd = driver_xdp_bpf(BPF_LINK_CREATE, &attr);
+  if (xdp->link_fd < 0)
+    goto fail;
+  Log("Using interface %s (AF_XDP, skb mode), my IP is %s, my MAC is %s", netif->name, LOG_IP(netif->ip),
+      LOG_MAC(netif->mac));
+  return 0;
+
+fail:
+  Err("xdp: open %s: %s", netif->name, strerror(errno));
+  driver_xdp_close(netif);
+  return -1;
+}
+
+/**
+ * @brief 从接收队列取下一帧，帧留在UMEM中原地处理。
+ *        上一帧在本次调用时才归还，归还的帧攒够一批后一起放回填充队列
+ *
+ * @param netif 网卡
+ * @param buf 指向UMEM中帧数据的buffer，在下一次接收前有效
+ * @return int 数据包的长度，未收到为0
+ */
+static int driver_xdp_recv(netif_t *netif, buf_t *buf) {
+  driver_xdp_t *xdp = netif->priv;
+  if (xdp->rx_next > 0) {
+    // 上一帧已处理完
+    xdp->fill_pending[xdp->fill_num++] = xdp->rx_desc[xdp->rx_next - 1].addr & ~(uint64_t) (XDP_FRAME_SIZE - 1);
+    if (xdp->fill_num == XDP_BATCH) {
+      driver_xdp_fill(xdp, xdp->fill_pending, xdp->fill_num);
+      xdp->fill_num = 0;
+    }
+  }
+  if (xdp->rx_next == xdp->rx_num) {
+    xdp->rx_next = xdp->rx_num = 0;
+    uint32_t cons = *xdp->rx.consumer;
+    uint32_t prod = __atomic_load_n(xdp->rx.producer, __ATOMIC_ACQUIRE);
+    if (cons == prod) {
+      // 没有新帧时把零散的待归还帧放回，避免内核缺少接收帧
+      if (xdp->fill_num) {
+        driver_xdp_fill(xdp, xdp->fill_pending, xdp->fill_num);
+        xdp->fill_num = 0;
+      }
+      return 0;
+    }
+    struct xdp_desc *ring = xdp->rx.desc;
+    for (; cons != prod && xdp->rx_num < XDP_BATCH; cons++)
+      xdp->rx_desc[xdp->rx_num++] = ring[cons & xdp->rx.mask];
+    __atomic_store_n(xdp->rx.consumer, cons, __ATOMIC_RELEASE);
+  }
+  struct xdp_desc *desc = &xdp->rx_desc[xdp->rx_next++];
+  uint8_t *frame = xdp->umem + (desc->addr & ~(uint64_t) (XDP_FRAME_SIZE - 1));
+  buf_attach(buf, xdp->umem + desc->addr, desc->len, frame, frame + XDP_FRAME_SIZE);
+  return desc->len;
+}
+
+/**
+ * @brief 把数据包拷入空闲的UMEM帧，放入发送队列并通知内核发送
+ *
+ * @param netif 网卡
+ * @param buf 要发送的数据包
+ * @return int 成功为0，失败为-1
+ */
+static int driver_xdp_send(netif_t *netif, buf_t *buf) {
+  driver_xdp_t *xdp = netif->priv;
+  if (buf->len > XDP_FRAME_SIZE) {
+    Err("xdp: frame too large (%zu)", buf->len);
+    return -1;
+  }
+  if (!xdp->tx_free_num) {
+    driver_xdp_complete(xdp);
+    if (!xdp->tx_free_num) {
+      sendto(xdp->fd, NULL, 0, MSG_DONTWAIT, NULL, 0);
+      driver_xdp_complete(xdp);
+      if (!xdp->tx_free_num) {
+        Err("xdp: no free tx frame, drop");
+        return -1;
+      }
+    }
+  }
+  uint64_t addr = xdp->tx_free[--xdp->tx_free_num];
+  memcpy(xdp->umem + addr, buf->data, buf->len);
+  uint32_t prod = *xdp->tx.producer;
+  struct xdp_desc *ring = xdp->tx.desc;
+  ring[prod & xdp->tx.mask] = (struct xdp_desc) {.addr = addr, .len = buf->len};
+  __atomic_store_n(xdp->tx.producer, prod + 1, __ATOMIC_RELEASE);
+  // 拷贝模式下必须由系统调用触发发送
+  if (sendto(xdp->fd, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0 && errno != EAGAIN && errno != ENOBUFS &&
+      errno != EBUSY) {
+    Err("xdp: send: %s", strerror(errno));
+    return -1;
+  }
+  driver_xdp_complete(xdp);
+  return 0;
+}
+
+/**
+ * @brief AF_XDP驱动操作表，收到的帧直接以UMEM作为buf_t的存储
+ *
+ */
+const driver_ops_t driver_xdp_ops = {
+    .name = "xdp",
+    .open = driver_xdp_open,
+    .recv = driver_xdp_recv,
+    .send = driver_xdp_send,
+    .close = driver_xdp_close,
+};
+
+#endif
@@ -1,56 +1,79 @@
 #include "ethernet.h"
 #include "driver.h"
-#include "debug_macros.h"
+#include "log.h"
+#include "stats.h"
+#include "latency.h"
+#include "recorder.h"
 
 /**
  * @brief 处理一个收到的数据包
  * 
+ * @param netif 收到数据包的网卡
  * @param buf 要处理的数据包
  */
-void ethernet_in(buf_t *buf) {
+void ethernet_in(netif_t *netif, buf_t *buf) {
+  LATENCY_RX();
+  recorder_rx(netif, buf);
   ether_hdr_t *hdr = (ether_hdr_t *) buf->data;
   uint16_t length_type = swap16(hdr->protocol16);
+  NET_STATS_INC(ETH_RX_PACKETS);
+  NET_STATS_ADD(ETH_RX_BYTES, buf->len);
   // if is broadcast or is for me, handle it
-  if (memcmp(hdr->dst, net_if_mac, NET_MAC_LEN) == 0 ||
+  if (memcmp(hdr->dst, netif->mac, NET_MAC_LEN) == 0 ||
       memcmp(hdr->dst, net_broadcast_mac, NET_MAC_LEN) == 0) {
-    Dbg("ethernet: package for me, dst=%s, src=%s, length/type=%x(%d)", mactos(buf->data),
-        mactos(hdr->src), length_type, length_type);
+    Dbg("ethernet: package for me, dst=%s, src=%s, length/type=%x(%d)", LOG_MAC(buf->data),
+        LOG_MAC(hdr->src), length_type, length_type);
     if (46 <= length_type && length_type <= 1500) {
       // this is a length field
       Err("ethernet: unknown protocol! length = %d", length_type);
+      NET_STATS_DROP(ETH_DROP_BAD_TYPE);
     } else if (length_type >= 0x0600) {
       // this is a type field
       buf_remove_header(buf, sizeof(ether_hdr_t));
-      net_in(buf, length_type, hdr->src);
+      if (net_in(netif, buf, length_type, hdr->src) < 0)
+        NET_STATS_DROP(ETH_DROP_NO_HANDLER);
     } else {
       Log("ethernet: invalid length/type field, drop this packet");
+      NET_STATS_DROP(ETH_DROP_BAD_TYPE);
       return;
     }
   } else {
-    Log("ethernet: package not for me, dst=%s, src=%s", mactos(buf->data), mactos(buf->data + NET_MAC_LEN));
+    Log("ethernet: package not for me, dst=%s, src=%s", LOG_MAC(buf->data), LOG_MAC(buf->data + NET_MAC_LEN));
+    NET_STATS_DROP(ETH_DROP_NOT_MINE);
   }
 }
 
 /**
  * @brief 处理一个要发送的数据包
  * 
+ * @param netif 发送数据包的网卡
  * @param buf 要处理的数据包
  * @param mac 目标MAC地址
  * @param protocol 上层协议
  */
-void ethernet_out(buf_t *buf, const uint8_t *mac, net_protocol_t protocol) {
+void ethernet_out(netif_t *netif, buf_t *buf, const uint8_t *mac, net_protocol_t protocol) {
   protocol = swap16(protocol);
-  Dbg("ethernet: out, mac=%s, protocol=%x, payload size=%zu", mactos(mac), protocol, buf->len);
+  Dbg("ethernet: out, mac=%s, protocol=%x, payload size=%zu", LOG_MAC(mac), protocol, buf->len);
   // if smaller than 46, pad it
   if (buf->len < 46) {
     buf_add_padding(buf, 46 - buf->len);
   }
   buf_add_header(buf, sizeof(ether_hdr_t));
   ether_hdr_t *hdr = (ether_hdr_t *) buf->data;
-  memcpy(hdr->src, net_if_mac, NET_MAC_LEN);
+  memcpy(hdr->src, netif->mac, NET_MAC_LEN);
   memcpy(hdr->dst, mac, NET_MAC_LEN);
   hdr->protocol16 = protocol;
-  driver_send(buf);
+  // 只有ip包算作回复，arp请求不结束打点
+  if (protocol == constswap16(NET_PROTOCOL_IP))
+    LATENCY_TX();
+  recorder_tx(netif, buf);
+  if (driver_send(netif, buf) == 0) {
+    netif->tx_packets++;
+    NET_STATS_INC(ETH_TX_PACKETS);
+    NET_STATS_ADD(ETH_TX_BYTES, buf->len);
+  } else {
+    NET_STATS_INC(ETH_TX_ERRORS);
+  }
 }
 
 /**
@@ -58,14 +81,21 @@ void ethernet_out(buf_t *buf, const uint8_t *mac, net_protocol_t protocol) {
  * 
  */
 void ethernet_init() {
-  buf_init(&rxbuf, ETHERNET_MAX_TRANSPORT_UNIT + sizeof(ether_hdr_t));
+  netif_t *netif;
+  for (size_t i = 0; (netif = netif_get(i)) != NULL; i++)
+    buf_init(&netif->rxbuf, netif->mtu + sizeof(ether_hdr_t));
 }
 
 /**
- * @brief 一次以太网轮询
+ * @brief 一次以太网轮询，最多处理ETHERNET_POLL_BUDGET个帧，使驱动可以批量交付
  * 
+ * @param netif 要轮询的网卡
+ * @return size_t 本次处理的帧数
  */
-void ethernet_poll() {
-  if (driver_recv(&rxbuf) > 0)
-    ethernet_in(&rxbuf);
+size_t ethernet_poll(netif_t *netif) {
+  size_t count;
+  for (count = 0; count < ETHERNET_POLL_BUDGET && driver_recv(netif, &netif->rxbuf) > 0; count++)
+    ethernet_in(netif, &netif->rxbuf);
+  netif->rx_packets += count;
+  return count;
 }
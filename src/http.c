@@ -2,119 +2,701 @@
 #include "tcp.h"
 #include "net.h"
 #include "assert.h"
-#include "debug_macros.h"
+#include "log.h"
+#include "metrics.h"
+#include "latency.h"
+#include "http_cache.h"
+#include "http_parser.h"
+#include <stdarg.h>
+#include <strings.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/stat.h>
 
-#define TCP_FIFO_SIZE 40
+#define HTTP_NO_LENGTH ((size_t) -1) // 没有响应体的响应(304)与分块的响应不带Content-Length
+#define HTTP_CHUNK_HEAD 6            // 块长度行"5b4\r\n"预留的字节数，块不超过HTTP_OUT_SIZE
 
-typedef struct http_fifo {
-  tcp_connect_t *buffer[TCP_FIFO_SIZE];
-  uint8_t front, tail, count;
-} http_fifo_t;
+/*
+ * 接受队列：连接数达到HTTP_CONN_MAX时新连接在此排队，有空位时按到达顺序取出。
+ * 队列中保存带代号的句柄而不是连接指针，排队的连接被释放、槽位又被新连接复用时，
+ * 旧句柄解析不出连接，取出时跳过；排队的连接的app指向http_queued，释放时据此计数。
+ * 队列满时先清掉已释放的句柄，仍然满则回复503并关闭，不会无声地丢弃连接
+ */
+typedef struct http_accept_queue {
+  tcp_handle_t handles[HTTP_ACCEPT_BACKLOG];
+  size_t head, count;             // 环形队列的队首与句柄数，含已释放的
+  size_t pending, peak;           // 仍然存在的排队连接数及其最大值
+  uint64_t accepted;              // 接受的连接数，含排队后接受的
+  uint64_t rejected;              // 队列满被拒绝的连接数
+  uint64_t dropped;               // 排队时被对端关闭的连接数
+} http_accept_queue_t;
 
-static http_fifo_t http_fifo_v;
+typedef enum http_conn_state {
+  HTTP_CONN_READ, // 读取请求头
+  HTTP_CONN_SEND, // 发送响应
+} http_conn_state_t;
 
-static void http_fifo_init(http_fifo_t *fifo) {
-  fifo->count = 0;
-  fifo->front = 0;
-  fifo->tail = 0;
+/*
+ * 每个连接一个状态机：读取请求头 -> 解析 -> 发送响应 -> 读取下一个请求或关闭。
+ * tcp的处理程序只把连接放入就绪队列，http_server_run依次推进就绪的连接，
+ * 对端窗口已满时返回，等待确认后的TCP_CONN_WRITABLE，一个慢的客户端不会阻塞其他连接。
+ * 请求头直接在tcp接收缓存中解析，响应准备好后才从接收缓存中消费；
+ * HTTP/1.1默认保持连接，流水线发来的多个请求留在接收缓存中，按顺序逐个响应；
+ * 等待请求的连接按开始等待的先后挂在空闲链表上，超过HTTP_KEEPALIVE_TIMEOUT秒的被关闭
+ */
+struct http_conn {
+  tcp_connect_t *tcp;             // 所属连接，连接已释放时为NULL
+  http_conn_state_t state;
+  int ready;                      // 是否在就绪队列中
+  struct http_conn *next;         // 就绪队列或空闲链表中的下一个
+  struct http_conn *idle_prev, *idle_next; // 等待请求的连接链表
+  time_t idle_since;              // 开始等待请求的时间
+  uint64_t start;                 // 请求开始到达时的周期数
+  unsigned requests;              // 已处理的请求数
+  int keep_alive;                 // 当前响应发完后是否保持连接
+  int http11;                     // 请求是HTTP/1.1，可以分块发送
+  size_t request_len;             // 上次解析时接收缓存中的字节数
+  size_t request_scan;            // 已确认不含请求头结尾的字节数
+  const char *body;               // 内存中的响应体
+  size_t body_len, body_sent;
+  char *body_owned;               // 需要释放的响应体
+  http_cache_entry_t *cache;      // 响应头与响应体所在的缓存项，发送完后释放引用
+  FILE *file;                     // 不能缓存的文件，映射后交给tcp，不能映射时按块读入out
+  off_t file_off;                 // 响应的第一个字节在文件中的位置
+  size_t file_len;                // 尚未发送的长度
+  int file_map;                   // 尚未尝试映射
+  http_stream_t stream;           // 流式响应体的生产函数，结束后为NULL
+  void *stream_arg;
+  int chunked;                    // 流式响应体按块发送，尚未发出最后的空块
+  const char *out_data;           // 待写入的响应头或文件块，指向out、缓存项或固定的500响应头
+  size_t out_len, out_sent;
+  char out[HTTP_OUT_SIZE];        // 响应头与文件块
+};
+
+typedef struct http_route_node //路由字典树的节点，子节点以首个子节点与兄弟节点串起
+{
+  char byte;                      // 从父节点到此的路径字节
+  int child, sibling;             // 节点下标，没有时为-1
+  int exact, prefix;              // 以此结尾的精确与前缀路由，没有时为-1
+} http_route_node_t;
+
+typedef struct http_route_entry //注册的处理函数
+{
+  http_handler_t handler;
+  void *arg;
+} http_route_entry_t;
+
+typedef struct http_file //响应的文件及由大小与修改时间生成的验证器
+{
+  size_t size;
+  char etag[40];                  // "大小-修改时间"，均为十六进制
+  char last_modified[32];         // HTTP日期
+  char headers[224];              // ETag、Last-Modified、Accept-Ranges与内容编码的头部
+} http_file_t;
+
+static NET_THREAD_LOCAL http_accept_queue_t http_queue;
+static NET_THREAD_LOCAL char http_queued; // 排队中的连接的app指向此处
+static NET_THREAD_LOCAL http_conn_t *http_ready_head, *http_ready_tail;
+static NET_THREAD_LOCAL http_conn_t *http_free_list;
+static NET_THREAD_LOCAL http_conn_t *http_idle_head, *http_idle_tail;
+static NET_THREAD_LOCAL size_t http_conn_num;
+static NET_THREAD_LOCAL http_route_node_t *http_route_nodes;
+static NET_THREAD_LOCAL size_t http_route_node_num, http_route_node_cap;
+static NET_THREAD_LOCAL http_route_entry_t *http_route_entries;
+static NET_THREAD_LOCAL size_t http_route_num, http_route_cap;
+
+static const char content_404[] = "<!DOCTYPE HTML PUBLIC \"-//W3C//DTD HTML 3.2 Final//EN\">\n"
+                                  "<title>404 Not Found</title>\n"
+                                  "<h1>Not Found</h1>\n"
+                                  "<p>The requested URL was not found on the server.  If you entered the URL manually please check your spelling and try again.</p>";
+static const char response_503[] = "HTTP/1.1 503 Service Unavailable\r\n"
+                                   "Content-Length: 0\r\n"
+                                   "Retry-After: 1\r\n"
+                                   "Connection: close\r\n"
+                                   "\r\n";
+static const char response_500[] = "HTTP/1.1 500 Internal Server Error\r\n"
+                                   "Content-Length: 0\r\n"
+                                   "Connection: close\r\n"
+                                   "\r\n";
+
+static void http_queue_init(http_accept_queue_t *queue) {
+  memset(queue, 0, sizeof(*queue));
 }
 
-static int http_fifo_in(http_fifo_t *fifo, tcp_connect_t *tcp) {
-  if (fifo->count >= TCP_FIFO_SIZE) {
+/**
+ * @brief 去掉队列中已释放的连接的句柄，保持其余句柄的顺序
+ *
+ */
+static void http_queue_compact(http_accept_queue_t *queue) {
+  size_t count = 0;
+  for (size_t i = 0; i < queue->count; i++) {
+    tcp_handle_t handle = queue->handles[(queue->head + i) % HTTP_ACCEPT_BACKLOG];
+    if (tcp_handle_get(handle))
+      queue->handles[(queue->head + count++) % HTTP_ACCEPT_BACKLOG] = handle;
+  }
+  queue->count = count;
+}
+
+/**
+ * @brief 新连接排队
+ *
+ * @return int 成功为0，队列已满为-1
+ */
+static int http_queue_push(http_accept_queue_t *queue, tcp_connect_t *tcp) {
+  if (queue->count == HTTP_ACCEPT_BACKLOG && queue->pending < queue->count)
+    http_queue_compact(queue);
+  if (queue->count == HTTP_ACCEPT_BACKLOG)
     return -1;
+  queue->handles[(queue->head + queue->count++) % HTTP_ACCEPT_BACKLOG] = tcp_connect_handle(tcp);
+  tcp->app = &http_queued;
+  if (++queue->pending > queue->peak)
+    queue->peak = queue->pending;
+  return 0;
+}
+
+/**
+ * @brief 按到达顺序取出仍然存在的连接
+ *
+ * @return tcp_connect_t* 没有排队的连接时为NULL
+ */
+static tcp_connect_t *http_queue_pop(http_accept_queue_t *queue) {
+  while (queue->count) {
+    tcp_connect_t *tcp = tcp_handle_get(queue->handles[queue->head]);
+    queue->head = (queue->head + 1) % HTTP_ACCEPT_BACKLOG;
+    queue->count--;
+    if (tcp) {
+      queue->pending--;
+      tcp->app = NULL;
+      return tcp;
+    }
   }
-  fifo->buffer[fifo->front] = tcp;
-  fifo->front++;
-  if (fifo->front >= TCP_FIFO_SIZE) {
-    fifo->front = 0;
+  return NULL;
+}
+
+/**
+ * @brief 把连接放入就绪队列，已在队列中时不重复放入
+ *
+ */
+static void http_ready(http_conn_t *conn) {
+  if (conn->ready)
+    return;
+  conn->ready = 1;
+  conn->next = NULL;
+  if (http_ready_tail)
+    http_ready_tail->next = conn;
+  else
+    http_ready_head = conn;
+  http_ready_tail = conn;
+}
+
+/**
+ * @brief 连接开始等待请求，放到空闲链表尾部；超时相同，链表按到期先后排列
+ *
+ */
+static void http_idle_add(http_conn_t *conn) {
+  conn->idle_since = time(NULL);
+  conn->idle_next = NULL;
+  conn->idle_prev = http_idle_tail;
+  if (http_idle_tail)
+    http_idle_tail->idle_next = conn;
+  else
+    http_idle_head = conn;
+  http_idle_tail = conn;
+}
+
+static void http_idle_remove(http_conn_t *conn) {
+  if (conn->idle_prev)
+    conn->idle_prev->idle_next = conn->idle_next;
+  else if (http_idle_head == conn)
+    http_idle_head = conn->idle_next;
+  else
+    return; // 不在链表中
+  if (conn->idle_next)
+    conn->idle_next->idle_prev = conn->idle_prev;
+  else
+    http_idle_tail = conn->idle_prev;
+  conn->idle_prev = conn->idle_next = NULL;
+}
+
+static http_conn_t *http_ready_pop() {
+  http_conn_t *conn = http_ready_head;
+  if (!conn)
+    return NULL;
+  http_ready_head = conn->next;
+  if (!http_ready_head)
+    http_ready_tail = NULL;
+  conn->ready = 0;
+  return conn;
+}
+
+/**
+ * @brief 为取出的连接分配状态，优先复用空闲链表
+ *
+ */
+static void http_accept(tcp_connect_t *tcp) {
+  http_conn_t *conn = http_free_list;
+  if (conn)
+    http_free_list = conn->next;
+  else if (!(conn = malloc(sizeof(http_conn_t)))) {
+    Err("http: out of memory");
+    tcp_connect_close(tcp);
+    return;
   }
-  fifo->count++;
+  conn->tcp = tcp;
+  conn->state = HTTP_CONN_READ;
+  conn->ready = 0;
+  conn->start = cycles_now();
+  conn->requests = 0;
+  conn->keep_alive = conn->http11 = 0;
+  conn->request_len = conn->request_scan = 0;
+  conn->body = conn->body_owned = NULL;
+  conn->body_len = conn->body_sent = 0;
+  conn->cache = NULL;
+  conn->file = NULL;
+  conn->file_off = 0;
+  conn->file_len = 0;
+  conn->file_map = 0;
+  conn->stream = NULL;
+  conn->chunked = 0;
+  conn->out_data = conn->out;
+  conn->out_len = conn->out_sent = 0;
+  tcp->app = conn;
+  http_conn_num++;
+  http_queue.accepted++;
+  http_idle_add(conn);
+  // 排队时可能已经收到了请求
+  http_ready(conn);
+}
+
+static void http_conn_free(http_conn_t *conn) {
+  http_idle_remove(conn);
+  if (conn->stream)
+    conn->stream(conn->stream_arg, NULL, 0);
+  if (conn->file)
+    fclose(conn->file);
+  if (conn->cache)
+    http_cache_put(conn->cache);
+  free(conn->body_owned);
+  conn->next = http_free_list;
+  http_free_list = conn;
+  http_conn_num--;
+}
+
+static void close_http(http_conn_t *conn) {
+  tcp_connect_t *tcp = conn->tcp;
+  conn->tcp = NULL;
+  tcp->app = NULL;
+  tcp_connect_close(tcp);
+  http_conn_free(conn);
+  Log("http closed.");
+}
+
+/**
+ * @brief 向缓冲追加格式化的头部，放不下时不追加
+ *
+ * @param buf 缓冲
+ * @param size 缓冲大小
+ * @param len 已有的长度，成功时加上追加的长度
+ * @param fmt 格式串
+ * @return int 成功为0，放不下为-1
+ */
+static int http_appendf(char *buf, size_t size, size_t *len, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  int n = *len < size ? vsnprintf(buf + *len, size - *len, fmt, args) : -1;
+  va_end(args);
+  if (n < 0 || (size_t) n >= size - *len)
+    return -1;
+  *len += n;
   return 0;
 }
 
-static tcp_connect_t *http_fifo_out(http_fifo_t *fifo) {
-  if (fifo->count == 0) {
-    return NULL;
+/**
+ * @brief 生成响应头，以CRLF分行，并按是否保持连接给出Connection头部
+ *
+ * @param buf 缓冲
+ * @param size 缓冲大小
+ * @param keep_alive 响应后是否保持连接
+ * @param status 状态码与原因短语
+ * @param content_type 响应体类型，为NULL时不带Content-Type
+ * @param length 响应体长度，为HTTP_NO_LENGTH时不带Content-Length
+ * @param extra 其他头部，每行以CRLF结尾，可以为NULL
+ * @return size_t 响应头长度，缓冲放不下时为0
+ */
+static size_t http_format_head(char *buf, size_t size, int keep_alive, const char *status, const char *content_type,
+                               size_t length, const char *extra) {
+  size_t len = 0;
+  int err = http_appendf(buf, size, &len, "HTTP/1.1 %s\r\n", status);
+  if (length != HTTP_NO_LENGTH)
+    err |= http_appendf(buf, size, &len, "Content-Length: %zu\r\n", length);
+  if (content_type)
+    err |= http_appendf(buf, size, &len, "Content-Type: %s\r\n", content_type);
+  if (extra)
+    err |= http_appendf(buf, size, &len, "%s", extra);
+  if (keep_alive)
+    err |= http_appendf(buf, size, &len, "Connection: keep-alive\r\n"
+                                         "Keep-Alive: timeout=%d\r\n", HTTP_KEEPALIVE_TIMEOUT);
+  else
+    err |= http_appendf(buf, size, &len, "Connection: close\r\n");
+  err |= http_appendf(buf, size, &len, "Server: ChiServer/0.1\r\n\r\n");
+  return err ? 0 : len;
+}
+
+/**
+ * @brief 响应头放不下时改为回复500并关闭连接，不发送截断的响应头
+ *
+ */
+static void http_send_head_error(http_conn_t *conn) {
+  Err("http: response head too long");
+  conn->keep_alive = 0;
+  conn->out_data = response_500;
+  conn->out_len = sizeof(response_500) - 1;
+}
+
+/**
+ * @brief 生成响应头放入out
+ *
+ * @return int 成功为0，放不下时已改为回复500，为-1，调用者不再附加响应体
+ */
+static int http_send_head(http_conn_t *conn, const char *status, const char *content_type, size_t length,
+                          const char *extra) {
+  conn->out_data = conn->out;
+  conn->out_len = http_format_head(conn->out, sizeof(conn->out), conn->keep_alive, status, content_type, length,
+                                   extra);
+  if (conn->out_len)
+    return 0;
+  http_send_head_error(conn);
+  return -1;
+}
+
+/**
+ * @brief 以内存中的数据作为响应
+ *
+ * @param conn 连接
+ * @param status 状态码与原因短语
+ * @param content_type 响应体类型
+ * @param content 响应体
+ * @param size 响应体长度
+ * @param owned 发送完后需要释放的缓冲，可以为NULL
+ */
+void http_respond(http_conn_t *conn, const char *status, const char *content_type, const char *content, size_t size,
+                  char *owned) {
+  if (http_send_head(conn, status, content_type, size, NULL) != 0) {
+    free(owned);
+    return;
+  }
+  conn->body = content;
+  conn->body_len = size;
+  conn->body_owned = owned;
+}
+
+/**
+ * @brief 以生产函数逐块产生的数据作为响应，长度事先未知。HTTP/1.1按块发送(Transfer-Encoding: chunked)，
+ *        每次产生的数据成为一块，连接可以保持；HTTP/1.0的响应体以关闭连接结束
+ *
+ * @param conn 连接
+ * @param status 状态码与原因短语
+ * @param content_type 响应体类型
+ * @param stream 生产函数，对端窗口有空间时被调用
+ * @param arg 生产函数的参数
+ */
+void http_respond_stream(http_conn_t *conn, const char *status, const char *content_type, http_stream_t stream,
+                         void *arg) {
+  conn->chunked = conn->http11;
+  if (!conn->chunked)
+    conn->keep_alive = 0;
+  if (http_send_head(conn, status, content_type, HTTP_NO_LENGTH,
+                     conn->chunked ? "Transfer-Encoding: chunked\r\n" : NULL) != 0) {
+    conn->chunked = 0;
+    stream(arg, NULL, 0);
+    return;
   }
-  tcp_connect_t *tcp = fifo->buffer[fifo->tail];
-  fifo->tail++;
-  if (fifo->tail >= TCP_FIFO_SIZE) {
-    fifo->tail = 0;
+  conn->stream = stream;
+  conn->stream_arg = arg;
+}
+
+/**
+ * @brief 取得流式响应体的下一段放入out，分块时在前面加上十六进制的长度行，后面加上CRLF；
+ *        生产函数结束后发出最后的空块
+ *
+ */
+static void http_stream_next(http_conn_t *conn) {
+  conn->out_sent = 0;
+  if (!conn->chunked) {
+    conn->out_data = conn->out;
+    conn->out_len = conn->stream(conn->stream_arg, conn->out, sizeof(conn->out));
+    if (!conn->out_len)
+      conn->stream = NULL;
+    return;
   }
-  fifo->count--;
-  return tcp;
+  char *data = conn->out + HTTP_CHUNK_HEAD;
+  size_t len = conn->stream(conn->stream_arg, data, sizeof(conn->out) - HTTP_CHUNK_HEAD - 2);
+  if (!len) {
+    conn->stream = NULL;
+    conn->chunked = 0;
+    conn->out_data = "0\r\n\r\n";
+    conn->out_len = 5;
+    return;
+  }
+  // 长度行紧挨在数据之前
+  char head[HTTP_CHUNK_HEAD + 1];
+  int head_len = snprintf(head, sizeof(head), "%zx\r\n", len);
+  memcpy(data - head_len, head, head_len);
+  memcpy(data + len, "\r\n", 2);
+  conn->out_data = data - head_len;
+  conn->out_len = head_len + len + 2;
 }
 
-static size_t get_line(tcp_connect_t *tcp, char *buf, size_t size) {
-  size_t i = 0;
-  while (i < size) {
-    char c;
-    if (tcp_connect_read(tcp, (uint8_t *) &c, 1) > 0) {
-      if (c == '\n') {
-        break;
-      }
-      if (c != '\n' && c != '\r') {
-        buf[i] = c;
-        i++;
+static void http_send_404(http_conn_t *conn) {
+  http_respond(conn, "404 NOT FOUND", "text/html", content_404, sizeof(content_404) - 1, NULL);
+}
+
+/**
+ * @brief 内置的健康检查路由，协议栈在轮询就返回ok
+ *
+ */
+static void send_health(http_conn_t *conn, const http_request_t *req, void *arg) {
+  static const char ok[] = "ok\n";
+  http_respond(conn, "200 OK", "text/plain", ok, sizeof(ok) - 1, NULL);
+}
+
+/**
+ * @brief 内置的/metrics路由，以Prometheus文本格式返回协议栈指标，不读取文件
+ *
+ * @param conn 连接
+ */
+static void send_metrics(http_conn_t *conn, const http_request_t *req, void *arg) {
+  char *body = malloc(METRICS_BUF_SIZE);
+  if (!body) {
+    http_send_404(conn);
+    return;
+  }
+  size_t len = metrics_render(body, METRICS_BUF_SIZE);
+  len = metrics_printf(body, METRICS_BUF_SIZE, len, "# TYPE http_accept_queue_used gauge\n"
+                                                    "http_accept_queue_used %zu\n"
+                                                    "# TYPE http_accept_queue_peak gauge\n"
+                                                    "http_accept_queue_peak %zu\n"
+                                                    "# TYPE http_accept_queue_capacity gauge\n"
+                                                    "http_accept_queue_capacity %d\n"
+                                                    "# TYPE http_accepted_total counter\n"
+                                                    "http_accepted_total %llu\n"
+                                                    "# TYPE http_accept_rejected_total counter\n"
+                                                    "http_accept_rejected_total %llu\n"
+                                                    "# TYPE http_accept_dropped_total counter\n"
+                                                    "http_accept_dropped_total %llu\n"
+                                                    "# TYPE http_connections gauge\n"
+                                                    "http_connections %zu\n"
+                                                    "# TYPE http_connections_capacity gauge\n"
+                                                    "http_connections_capacity %d\n",
+                       http_queue.pending, http_queue.peak, HTTP_ACCEPT_BACKLOG,
+                       (unsigned long long) http_queue.accepted, (unsigned long long) http_queue.rejected,
+                       (unsigned long long) http_queue.dropped, http_conn_num, HTTP_CONN_MAX);
+  const http_cache_stats_t *cache = http_cache_stats();
+  len = metrics_printf(body, METRICS_BUF_SIZE, len, "# TYPE http_cache_hits_total counter\n"
+                                                    "http_cache_hits_total %llu\n"
+                                                    "# TYPE http_cache_misses_total counter\n"
+                                                    "http_cache_misses_total %llu\n"
+                                                    "# TYPE http_cache_reloads_total counter\n"
+                                                    "http_cache_reloads_total %llu\n"
+                                                    "# TYPE http_cache_entries gauge\n"
+                                                    "http_cache_entries %zu\n"
+                                                    "# TYPE http_cache_bytes gauge\n"
+                                                    "http_cache_bytes %zu\n",
+                       (unsigned long long) cache->hits, (unsigned long long) cache->misses,
+                       (unsigned long long) cache->reloads, cache->entries, cache->bytes);
+  http_respond(conn, "200 OK", "text/plain; version=0.0.4", body, len, body);
+}
+
+/**
+ * @brief 格式化HTTP日期，如Sun, 06 Nov 1994 08:49:37 GMT
+ *
+ */
+static void http_format_date(char *buf, size_t size, time_t t) {
+  struct tm tm;
+#ifdef _WIN32
+  gmtime_s(&tm, &t);
+#else
+  gmtime_r(&t, &tm);
+#endif
+  strftime(buf, size, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
+
+/**
+ * @brief 由文件大小与修改时间生成ETag与Last-Modified，文件内容变化时两者随之变化；
+ *        可协商编码的文件带Vary，预压缩版本带Content-Encoding
+ *
+ * @param file 文件
+ * @param size 文件大小
+ * @param mtime 文件的修改时间
+ * @param vary 响应是否随Accept-Encoding变化
+ * @param encoding 预压缩版本的编码，原文件为HTTP_ENCODING_NUM
+ * @return int 成功为0，头部放不下为-1
+ */
+static int http_file_init(http_file_t *file, size_t size, time_t mtime, int vary, http_encoding_t encoding) {
+  file->size = size;
+  snprintf(file->etag, sizeof(file->etag), "\"%zx-%llx\"", size, (unsigned long long) mtime);
+  http_format_date(file->last_modified, sizeof(file->last_modified), mtime);
+  size_t len = 0;
+  int err = http_appendf(file->headers, sizeof(file->headers), &len, "ETag: %s\r\n"
+                                                                     "Last-Modified: %s\r\n"
+                                                                     "Accept-Ranges: bytes\r\n",
+                         file->etag, file->last_modified);
+  if (vary)
+    err |= http_appendf(file->headers, sizeof(file->headers), &len, "Vary: Accept-Encoding\r\n");
+  if (encoding != HTTP_ENCODING_NUM)
+    err |= http_appendf(file->headers, sizeof(file->headers), &len, "Content-Encoding: %s\r\n",
+                        http_encoding_name[encoding]);
+  return err ? -1 : 0;
+}
+
+/**
+ * @brief Accept-Encoding中是否接受某种编码，q=0表示不接受
+ *
+ */
+static int http_accepts(http_slice_t value, const char *coding) {
+  size_t len = strlen(coding);
+  const char *p = value.data, *end = value.data + value.len;
+  while (p < end) {
+    const char *next = memchr(p, ',', end - p);
+    if (!next)
+      next = end;
+    while (p < next && *p == ' ') p++;
+    if ((size_t) (next - p) >= len && strncasecmp(p, coding, len) == 0 &&
+        (p + len == next || p[len] == ';' || p[len] == ' ')) {
+      // 有q=时，其中有非0数字才接受
+      for (p += len; p + 2 <= next && (p[0] != 'q' || p[1] != '='); p++);
+      if (p + 2 > next)
+        return 1;
+      for (p += 2; p < next && ((*p >= '0' && *p <= '9') || *p == '.'); p++) {
+        if (*p >= '1' && *p <= '9')
+          return 1;
       }
+      return 0;
     }
-    net_poll();
+    p = next + 1;
   }
-  buf[i] = '\0';
-  return i;
+  return 0;
 }
 
-static size_t http_send(tcp_connect_t *tcp, const char *buf, size_t size) {
-  size_t send = 0;
-  while (send < size) {
-    send += tcp_connect_write(tcp, (const uint8_t *) buf + send, size - send);
-    net_poll();
-    Dbg("http: write %zu, target size=%zu", send, size);
+/**
+ * @brief 打开要发送的文件，优先从缓存取得
+ *
+ * @param path 文件路径
+ * @param entry 缓存项，不能缓存时为NULL
+ * @param mtime 文件的修改时间
+ * @param size 文件大小
+ * @return FILE* 不能缓存的文件；文件在缓存中或不存在时为NULL
+ */
+static FILE *http_open_file(const char *path, http_cache_entry_t **entry, time_t *mtime, size_t *size) {
+  if ((*entry = http_cache_get(path))) {
+    *mtime = (*entry)->mtime;
+    *size = (*entry)->body_len;
+    return NULL;
+  }
+  FILE *f = fopen(path, "rb");
+  struct stat st;
+  if (f && (fstat(fileno(f), &st) != 0 || !S_ISREG(st.st_mode))) {
+    fclose(f);
+    f = NULL;
   }
-  return send;
+  if (f) {
+    *mtime = st.st_mtime;
+    *size = st.st_size;
+  }
+  return f;
 }
 
-static void http_send_content(tcp_connect_t *tcp, const char *content_type, const char *content, size_t size) {
-  char tx_buffer[4096];
-  sprintf(tx_buffer, "HTTP/1.1 200 OK\n"
-                     "Content-Length: %zu\n"
-                     "Content-Type: %s\n"
-                     "Server: ChiServer\n", size, content_type);
-  size_t len = strlen(tx_buffer);
-  memcpy(tx_buffer + len, content, size);
-  http_send(tcp, tx_buffer, len + size);
+/**
+ * @brief 客户端缓存的版本是否仍是当前文件。If-None-Match优先，If-Modified-Since按与Last-Modified相同比较
+ *
+ */
+static int http_not_modified(const http_request_t *req, const http_file_t *file) {
+  if (req->if_none_match.data)
+    return http_slice_is(req->if_none_match, "*") || http_slice_find(req->if_none_match, file->etag) != NULL;
+  return http_slice_is(req->if_modified_since, file->last_modified);
 }
 
-static void close_http(tcp_connect_t *tcp) {
-  tcp_connect_close(tcp);
-  Log("http closed.");
+/**
+ * @brief 读取十进制数，过大时取最大值
+ *
+ * @return int 没有数字时为0
+ */
+static int http_parse_uint(const char **p, const char *end, unsigned long long *value) {
+  const char *start = *p;
+  *value = 0;
+  for (; *p < end && **p >= '0' && **p <= '9'; (*p)++)
+    *value = *value > (ULLONG_MAX - 9) / 10 ? ULLONG_MAX : *value * 10 + (**p - '0');
+  return *p > start;
 }
 
-static bool send_local_file(tcp_connect_t *tcp, FILE *f, const char *content_type) {
-  if (!f) {
-    Err("http: Not Found!");
-    return false;
-  }
-  char tx_buffer[1024];
-  fseek(f, 0, SEEK_END);
-  size_t filesize = ftell(f);
-  fseek(f, 0, SEEK_SET);
-  sprintf(tx_buffer, "HTTP/1.1 200 OK\n"
-                     "Content-Length: %zu\n"
-                     "Content-Type: %s\n"
-                     "Server: ChiServer/0.1\n\n", filesize, content_type);
-  size_t len = strlen(tx_buffer);
-  Assert(http_send(tcp, tx_buffer, len) == len, "Cannot write http headers!");
-  size_t sz;
-  Log("http: header size %zu, file size %zu", len, filesize);
-  do {
-    // sz = fread(tx_buffer + len, 1, sizeof(tx_buffer) - len, f);
-    // if (sz) http_send(tcp, tx_buffer, sz + len);
-    sz = fread(tx_buffer, 1, sizeof(tx_buffer), f);
-    Dbg("http: read static file for %zu bytes", sz);
-    if (sz) http_send(tcp, tx_buffer, sz);
-  } while (sz);
-  return true;
+/**
+ * @brief 解析Range中的一个字节范围；多个范围、格式错误或If-Range与当前文件不符时忽略，发送整个文件
+ *
+ * @param req 请求头
+ * @param file 文件
+ * @param start 范围的起始位置
+ * @param len 范围的长度
+ * @return int 有效范围为1，按整个文件响应为0，范围不能满足为-1
+ */
+static int http_parse_range(const http_request_t *req, const http_file_t *file, size_t *start, size_t *len) {
+  http_slice_t range = req->range;
+  if (!range.data || range.len < 6 || strncasecmp(range.data, "bytes=", 6) != 0 || memchr(range.data, ',', range.len))
+    return 0;
+  if (req->if_range.data && !http_slice_is(req->if_range, file->etag) &&
+      !http_slice_is(req->if_range, file->last_modified))
+    return 0;
+  const char *p = range.data + 6, *end = range.data + range.len;
+  unsigned long long first, last;
+  if (p < end && *p == '-') {
+    // 最后n个字节
+    p++;
+    if (!http_parse_uint(&p, end, &last) || p != end)
+      return 0;
+    if (!last || !file->size)
+      return -1;
+    first = last < file->size ? file->size - last : 0;
+    last = file->size - 1;
+  } else {
+    if (!http_parse_uint(&p, end, &first) || p == end || *p++ != '-')
+      return 0;
+    last = file->size - 1;
+    if (p != end && (!http_parse_uint(&p, end, &last) || p != end || last < first))
+      return 0;
+    if (first >= file->size)
+      return -1;
+    if (last >= file->size)
+      last = file->size - 1;
+  }
+  *start = first;
+  *len = last - first + 1;
+  return 1;
+}
+
+/**
+ * @brief 以缓存的文件作为完整的响应，响应头第一次使用时生成并保存在缓存项中
+ *
+ * @param conn 连接
+ * @param entry 缓存项，连接持有其引用直到响应发送完；响应头放不下时释放引用并回复500
+ * @param content_type 响应体类型
+ * @param file 文件的验证器
+ */
+static void send_cached_file(http_conn_t *conn, http_cache_entry_t *entry, const char *content_type,
+                             const http_file_t *file) {
+  int keep_alive = conn->keep_alive;
+  if (!entry->head_len[keep_alive])
+    entry->head_len[keep_alive] = http_format_head(entry->head[keep_alive], sizeof(entry->head[keep_alive]),
+                                                   keep_alive, "200 OK", content_type, entry->body_len,
+                                                   file->headers);
+  if (!entry->head_len[keep_alive]) {
+    http_cache_put(entry);
+    http_send_head_error(conn);
+    return;
+  }
+  conn->cache = entry;
+  conn->out_data = entry->head[keep_alive];
+  conn->out_len = entry->head_len[keep_alive];
+  conn->body = entry->body;
+  conn->body_len = entry->body_len;
 }
 
 bool str_endswith(const char *s, const char *patten) {
@@ -128,20 +710,18 @@ bool str_endswith(const char *s, const char *patten) {
   return *s == '\0' && *patten == '\0';
 }
 
-static void send_file(tcp_connect_t *tcp, const char *url) {
-  // FILE *file;
-  // uint32_t size;
-  const char *static_path = XHTTP_DOC_DIR;
+/**
+ * @brief 静态文件路由：客户端接受且有预压缩版本时发送该版本；客户端的版本仍有效时为304，
+ *        Range有效时为206，只发送请求的范围，否则为整个文件；范围与整个文件一样从缓存项或映射发送
+ *
+ * @param conn 连接
+ * @param req 请求
+ * @param arg 文件所在的目录
+ */
+static void send_file(http_conn_t *conn, const http_request_t *req, void *arg) {
+  const char *static_path = arg;
+  http_slice_t url = req->path;
   char file_path[255];
-  const char content_404[] = "HTTP/1.1 404 NOT FOUND\n"
-                             "Content-Type: text/html\n"
-                             "Content-Length: 233\n"
-                             "Server: ChiServer/0.1\n"
-                             "\n"
-                             "<!DOCTYPE HTML PUBLIC \"-//W3C//DTD HTML 3.2 Final//EN\">\n"
-                             "<title>404 Not Found</title>\n"
-                             "<h1>Not Found</h1>\n"
-                             "<p>The requested URL was not found on the server.  If you entered the URL manually please check your spelling and try again.</p>";
 
   /*
   解析url路径，查看是否是查看XHTTP_DOC_DIR目录下的文件
@@ -152,32 +732,426 @@ static void send_file(tcp_connect_t *tcp, const char *url) {
   */
 
   char *content_type = "text/html";
-  if (!*url) return;
-  if (*url == '/' && *(url + 1) == '\0') {
-    sprintf(file_path, "%s/%s", static_path, "index.html");
-  } else {
-    if (*url == '/') sprintf(file_path, "%s/%s", static_path, url + 1);
-    else sprintf(file_path, "%s/%s", static_path, url);
+  // 路径过长时不截断
+  if (url.len && *url.data == '/') {
+    url.data++;
+    url.len--;
+  }
+  if (url.len + strlen(static_path) + 2 > sizeof(file_path)) {
+    http_send_404(conn);
+    return;
   }
-  FILE *f = fopen(file_path, "rb");
+  if (!url.len)
+    sprintf(file_path, "%s/%s", static_path, "index.html");
+  else
+    snprintf(file_path, sizeof(file_path), "%s/%.*s", static_path, (int) url.len, url.data);
   if (str_endswith(file_path, ".jpg")) {
     content_type = "image/jpeg";
   } else if (str_endswith(file_path, ".css")) {
     content_type = "text/css";
   }
   Log("http: static file %s, content_type %s", file_path, content_type);
-  if (!send_local_file(tcp, f, content_type)) {
-    http_send(tcp, content_404, sizeof(content_404));
+  http_cache_entry_t *entry;
+  time_t mtime;
+  size_t size;
+  FILE *f = http_open_file(file_path, &entry, &mtime, &size);
+  if (!entry && !f) {
+    Err("http: Not Found!");
+    http_send_404(conn);
+    return;
+  }
+  // 文本按Accept-Encoding协商：客户端接受且有预压缩版本时改为发送该版本
+  int vary = strncmp(content_type, "text/", 5) == 0;
+  http_encoding_t encoding = HTTP_ENCODING_NUM;
+  if (vary && req->accept_encoding.data) {
+    unsigned encodings = entry ? entry->encodings : http_cache_encodings(file_path, mtime);
+    for (int i = 0; i < HTTP_ENCODING_NUM; i++) {
+      if (!(encodings & (1u << i)) || !http_accepts(req->accept_encoding, http_encoding_name[i]))
+        continue;
+      char variant_path[sizeof(file_path) + 8];
+      snprintf(variant_path, sizeof(variant_path), "%s%s", file_path, http_encoding_suffix[i]);
+      http_cache_entry_t *variant;
+      FILE *vf = http_open_file(variant_path, &variant, &mtime, &size);
+      if (!variant && !vf)
+        continue; // 检查之后被删除
+      if (entry)
+        http_cache_put(entry);
+      if (f)
+        fclose(f);
+      entry = variant;
+      f = vf;
+      encoding = i;
+      break;
+    }
+  }
+  http_file_t file;
+  size_t start = 0, len = size;
+  int range = 0;
+  char extra[sizeof(file.headers) + 96];
+  if (http_file_init(&file, size, mtime, vary, encoding) != 0) {
+    http_send_head_error(conn);
+  } else if (http_not_modified(req, &file)) {
+    http_send_head(conn, "304 Not Modified", NULL, HTTP_NO_LENGTH, file.headers);
+  } else if ((range = http_parse_range(req, &file, &start, &len)) < 0) {
+    snprintf(extra, sizeof(extra), "Content-Range: bytes */%zu\r\n", file.size);
+    http_send_head(conn, "416 Range Not Satisfiable", "text/html", 0, extra);
+  } else if (entry && !range) {
+    send_cached_file(conn, entry, content_type, &file);
+    return;
+  } else {
+    if (range)
+      snprintf(extra, sizeof(extra), "%sContent-Range: bytes %zu-%zu/%zu\r\n", file.headers, start,
+               start + len - 1, file.size);
+    if (http_send_head(conn, range ? "206 Partial Content" : "200 OK", content_type, len,
+                       range ? extra : file.headers) == 0) {
+      Log("http: header size %zu, range %zu+%zu of %zu", conn->out_len, start, len, file.size);
+      if (entry) {
+        conn->cache = entry;
+        conn->body = entry->body + start;
+        conn->body_len = len;
+      } else {
+        conn->file = f;
+        conn->file_off = start;
+        conn->file_len = len;
+        conn->file_map = 1;
+      }
+      return;
+    }
   }
+  // 只有响应头，或响应头放不下改为回复500
+  if (entry)
+    http_cache_put(entry);
+  if (f)
+    fclose(f);
+}
+
+/**
+ * @brief 根据协议版本与Connection头部决定响应后是否保持连接，并记下条件请求、范围请求与内容编码的头部
+ *
+ * @param conn 连接
+ * @param parser 解析出的请求
+ * @param req 记下的头部
+ */
+static void http_parse_headers(http_conn_t *conn, const http_parser_t *parser, http_request_t *req) {
+  // HTTP/1.1默认保持连接，HTTP/1.0需要显式的keep-alive
+  conn->http11 = conn->keep_alive = parser->minor_version >= 1;
+  memset(req, 0, sizeof(*req));
+  req->parser = parser;
+  req->path = parser->path;
+  const char *query = memchr(parser->path.data, '?', parser->path.len);
+  if (query) {
+    req->path.len = query - parser->path.data;
+    req->query.data = query + 1;
+    req->query.len = parser->path.len - req->path.len - 1;
+  }
+  for (size_t i = 0; i < parser->num_headers; i++) {
+    const http_header_t *header = &parser->headers[i];
+    if (http_slice_is_nocase(header->name, "Connection")) {
+      if (http_slice_has_token(header->value, "close"))
+        conn->keep_alive = 0;
+      else if (http_slice_has_token(header->value, "keep-alive"))
+        conn->keep_alive = 1;
+    } else if (http_slice_is_nocase(header->name, "Range")) {
+      req->range = header->value;
+    } else if (http_slice_is_nocase(header->name, "If-Range")) {
+      req->if_range = header->value;
+    } else if (http_slice_is_nocase(header->name, "If-None-Match")) {
+      req->if_none_match = header->value;
+    } else if (http_slice_is_nocase(header->name, "If-Modified-Since")) {
+      req->if_modified_since = header->value;
+    } else if (http_slice_is_nocase(header->name, "Accept-Encoding")) {
+      req->accept_encoding = header->value;
+    }
+  }
+  // 达到请求数上限，或有新连接在等待空位时，响应后关闭
+  if (conn->requests >= HTTP_KEEPALIVE_MAX || (http_queue.pending && http_conn_num >= HTTP_CONN_MAX))
+    conn->keep_alive = 0;
+}
+
+/**
+ * @brief 新建路由字典树的节点
+ *
+ * @return int 节点下标，内存不足时为-1
+ */
+static int http_route_node_new(char byte) {
+  if (http_route_node_num == http_route_node_cap) {
+    size_t cap = http_route_node_cap ? http_route_node_cap * 2 : 64;
+    http_route_node_t *nodes = realloc(http_route_nodes, cap * sizeof(http_route_node_t));
+    if (!nodes)
+      return -1;
+    http_route_nodes = nodes;
+    http_route_node_cap = cap;
+  }
+  http_route_node_t *node = &http_route_nodes[http_route_node_num];
+  node->byte = byte;
+  node->child = node->sibling = node->exact = node->prefix = -1;
+  return (int) http_route_node_num++;
+}
+
+/**
+ * @brief 在当前线程注册路由，同一路径与匹配方式的路由被替换
+ *
+ * @param path 路径，以'/'开头
+ * @param prefix HTTP_ROUTE_EXACT或HTTP_ROUTE_PREFIX
+ * @param handler 处理函数
+ * @param arg 处理函数的参数
+ * @return int 成功为0，内存不足为-1
+ */
+int http_route(const char *path, int prefix, http_handler_t handler, void *arg) {
+  if (!http_route_node_num && http_route_node_new('\0') < 0)
+    return -1;
+  int node = 0;
+  for (const char *p = path; *p; p++) {
+    int child = http_route_nodes[node].child;
+    while (child >= 0 && http_route_nodes[child].byte != *p)
+      child = http_route_nodes[child].sibling;
+    if (child < 0) {
+      if ((child = http_route_node_new(*p)) < 0)
+        return -1;
+      http_route_nodes[child].sibling = http_route_nodes[node].child;
+      http_route_nodes[node].child = child;
+    }
+    node = child;
+  }
+  int *route = prefix ? &http_route_nodes[node].prefix : &http_route_nodes[node].exact;
+  if (*route < 0) {
+    if (http_route_num == http_route_cap) {
+      size_t cap = http_route_cap ? http_route_cap * 2 : 16;
+      http_route_entry_t *entries = realloc(http_route_entries, cap * sizeof(http_route_entry_t));
+      if (!entries)
+        return -1;
+      http_route_entries = entries;
+      http_route_cap = cap;
+    }
+    *route = (int) http_route_num++;
+  }
+  http_route_entries[*route].handler = handler;
+  http_route_entries[*route].arg = arg;
+  return 0;
+}
+
+/**
+ * @brief 沿路径走一遍字节树，整个路径走完且有精确路由时取它，否则取途经的最长前缀路由
+ *
+ * @return http_route_entry_t* 没有匹配的路由时为NULL
+ */
+static http_route_entry_t *http_route_find(http_slice_t path) {
+  if (!http_route_node_num)
+    return NULL;
+  int node = 0, found = http_route_nodes[0].prefix;
+  for (size_t i = 0; i < path.len; i++) {
+    node = http_route_nodes[node].child;
+    while (node >= 0 && http_route_nodes[node].byte != path.data[i])
+      node = http_route_nodes[node].sibling;
+    if (node < 0)
+      break;
+    if (http_route_nodes[node].prefix >= 0)
+      found = http_route_nodes[node].prefix;
+  }
+  if (node >= 0 && http_route_nodes[node].exact >= 0)
+    found = http_route_nodes[node].exact;
+  return found >= 0 ? &http_route_entries[found] : NULL;
+}
+
+/**
+ * @brief 在接收缓存中解析已到达的数据，请求头完整后准备响应，再消费掉请求头
+ *
+ * @param conn 连接
+ * @return int 已准备好响应为1，请求头不完整为0
+ */
+static int http_read_request(http_conn_t *conn) {
+  /*
+  1、从上次的位置继续查找请求头结尾，不完整时等待下一次TCP_CONN_DATA_RECV；
+     上一个响应发送期间以流水线发来的请求已经在接收缓存中
+  */
+
+  size_t len;
+  const char *data = (const char *) tcp_connect_peek(conn->tcp, &len);
+  if (!conn->request_len && len && conn->requests)
+    conn->start = cycles_now();
+  conn->request_len = len;
+  http_parser_t parser;
+  int ret = http_parse_request(&parser, data, len, &conn->request_scan, HTTP_REQUEST_MAX);
+  if (ret == HTTP_PARSE_INCOMPLETE)
+    return 0;
+  http_idle_remove(conn);
+  conn->requests++;
+  conn->state = HTTP_CONN_SEND;
+
+  /*
+  2、格式错误或过大的请求得到错误响应后关闭连接，剩下的数据不再解析；
+     只支持GET请求
+  */
+
+  if (ret < 0) {
+    Err("http: %s request", ret == HTTP_PARSE_TOO_LARGE ? "too large" : "malformed");
+    conn->keep_alive = 0;
+    if (ret == HTTP_PARSE_TOO_LARGE)
+      http_respond(conn, "431 Request Header Fields Too Large", "text/html", NULL, 0, NULL);
+    else
+      http_respond(conn, "400 Bad Request", "text/html", NULL, 0, NULL);
+    return 1;
+  }
+  Dbg("http: %.*s %.*s", (int) parser.method.len, parser.method.data, (int) parser.path.len, parser.path.data);
+  http_request_t req;
+  http_parse_headers(conn, &parser, &req);
+  LATENCY_SPAN_END(HTTP_REQUEST, HANDLER, conn->start);
+
+  /*
+  3、按路径找到处理函数准备响应，之后请求头不再被访问，从接收缓存中消费
+  */
+
+  http_route_entry_t *route = http_route_find(req.path);
+  if (!http_slice_is(parser.method, "GET")) {
+    conn->keep_alive = 0;
+    http_respond(conn, "501 Not Implemented", "text/html", NULL, 0, NULL);
+  } else if (!route) {
+    http_send_404(conn);
+  } else {
+    conn->out_len = 0;
+    route->handler(conn, &req, route->arg);
+    if (!conn->out_len) {
+      Err("http: handler gave no response");
+      conn->keep_alive = 0;
+      http_respond(conn, "500 Internal Server Error", "text/html", NULL, 0, NULL);
+    }
+  }
+  tcp_connect_consume(conn->tcp, ret);
+  return 1;
+}
+
+/**
+ * @brief 响应发完后保持连接，丢弃已处理的请求头，开始等待下一个请求
+ *
+ */
+static void http_conn_next(http_conn_t *conn) {
+  if (conn->cache) {
+    http_cache_put(conn->cache);
+    conn->cache = NULL;
+  }
+  free(conn->body_owned);
+  conn->body = conn->body_owned = NULL;
+  conn->body_len = conn->body_sent = 0;
+  conn->out_len = conn->out_sent = 0;
+  conn->request_len = conn->request_scan = 0;
+  conn->start = cycles_now();
+  conn->state = HTTP_CONN_READ;
+  http_idle_add(conn);
+}
+
+/**
+ * @brief 把响应写入发送缓存，对端窗口已满时返回，等待TCP_CONN_WRITABLE；
+ *        写完后保持连接时转为读取下一个请求，否则关闭连接
+ *
+ * @param conn 连接
+ * @return int 响应已写完且连接保持为1，等待窗口为0，连接已关闭为-1
+ */
+static int http_send_response(http_conn_t *conn) {
+  tcp_connect_t *tcp = conn->tcp;
+  for (;;) {
+    if (conn->out_sent < conn->out_len) {
+      conn->out_sent += tcp_connect_write(tcp, (const uint8_t *) conn->out_data + conn->out_sent,
+                                          conn->out_len - conn->out_sent);
+      if (conn->out_sent < conn->out_len)
+        return 0;
+    } else if (conn->body_sent < conn->body_len) {
+      conn->body_sent += tcp_connect_write(tcp, (const uint8_t *) conn->body + conn->body_sent,
+                                           conn->body_len - conn->body_sent);
+      if (conn->body_sent < conn->body_len)
+        return 0;
+    } else if (conn->file && conn->file_map) {
+      // 响应头已写入，文件(或请求的范围)映射后由tcp直接分段发送，不经过out与tx_buf
+      conn->file_map = 0;
+      if (tcp_connect_sendfile(tcp, fileno(conn->file), conn->file_off, conn->file_len) == 0) {
+        fclose(conn->file);
+        conn->file = NULL;
+        conn->file_len = 0;
+      } else {
+        fseek(conn->file, conn->file_off, SEEK_SET);
+      }
+    } else if (conn->stream) {
+      http_stream_next(conn);
+    } else if (conn->file) {
+      conn->out_data = conn->out;
+      conn->out_sent = 0;
+      conn->out_len = fread(conn->out, 1, conn->file_len < sizeof(conn->out) ? conn->file_len : sizeof(conn->out),
+                            conn->file);
+      conn->file_len -= conn->out_len;
+      Dbg("http: read static file for %zu bytes", conn->out_len);
+      if (!conn->out_len) {
+        fclose(conn->file);
+        conn->file = NULL;
+      }
+    } else {
+      if (tcp->tx_map_len) {
+        // 映射的数据全部发出后才结束响应，关闭时FIN排在所有数据之后；
+        // 保持连接时下一个响应在映射被确认前写不进去，等待TCP_CONN_WRITABLE
+        tcp_connect_flush(tcp);
+        if (tcp_connect_unsent(tcp))
+          return 0;
+      }
+      LATENCY_SPAN_END(HTTP_REQUEST, DRIVER_SEND, conn->start);
+      if (!conn->keep_alive) {
+        // 关闭时随FIN发出剩余数据
+        close_http(conn);
+        return -1;
+      }
+      http_conn_next(conn);
+      return 1;
+    }
+  }
+}
+
+/**
+ * @brief 推进一个就绪连接的状态机，依次响应已完整到达的请求
+ *
+ */
+static void http_conn_run(http_conn_t *conn) {
+  if (!conn->tcp) {
+    // 对端关闭或复位了连接
+    http_conn_free(conn);
+    return;
+  }
+  int ret;
+  do {
+    if (conn->state == HTTP_CONN_READ && (ret = http_read_request(conn)) <= 0)
+      break;
+    ret = http_send_response(conn);
+  } while (ret > 0);
+  // 流水线上的多个响应一起按MSS分段发出
+  if (ret >= 0)
+    tcp_connect_flush(conn->tcp);
 }
 
 static void http_handler(tcp_connect_t *tcp, connect_state_t state) {
+  http_conn_t *conn = tcp->app == &http_queued ? NULL : tcp->app;
   if (state == TCP_CONN_CONNECTED) {
-    http_fifo_in(&http_fifo_v, tcp);
+    if (http_queue_push(&http_queue, tcp) != 0) {
+      Err("http: accept queue full");
+      http_queue.rejected++;
+      tcp_connect_write(tcp, (const uint8_t *) response_503, sizeof(response_503) - 1);
+      tcp_connect_close(tcp);
+      return;
+    }
     Ok("http conntected.");
-  } else if (state == TCP_CONN_DATA_RECV) {
   } else if (state == TCP_CONN_CLOSED) {
+    // 连接即将释放，不能再使用tcp
+    if (conn) {
+      conn->tcp = NULL;
+      tcp->app = NULL;
+      http_idle_remove(conn);
+      http_ready(conn);
+    } else if (tcp->app == &http_queued) {
+      // 句柄留在队列中，取出时跳过
+      tcp->app = NULL;
+      http_queue.pending--;
+      http_queue.dropped++;
+    }
     Log("http closed.");
+  } else if (state == TCP_CONN_DATA_RECV || state == TCP_CONN_WRITABLE) {
+    // 排队中的连接收到的请求留在接收缓存中
+    if (conn)
+      http_ready(conn);
   } else {
     assert(0);
   }
@@ -186,60 +1160,37 @@ static void http_handler(tcp_connect_t *tcp, connect_state_t state) {
 
 // 在端口上创建服务器。
 
+/**
+ * @brief 在当前线程打开http服务器，注册静态文件、指标与健康检查路由；
+ *        应用的路由在此之后注册
+ *
+ */
 int http_server_open(uint16_t port) {
-  if (!tcp_open(port, http_handler)) {
+  if (tcp_open(port, http_handler) != 0) {
     return -1;
   }
-  http_fifo_init(&http_fifo_v);
+  http_queue_init(&http_queue);
+  if (http_route("/", HTTP_ROUTE_PREFIX, send_file, XHTTP_DOC_DIR) != 0 ||
+      http_route(HTTP_METRICS_PATH, HTTP_ROUTE_EXACT, send_metrics, NULL) != 0 ||
+      http_route(HTTP_HEALTH_PATH, HTTP_ROUTE_EXACT, send_health, NULL) != 0)
+    return -1;
   return 0;
 }
 
-// 从FIFO取出请求并处理。新的HTTP请求时会发送到FIFO中等待处理。
+// 从接受队列取出新连接，再推进所有就绪的连接，最后关闭等待请求超时的连接。每次调用都不会等待网络。
 
 void http_server_run(void) {
   tcp_connect_t *tcp;
-  char rx_buffer[1024];
-
-  while ((tcp = http_fifo_out(&http_fifo_v)) != NULL) {
-    /*
-    1、调用get_line从rx_buffer中获取一行数据，如果没有数据，则调用close_http关闭tcp，并继续循环
-    */
-
-    if (get_line(tcp, rx_buffer, sizeof(rx_buffer)) == 0) {
-      close_http(tcp);
-      continue;
+  while (http_conn_num < HTTP_CONN_MAX && (tcp = http_queue_pop(&http_queue)) != NULL)
+    http_accept(tcp);
+  http_conn_t *conn;
+  while ((conn = http_ready_pop()) != NULL)
+    http_conn_run(conn);
+  if (http_idle_head) {
+    time_t now = time(NULL);
+    while ((conn = http_idle_head) != NULL && conn->idle_since + HTTP_KEEPALIVE_TIMEOUT < now) {
+      Log("http: keep-alive timeout");
+      close_http(conn);
     }
-    Dbg("http: first line %s", rx_buffer);
-
-    /*
-    2、检查是否有GET请求，如果没有，则调用close_http关闭tcp，并继续循环
-    */
-
-    char *p = strstr(rx_buffer, "GET");
-    if (p == NULL) {
-      close_http(tcp);
-      continue;
-    }
-
-    /*
-    3、解析GET请求的路径，注意跳过空格，找到GET请求的文件，调用send_file发送文件
-    */
-
-    p += 3;
-    while (*p && *p == ' ') p++;
-    char *path = p;
-    while (*p && *p != ' ') p++;
-    *p = '\0';
-    Dbg("http: got path %s", path);
-    send_file(tcp, path);
-
-    /*
-    4、调用close_http关掉连接
-    */
-
-    close_http(tcp);
-    continue;
-
-    Err("!! final close\n");
   }
 }
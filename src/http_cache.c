@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "http_cache.h"
+#include "net.h"
+#include "log.h"
+
+static NET_THREAD_LOCAL http_cache_entry_t *http_cache_table[HTTP_CACHE_BUCKETS];
+static NET_THREAD_LOCAL http_cache_stats_t http_cache_stats_v;
+
+const char *const http_encoding_name[HTTP_ENCODING_NUM] = {"br", "gzip"};
+const char *const http_encoding_suffix[HTTP_ENCODING_NUM] = {".br", ".gz"};
+
+static uint32_t http_cache_hash(const char *path) {
+  uint32_t hash = 2166136261u;
+  while (*path)
+    hash = (hash ^ (uint8_t) *path++) * 16777619u;
+  return hash & (HTTP_CACHE_BUCKETS - 1);
+}
+
+static void http_cache_free(http_cache_entry_t *entry) {
+  free(entry->path);
+  free(entry->body);
+  free(entry);
+}
+
+/**
+ * @brief 从散列表中移除缓存项并释放缓存本身的引用
+ *
+ * @param link 指向该项的指针
+ */
+static void http_cache_remove(http_cache_entry_t **link) {
+  http_cache_entry_t *entry = *link;
+  *link = entry->next;
+  entry->next = NULL;
+  http_cache_stats_v.entries--;
+  http_cache_stats_v.bytes -= entry->body_len;
+  http_cache_put(entry);
+}
+
+/**
+ * @brief 读入整个文件作为新的缓存项
+ *
+ * @return http_cache_entry_t* 缓存项，文件不存在、过大或超出缓存上限时为NULL
+ */
+static http_cache_entry_t *http_cache_load(const char *path, const struct stat *st) {
+  if (st->st_size > HTTP_CACHE_FILE_MAX || http_cache_stats_v.bytes + st->st_size > HTTP_CACHE_SIZE)
+    return NULL;
+  FILE *f = fopen(path, "rb");
+  if (!f)
+    return NULL;
+  http_cache_entry_t *entry = calloc(1, sizeof(http_cache_entry_t));
+  if (entry) {
+    entry->path = strdup(path);
+    entry->body = malloc(st->st_size ? st->st_size : 1);
+  }
+  if (!entry || !entry->path || !entry->body ||
+      fread(entry->body, 1, st->st_size, f) != (size_t) st->st_size) {
+    Err("http cache: cannot load %s", path);
+    fclose(f);
+    if (entry)
+      http_cache_free(entry);
+    return NULL;
+  }
+  fclose(f);
+  entry->body_len = st->st_size;
+  entry->mtime = st->st_mtime;
+  entry->checked = time(NULL);
+  entry->encodings = http_cache_encodings(path, entry->mtime);
+  entry->refs = 1;
+  return entry;
+}
+
+/**
+ * @brief 查找文件的缓存项，不存在或文件已修改时(重新)加载
+ *
+ * @param path 文件路径
+ * @return http_cache_entry_t* 缓存项，调用者持有一个引用，用完后调用http_cache_put；
+ *         文件不存在或不可缓存时为NULL
+ */
+http_cache_entry_t *http_cache_get(const char *path) {
+  http_cache_entry_t **link = &http_cache_table[http_cache_hash(path)];
+  while (*link && strcmp((*link)->path, path) != 0)
+    link = &(*link)->next;
+  http_cache_entry_t *entry = *link;
+  time_t now = time(NULL);
+  struct stat st;
+  if (entry && entry->checked + HTTP_CACHE_CHECK > now) {
+    http_cache_stats_v.hits++;
+    entry->refs++;
+    return entry;
+  }
+  // 新文件，或距上次检查已超过HTTP_CACHE_CHECK秒
+  int found = stat(path, &st) == 0 && S_ISREG(st.st_mode);
+  if (entry) {
+    if (found && entry->mtime == st.st_mtime && entry->body_len == (size_t) st.st_size) {
+      entry->checked = now;
+      entry->encodings = http_cache_encodings(path, entry->mtime);
+      http_cache_stats_v.hits++;
+      entry->refs++;
+      return entry;
+    }
+    Log("http cache: %s changed", path);
+    http_cache_remove(link);
+    http_cache_stats_v.reloads++;
+  }
+  http_cache_stats_v.misses++;
+  if (!found || !(entry = http_cache_load(path, &st)))
+    return NULL;
+  entry->next = *link;
+  *link = entry;
+  http_cache_stats_v.entries++;
+  http_cache_stats_v.bytes += entry->body_len;
+  entry->refs++;
+  return entry;
+}
+
+/**
+ * @brief 释放http_cache_get取得的引用
+ *
+ */
+void http_cache_put(http_cache_entry_t *entry) {
+  if (--entry->refs == 0)
+    http_cache_free(entry);
+}
+
+/**
+ * @brief 清空当前线程的缓存，正在发送的缓存项在连接释放引用后才被释放
+ *
+ */
+void http_cache_clear() {
+  for (size_t i = 0; i < HTTP_CACHE_BUCKETS; i++) {
+    while (http_cache_table[i])
+      http_cache_remove(&http_cache_table[i]);
+  }
+}
+
+const http_cache_stats_t *http_cache_stats() {
+  return &http_cache_stats_v;
+}
+
+/**
+ * @brief 查看文件的预压缩版本，比文件旧的版本视为过期，不使用
+ *
+ * @param path 文件路径
+ * @param mtime 文件的修改时间
+ * @return unsigned 可用的版本，按http_encoding_t的位
+ */
+unsigned http_cache_encodings(const char *path, time_t mtime) {
+  unsigned encodings = 0;
+  char variant[512];
+  struct stat st;
+  for (int i = 0; i < HTTP_ENCODING_NUM; i++) {
+    snprintf(variant, sizeof(variant), "%s%s", path, http_encoding_suffix[i]);
+    if (stat(variant, &st) == 0 && S_ISREG(st.st_mode) && st.st_mtime >= mtime)
+      encodings |= 1u << i;
+  }
+  return encodings;
+}
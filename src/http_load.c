@@ -0,0 +1,376 @@
+#include "http_load.h"
+#include "tcp.h"
+#include "log.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+typedef enum http_load_state {
+  HTTP_LOAD_CLOSED,       // 没有连接，下次推进时重新连接
+  HTTP_LOAD_CONNECTING,   // 等待握手完成
+  HTTP_LOAD_IDLE,         // 等待发送下一个请求
+  HTTP_LOAD_HEAD,         // 等待响应头
+  HTTP_LOAD_BODY,         // 按Content-Length接收响应体
+  HTTP_LOAD_CHUNK,        // 等待块长度行
+  HTTP_LOAD_CHUNK_DATA,   // 接收块数据及其后的CRLF
+  HTTP_LOAD_UNTIL_CLOSE,  // 没有长度的响应体，到连接关闭为止
+  HTTP_LOAD_CLOSING,      // 响应带Connection: close，等待服务器关闭连接
+} http_load_state_t;
+
+typedef struct http_load_conn //一个压测连接
+{
+  tcp_handle_t tcp;               // 连接的句柄，连接释放后解析不出连接
+  http_load_state_t state;
+  uint64_t since;                 // 开始握手、发出请求或最近收到响应数据时的周期数，用于超时
+  uint64_t planned;               // 请求的计划发送时间，延迟从此算起
+  uint64_t left;                  // 响应体或当前块(含CRLF)尚未收到的字节数
+  int status;                     // 响应状态码
+  int close;                      // 响应带Connection: close
+  int last;                       // 当前块是最后的空块
+} http_load_conn_t;
+
+static NET_THREAD_LOCAL http_load_config_t load_config;
+static NET_THREAD_LOCAL http_load_stats_t load_stats;
+static NET_THREAD_LOCAL http_load_conn_t *load_conns;
+static NET_THREAD_LOCAL char load_request[HTTP_LOAD_HEAD_MAX];
+static NET_THREAD_LOCAL size_t load_request_len;
+static NET_THREAD_LOCAL uint64_t load_start, load_end, load_timeout; // 周期数，load_end为0时不限时
+static NET_THREAD_LOCAL double load_interval;                        // 相邻请求计划时间的间隔周期数
+
+/**
+ * @brief 是否还可以发送请求
+ *
+ */
+static int http_load_sending(uint64_t now) {
+  return (!load_config.requests || load_stats.sent < load_config.requests) && (!load_end || now < load_end);
+}
+
+/**
+ * @brief 放弃连接：与tcp连接解除关联后关闭，之后的回调不再涉及此连接
+ *
+ */
+static void http_load_close(http_load_conn_t *conn) {
+  tcp_connect_t *tcp = tcp_handle_get(conn->tcp);
+  conn->state = HTTP_LOAD_CLOSED;
+  conn->tcp = (tcp_handle_t) {NULL, 0};
+  if (tcp) {
+    tcp->app = NULL;
+    tcp_connect_close(tcp);
+  }
+}
+
+/**
+ * @brief 到计划时间时在空闲连接上发出下一个请求，数据在回调返回后或由调用者发出
+ *
+ * @return int 发出了请求为1
+ */
+static int http_load_send(http_load_conn_t *conn, tcp_connect_t *tcp, uint64_t now) {
+  if (!http_load_sending(now))
+    return 0;
+  uint64_t planned = now;
+  if (load_interval > 0) {
+    planned = load_start + (uint64_t) (load_stats.sent * load_interval);
+    if (planned > now)
+      return 0;
+  }
+  if (tcp_connect_write(tcp, (const uint8_t *) load_request, load_request_len) != load_request_len) {
+    // 对端窗口容不下一个请求
+    load_stats.errors++;
+    http_load_close(conn);
+    return 0;
+  }
+  load_stats.sent++;
+  conn->planned = planned;
+  conn->since = now;
+  conn->state = HTTP_LOAD_HEAD;
+  return 1;
+}
+
+/**
+ * @brief 收完一个响应，记下状态与延迟
+ *
+ */
+static void http_load_complete(http_load_conn_t *conn) {
+  load_stats.completed++;
+  if (conn->status >= 200 && conn->status < 400)
+    load_stats.status_2xx++;
+  else
+    load_stats.status_other++;
+  latency_hist_record(&load_stats.latency, cycles_now() - conn->planned);
+  conn->state = conn->close ? HTTP_LOAD_CLOSING : HTTP_LOAD_IDLE;
+}
+
+/**
+ * @brief 查找响应头结尾的空行
+ *
+ * @return size_t 响应头的长度，不完整时为0
+ */
+static size_t http_load_head_end(const char *data, size_t len) {
+  for (size_t i = 3; i < len; i++) {
+    if (data[i] == '\n' && data[i - 1] == '\r' && data[i - 2] == '\n' && data[i - 3] == '\r')
+      return i + 1;
+  }
+  return 0;
+}
+
+/**
+ * @brief 解析完整的响应头，决定响应体的接收方式
+ *
+ * @param head 响应头，以空行结尾
+ * @param len 响应头的长度
+ * @return int 成功为0，格式错误为-1
+ */
+static int http_load_parse_head(http_load_conn_t *conn, const char *head, size_t len) {
+  if (len < 12 || memcmp(head, "HTTP/1.", 7) != 0 || head[8] != ' ')
+    return -1;
+  conn->status = atoi(head + 9);
+  if (conn->status < 100 || conn->status > 999)
+    return -1;
+  conn->close = 0;
+  int chunked = 0, has_length = 0;
+  uint64_t length = 0;
+  const char *end = head + len;
+  for (const char *line = memchr(head, '\n', len) + 1; line < end - 2;) {
+    const char *next = memchr(line, '\n', end - line) + 1;
+    // 取值以'\r'结尾，strtoull与逐字节查找都在此停下
+    if (strncasecmp(line, "Content-Length:", 15) == 0) {
+      length = strtoull(line + 15, NULL, 10);
+      has_length = 1;
+    } else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0) {
+      for (const char *p = line + 18; p + 7 <= next; p++)
+        chunked |= strncasecmp(p, "chunked", 7) == 0;
+    } else if (strncasecmp(line, "Connection:", 11) == 0) {
+      for (const char *p = line + 11; p + 5 <= next; p++)
+        conn->close |= strncasecmp(p, "close", 5) == 0;
+    }
+    line = next;
+  }
+  if (conn->status < 200 || conn->status == 204 || conn->status == 304) {
+    conn->left = 0;
+    conn->state = HTTP_LOAD_BODY;
+  } else if (chunked) {
+    conn->state = HTTP_LOAD_CHUNK;
+  } else if (has_length) {
+    conn->left = length;
+    conn->state = HTTP_LOAD_BODY;
+  } else {
+    conn->left = UINT64_MAX;
+    conn->state = HTTP_LOAD_UNTIL_CLOSE;
+  }
+  return 0;
+}
+
+/**
+ * @brief 处理接收缓存中的数据，响应体收到即丢弃，接收缓存只需容纳响应头或块长度行
+ *
+ * @return int 正常为0，响应格式错误为-1
+ */
+static int http_load_recv(http_load_conn_t *conn, tcp_connect_t *tcp) {
+  for (;;) {
+    size_t len;
+    const char *data = (const char *) tcp_connect_peek(tcp, &len);
+    if (!len)
+      return 0;
+    size_t used;
+    switch (conn->state) {
+      case HTTP_LOAD_HEAD:
+        if (!(used = http_load_head_end(data, len)))
+          return len < HTTP_LOAD_HEAD_MAX ? 0 : -1;
+        if (http_load_parse_head(conn, data, used) != 0)
+          return -1;
+        if (conn->state == HTTP_LOAD_BODY && !conn->left)
+          http_load_complete(conn);
+        break;
+      case HTTP_LOAD_CHUNK: {
+        const char *line_end = memchr(data, '\n', len);
+        if (!line_end)
+          return len < HTTP_LOAD_HEAD_MAX ? 0 : -1;
+        char *hex_end;
+        uint64_t size = strtoull(data, &hex_end, 16);
+        if (hex_end == data)
+          return -1;
+        used = line_end + 1 - data;
+        // 块数据之后的CRLF一并丢弃，最后的空块之后不支持尾部头
+        conn->left = size + 2;
+        conn->last = size == 0;
+        conn->state = HTTP_LOAD_CHUNK_DATA;
+        break;
+      }
+      case HTTP_LOAD_BODY:
+      case HTTP_LOAD_CHUNK_DATA:
+      case HTTP_LOAD_UNTIL_CLOSE:
+        used = len < conn->left ? len : (size_t) conn->left;
+        conn->left -= used;
+        if (conn->left)
+          break;
+        if (conn->state == HTTP_LOAD_CHUNK_DATA && !conn->last)
+          conn->state = HTTP_LOAD_CHUNK;
+        else
+          http_load_complete(conn);
+        break;
+      default:
+        // 没有请求时到达的数据
+        return -1;
+    }
+    load_stats.bytes += used;
+    tcp_connect_consume(tcp, used);
+    // 超时按没有进展的时间计算，慢速的长响应只要持续有数据就不会超时
+    conn->since = cycles_now();
+  }
+}
+
+static void http_load_handler(tcp_connect_t *tcp, connect_state_t state) {
+  http_load_conn_t *conn = tcp->app;
+  if (!conn)
+    return;
+  if (state == TCP_CONN_CONNECTED) {
+    load_stats.connects++;
+    conn->state = HTTP_LOAD_IDLE;
+    // 请求随握手的ACK一起发出
+    http_load_send(conn, tcp, cycles_now());
+  } else if (state == TCP_CONN_DATA_RECV) {
+    if (http_load_recv(conn, tcp) != 0) {
+      Err("http_load: bad response");
+      load_stats.errors++;
+      http_load_close(conn);
+      return;
+    }
+    if (conn->state == HTTP_LOAD_IDLE)
+      http_load_send(conn, tcp, cycles_now());
+  } else if (state == TCP_CONN_CLOSED) {
+    // 随FIN到达的数据没有单独的通知，在此处理
+    int bad = conn->state >= HTTP_LOAD_HEAD && conn->state < HTTP_LOAD_CLOSING && http_load_recv(conn, tcp) != 0;
+    if (!bad && conn->state == HTTP_LOAD_UNTIL_CLOSE)
+      http_load_complete(conn);
+    else if (conn->state == HTTP_LOAD_CONNECTING)
+      load_stats.connect_errors++;
+    else if (bad || (conn->state >= HTTP_LOAD_HEAD && conn->state < HTTP_LOAD_CLOSING))
+      load_stats.errors++;
+    tcp->app = NULL;
+    conn->tcp = (tcp_handle_t) {NULL, 0};
+    conn->state = HTTP_LOAD_CLOSED;
+  }
+}
+
+/**
+ * @brief 开始压测，之后在主循环中反复调用http_load_run
+ *
+ * @param config 压测参数，path与connections不能为空
+ * @return int 成功为0，参数错误或内存不足为-1
+ */
+int http_load_start(const http_load_config_t *config) {
+  if (!config->path || !config->connections || config->connections > HTTP_LOAD_CONN_MAX ||
+      (!config->duration && !config->requests) || config->rate < 0)
+    return -1;
+  int len = snprintf(load_request, sizeof(load_request), "GET %s HTTP/1.1\r\nHost: %u.%u.%u.%u:%u\r\n\r\n",
+                     config->path, config->ip[0], config->ip[1], config->ip[2], config->ip[3], config->port);
+  if (len < 0 || (size_t) len >= sizeof(load_request))
+    return -1;
+  http_load_conn_t *conns = calloc(config->connections, sizeof(http_load_conn_t));
+  if (!conns)
+    return -1;
+  free(load_conns);
+  load_conns = conns;
+  load_request_len = len;
+  load_config = *config;
+  memset(&load_stats, 0, sizeof(load_stats));
+  double cycles_per_sec = 1e9 / latency_ns_per_cycle();
+  load_start = cycles_now();
+  load_end = config->duration > 0 ? load_start + (uint64_t) (config->duration * cycles_per_sec) : 0;
+  load_timeout = (uint64_t) (HTTP_LOAD_TIMEOUT * cycles_per_sec);
+  load_interval = config->rate > 0 ? cycles_per_sec / config->rate : 0;
+  return 0;
+}
+
+/**
+ * @brief 推进压测：重新连接关闭了的连接，在空闲连接上按计划发送请求，关闭超时的连接。
+ *        停止发送且没有未完成的请求时关闭所有连接
+ *
+ * @return int 仍在进行为1，已经结束为0
+ */
+int http_load_run(void) {
+  if (!load_conns)
+    return 0;
+  uint64_t now = cycles_now();
+  int sending = http_load_sending(now);
+  size_t busy = 0;
+  for (size_t i = 0; i < load_config.connections; i++) {
+    http_load_conn_t *conn = &load_conns[i];
+    tcp_connect_t *tcp = tcp_handle_get(conn->tcp);
+    if (conn->state == HTTP_LOAD_CLOSED) {
+      if (!sending)
+        continue;
+      if (!(tcp = tcp_connect(load_config.ip, load_config.port, http_load_handler))) {
+        load_stats.connect_errors++;
+        continue;
+      }
+      tcp->app = conn;
+      conn->tcp = tcp_connect_handle(tcp);
+      conn->state = HTTP_LOAD_CONNECTING;
+      conn->since = now;
+      busy++;
+    } else if (conn->state == HTTP_LOAD_IDLE) {
+      if (http_load_send(conn, tcp, now)) {
+        tcp_connect_flush(tcp);
+        busy++;
+      }
+    } else if (conn->state != HTTP_LOAD_CLOSING) {
+      if (now - conn->since > load_timeout) {
+        load_stats.timeouts++;
+        http_load_close(conn);
+      } else {
+        busy++;
+      }
+    }
+  }
+  if (sending || busy)
+    return 1;
+  http_load_stop();
+  return 0;
+}
+
+/**
+ * @brief 结束压测，关闭所有连接，未完成的请求不再计入
+ *
+ */
+void http_load_stop(void) {
+  if (!load_conns)
+    return;
+  for (size_t i = 0; i < load_config.connections; i++)
+    http_load_close(&load_conns[i]);
+  free(load_conns);
+  load_conns = NULL;
+  load_stats.seconds = (cycles_now() - load_start) * latency_ns_per_cycle() / 1e9;
+}
+
+/**
+ * @brief 当前线程的压测结果，结束后seconds才有效
+ *
+ */
+const http_load_stats_t *http_load_stats(void) {
+  return &load_stats;
+}
+
+/**
+ * @brief 输出压测结果：吞吐量、各类错误与延迟分位数
+ *
+ * @param f 输出文件
+ */
+void http_load_report(FILE *f) {
+  const http_load_stats_t *s = &load_stats;
+  double seconds = s->seconds > 0 ? s->seconds : 1e-9;
+  double us = latency_ns_per_cycle() / 1e3;
+  fprintf(f, "http_load: %u.%u.%u.%u:%u%s, %zu connections, %.2f s\n", load_config.ip[0], load_config.ip[1],
+          load_config.ip[2], load_config.ip[3], load_config.port, load_config.path, load_config.connections, seconds);
+  fprintf(f, "  requests: %llu sent, %llu completed (%llu 2xx/3xx, %llu other), %.1f req/s, %.2f MB/s\n",
+          (unsigned long long) s->sent, (unsigned long long) s->completed, (unsigned long long) s->status_2xx,
+          (unsigned long long) s->status_other, s->completed / seconds, s->bytes / seconds / 1e6);
+  fprintf(f, "  connections: %llu connected, %llu refused, %llu timeouts, %llu errors\n",
+          (unsigned long long) s->connects, (unsigned long long) s->connect_errors, (unsigned long long) s->timeouts,
+          (unsigned long long) s->errors);
+  fprintf(f, "  latency(us): p50 %.1f, p90 %.1f, p99 %.1f, p999 %.1f, max %.1f\n",
+          latency_hist_quantile(&s->latency, 0.5) * us, latency_hist_quantile(&s->latency, 0.9) * us,
+          latency_hist_quantile(&s->latency, 0.99) * us, latency_hist_quantile(&s->latency, 0.999) * us,
+          s->latency.max * us);
+}
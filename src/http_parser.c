@@ -0,0 +1,191 @@
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include "http_parser.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * @brief 方法与头部名称中允许的字符(RFC 7230的tchar)
+ *
+ */
+static int http_is_token(char c) {
+  if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))
+    return 1;
+  return c && strchr("!#$%&'*+-.^_`|~", c) != NULL;
+}
+
+/**
+ * @brief 查找第一个小于below的字节或DEL，SSE2下每次比较16字节
+ *
+ * @param p 开始位置
+ * @param end 结束位置
+ * @param below 0x20查找控制字符(行尾与非法字节)，0x21同时查找空格
+ * @return const char* 找到的位置，没有时为end
+ */
+static const char *http_scan(const char *p, const char *end, uint8_t below) {
+#ifdef __SSE2__
+  const __m128i limit = _mm_set1_epi8((char) (below - 1)), del = _mm_set1_epi8(0x7f);
+  for (; end - p >= 16; p += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *) p);
+    // 无符号比较：min(v, below-1) == v即v < below
+    __m128i hit = _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(v, limit), v), _mm_cmpeq_epi8(v, del));
+    int mask = _mm_movemask_epi8(hit);
+    if (mask)
+      return p + __builtin_ctz(mask);
+  }
+#endif
+  for (; p < end; p++) {
+    if ((uint8_t) *p < below || *p == 0x7f)
+      return p;
+  }
+  return end;
+}
+
+/**
+ * @brief 从上次的位置继续查找请求头结尾的空行
+ *
+ * @param buf 缓存
+ * @param len 缓存中的字节数
+ * @param scan 已确认不含请求头结尾的字节数，没有找到时更新
+ * @return size_t 请求头的长度，没有找到时为0
+ */
+static size_t http_header_end(const char *buf, size_t len, size_t *scan) {
+  const char *end = buf + len;
+  for (const char *p = buf + *scan; (p = http_scan(p, end, 0x20)) < end; p++) {
+    if (*p != '\n')
+      continue;
+    if (end - p < 2 || (p[1] == '\r' && end - p < 3)) {
+      // 空行可能还没有完整到达，下次从这个换行开始
+      *scan = p - buf;
+      return 0;
+    }
+    if (p[1] == '\n')
+      return p + 2 - buf;
+    if (p[1] == '\r' && p[2] == '\n')
+      return p + 3 - buf;
+  }
+  *scan = len;
+  return 0;
+}
+
+/**
+ * @brief 跳过行尾的CRLF或LF
+ *
+ * @return const char* 下一行的开头，不是行尾时为NULL
+ */
+static const char *http_line_end(const char *p, const char *end) {
+  if (*p == '\n')
+    return p + 1;
+  if (*p == '\r' && end - p >= 2 && p[1] == '\n')
+    return p + 2;
+  return NULL;
+}
+
+/**
+ * @brief 解析缓存开头的请求头，不完整时记下查找位置，下次从该位置继续
+ *
+ * @param parser 解析结果，各片段指向buf
+ * @param buf 缓存，不需要以'\0'结尾
+ * @param len 缓存中的字节数
+ * @param scan 已确认不含请求头结尾的字节数，新请求从0开始
+ * @param max 请求头最大长度
+ * @return int 请求头完整时为其长度；HTTP_PARSE_INCOMPLETE、HTTP_PARSE_BAD或HTTP_PARSE_TOO_LARGE
+ */
+int http_parse_request(http_parser_t *parser, const char *buf, size_t len, size_t *scan, size_t max) {
+  size_t total = http_header_end(buf, len < max ? len : max, scan);
+  if (!total)
+    return len >= max ? HTTP_PARSE_TOO_LARGE : HTTP_PARSE_INCOMPLETE;
+  // 请求头以换行结尾，以下查找都在end之前停下
+  const char *p = buf, *end = buf + total;
+  while (*p == '\r' || *p == '\n') {
+    // 请求行之前的空行
+    if (++p == end)
+      return HTTP_PARSE_BAD;
+  }
+  parser->method.data = p;
+  while (http_is_token(*p)) p++;
+  parser->method.len = p - parser->method.data;
+  if (!parser->method.len || *p++ != ' ')
+    return HTTP_PARSE_BAD;
+  parser->path.data = p;
+  p = http_scan(p, end, 0x21);
+  parser->path.len = p - parser->path.data;
+  if (!parser->path.len || *p++ != ' ')
+    return HTTP_PARSE_BAD;
+  if (end - p < 9 || memcmp(p, "HTTP/1.", 7) != 0 || p[7] < '0' || p[7] > '9')
+    return HTTP_PARSE_BAD;
+  parser->minor_version = p[7] - '0';
+  if (!(p = http_line_end(p + 8, end)))
+    return HTTP_PARSE_BAD;
+  parser->num_headers = 0;
+  while (*p != '\r' && *p != '\n') {
+    if (parser->num_headers == HTTP_PARSER_HEADERS_MAX)
+      return HTTP_PARSE_TOO_LARGE;
+    http_header_t *header = &parser->headers[parser->num_headers++];
+    // 名称与冒号之间不能有空白，以空白开头的续行已废弃，都按格式错误处理
+    header->name.data = p;
+    while (http_is_token(*p)) p++;
+    header->name.len = p - header->name.data;
+    if (!header->name.len || *p++ != ':')
+      return HTTP_PARSE_BAD;
+    while (*p == ' ' || *p == '\t') p++;
+    header->value.data = p;
+    while (*(p = http_scan(p, end, 0x20)) == '\t') p++;
+    const char *value_end = p;
+    while (value_end > header->value.data && (value_end[-1] == ' ' || value_end[-1] == '\t'))
+      value_end--;
+    header->value.len = value_end - header->value.data;
+    if (!(p = http_line_end(p, end)))
+      return HTTP_PARSE_BAD;
+  }
+  return (int) total;
+}
+
+/**
+ * @brief 片段是否与字符串相同
+ *
+ */
+int http_slice_is(http_slice_t s, const char *str) {
+  size_t len = strlen(str);
+  return s.data && s.len == len && memcmp(s.data, str, len) == 0;
+}
+
+/**
+ * @brief 片段是否与字符串相同，不区分大小写
+ *
+ */
+int http_slice_is_nocase(http_slice_t s, const char *str) {
+  size_t len = strlen(str);
+  return s.data && s.len == len && strncasecmp(s.data, str, len) == 0;
+}
+
+/**
+ * @brief 逗号分隔的头部取值中是否有某个选项，不区分大小写
+ *
+ */
+int http_slice_has_token(http_slice_t s, const char *token) {
+  size_t len = strlen(token);
+  const char *p = s.data, *end = s.data + s.len;
+  for (; s.data && (size_t) (end - p) >= len; p++) {
+    if ((p == s.data || p[-1] == ' ' || p[-1] == ',') && strncasecmp(p, token, len) == 0 &&
+        (p + len == end || p[len] == ',' || p[len] == ' '))
+      return 1;
+  }
+  return 0;
+}
+
+/**
+ * @brief 在片段中查找字符串
+ *
+ * @return const char* 第一次出现的位置，没有时为NULL
+ */
+const char *http_slice_find(http_slice_t s, const char *str) {
+  size_t len = strlen(str);
+  for (size_t i = 0; s.data && i + len <= s.len; i++) {
+    if (s.data[i] == str[0] && memcmp(s.data + i, str, len) == 0)
+      return s.data + i;
+  }
+  return NULL;
+}
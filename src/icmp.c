@@ -1,20 +1,24 @@
 #include "net.h"
 #include "icmp.h"
 #include "ip.h"
-#include "debug_macros.h"
+#include "log.h"
+#include "stats.h"
+#include "latency.h"
 
 /**
  * @brief 发送icmp响应
  * 
+ * @param netif 收到请求的网卡
  * @param req_buf 收到的icmp请求包
  * @param src_ip 源ip地址
  */
-static void icmp_resp(buf_t *req_buf, uint8_t *src_ip) {
+static void icmp_resp(netif_t *netif, buf_t *req_buf, uint8_t *src_ip) {
   Log("icmp: resp, req_buf len %zu", req_buf->len);
+  buf_t *txbuf = &netif->txbuf;
   // init txbuf, icmp reply should copy request data
-  buf_copy(&txbuf, req_buf, 0);
-  // buf_init(&txbuf, 8);
-  icmp_hdr_t *p = (icmp_hdr_t *) txbuf.data;
+  buf_copy(txbuf, req_buf, 0);
+  // buf_init(txbuf, 8);
+  icmp_hdr_t *p = (icmp_hdr_t *) txbuf->data;
   // icmp_hdr_t *recv = (icmp_hdr_t *) req_buf->data;
   // only ping
   p->type = ICMP_TYPE_ECHO_REPLY;
@@ -22,47 +26,59 @@ static void icmp_resp(buf_t *req_buf, uint8_t *src_ip) {
   p->checksum16 = 0;
   // p->id16 = recv->id16;
   // p->seq16 = recv->seq16;
-  p->checksum16 = checksum16((uint16_t *) p, txbuf.len);
-  ip_out(&txbuf, src_ip, NET_PROTOCOL_ICMP);
+  p->checksum16 = checksum16((uint16_t *) p, txbuf->len);
+  NET_STATS_INC(ICMP_TX_ECHO_REPLIES);
+  ip_out(netif, txbuf, src_ip, NET_PROTOCOL_ICMP);
 }
 
 /**
  * @brief 处理一个收到的数据包
  * 
+ * @param netif 收到数据包的网卡
  * @param buf 要处理的数据包
  * @param src_ip 源ip地址
  */
-void icmp_in(buf_t *buf, uint8_t *src_ip) {
-  Log("icmp: in from %s", iptos(src_ip));
+void icmp_in(netif_t *netif, buf_t *buf, uint8_t *src_ip) {
+  Log("icmp: in from %s", LOG_IP(src_ip));
+  LATENCY_MARK(TRANSPORT_IN);
+  NET_STATS_INC(ICMP_RX_PACKETS);
   // check package length
-  if (buf->len < sizeof(icmp_hdr_t)) return;
+  if (buf->len < sizeof(icmp_hdr_t)) {
+    NET_STATS_DROP(ICMP_DROP_TOO_SHORT);
+    return;
+  }
   // if it's an echo request, send an echo reply
   icmp_hdr_t *icmp_hdr = (icmp_hdr_t *) buf->data;
   if (icmp_hdr->type == ICMP_TYPE_ECHO_REQUEST) {
-    Log("icmp: ping recv from %s, send ping reply", iptos(src_ip));
-    icmp_resp(buf, src_ip);
+    Log("icmp: ping recv from %s, send ping reply", LOG_IP(src_ip));
+    LATENCY_PATH(ICMP_ECHO);
+    LATENCY_MARK(HANDLER);
+    icmp_resp(netif, buf, src_ip);
   }
 }
 
 /**
  * @brief 发送icmp不可达
  * 
+ * @param netif 收到数据包的网卡
  * @param recv_buf 收到的ip数据包
  * @param src_ip 源ip地址
  * @param code icmp code，协议不可达或端口不可达
  */
-void icmp_unreachable(buf_t *recv_buf, uint8_t *src_ip, icmp_code_t code) {
-  Log("icmp: unreachable, send to %s, code=%d", iptos(src_ip), code);
-  buf_init(&txbuf, sizeof(icmp_hdr_t) + sizeof(ip_hdr_t) + 8);
-  icmp_hdr_t *p = (icmp_hdr_t *) txbuf.data;
+void icmp_unreachable(netif_t *netif, buf_t *recv_buf, uint8_t *src_ip, icmp_code_t code) {
+  Log("icmp: unreachable, send to %s, code=%d", LOG_IP(src_ip), code);
+  buf_t *txbuf = &netif->txbuf;
+  buf_init(txbuf, sizeof(icmp_hdr_t) + sizeof(ip_hdr_t) + 8);
+  icmp_hdr_t *p = (icmp_hdr_t *) txbuf->data;
   p->type = ICMP_TYPE_UNREACH;
   p->code = code;
   p->checksum16 = 0;
   p->id16 = 0;
   p->seq16 = 0;
-  memcpy(txbuf.data + sizeof(icmp_hdr_t), recv_buf->data, sizeof(ip_hdr_t) + 8);
-  p->checksum16 = checksum16((uint16_t *) txbuf.data, txbuf.len);
-  ip_out(&txbuf, src_ip, NET_PROTOCOL_ICMP);
+  memcpy(txbuf->data + sizeof(icmp_hdr_t), recv_buf->data, sizeof(ip_hdr_t) + 8);
+  p->checksum16 = checksum16((uint16_t *) txbuf->data, txbuf->len);
+  NET_STATS_INC(ICMP_TX_UNREACH);
+  ip_out(netif, txbuf, src_ip, NET_PROTOCOL_ICMP);
 }
 
 /**
@@ -1,48 +1,61 @@
+#include <stdatomic.h>
 #include "net.h"
 #include "ip.h"
 #include "arp.h"
 #include "icmp.h"
-#include "debug_macros.h"
+#include "log.h"
+#include "stats.h"
+#include "latency.h"
 
-static uint16_t ip_id = 0;
+static atomic_uint_least16_t ip_id = 0; //所有分片线程共享，避免发往同一主机的分片id冲突
 
 /**
  * @brief 处理一个收到的数据包
  * 
+ * @param netif 收到数据包的网卡
  * @param buf 要处理的数据包
  * @param src_mac 源mac地址
  */
-void ip_in(buf_t *buf, uint8_t *src_mac) {
-  Dbg("ip: in from %s", mactos(src_mac));
+void ip_in(netif_t *netif, buf_t *buf, uint8_t *src_mac) {
+  Dbg("ip: in from %s", LOG_MAC(src_mac));
+  LATENCY_MARK(IP_IN);
+  NET_STATS_INC(IP_RX_PACKETS);
+  NET_STATS_ADD(IP_RX_BYTES, buf->len);
   // check package length
   if (buf->len < sizeof(ip_hdr_t)) {
     Log("ip: package too short");
+    NET_STATS_DROP(IP_DROP_TOO_SHORT);
     return;
   }
   ip_hdr_t *p = (ip_hdr_t *) buf->data;
   if (buf->len < p->hdr_len << 2) {
     Log("ip: package shorter than header expected");
+    NET_STATS_DROP(IP_DROP_TOO_SHORT);
     return;
   }
   // check version, support ipv4 only
   if (p->version != IP_VERSION_4) {
-    Log("ip: invalid version %d", p->version);
+    Log("ip: invalid version %d", (int) p->version);
+    NET_STATS_DROP(IP_DROP_BAD_VERSION);
     return;
   }
   // check header length
   if (p->hdr_len < 5) {
-    Log("ip: invalid header length %d", p->hdr_len);
+    Log("ip: invalid header length %d", (int) p->hdr_len);
+    NET_STATS_DROP(IP_DROP_BAD_HDR_LEN);
     return;
   }
   // check DF bit
-  if (p->flags_fragment16 & IP_DO_NOT_FRAGMENT && buf->len > ETHERNET_MAX_TRANSPORT_UNIT) {
+  if (p->flags_fragment16 & IP_DO_NOT_FRAGMENT && buf->len > netif->mtu) {
     Log("ip: DF bit set, but it is a large frame");
-    icmp_unreachable(buf, p->src_ip, ICMP_CODE_PROTOCOL_UNREACH);
+    NET_STATS_DROP(IP_DROP_DF_TOO_LARGE);
+    icmp_unreachable(netif, buf, p->src_ip, ICMP_CODE_PROTOCOL_UNREACH);
     return;
   }
   // check ip destination
-  if (memcmp(p->dst_ip, net_if_ip, NET_IP_LEN) != 0) {
-    Log("ip: destination is %s, not mine", iptos(p->dst_ip));
+  if (memcmp(p->dst_ip, netif->ip, NET_IP_LEN) != 0) {
+    Log("ip: destination is %s, not mine", LOG_IP(p->dst_ip));
+    NET_STATS_DROP(IP_DROP_NOT_MINE);
     return;
   }
   // checksum
@@ -51,9 +64,12 @@ void ip_in(buf_t *buf, uint8_t *src_mac) {
   uint16_t checksum_actual = checksum16((uint16_t *) buf->data, sizeof(ip_hdr_t));
   if (checksum_expected != checksum_actual) {
     Log("ip: checksum failed! expected: %x, actual: %x", checksum_expected, checksum_actual);
+    NET_STATS_DROP(IP_DROP_BAD_CHECKSUM);
     return;
   }
   p->hdr_checksum16 = checksum_expected;
+  if (p->flags_fragment16 & constswap16(IP_MORE_FRAGMENT | IP_FRAGMENT_OFFSET_MASK))
+    NET_STATS_INC(IP_RX_FRAGMENTS);
   uint16_t total_len = swap16(p->total_len16);
   Dbg("ip: before remove padding, len=%zu, total_len16=%d", buf->len, total_len);
   // removing paddings
@@ -61,16 +77,18 @@ void ip_in(buf_t *buf, uint8_t *src_mac) {
   Dbg("ip: after remove padding, len=%zu", buf->len);
   // remove ip header
   buf_remove_header(buf, sizeof(ip_hdr_t));
-  if (net_in(buf, p->protocol, p->src_ip) < 0) {
+  if (net_in(netif, buf, p->protocol, p->src_ip) < 0) {
     Log("ip: in, unrecognized protocol %d, send icmp protocol unreachable", p->protocol);
+    NET_STATS_DROP(IP_DROP_NO_HANDLER);
     buf_add_header(buf, sizeof(ip_hdr_t));
-    icmp_unreachable(buf, p->src_ip, ICMP_CODE_PROTOCOL_UNREACH);
+    icmp_unreachable(netif, buf, p->src_ip, ICMP_CODE_PROTOCOL_UNREACH);
   }
 }
 
 /**
  * @brief 处理一个要发送的ip分片
  * 
+ * @param netif 出口网卡
  * @param buf 要发送的分片
  * @param ip 目标ip地址
  * @param protocol 上层协议
@@ -78,8 +96,9 @@ void ip_in(buf_t *buf, uint8_t *src_mac) {
  * @param offset 分片offset，必须被8整除
  * @param mf 分片mf标志，是否有下一个分片
  */
-void ip_fragment_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, uint16_t offset, int mf) {
-  Dbg("ip: ip_fragment_out ip=%s, id=%d, offset=%d, mf=%d, len=%zu", iptos(ip), id, offset, mf, buf->len);
+void ip_fragment_out(netif_t *netif, buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, uint16_t offset,
+                     int mf) {
+  Dbg("ip: ip_fragment_out ip=%s, id=%d, offset=%d, mf=%d, len=%zu", LOG_IP(ip), id, offset, mf, buf->len);
   buf_add_header(buf, sizeof(ip_hdr_t));
   ip_hdr_t *p = (ip_hdr_t *) buf->data;
   p->version = IP_VERSION_4;
@@ -93,26 +112,35 @@ void ip_fragment_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, u
   p->hdr_checksum16 = 0;
   // fill in ip data
   memcpy(p->dst_ip, ip, NET_IP_LEN);
-  memcpy(p->src_ip, net_if_ip, NET_IP_LEN);
+  memcpy(p->src_ip, netif->ip, NET_IP_LEN);
   // calculate checksum
   p->hdr_checksum16 = checksum16((uint16_t *) buf->data, sizeof(ip_hdr_t));
+  NET_STATS_INC(IP_TX_PACKETS);
+  NET_STATS_ADD(IP_TX_BYTES, buf->len);
+  if (mf || offset)
+    NET_STATS_INC(IP_TX_FRAGMENTS);
   // send package
-  arp_out(buf, ip);
+  arp_out(netif, buf, ip);
 }
 
 /**
  * @brief 处理一个要发送的ip数据包
  * 
+ * @param netif 出口网卡，回复与已有连接使用收到数据包的网卡，为NULL时按目的ip选择
  * @param buf 要处理的包
  * @param ip 目标ip地址
  * @param protocol 上层协议
  */
-void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol) {
-  if (ip[0] == 0) Err("ip: out to %s", iptos(ip));
+void ip_out(netif_t *netif, buf_t *buf, uint8_t *ip, net_protocol_t protocol) {
+  if (ip[0] == 0) Err("ip: out to %s", LOG_IP(ip));
   else
-    Dbg("ip: out to %s", iptos(ip));
+    Dbg("ip: out to %s", LOG_IP(ip));
+  LATENCY_MARK(IP_OUT);
+  if (!netif)
+    netif = netif_route(ip);
+  uint16_t id = atomic_fetch_add(&ip_id, 1);
   // check if ip package larger than MTU - ip header
-  const size_t ip_max_length = ETHERNET_MAX_TRANSPORT_UNIT - sizeof(ip_hdr_t);
+  const size_t ip_max_length = netif->mtu - sizeof(ip_hdr_t);
   if (buf->len > ip_max_length) {
     Log("ip: handle large package(%zu bytes)", buf->len);
     // split this package to multy packages, backup buf data
@@ -129,7 +157,7 @@ void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol) {
         // backup data in header area
         uint8_t *data_now = buf->data;
         memcpy(backup, data_now, sizeof(ip_hdr_t));
-        ip_fragment_out(buf, ip, protocol, ip_id, offset, 1);
+        ip_fragment_out(netif, buf, ip, protocol, id, offset, 1);
         // restore backup data
         memcpy(data_now, backup, sizeof(ip_hdr_t));
         offset += ip_max_length;
@@ -139,7 +167,7 @@ void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol) {
       } else {
         buf->len = original_len - offset;
         // last len may be zero
-        if (buf->len) ip_fragment_out(buf, ip, protocol, ip_id++, offset, 0);
+        if (buf->len) ip_fragment_out(netif, buf, ip, protocol, id, offset, 0);
         done = true;
       }
     }
@@ -148,7 +176,7 @@ void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol) {
     buf->len = original_len;
   } else {
     Dbg("ip: handle small package(%zu bytes)", buf->len);
-    ip_fragment_out(buf, ip, protocol, ip_id++, 0, 0);
+    ip_fragment_out(netif, buf, ip, protocol, id, 0, 0);
   }
 }
 
@@ -0,0 +1,235 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "latency.h"
+
+typedef struct latency_block //每个线程一份的直方图与当前帧的打点
+{
+  latency_hist_t hist[LATENCY_PATH_NUM][LATENCY_STAGE_NUM];
+  uint64_t start;                          // 当前帧进入ethernet_in的周期数
+  uint64_t stamp[LATENCY_STAGE_NUM];       // 当前帧各打点的周期数，0为未经过
+  latency_path_t path;                     // 当前帧的路径
+  int active;                              // 当前帧尚未发出回复
+  thread_block_t link;                     // 挂在所有块组成的链表上，供快照遍历
+} latency_block_t;
+
+static NET_THREAD_LOCAL latency_block_t *latency_self;
+static thread_block_list_t latency_blocks;
+
+static const char *latency_path_names[LATENCY_PATH_NUM] = {"icmp_echo", "udp_echo", "tcp_data", "http_request"};
+static const char *latency_stage_names[LATENCY_STAGE_NUM] = {"ip_in", "transport_in", "handler", "ip_out",
+                                                             "driver_send"};
+
+/**
+ * @brief 当前线程的块，首次使用时分配并挂入全局链表
+ *
+ * @return latency_block_t* 块，分配失败为NULL
+ */
+static latency_block_t *latency_local() {
+  latency_block_t *block = latency_self;
+  if (block)
+    return block;
+  block = thread_block_attach(&latency_blocks, sizeof(latency_block_t), offsetof(latency_block_t, link));
+  if (!block)
+    return NULL;
+  block->path = LATENCY_PATH_NONE;
+  latency_self = block;
+  return block;
+}
+
+static size_t latency_bucket(uint64_t value) {
+  if (value >> LATENCY_MAX_BITS)
+    return LATENCY_BUCKETS - 1;
+  if (value < (1 << LATENCY_SUB_BITS))
+    return value;
+  int shift = 63 - __builtin_clzll(value) - LATENCY_SUB_BITS;
+  return ((size_t) (shift + 1) << LATENCY_SUB_BITS) + (value >> shift) - (1 << LATENCY_SUB_BITS);
+}
+
+/**
+ * @brief 桶中可能的最大值
+ *
+ */
+static uint64_t latency_bucket_high(size_t index) {
+  if (index < (1 << LATENCY_SUB_BITS))
+    return index;
+  int shift = (index >> LATENCY_SUB_BITS) - 1;
+  uint64_t low = (uint64_t) ((1 << LATENCY_SUB_BITS) + (index & ((1 << LATENCY_SUB_BITS) - 1))) << shift;
+  return low + ((uint64_t) 1 << shift) - 1;
+}
+
+/**
+ * @brief 记录一个值
+ *
+ * @param hist 直方图
+ * @param value 值
+ */
+void latency_hist_record(latency_hist_t *hist, uint64_t value) {
+  hist->bucket[latency_bucket(value)]++;
+  hist->count++;
+  if (value > hist->max)
+    hist->max = value;
+}
+
+/**
+ * @brief 分位数，返回所在桶中可能的最大值，不超过记录过的最大值
+ *
+ * @param hist 直方图
+ * @param q 分位，如0.99
+ * @return uint64_t 分位数，直方图为空时为0
+ */
+uint64_t latency_hist_quantile(const latency_hist_t *hist, double q) {
+  if (!hist->count)
+    return 0;
+  uint64_t target = q * hist->count;
+  if (target < q * hist->count || target == 0)
+    target++;
+  uint64_t seen = 0;
+  for (size_t i = 0; i < LATENCY_BUCKETS; i++) {
+    seen += hist->bucket[i];
+    if (seen >= target) {
+      if (i == LATENCY_BUCKETS - 1)
+        return hist->max;
+      uint64_t high = latency_bucket_high(i);
+      return high < hist->max ? high : hist->max;
+    }
+  }
+  return hist->max;
+}
+
+/**
+ * @brief 驱动交付了一帧，开始为其打点
+ *
+ */
+void latency_rx() {
+  latency_block_t *block = latency_local();
+  if (!block)
+    return;
+  block->start = cycles_now();
+  memset(block->stamp, 0, sizeof(block->stamp));
+  block->path = LATENCY_PATH_NONE;
+  block->active = 1;
+}
+
+/**
+ * @brief 当前帧经过一个打点位置，同一位置只记第一次
+ *
+ * @param stage 打点位置
+ */
+void latency_mark(latency_stage_t stage) {
+  latency_block_t *block = latency_self;
+  if (block && block->active && !block->stamp[stage])
+    block->stamp[stage] = cycles_now();
+}
+
+/**
+ * @brief 标记当前帧的处理路径
+ *
+ * @param path 路径
+ */
+void latency_path(latency_path_t path) {
+  latency_block_t *block = latency_self;
+  if (block && block->active)
+    block->path = path;
+}
+
+/**
+ * @brief 当前帧的回复交给驱动发送，把各打点记入其路径的直方图。
+ *        之后同一帧再发出的包不再计入
+ *
+ */
+void latency_tx() {
+  latency_block_t *block = latency_self;
+  if (!block || !block->active || block->path == LATENCY_PATH_NONE)
+    return;
+  block->stamp[LATENCY_DRIVER_SEND] = cycles_now();
+  for (size_t i = 0; i < LATENCY_STAGE_NUM; i++)
+    if (block->stamp[i])
+      latency_hist_record(&block->hist[block->path][i], block->stamp[i] - block->start);
+  block->active = 0;
+}
+
+/**
+ * @brief 直接记录一段耗时，用于不以单帧计的路径
+ *
+ * @param path 路径
+ * @param stage 打点位置
+ * @param cycles 周期数
+ */
+void latency_record(latency_path_t path, latency_stage_t stage, uint64_t cycles) {
+  latency_block_t *block = latency_local();
+  if (block)
+    latency_hist_record(&block->hist[path][stage], cycles);
+}
+
+/**
+ * @brief 汇总所有线程的一个直方图
+ *
+ * @param out 汇总结果
+ * @param path 路径
+ * @param stage 打点位置
+ * @return size_t 汇总的线程数
+ */
+size_t latency_snapshot(latency_hist_t *out, latency_path_t path, latency_stage_t stage) {
+  memset(out, 0, sizeof(*out));
+  size_t count = 0;
+  for (thread_block_t *link = atomic_load(&latency_blocks.head); link; link = link->next, count++) {
+    const volatile latency_hist_t *hist = &thread_block_of(link, latency_block_t, link)->hist[path][stage];
+    for (size_t i = 0; i < LATENCY_BUCKETS; i++)
+      out->bucket[i] += hist->bucket[i];
+    out->count += hist->count;
+    if (hist->max > out->max)
+      out->max = hist->max;
+  }
+  return count;
+}
+
+const char *latency_path_name(latency_path_t path) {
+  return path >= 0 && path < LATENCY_PATH_NUM ? latency_path_names[path] : "none";
+}
+
+const char *latency_stage_name(latency_stage_t stage) {
+  return stage < LATENCY_STAGE_NUM ? latency_stage_names[stage] : "unknown";
+}
+
+/**
+ * @brief 每个周期对应的纳秒数，首次调用时用10ms墙上时间校准
+ *
+ * @return double 纳秒数
+ */
+double latency_ns_per_cycle() {
+  static double ns_per_cycle;
+  if (ns_per_cycle)
+    return ns_per_cycle;
+  struct timespec ts0, ts1, delay = {0, 10000000};
+  clock_gettime(CLOCK_MONOTONIC, &ts0);
+  uint64_t c0 = cycles_now();
+  nanosleep(&delay, NULL);
+  clock_gettime(CLOCK_MONOTONIC, &ts1);
+  uint64_t c1 = cycles_now();
+  double ns = (ts1.tv_sec - ts0.tv_sec) * 1e9 + (ts1.tv_nsec - ts0.tv_nsec);
+  ns_per_cycle = c1 > c0 ? ns / (c1 - c0) : 1;
+  return ns_per_cycle;
+}
+
+/**
+ * @brief 输出所有非空直方图的分位数，单位为纳秒
+ *
+ * @param f 输出文件
+ */
+void latency_dump(FILE *f) {
+  double scale = latency_ns_per_cycle();
+  fprintf(f, "%-13s %-13s %10s %10s %10s %10s %10s\n", "path", "stage(ns)", "count", "p50", "p99", "p999", "max");
+  for (int path = 0; path < LATENCY_PATH_NUM; path++) {
+    for (int stage = 0; stage < LATENCY_STAGE_NUM; stage++) {
+      latency_hist_t hist;
+      latency_snapshot(&hist, path, stage);
+      if (!hist.count)
+        continue;
+      fprintf(f, "%-13s %-13s %10llu %10.0f %10.0f %10.0f %10.0f\n", latency_path_names[path],
+              latency_stage_names[stage], (unsigned long long) hist.count,
+              latency_hist_quantile(&hist, 0.5) * scale, latency_hist_quantile(&hist, 0.99) * scale,
+              latency_hist_quantile(&hist, 0.999) * scale, hist.max * scale);
+    }
+  }
+}
@@ -0,0 +1,287 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "log.h"
+#include "utils.h"
+
+typedef struct log_record //环形缓冲中的一条记录，只保存原始参数
+{
+  uint64_t cycles;
+  const log_site_t *site;
+  size_t nargs;
+  log_arg_t args[LOG_ARG_MAX];
+  char str[LOG_STR_MAX];      // 字符串参数的内容
+} log_record_t;
+
+typedef struct log_ring //每个线程一个的环形缓冲，只有所属线程写入，无需加锁
+{
+  atomic_size_t head;         // 已写入的记录总数
+  thread_block_t link;        // 挂在所有缓冲组成的链表上，供log_dump遍历，其中有线程序号
+  log_record_t records[LOG_RING_SIZE];
+} log_ring_t;
+
+static NET_THREAD_LOCAL log_ring_t *log_ring_self;
+static thread_block_list_t log_rings;
+
+/**
+ * @brief 为当前线程分配环形缓冲并挂入全局链表
+ *
+ * @return log_ring_t* 缓冲，分配失败为NULL
+ */
+static log_ring_t *log_ring_attach() {
+  log_ring_t *ring = thread_block_attach(&log_rings, sizeof(log_ring_t), offsetof(log_ring_t, link));
+  if (!ring)
+    return NULL;
+  log_ring_self = ring;
+  return ring;
+}
+
+/**
+ * @brief 把一条日志写入当前线程的环形缓冲，不做格式化
+ *
+ * @param site 日志点
+ * @param args 参数
+ * @param n 参数个数，超过LOG_ARG_MAX的部分被丢弃
+ */
+void log_ring_write(const log_site_t *site, const log_arg_t *args, size_t n) {
+  log_ring_t *ring = log_ring_self;
+  if (!ring && !(ring = log_ring_attach()))
+    return;
+  size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  log_record_t *record = &ring->records[head & (LOG_RING_SIZE - 1)];
+  record->cycles = cycles_now();
+  record->site = site;
+  record->nargs = n < LOG_ARG_MAX ? n : LOG_ARG_MAX;
+  size_t used = 0;
+  for (size_t i = 0; i < record->nargs; i++) {
+    record->args[i] = args[i];
+    if (args[i].type != LOG_ARG_STR)
+      continue;
+    size_t len = args[i].s ? strnlen(args[i].s, LOG_STR_MAX - used) : 0;
+    memcpy(record->str + used, args[i].s, len);
+    record->args[i].len = len;
+    record->args[i].u = used;
+    used += len;
+  }
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+static void log_write_str(FILE *f, const char *s, size_t len) {
+  uint16_t n = len;
+  fwrite(&n, sizeof(n), 1, f);
+  fwrite(s, 1, len, f);
+}
+
+/**
+ * @brief 导出所有线程环形缓冲中的记录，格式串与文件名按值写出，供离线解码。
+ *        写入线程仍在运行时，正被覆盖的记录可能不完整
+ *
+ * @param f 输出文件
+ * @return int 导出的记录数
+ */
+int log_dump(FILE *f) {
+  uint64_t magic = LOG_DUMP_MAGIC;
+  fwrite(&magic, sizeof(magic), 1, f);
+  // 用一段墙上时间校准周期计数，解码时把周期换算为时间
+  struct timespec ts0, ts1;
+  clock_gettime(CLOCK_REALTIME, &ts0);
+  uint64_t c0 = cycles_now();
+  struct timespec delay = {0, 10000000};
+  nanosleep(&delay, NULL);
+  clock_gettime(CLOCK_REALTIME, &ts1);
+  uint64_t c1 = cycles_now();
+  uint64_t calib[4] = {c0, (uint64_t) ts0.tv_sec * 1000000000 + ts0.tv_nsec,
+                       c1, (uint64_t) ts1.tv_sec * 1000000000 + ts1.tv_nsec};
+  fwrite(calib, sizeof(calib), 1, f);
+  int count = 0;
+  for (thread_block_t *link = atomic_load(&log_rings.head); link; link = link->next) {
+    log_ring_t *ring = thread_block_of(link, log_ring_t, link);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t first = head > LOG_RING_SIZE ? head - LOG_RING_SIZE : 0;
+    for (size_t i = first; i < head; i++, count++) {
+      log_record_t *record = &ring->records[i & (LOG_RING_SIZE - 1)];
+      uint32_t hdr[3] = {link->thread, record->site->level, record->site->line};
+      fwrite(hdr, sizeof(hdr), 1, f);
+      fwrite(&record->cycles, sizeof(record->cycles), 1, f);
+      log_write_str(f, record->site->file, strlen(record->site->file));
+      log_write_str(f, record->site->fmt, strlen(record->site->fmt));
+      uint8_t nargs = record->nargs;
+      fwrite(&nargs, sizeof(nargs), 1, f);
+      for (size_t j = 0; j < nargs; j++) {
+        log_arg_t *arg = &record->args[j];
+        uint8_t type = arg->type;
+        fwrite(&type, sizeof(type), 1, f);
+        if (type == LOG_ARG_STR)
+          log_write_str(f, record->str + arg->u, arg->len);
+        else
+          fwrite(&arg->u, sizeof(arg->u), 1, f);
+      }
+    }
+  }
+  fflush(f);
+  return count;
+}
+
+typedef struct log_entry //解码时的一条记录
+{
+  uint32_t thread, level, line;
+  uint64_t cycles;
+  char *file, *fmt;
+  uint8_t nargs;
+  log_arg_t args[LOG_ARG_MAX];
+  char *strs[LOG_ARG_MAX];
+} log_entry_t;
+
+static char *log_read_str(FILE *f) {
+  uint16_t n;
+  if (fread(&n, sizeof(n), 1, f) != 1)
+    return NULL;
+  char *s = malloc(n + 1);
+  if (fread(s, 1, n, f) != n) {
+    free(s);
+    return NULL;
+  }
+  s[n] = '\0';
+  return s;
+}
+
+static int log_read_entry(FILE *f, log_entry_t *e) {
+  uint32_t hdr[3];
+  memset(e, 0, sizeof(*e));
+  if (fread(hdr, sizeof(hdr), 1, f) != 1 || fread(&e->cycles, sizeof(e->cycles), 1, f) != 1)
+    return -1;
+  e->thread = hdr[0];
+  e->level = hdr[1];
+  e->line = hdr[2];
+  if (!(e->file = log_read_str(f)) || !(e->fmt = log_read_str(f)) || fread(&e->nargs, 1, 1, f) != 1 ||
+      e->nargs > LOG_ARG_MAX)
+    return -1;
+  for (size_t i = 0; i < e->nargs; i++) {
+    uint8_t type;
+    if (fread(&type, 1, 1, f) != 1)
+      return -1;
+    e->args[i].type = type;
+    if (type == LOG_ARG_STR) {
+      if (!(e->strs[i] = log_read_str(f)))
+        return -1;
+    } else if (fread(&e->args[i].u, sizeof(e->args[i].u), 1, f) != 1) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static void log_free_entry(log_entry_t *e) {
+  free(e->file);
+  free(e->fmt);
+  for (size_t i = 0; i < LOG_ARG_MAX; i++)
+    free(e->strs[i]);
+}
+
+static int log_entry_cmp(const void *a, const void *b) {
+  const log_entry_t *x = a, *y = b;
+  return x->cycles < y->cycles ? -1 : x->cycles > y->cycles;
+}
+
+/**
+ * @brief 按记录中的格式串格式化参数。长度修饰符被忽略，整数总是按64位输出
+ *
+ */
+static void log_format(FILE *out, log_entry_t *e) {
+  const char *p = e->fmt;
+  size_t next = 0;
+  while (*p) {
+    if (*p != '%') {
+      fputc(*p++, out);
+      continue;
+    }
+    if (p[1] == '%') {
+      fputc('%', out);
+      p += 2;
+      continue;
+    }
+    char spec[32] = "%";
+    size_t n = 1;
+    p++;
+    while (*p && strchr("-+ #0123456789.*", *p) && n < sizeof(spec) - 4)
+      spec[n++] = *p++;
+    while (*p && strchr("hlLqjzt", *p))
+      p++;
+    char conv = *p ? *p++ : 's';
+    if (next >= e->nargs) {
+      fputs("<?>", out);
+      continue;
+    }
+    log_arg_t *arg = &e->args[next];
+    char addr[32];
+    const char *s = NULL;
+    if (arg->type == LOG_ARG_STR)
+      s = e->strs[next];
+    else if (arg->type == LOG_ARG_IP)
+      s = addr, sprintf(addr, "%d.%d.%d.%d", arg->addr[0], arg->addr[1], arg->addr[2], arg->addr[3]);
+    else if (arg->type == LOG_ARG_MAC)
+      s = addr, sprintf(addr, "%02X-%02X-%02X-%02X-%02X-%02X", arg->addr[0], arg->addr[1], arg->addr[2],
+                        arg->addr[3], arg->addr[4], arg->addr[5]);
+    next++;
+    if (s || conv == 's') {
+      spec[n++] = 's';
+      spec[n] = '\0';
+      fprintf(out, spec, s ? s : "(ptr)");
+    } else if (strchr("fFeEgGaA", conv)) {
+      spec[n++] = conv;
+      spec[n] = '\0';
+      fprintf(out, spec, arg->type == LOG_ARG_DOUBLE ? arg->d : (double) arg->i);
+    } else if (conv == 'p') {
+      fprintf(out, "%p", arg->p);
+    } else if (conv == 'c') {
+      fputc((int) arg->i, out);
+    } else {
+      spec[n++] = 'l';
+      spec[n++] = 'l';
+      spec[n++] = conv == 'i' ? 'd' : conv;
+      spec[n] = '\0';
+      fprintf(out, spec, arg->type == LOG_ARG_DOUBLE ? (long long) arg->d : (long long) arg->i);
+    }
+  }
+}
+
+/**
+ * @brief 解码log_dump导出的文件，按时间顺序输出文本
+ *
+ * @param in 导出文件
+ * @param out 文本输出
+ * @return long 解码的记录数，文件格式错误为-1
+ */
+long log_decode(FILE *in, FILE *out) {
+  static const char *level_name[] = {"NONE", "ERR", "INFO", "DBG"};
+  uint64_t magic, calib[4];
+  if (fread(&magic, sizeof(magic), 1, in) != 1 || magic != LOG_DUMP_MAGIC ||
+      fread(calib, sizeof(calib), 1, in) != 1)
+    return -1;
+  double ns_per_cycle = calib[2] > calib[0] ? (double) (calib[3] - calib[1]) / (calib[2] - calib[0]) : 1;
+  size_t num = 0, cap = 0;
+  log_entry_t *entries = NULL;
+  log_entry_t e;
+  while (log_read_entry(in, &e) == 0) {
+    if (num == cap) {
+      cap = cap ? cap * 2 : 1024;
+      entries = realloc(entries, cap * sizeof(log_entry_t));
+    }
+    entries[num++] = e;
+  }
+  log_free_entry(&e);
+  qsort(entries, num, sizeof(log_entry_t), log_entry_cmp);
+  for (size_t i = 0; i < num; i++) {
+    log_entry_t *entry = &entries[i];
+    // 以导出时刻为基准换算出墙上时间
+    double ns = calib[1] - ((double) calib[0] - entry->cycles) * ns_per_cycle;
+    time_t sec = ns / 1e9;
+    fprintf(out, "%s.%06ld [%u] %-4s %s:%u: ", timetos(sec), (long) (ns - sec * 1e9) / 1000, entry->thread,
+            level_name[entry->level & 3], entry->file, entry->line);
+    log_format(out, entry);
+    fputc('\n', out);
+    log_free_entry(entry);
+  }
+  free(entries);
+  return num;
+}
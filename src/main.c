@@ -2,9 +2,15 @@
 #include "udp.h"
 #include "tcp.h"
 #include "http.h"
+#include "http_load.h"
 #include "driver.h"
+#include "shard.h"
 #include "time.h"
-#include "debug_macros.h"
+#include "log.h"
+#include "stats.h"
+#include "latency.h"
+#include "recorder.h"
+#include <signal.h>
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wformat="
@@ -13,12 +19,12 @@
 
 #ifdef UDP
 
-void udp_handler(uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port) {
+void udp_handler(netif_t *netif, uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port) {
   printf("recv udp packet from %s:%u len=%zu\n", iptos(src_ip), src_port, len);
   for (int i = 0; i < len; i++)
     putchar(data[i]);
   putchar('\n');
-  udp_send(data, len, 60000, src_ip, src_port); //发送udp包
+  udp_send(netif, data, len, 60000, src_ip, src_port); //从收到的网卡发回udp包
 }
 
 #endif
@@ -30,7 +36,7 @@ void tcp_handler(tcp_connect_t *connect, connect_state_t state) {
   size_t len = tcp_connect_read(connect, buf, sizeof(buf) - 1);
   buf[len] = 0;
   Log("recv tcp packet from %s:%u len=%zu, content: %s",
-      iptos(connect->ip), connect->remote_port, len, buf);
+      LOG_IP(connect->ip), connect->remote_port, len, buf);
   // printf("%s\n", buf);
   if (len) tcp_connect_write(connect, buf, len);
   // else {
@@ -42,13 +48,109 @@ void tcp_handler(tcp_connect_t *connect, connect_state_t state) {
 
 #endif
 
-int main(int argc, char const *argv[]) {
-  srand(0x55aa);
-  Log("Computer Networking Lab");
-  if (net_init() != 0) {
-    Err("net init failed.");
+/**
+ * @brief 解析网卡参数，格式为 ifname,ip[/prefix],mac[,driver]，ifname为空时自动选取网卡，
+ *        prefix为子网前缀长度，默认为NET_IF_MASK，driver默认为pcap
+ * 
+ * @param arg 参数字符串
+ * @return int 成功为0，失败为-1
+ */
+static int parse_netif(const char *arg) {
+  char name[NET_IF_NAME_LEN] = {0};
+  unsigned int ip[NET_IP_LEN], mac[NET_MAC_LEN], prefix = 0;
+  uint8_t if_ip[NET_IP_LEN], if_mac[NET_MAC_LEN];
+  int end = 0, ip_end = 0;
+  const driver_ops_t *ops = NULL;
+  const char *p = strchr(arg, ',');
+  if (!p || p - arg >= NET_IF_NAME_LEN) return -1;
+  memcpy(name, arg, p - arg);
+  if (sscanf(p + 1, "%u.%u.%u.%u%n", &ip[0], &ip[1], &ip[2], &ip[3], &ip_end) != NET_IP_LEN)
     return -1;
+  p += 1 + ip_end;
+  if (*p == '/') {
+    if (sscanf(p + 1, "%u%n", &prefix, &end) != 1 || prefix == 0 || prefix > 32)
+      return -1;
+    p += 1 + end;
   }
+  if (sscanf(p, ",%x:%x:%x:%x:%x:%x%n", &mac[0], &mac[1], &mac[2], &mac[3], &mac[4], &mac[5], &end) != NET_MAC_LEN)
+    return -1;
+  p += end;
+  if (*p == ',') {
+    ops = driver_find_ops(p + 1);
+    if (!ops) {
+      Err("unknown driver %s", p + 1);
+      return -1;
+    }
+  } else if (*p) {
+    return -1;
+  }
+  for (int i = 0; i < NET_IP_LEN; i++) if_ip[i] = ip[i];
+  for (int i = 0; i < NET_MAC_LEN; i++) if_mac[i] = mac[i];
+  netif_t *netif = netif_add(name, if_ip, if_mac, ops);
+  if (!netif)
+    return -1;
+  if (prefix) {
+    uint32_t mask = prefix == 32 ? UINT32_MAX : ~(UINT32_MAX >> prefix);
+    for (int i = 0; i < NET_IP_LEN; i++) netif->mask[i] = mask >> (24 - 8 * i);
+  }
+  return 0;
+}
+
+#ifdef __linux__
+
+/**
+ * @brief 解析虚拟链路参数，格式为 latency_us,mbit[,loss[,reorder[,seed]]]，对所有虚拟链路生效
+ *
+ * @param arg 参数字符串
+ * @return int 成功为0，失败为-1
+ */
+static int parse_wire(const char *arg) {
+  double latency_us, mbit;
+  driver_wire_config_t config = {0};
+  unsigned long long seed = 0;
+  if (sscanf(arg, "%lf,%lf,%lf,%lf,%llu", &latency_us, &mbit, &config.loss, &config.reorder, &seed) < 2 ||
+      latency_us < 0 || mbit < 0)
+    return -1;
+  config.latency_ns = latency_us * 1000;
+  config.bandwidth = mbit * 1000000;
+  config.seed = seed;
+  return driver_wire_config(NULL, &config);
+}
+
+#endif
+
+#ifdef HTTP
+
+static int load_mode;                  //-b: 作为http压测客户端运行，不打开http服务器
+static http_load_config_t load_config = {.path = "/", .connections = 16};
+
+/**
+ * @brief 解析压测目标，格式为 ip:port[/path]，path默认为/
+ *
+ * @param arg 参数字符串
+ * @return int 成功为0，失败为-1
+ */
+static int parse_load_target(const char *arg) {
+  unsigned int ip[NET_IP_LEN], port;
+  int end = 0;
+  if (sscanf(arg, "%u.%u.%u.%u:%u%n", &ip[0], &ip[1], &ip[2], &ip[3], &port, &end) != NET_IP_LEN + 1 ||
+      port == 0 || port > UINT16_MAX || (arg[end] && arg[end] != '/'))
+    return -1;
+  for (int i = 0; i < NET_IP_LEN; i++) load_config.ip[i] = ip[i];
+  load_config.port = port;
+  if (arg[end])
+    load_config.path = arg + end;
+  load_mode = 1;
+  return 0;
+}
+
+#endif
+
+/**
+ * @brief 注册应用，单线程模式下在主线程调用，分片模式下在每个分片线程调用
+ * 
+ */
+static void app_setup() {
 #ifdef UDP
   udp_open(60000, udp_handler); //注册端口的udp监听回调
 #endif
@@ -56,21 +158,272 @@ int main(int argc, char const *argv[]) {
   tcp_open(61000, tcp_handler); //注册端口的tcp监听回调
 #endif
 #ifdef HTTP
-  http_server_open(62000);
+  if (!load_mode)
+    http_server_open(62000);
+#endif
+}
+
+/**
+ * @brief 每次轮询后运行应用
+ * 
+ */
+static void app_poll() {
+#ifdef HTTP
+  http_server_run();
+#endif
+}
+
+/**
+ * @brief 每秒打印一次各网卡的收发速率，以及协议栈处理每帧平均消耗的周期数
+ * 
+ * @param busy_cycles 累计的处理周期数，打印后清零
+ */
+static void stats_poll(uint64_t *busy_cycles) {
+  static time_t last_time = 0;
+  static uint64_t last_rx[NET_IF_MAX_NUM], last_tx[NET_IF_MAX_NUM];
+  time_t now = time(NULL);
+  if (now == last_time)
+    return;
+  netif_t *netif;
+  uint64_t rx_total = 0;
+  for (size_t i = 0; (netif = netif_get(i)) != NULL; i++) {
+    uint64_t rx = netif->rx_packets - last_rx[i], tx = netif->tx_packets - last_tx[i];
+    if (last_time)
+      Log("stats: %s(%s) rx %llu pps, tx %llu pps", netif->name, netif->ops->name,
+          (unsigned long long) (rx / (now - last_time)), (unsigned long long) (tx / (now - last_time)));
+    last_rx[i] = netif->rx_packets;
+    last_tx[i] = netif->tx_packets;
+    rx_total += rx;
+  }
+  if (last_time && rx_total)
+    Log("stats: %.1f cycles/packet", (double) *busy_cycles / rx_total);
+  *busy_cycles = 0;
+  last_time = now;
+}
+
+static volatile sig_atomic_t net_stop; //收到SIGINT/SIGTERM后退出主循环
+
+static void stop_handler(int sig) {
+  net_stop = 1;
+}
+
+static volatile sig_atomic_t recorder_request; //收到SIGUSR1后在主循环中导出飞行记录
+
+static void recorder_handler(int sig) {
+  recorder_request = 1;
+}
+
+/**
+ * @brief 把飞行记录导出到-r指定的文件
+ *
+ * @param path 导出文件路径，为NULL时不导出
+ */
+static void recorder_save(const char *path) {
+  if (!path)
+    return;
+  int count = recorder_dump(path);
+  if (count < 0)
+    fprintf(stderr, "cannot write flight recorder to %s\n", path);
+  else
+    fprintf(stderr, "%d frames saved to %s\n", count, path);
+}
+
+/**
+ * @brief 主循环中检查是否收到导出请求
+ *
+ */
+static void recorder_poll(const char *path) {
+  if (!recorder_request)
+    return;
+  recorder_request = 0;
+  recorder_save(path);
+}
+
+/**
+ * @brief 退出前输出各线程汇总的协议栈计数器
+ * 
+ * @param show_stats 为0时不输出
+ */
+static void stats_save(int show_stats) {
+  if (!show_stats)
+    return;
+  net_stats_t stats;
+  size_t threads = net_stats_snapshot(&stats, -1);
+  fprintf(stderr, "net_stats: %zu threads\n", threads);
+  net_stats_dump(stderr, &stats, 0);
+#ifdef NET_LATENCY
+  latency_dump(stderr);
+#endif
+}
+
+/**
+ * @brief 退出前把环形缓冲中的日志导出到文件，需以NET_LOG_RING编译
+ * 
+ * @param path 导出文件路径，为NULL时不导出
+ */
+static void log_save(const char *path) {
+  if (!path)
+    return;
+  FILE *f = fopen(path, "wb");
+  if (!f) {
+    fprintf(stderr, "cannot write log to %s\n", path);
+    return;
+  }
+  int count = log_dump(f);
+  fclose(f);
+  fprintf(stderr, "%d log records saved to %s, decode with log_decode\n", count, path);
+}
+
+/**
+ * @brief 退出前关闭所有网卡，虚拟链路由此释放本端
+ *
+ */
+static void netif_close_all() {
+  netif_t *netif;
+  for (size_t i = 0; (netif = netif_get(i)) != NULL; i++)
+    driver_close(netif);
+}
+
+int main(int argc, char const *argv[]) {
+  srand(0x55aa);
+  Log("Computer Networking Lab");
+  size_t workers = 0;
+  int show_stats = 0;
+  const char *log_path = NULL;
+  const char *recorder_path = NULL;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+      if (parse_netif(argv[++i]) != 0) {
+        Err("bad interface %s, expected ifname,ip[/prefix],mac[,driver]", argv[i]);
+        return -1;
+      }
+    } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+      workers = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "-s") == 0) {
+      show_stats = 1;
+    } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+      log_path = argv[++i];
+    } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+      recorder_path = argv[++i];
+#ifdef __linux__
+    } else if (strcmp(argv[i], "-W") == 0 && i + 1 < argc) {
+      if (parse_wire(argv[++i]) != 0) {
+        Err("bad wire %s, expected latency_us,mbit[,loss[,reorder[,seed]]]", argv[i]);
+        return -1;
+      }
+#endif
+#ifdef HTTP
+    } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+      if (parse_load_target(argv[++i]) != 0) {
+        Err("bad load target %s, expected ip:port[/path]", argv[i]);
+        return -1;
+      }
+    } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+      load_config.connections = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "-q") == 0 && i + 1 < argc) {
+      load_config.rate = strtod(argv[++i], NULL);
+    } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+      load_config.duration = strtod(argv[++i], NULL);
+    } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      load_config.requests = strtoull(argv[++i], NULL, 10);
 #endif
-  while (1) {
+    } else {
+      Err("usage: %s [-i ifname,ip[/prefix],mac[,driver]]... [-w workers] [-s] [-l log.bin] [-r flight.pcapng] "
+          "[-W latency_us,mbit[,loss[,reorder[,seed]]]] "
+          "[-b ip:port[/path] [-c connections] [-q req/s] [-d seconds] [-n requests]]", argv[0]);
+      return -1;
+    }
+  }
+#ifdef HTTP
+  // 压测默认持续10秒
+  if (!load_config.duration && !load_config.requests)
+    load_config.duration = 10;
+  if (load_mode && workers) {
+    Err("the load client runs single-threaded, drop -w");
+    return -1;
+  }
+#endif
+  if (net_init() != 0) {
+    Err("net init failed.");
+    return -1;
+  }
+  signal(SIGINT, stop_handler);
+  signal(SIGTERM, stop_handler);
+  if (recorder_path) {
+    if (recorder_open(recorder_path) != 0) {
+      Err("bad flight recorder path %s", recorder_path);
+      return -1;
+    }
+    signal(SIGUSR1, recorder_handler);
+    signal(SIGSEGV, recorder_crash);
+    signal(SIGBUS, recorder_crash);
+    signal(SIGABRT, recorder_crash);
+    signal(SIGFPE, recorder_crash);
+  }
+#ifndef _MSC_VER
+  if (workers) {
+    //分片模式：主线程只负责收发与分发，协议栈运行在分片线程中
+    if (shard_start(workers, app_setup, app_poll) != 0) {
+      Err("shard start failed.");
+      return -1;
+    }
+    while (!net_stop) {
+      if (!shard_poll()) {
+        struct timespec sleepTime = {0, SHARD_IDLE_NS};
+        nanosleep(&sleepTime, NULL);
+      }
+      recorder_poll(recorder_path);
+    }
+    shard_stop();
+    netif_close_all();
+    stats_save(show_stats);
+    log_save(log_path);
+    recorder_save(recorder_path);
+    return 0;
+  }
+#endif
+  app_setup();
+#ifdef HTTP
+  if (load_mode && http_load_start(&load_config) != 0) {
+    Err("bad load parameters: need -c 1..%d and -d or -n", HTTP_LOAD_CONN_MAX);
+    return -1;
+  }
+#endif
+  uint64_t busy_cycles = 0;
+  int polling = 0;
+  while (!net_stop) {
     //一次主循环
-    net_poll(); //一次主循环
+    uint64_t start = cycles_now();
+    size_t count = net_poll();
+    if (count)
+      busy_cycles += cycles_now() - start;
+    app_poll();
 #ifdef HTTP
-    http_server_run();
+    // 压测客户端一直轮询，不因空闲而休眠，以免延迟中混入休眠时间
+    if (load_mode && !(polling = http_load_run()))
+      break;
 #endif
-    // 节约用电
+    if (show_stats)
+      stats_poll(&busy_cycles);
+    recorder_poll(recorder_path);
+    // 空闲时节约用电
 #ifndef _MSC_VER
-    struct timespec sleepTime = {0, 1000000};
-    nanosleep(&sleepTime, NULL);
+    if (!count && !polling) {
+      struct timespec sleepTime = {0, 1000000};
+      nanosleep(&sleepTime, NULL);
+    }
 #endif
   }
-
+#ifdef HTTP
+  if (load_mode) {
+    http_load_stop();
+    http_load_report(stdout);
+  }
+#endif
+  netif_close_all();
+  stats_save(show_stats);
+  log_save(log_path);
+  recorder_save(recorder_path);
   return 0;
 }
 
@@ -71,7 +71,7 @@ int map_entry_valid(map_t *map, const void *entry) {
 void *map_get(map_t *map, const void *key) {
   if (key == NULL)
     return NULL;
-  for (size_t i = 0; i < map->max_size; i++) {
+  for (size_t i = 0; i < map->top; i++) {
     uint8_t *entry = map_entry_get(map, i);
     if (map_entry_valid(map, entry) && !memcmp(key, entry, map->key_len))
       return entry + map->key_len;
@@ -94,15 +94,20 @@ int map_set(map_t *map, const void *key, const void *value) {
     *(time_t *) (old_value + map->value_len) = time(NULL);
     return 0;
   }
-  if (map->size == map->max_size)
-    return -1;
   for (size_t i = 0; i < map->max_size; i++) {
     uint8_t *entry = map_entry_get(map, i);
     if (!map_entry_valid(map, entry)) {
+      time_t *timestamp = (time_t *) (entry + map->key_len + map->value_len);
+      // 超时但尚未清理的键值对仍计入size，复用其位置前先释放值持有的资源
+      if (!*timestamp)
+        map->size++;
+      else if (map->expire_handler)
+        map->expire_handler(entry, entry + map->key_len, timestamp);
       memcpy(entry, key, map->key_len);
       map->value_constuctor(entry + map->key_len, value, map->value_len);
-      *(time_t *) (entry + map->key_len + map->value_len) = time(NULL);
-      map->size++;
+      *timestamp = time(NULL);
+      if (i >= map->top)
+        map->top = i + 1;
       return 0;
     }
   }
@@ -131,9 +136,42 @@ void map_delete(map_t *map, const void *key) {
  * @param handler 对每个键值对应用的回调函数，参数为（键指针，值指针，更新时间指针）
  */
 void map_foreach(map_t *map, map_entry_handler_t handler) {
-  for (size_t i = 0; i < map->max_size; i++) {
+  for (size_t i = 0; i < map->top; i++) {
     uint8_t *entry = map_entry_get(map, i);
     if (map_entry_valid(map, entry))
       handler(entry, entry + map->key_len, (time_t *) (entry + map->key_len + map->value_len));
   }
 }
+
+/**
+ * @brief 设置超时的键值对被清理前的回调函数，用于释放值持有的资源，
+ *        map_expire清理与map_set复用超时位置时都会调用
+ * 
+ * @param map 要操作的map
+ * @param handler 回调函数，参数为（键指针，值指针，更新时间指针），为NULL则不调用
+ */
+void map_on_expire(map_t *map, map_entry_handler_t handler) {
+  map->expire_handler = handler;
+}
+
+/**
+ * @brief 清理已超时的键值对，否则超时的键值对只是不再可见，其中的值持有的资源要等位置被复用才能释放
+ * 
+ * @param map 要操作的map
+ */
+void map_expire(map_t *map) {
+  map_entry_handler_t handler = map->expire_handler;
+  if (!map->timeout)
+    return;
+  time_t now = time(NULL);
+  for (size_t i = 0; i < map->top; i++) {
+    uint8_t *entry = map_entry_get(map, i);
+    time_t *timestamp = (time_t *) (entry + map->key_len + map->value_len);
+    if (*timestamp && *timestamp + map->timeout < now) {
+      if (handler)
+        handler(entry, entry + map->key_len, timestamp);
+      *timestamp = 0;
+      map->size--;
+    }
+  }
+}
@@ -0,0 +1,134 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "metrics.h"
+#include "driver.h"
+#include "stats.h"
+#include "arp.h"
+#include "tcp.h"
+#include "latency.h"
+
+/**
+ * @brief 向缓冲末尾追加格式化文本，空间不足时截断，之后的追加都被忽略
+ *
+ * @param buf 缓冲
+ * @param size 缓冲大小
+ * @param len 已有文本长度
+ * @param fmt 格式串
+ * @return size_t 追加后的文本长度，不超过size - 1
+ */
+size_t metrics_printf(char *buf, size_t size, size_t len, const char *fmt, ...) {
+  if (len + 1 >= size)
+    return len;
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(buf + len, size - len, fmt, args);
+  va_end(args);
+  if (n < 0)
+    return len;
+  return len + n < size ? len + n : size - 1;
+}
+
+/**
+ * @brief 把计数器名转换为指标名，如ip.rx_packets转为net_ip_rx_packets_total，
+ *        ip.drop.bad_checksum转为net_ip_drops_total{reason="bad_checksum"}
+ *
+ * @param name 计数器名
+ * @param family 指标名，不含标签
+ * @param reason 丢弃原因，不是丢弃计数器时为空串
+ */
+static void metrics_name(const char *name, char family[64], char reason[32]) {
+  const char *dot = strchr(name, '.');
+  size_t layer = dot - name;
+  reason[0] = '\0';
+  if (strncmp(dot + 1, "drop.", 5) == 0) {
+    snprintf(family, 64, "net_%.*s_drops_total", (int) layer, name);
+    snprintf(reason, 32, "%s", dot + 6);
+  } else {
+    snprintf(family, 64, "net_%.*s_%s_total", (int) layer, name, dot + 1);
+  }
+}
+
+/**
+ * @brief 以Prometheus文本格式渲染协议栈指标，不做文件读写。
+ *        计数器汇总所有线程；连接、arp表与缓冲池是协议栈状态，只反映调用线程
+ *
+ * @param buf 输出缓冲，建议METRICS_BUF_SIZE字节
+ * @param size 缓冲大小
+ * @return size_t 文本长度
+ */
+size_t metrics_render(char *buf, size_t size) {
+  size_t len = 0;
+  net_stats_t stats;
+  size_t threads = net_stats_snapshot(&stats, -1);
+  len = metrics_printf(buf, size, len, "# HELP net_stats_threads Threads that reported counters.\n"
+                                       "# TYPE net_stats_threads gauge\n"
+                                       "net_stats_threads %zu\n", threads);
+  char last[64] = "";
+  for (size_t i = 0; i < NET_STATS_NUM; i++) {
+    char family[64], reason[32];
+    metrics_name(net_stats_name(i), family, reason);
+    // 同一指标的计数器在表中相邻，只输出一次说明
+    if (strcmp(family, last) != 0) {
+      len = metrics_printf(buf, size, len, "# TYPE %s counter\n", family);
+      strcpy(last, family);
+    }
+    if (reason[0])
+      len = metrics_printf(buf, size, len, "%s{reason=\"%s\"} %llu\n", family, reason,
+                           (unsigned long long) stats.counter[i]);
+    else
+      len = metrics_printf(buf, size, len, "%s %llu\n", family, (unsigned long long) stats.counter[i]);
+  }
+
+  netif_t *netif;
+  len = metrics_printf(buf, size, len, "# TYPE net_netif_rx_packets_total counter\n");
+  for (size_t i = 0; (netif = netif_get(i)) != NULL; i++)
+    len = metrics_printf(buf, size, len, "net_netif_rx_packets_total{netif=\"%s\",driver=\"%s\"} %llu\n",
+                         netif->name, netif->ops ? netif->ops->name : "", (unsigned long long) netif->rx_packets);
+  len = metrics_printf(buf, size, len, "# TYPE net_netif_tx_packets_total counter\n");
+  for (size_t i = 0; (netif = netif_get(i)) != NULL; i++)
+    len = metrics_printf(buf, size, len, "net_netif_tx_packets_total{netif=\"%s\",driver=\"%s\"} %llu\n",
+                         netif->name, netif->ops ? netif->ops->name : "", (unsigned long long) netif->tx_packets);
+
+  size_t count[TCP_STATE_NUM], capacity;
+  size_t total = tcp_connect_count(count, &capacity);
+  len = metrics_printf(buf, size, len, "# HELP net_tcp_connections TCP connections by state.\n"
+                                       "# TYPE net_tcp_connections gauge\n");
+  for (size_t i = 0; i < TCP_STATE_NUM; i++)
+    len = metrics_printf(buf, size, len, "net_tcp_connections{state=\"%s\"} %zu\n", tcp_state_name(i), count[i]);
+  len = metrics_printf(buf, size, len, "# TYPE net_tcp_connection_table_used gauge\n"
+                                       "net_tcp_connection_table_used %zu\n"
+                                       "# TYPE net_tcp_connection_table_capacity gauge\n"
+                                       "net_tcp_connection_table_capacity %zu\n", total, capacity);
+
+  len = metrics_printf(buf, size, len, "# TYPE net_arp_table_entries gauge\n"
+                                       "net_arp_table_entries %zu\n"
+                                       "# TYPE net_arp_pending_addresses gauge\n"
+                                       "net_arp_pending_addresses %zu\n"
+                                       "# TYPE net_arp_buf_pool_free gauge\n"
+                                       "net_arp_buf_pool_free %zu\n"
+                                       "# TYPE net_arp_buf_pool_capacity gauge\n"
+                                       "net_arp_buf_pool_capacity %d\n",
+                       arp_table_size(), arp_pending_size(), arp_buf_pool_free(), ARP_BUF_POOL_SIZE);
+#ifdef NET_LATENCY
+  static const double quantiles[] = {0.5, 0.99, 0.999};
+  double scale = latency_ns_per_cycle() * 1e-9;
+  len = metrics_printf(buf, size, len, "# HELP net_latency_seconds Time since ethernet_in at each layer boundary.\n"
+                                       "# TYPE net_latency_seconds summary\n");
+  for (int path = 0; path < LATENCY_PATH_NUM; path++) {
+    for (int stage = 0; stage < LATENCY_STAGE_NUM; stage++) {
+      static NET_THREAD_LOCAL latency_hist_t hist;
+      latency_snapshot(&hist, path, stage);
+      if (!hist.count)
+        continue;
+      const char *path_name = latency_path_name(path), *stage_name = latency_stage_name(stage);
+      for (size_t i = 0; i < sizeof(quantiles) / sizeof(quantiles[0]); i++)
+        len = metrics_printf(buf, size, len, "net_latency_seconds{path=\"%s\",stage=\"%s\",quantile=\"%g\"} %.9f\n",
+                             path_name, stage_name, quantiles[i], latency_hist_quantile(&hist, quantiles[i]) * scale);
+      len = metrics_printf(buf, size, len, "net_latency_seconds_count{path=\"%s\",stage=\"%s\"} %llu\n",
+                           path_name, stage_name, (unsigned long long) hist.count);
+    }
+  }
+#endif
+  return len;
+}
@@ -11,35 +11,100 @@
  * @brief 协议表 <协议号,处理程序>的容器
  * 
  */
-map_t net_table;
+NET_THREAD_LOCAL map_t net_table;
 
 /**
- * @brief 网卡MAC地址
+ * @brief 广播MAC地址
  * 
  */
-uint8_t net_if_mac[NET_MAC_LEN] = NET_IF_MAC;
 uint8_t net_broadcast_mac[NET_MAC_LEN] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
 
 /**
- * @brief 网卡IP地址
+ * @brief 网卡表
  * 
  */
-uint8_t net_if_ip[NET_IP_LEN] = NET_IF_IP;
+static NET_THREAD_LOCAL netif_t net_if_table[NET_IF_MAX_NUM];
+static NET_THREAD_LOCAL size_t net_if_num = 0;
 
 /**
- * @brief 网卡接收和发送缓冲区
+ * @brief 向协议栈添加一个网卡，需在net_init之前调用
  * 
+ * @param name 网卡名，为NULL或空则由驱动自动选取
+ * @param ip 网卡ip地址
+ * @param mac 网卡mac地址
+ * @param ops 驱动操作表，为NULL则使用pcap驱动
+ * @return netif_t* 添加的网卡，失败为NULL
  */
-buf_t rxbuf, txbuf; //一个buf足够单线程使用
+netif_t *netif_add(const char *name, const uint8_t *ip, const uint8_t *mac, const driver_ops_t *ops) {
+  static const uint8_t default_mask[NET_IP_LEN] = NET_IF_MASK;
+  if (net_if_num == NET_IF_MAX_NUM)
+    return NULL;
+  netif_t *netif = &net_if_table[net_if_num++];
+  memset(netif->name, 0, sizeof(netif->name));
+  if (name)
+    strncpy(netif->name, name, NET_IF_NAME_LEN - 1);
+  memcpy(netif->ip, ip, NET_IP_LEN);
+  memcpy(netif->mac, mac, NET_MAC_LEN);
+  memcpy(netif->mask, default_mask, NET_IP_LEN);
+  netif->mtu = ETHERNET_MAX_TRANSPORT_UNIT;
+  netif->ops = ops ? ops : &driver_pcap_ops;
+  netif->priv = NULL;
+  netif->rx_packets = netif->tx_packets = 0;
+  return netif;
+}
+
+/**
+ * @brief 获取第index个网卡
+ * 
+ * @param index 网卡序号
+ * @return netif_t* 网卡，不存在为NULL
+ */
+netif_t *netif_get(size_t index) {
+  return index < net_if_num ? &net_if_table[index] : NULL;
+}
+
+/**
+ * @brief 根据目的ip选择出口网卡，同子网内最长前缀匹配，否则使用第一个网卡
+ * 
+ * @param ip 目的ip地址
+ * @return netif_t* 出口网卡
+ */
+netif_t *netif_route(const uint8_t *ip) {
+  static uint8_t mask_all[NET_IP_LEN] = {0xff, 0xff, 0xff, 0xff};
+  netif_t *best = &net_if_table[0];
+  uint8_t best_match = 0;
+  for (size_t i = 0; i < net_if_num; i++) {
+    netif_t *netif = &net_if_table[i];
+    uint8_t match = ip_prefix_match((uint8_t *) ip, netif->ip);
+    if (match >= ip_prefix_match(netif->mask, mask_all) && match > best_match)
+      best = netif, best_match = match;
+  }
+  return best;
+}
 
 /**
  * @brief 初始化协议栈
  * 
  */
 int net_init() {
+  if (net_if_num == 0) {
+    uint8_t ip[NET_IP_LEN] = NET_IF_IP;
+    uint8_t mac[NET_MAC_LEN] = NET_IF_MAC;
+    netif_add(NULL, ip, mac, NULL);
+  }
+  for (size_t i = 0; i < net_if_num; i++)
+    if (driver_open(&net_if_table[i]) == -1)
+      return -1;
+  net_stack_init();
+  return 0;
+}
+
+/**
+ * @brief 初始化当前线程的协议栈各层，不打开网卡，网卡需已由netif_add添加
+ * 
+ */
+void net_stack_init() {
   map_init(&net_table, sizeof(uint16_t), sizeof(net_handler_t), 0, 0, NULL);
-  if (driver_open() == -1)
-    return -1;
 #ifdef ETHERNET
   ethernet_init();
 #ifdef ARP
@@ -58,7 +123,6 @@ int net_init() {
 #endif
 #endif
 #endif
-  return 0;
 }
 
 /**
@@ -74,15 +138,16 @@ void net_add_protocol(uint16_t protocol, net_handler_t handler) {
 /**
  * @brief 向协议栈的上层协议传递数据包
  * 
+ * @param netif 收到数据包的网卡
  * @param buf 要传递的数据包
  * @param protocol 上层协议号
  * @param src 源的本层协议地址，如mac或ip地址
  * @return int 成功为0，失败为-1
  */
-int net_in(buf_t *buf, uint16_t protocol, uint8_t *src) {
+int net_in(netif_t *netif, buf_t *buf, uint16_t protocol, uint8_t *src) {
   net_handler_t *handler = map_get(&net_table, &protocol);
   if (handler) {
-    (*handler)(buf, src);
+    (*handler)(netif, buf, src);
     return 0;
   }
   return -1;
@@ -91,9 +156,13 @@ int net_in(buf_t *buf, uint16_t protocol, uint8_t *src) {
 /**
  * @brief 一次协议栈轮询
  * 
+ * @return size_t 本次处理的帧数，为0时调用者可休眠
  */
-void net_poll() {
+size_t net_poll() {
+  size_t count = 0;
 #ifdef ETHERNET
-  ethernet_poll();
+  for (size_t i = 0; i < net_if_num; i++)
+    count += ethernet_poll(&net_if_table[i]);
 #endif
+  return count;
 }
\ No newline at end of file
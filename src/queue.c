@@ -5,7 +5,7 @@
 #include <string.h>
 #include <malloc.h>
 #include "queue.h"
-#include "debug_macros.h"
+#include "log.h"
 
 /**
  * Create a queue with one item
@@ -0,0 +1,372 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include "recorder.h"
+#include "stats.h"
+
+typedef struct recorder_entry //一个记录的帧
+{
+  uint64_t cycles;                  // 记录时的周期数
+  uint32_t len;                     // 帧的原始长度
+  uint16_t caplen;                  // 保存的字节数
+  uint8_t dir;                      // recorder_dir_t
+  uint8_t netif;                    // 网卡序号
+  int16_t drop;                     // 丢弃原因，net_stats_counter_t，-1为未丢弃
+  uint16_t remote_port;             // tcp连接的对端端口，连同local_port为0时没有连接
+  uint16_t local_port;
+  uint8_t ip[NET_IP_LEN];           // tcp连接的对端ip
+  uint8_t data[RECORDER_SNAPLEN];
+} recorder_entry_t;
+
+typedef struct recorder_block //每个线程一份的环形缓冲
+{
+  recorder_entry_t entry[RECORDER_SIZE];
+  _Atomic uint64_t count;           // 累计记录的帧数，count % RECORDER_SIZE为下一个槽位
+  recorder_entry_t *rx;             // 正在处理的收到的帧
+  uint16_t remote_port, local_port; // 下一个发出的帧所属的tcp连接
+  uint8_t ip[NET_IP_LEN];
+  thread_block_t link;              // 挂在所有块组成的链表上，供导出遍历
+} recorder_block_t;
+
+int recorder_enabled;
+
+static NET_THREAD_LOCAL recorder_block_t *recorder_self;
+static thread_block_list_t recorder_blocks;
+static char recorder_path[RECORDER_PATH_LEN];
+static char recorder_crash_path[RECORDER_PATH_LEN];
+static uint64_t recorder_base_cycles, recorder_base_ns; //开启时的周期数与墙上时间，用于换算时间戳
+static _Atomic int recorder_dumps;
+static _Atomic time_t recorder_last_dump;
+
+static uint64_t recorder_realtime_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @brief 开启记录，之后各线程首次记录时分配自己的环形缓冲
+ *
+ * @param path 收到信号或退出时导出的文件路径，tcp复位与崩溃时的导出文件在其后加后缀
+ * @return int 成功为0，路径过长为-1
+ */
+int recorder_open(const char *path) {
+  if (strlen(path) + 32 >= RECORDER_PATH_LEN)
+    return -1;
+  strcpy(recorder_path, path);
+  strcpy(recorder_crash_path, path);
+  strcat(recorder_crash_path, ".crash");
+  recorder_base_ns = recorder_realtime_ns();
+  recorder_base_cycles = cycles_now();
+  recorder_enabled = 1;
+  return 0;
+}
+
+/**
+ * @brief 当前线程的块，首次使用时分配并挂入全局链表
+ *
+ * @return recorder_block_t* 块，分配失败为NULL
+ */
+static recorder_block_t *recorder_local() {
+  recorder_block_t *block = recorder_self;
+  if (block)
+    return block;
+  block = thread_block_attach(&recorder_blocks, sizeof(recorder_block_t), offsetof(recorder_block_t, link));
+  if (!block)
+    return NULL;
+  recorder_self = block;
+  return block;
+}
+
+/**
+ * @brief 记录一帧，复制不超过RECORDER_SNAPLEN字节到下一个槽位，覆盖最旧的帧
+ *
+ * @param netif 收发的网卡
+ * @param buf 帧，从以太网头部开始
+ * @param dir 方向
+ */
+void recorder_record(netif_t *netif, const buf_t *buf, recorder_dir_t dir) {
+  recorder_block_t *block = recorder_local();
+  if (!block)
+    return;
+  uint64_t count = atomic_load_explicit(&block->count, memory_order_relaxed);
+  recorder_entry_t *entry = &block->entry[count & (RECORDER_SIZE - 1)];
+  entry->cycles = cycles_now();
+  entry->len = buf->len;
+  entry->caplen = buf->len < RECORDER_SNAPLEN ? buf->len : RECORDER_SNAPLEN;
+  entry->dir = dir;
+  entry->netif = 0;
+  for (size_t i = 0; i < NET_IF_MAX_NUM; i++) {
+    if (netif_get(i) == netif) {
+      entry->netif = i;
+      break;
+    }
+  }
+  entry->drop = -1;
+  memcpy(entry->data, buf->data, entry->caplen);
+  if (dir == RECORDER_IN) {
+    entry->remote_port = entry->local_port = 0;
+    block->rx = entry;
+  } else if (buf->len >= 14 && buf->data[12] == 0x08 && buf->data[13] == 0x00) {
+    // 发出的ip包取走tcp_send留下的连接，arp请求不取
+    entry->remote_port = block->remote_port;
+    entry->local_port = block->local_port;
+    memcpy(entry->ip, block->ip, NET_IP_LEN);
+    block->remote_port = block->local_port = 0;
+  } else {
+    entry->remote_port = entry->local_port = 0;
+  }
+  atomic_store_explicit(&block->count, count + 1, memory_order_release);
+}
+
+/**
+ * @brief 标记当前收到的帧的丢弃原因
+ *
+ * @param reason net_stats_counter_t
+ */
+void recorder_set_drop(int reason) {
+  recorder_block_t *block = recorder_self;
+  if (block && block->rx)
+    block->rx->drop = reason;
+}
+
+/**
+ * @brief 标记tcp连接，收到的帧直接标记，发出的帧在下一次recorder_tx时标记
+ *
+ * @param dir 方向
+ * @param ip 对端ip
+ * @param remote_port 对端端口
+ * @param local_port 本地端口
+ */
+void recorder_set_key(recorder_dir_t dir, const uint8_t *ip, uint16_t remote_port, uint16_t local_port) {
+  recorder_block_t *block = recorder_local();
+  if (!block)
+    return;
+  if (dir == RECORDER_IN) {
+    if (!block->rx)
+      return;
+    memcpy(block->rx->ip, ip, NET_IP_LEN);
+    block->rx->remote_port = remote_port;
+    block->rx->local_port = local_port;
+  } else {
+    memcpy(block->ip, ip, NET_IP_LEN);
+    block->remote_port = remote_port;
+    block->local_port = local_port;
+  }
+}
+
+/*
+ * 导出只使用可在信号处理函数中调用的open、write与clock_gettime，
+ * 块在栈上拼好后一次写出，因此也用于崩溃时的导出
+ */
+
+typedef struct recorder_writer {
+  uint8_t data[512];
+  size_t len;
+} recorder_writer_t;
+
+static void put_bytes(recorder_writer_t *w, const void *data, size_t len) {
+  memcpy(w->data + w->len, data, len);
+  w->len += len;
+  while (w->len % 4)
+    w->data[w->len++] = 0;
+}
+
+static void put32(recorder_writer_t *w, uint32_t value) {
+  memcpy(w->data + w->len, &value, sizeof(value));
+  w->len += sizeof(value);
+}
+
+static void put16x2(recorder_writer_t *w, uint16_t first, uint16_t second) {
+  memcpy(w->data + w->len, &first, sizeof(first));
+  memcpy(w->data + w->len + 2, &second, sizeof(second));
+  w->len += 4;
+}
+
+static void put_option(recorder_writer_t *w, uint16_t code, const void *data, uint16_t len) {
+  put16x2(w, code, len);
+  put_bytes(w, data, len);
+}
+
+static void block_begin(recorder_writer_t *w, uint32_t type) {
+  w->len = 0;
+  put32(w, type);
+  put32(w, 0);
+}
+
+/**
+ * @brief 补上块尾的长度并写出
+ *
+ * @return int 成功为0
+ */
+static int block_end(recorder_writer_t *w, int fd) {
+  put32(w, w->len + 4);
+  memcpy(w->data + 4, w->data + w->len - 4, 4);
+  size_t done = 0;
+  while (done < w->len) {
+    ssize_t n = write(fd, w->data + done, w->len - done);
+    if (n <= 0)
+      return -1;
+    done += n;
+  }
+  return 0;
+}
+
+static size_t put_text(char *out, size_t len, const char *s) {
+  while (*s)
+    out[len++] = *s++;
+  return len;
+}
+
+static size_t put_uint(char *out, size_t len, unsigned int value) {
+  char digits[10];
+  size_t n = 0;
+  do {
+    digits[n++] = '0' + value % 10;
+    value /= 10;
+  } while (value);
+  while (n)
+    out[len++] = digits[--n];
+  return len;
+}
+
+/**
+ * @brief 帧的注释，如 drop=ip.drop.bad_checksum conn=192.168.163.10:1234->62000
+ *
+ * @return size_t 注释长度，没有元数据时为0
+ */
+static size_t entry_comment(const recorder_entry_t *entry, char *out) {
+  size_t len = 0;
+  if (entry->drop >= 0 && entry->drop < NET_STATS_NUM) {
+    len = put_text(out, len, "drop=");
+    len = put_text(out, len, net_stats_name(entry->drop));
+  }
+  if (entry->remote_port || entry->local_port) {
+    len = put_text(out, len, len ? " conn=" : "conn=");
+    for (int i = 0; i < NET_IP_LEN; i++) {
+      len = put_uint(out, len, entry->ip[i]);
+      out[len++] = i + 1 < NET_IP_LEN ? '.' : ':';
+    }
+    len = put_uint(out, len, entry->remote_port);
+    len = put_text(out, len, entry->dir == RECORDER_IN ? "->" : "<-");
+    len = put_uint(out, len, entry->local_port);
+  }
+  return len;
+}
+
+static int recorder_write(int fd) {
+  recorder_writer_t w;
+  // section header block
+  block_begin(&w, 0x0A0D0D0A);
+  put32(&w, 0x1A2B3C4D);
+  put16x2(&w, 1, 0);       // 版本1.0
+  put32(&w, 0xffffffff);   // 段长度未知
+  put32(&w, 0xffffffff);
+  if (block_end(&w, fd) != 0)
+    return -1;
+  // 每个网卡一个interface description block，时间戳精度为纳秒
+  size_t netifs = 0;
+  netif_t *netif;
+  for (; (netif = netif_get(netifs)) != NULL || netifs == 0; netifs++) {
+    block_begin(&w, 0x00000001);
+    put16x2(&w, 1, 0);     // LINKTYPE_ETHERNET，保留字段
+    put32(&w, RECORDER_SNAPLEN);
+    if (netif && netif->name[0])
+      put_option(&w, 2, netif->name, strnlen(netif->name, NET_IF_NAME_LEN));
+    uint8_t tsresol = 9;
+    put_option(&w, 9, &tsresol, 1);
+    put32(&w, 0);
+    if (block_end(&w, fd) != 0)
+      return -1;
+    if (!netif)
+      break;
+  }
+  double ns_per_cycle = 0;
+  uint64_t now_cycles = cycles_now(), now_ns = recorder_realtime_ns();
+  if (now_cycles > recorder_base_cycles)
+    ns_per_cycle = (double) (now_ns - recorder_base_ns) / (now_cycles - recorder_base_cycles);
+  // 每个线程的帧按记录顺序写出enhanced packet block
+  int total = 0;
+  for (thread_block_t *link = atomic_load(&recorder_blocks.head); link; link = link->next) {
+    recorder_block_t *block = thread_block_of(link, recorder_block_t, link);
+    uint64_t count = atomic_load_explicit(&block->count, memory_order_acquire);
+    for (uint64_t i = count > RECORDER_SIZE ? count - RECORDER_SIZE : 0; i < count; i++) {
+      const recorder_entry_t *entry = &block->entry[i & (RECORDER_SIZE - 1)];
+      uint64_t ts = recorder_base_ns + (uint64_t) ((double) (entry->cycles - recorder_base_cycles) * ns_per_cycle);
+      block_begin(&w, 0x00000006);
+      put32(&w, entry->netif < netifs ? entry->netif : 0);
+      put32(&w, ts >> 32);
+      put32(&w, ts);
+      put32(&w, entry->caplen);
+      put32(&w, entry->len);
+      put_bytes(&w, entry->data, entry->caplen);
+      uint32_t flags = entry->dir;
+      put_option(&w, 2, &flags, sizeof(flags));
+      char comment[128];
+      size_t len = entry_comment(entry, comment);
+      if (len)
+        put_option(&w, 1, comment, len);
+      put32(&w, 0);
+      if (block_end(&w, fd) != 0)
+        return -1;
+      total++;
+    }
+  }
+  return total;
+}
+
+/**
+ * @brief 把所有线程的记录导出为pcapng，可在信号处理函数中调用
+ *
+ * @param path 文件路径
+ * @return int 导出的帧数，失败为-1
+ */
+int recorder_dump(const char *path) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    return -1;
+  int total = recorder_write(fd);
+  close(fd);
+  return total;
+}
+
+/**
+ * @brief 发生异常事件时导出，每秒至多一次，总数不超过RECORDER_DUMP_MAX。
+ *        文件为recorder_open的路径加上 .原因.序号
+ *
+ * @param reason 原因，用于文件名
+ */
+void recorder_trigger(const char *reason) {
+  if (!recorder_enabled)
+    return;
+  time_t now = time(NULL), last = atomic_load(&recorder_last_dump);
+  if (now == last || !atomic_compare_exchange_strong(&recorder_last_dump, &last, now))
+    return;
+  int index = atomic_fetch_add(&recorder_dumps, 1);
+  if (index >= RECORDER_DUMP_MAX)
+    return;
+  char path[RECORDER_PATH_LEN];
+  size_t len = put_text(path, 0, recorder_path);
+  path[len++] = '.';
+  len = put_text(path, len, reason);
+  path[len++] = '.';
+  len = put_uint(path, len, index);
+  path[len] = 0;
+  recorder_dump(path);
+}
+
+/**
+ * @brief 崩溃信号的处理函数，导出到recorder_open的路径加 .crash，再以默认处理重新触发信号
+ *
+ * @param sig 信号
+ */
+void recorder_crash(int sig) {
+  if (recorder_enabled)
+    recorder_dump(recorder_crash_path);
+  signal(sig, SIG_DFL);
+  raise(sig);
+}
@@ -0,0 +1,174 @@
+#include <string.h>
+#include <sched.h>
+#include "ring.h"
+
+/**
+ * @brief 初始化环形队列
+ *
+ * @param ring 要初始化的队列
+ * @param size 容量，必须为2的幂
+ * @return int 成功为0，失败为-1
+ */
+int ring_init(ring_t *ring, size_t size) {
+  if (size == 0 || (size & (size - 1)))
+    return -1;
+  ring->slots = calloc(size, sizeof(void *));
+  if (!ring->slots)
+    return -1;
+  ring->size = size;
+  atomic_init(&ring->reserve, 0);
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->tail, 0);
+  return 0;
+}
+
+/**
+ * @brief 释放环形队列的槽，不释放其中的元素
+ *
+ * @param ring 要释放的队列
+ */
+void ring_free(ring_t *ring) {
+  free(ring->slots);
+  ring->slots = NULL;
+  ring->size = 0;
+}
+
+/**
+ * @brief 在堆上创建环形队列，保证缓存行对齐
+ *
+ * @param size 容量，必须为2的幂
+ * @return ring_t* 队列，失败为NULL
+ */
+ring_t *ring_new(size_t size) {
+  ring_t *ring = aligned_alloc(RING_CACHE_LINE, sizeof(ring_t));
+  if (!ring)
+    return NULL;
+  if (ring_init(ring, size) != 0) {
+    free(ring);
+    return NULL;
+  }
+  return ring;
+}
+
+/**
+ * @brief 销毁ring_new创建的环形队列，不释放其中的元素
+ *
+ * @param ring 要销毁的队列
+ */
+void ring_delete(ring_t *ring) {
+  ring_free(ring);
+  free(ring);
+}
+
+/**
+ * @brief 批量入队，只能由唯一的生产者线程调用
+ *
+ * @param ring 队列
+ * @param items 元素数组
+ * @param n 元素个数
+ * @return size_t 实际入队的元素个数，队列剩余空间不足时少于n
+ */
+size_t ring_enqueue_burst(ring_t *ring, void *const *items, size_t n) {
+  size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  size_t space = ring->size - (head - tail);
+  if (n > space)
+    n = space;
+  for (size_t i = 0; i < n; i++)
+    ring->slots[(head + i) & (ring->size - 1)] = items[i];
+  atomic_store_explicit(&ring->reserve, head + n, memory_order_relaxed);
+  atomic_store_explicit(&ring->head, head + n, memory_order_release);
+  return n;
+}
+
+/**
+ * @brief 批量入队，可由多个生产者线程并发调用。
+ *        先用CAS预留槽位，写入后按预留顺序依次发布
+ *
+ * @param ring 队列
+ * @param items 元素数组
+ * @param n 元素个数
+ * @return size_t 实际入队的元素个数，队列剩余空间不足时少于n
+ */
+size_t ring_mp_enqueue_burst(ring_t *ring, void *const *items, size_t n) {
+  size_t reserve = atomic_load_explicit(&ring->reserve, memory_order_relaxed);
+  size_t count;
+  do {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    size_t space = ring->size - (reserve - tail);
+    count = n < space ? n : space;
+    if (count == 0)
+      return 0;
+  } while (!atomic_compare_exchange_weak_explicit(&ring->reserve, &reserve, reserve + count,
+                                                  memory_order_relaxed, memory_order_relaxed));
+  for (size_t i = 0; i < count; i++)
+    ring->slots[(reserve + i) & (ring->size - 1)] = items[i];
+  // 等待先预留的生产者发布完成，保证消费者看到的元素连续
+  while (atomic_load_explicit(&ring->head, memory_order_relaxed) != reserve)
+    sched_yield();
+  atomic_store_explicit(&ring->head, reserve + count, memory_order_release);
+  return count;
+}
+
+/**
+ * @brief 批量出队，只能由唯一的消费者线程调用
+ *
+ * @param ring 队列
+ * @param items 用于存放元素的数组
+ * @param n 最多出队的元素个数
+ * @return size_t 实际出队的元素个数
+ */
+size_t ring_dequeue_burst(ring_t *ring, void **items, size_t n) {
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  if (n > head - tail)
+    n = head - tail;
+  for (size_t i = 0; i < n; i++)
+    items[i] = ring->slots[(tail + i) & (ring->size - 1)];
+  atomic_store_explicit(&ring->tail, tail + n, memory_order_release);
+  return n;
+}
+
+/**
+ * @brief 入队，只能由唯一的生产者线程调用
+ *
+ * @param ring 队列
+ * @param item 元素
+ * @return int 成功为0，队列满为-1
+ */
+int ring_enqueue(ring_t *ring, void *item) {
+  return ring_enqueue_burst(ring, &item, 1) ? 0 : -1;
+}
+
+/**
+ * @brief 入队，可由多个生产者线程并发调用
+ *
+ * @param ring 队列
+ * @param item 元素
+ * @return int 成功为0，队列满为-1
+ */
+int ring_mp_enqueue(ring_t *ring, void *item) {
+  return ring_mp_enqueue_burst(ring, &item, 1) ? 0 : -1;
+}
+
+/**
+ * @brief 出队，只能由唯一的消费者线程调用
+ *
+ * @param ring 队列
+ * @return void* 元素，队列空为NULL
+ */
+void *ring_dequeue(ring_t *ring) {
+  void *item;
+  return ring_dequeue_burst(ring, &item, 1) ? item : NULL;
+}
+
+/**
+ * @brief 获取队列中元素个数
+ *
+ * @param ring 队列
+ * @return size_t 元素个数
+ */
+size_t ring_count(ring_t *ring) {
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  return atomic_load_explicit(&ring->head, memory_order_acquire) - tail;
+}
@@ -0,0 +1,361 @@
+#ifndef _MSC_VER
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include "shard.h"
+#include "ring.h"
+#include "driver.h"
+#include "ethernet.h"
+#include "arp.h"
+#include "ip.h"
+#include "log.h"
+
+#define SHARD_FRAME_LEN (ETHERNET_MAX_TRANSPORT_UNIT + sizeof(ether_hdr_t)) //环形队列中单帧最大长度
+
+typedef struct shard_frame //在分发线程与分片线程之间传递的帧
+{
+  size_t len;                     // 帧长度
+  size_t netif;                   // 网卡序号
+  uint8_t data[SHARD_FRAME_LEN];  // 帧数据
+} shard_frame_t;
+
+typedef struct shard //一个分片，拥有独立的协议栈实例和连接状态
+{
+  size_t index;                   // 分片序号
+  pthread_t thread;               // 分片线程
+  ring_t rx[NET_IF_MAX_NUM];      // 分发线程 -> 分片线程，每个网卡一个
+  ring_t rx_free;                 // 分片线程 -> 分发线程，归还接收帧
+  ring_t tx;                      // 分片线程 -> 分发线程，待发送帧
+  ring_t tx_free;                 // 分发线程 -> 分片线程，归还发送帧
+  shard_frame_t *frames;          // 所有帧的存储
+  size_t rx_drop;                 // 因分片接收队列满而丢弃的帧数，只由分发线程修改
+} shard_t;
+
+/**
+ * @brief 微软RSS规范中的默认Toeplitz密钥
+ *
+ */
+static const uint8_t shard_rss_key[40] = {
+    0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2, 0x41, 0x67,
+    0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0, 0xd0, 0xca, 0x2b, 0xcb,
+    0xae, 0x7b, 0x30, 0xb4, 0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30,
+    0xf2, 0x0c, 0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa};
+
+static shard_t shards[SHARD_MAX_NUM];
+static size_t shard_num = 0;
+static size_t shard_reta[SHARD_RETA_SIZE];     // RSS重定向表，hash -> 分片序号
+static netif_t *shard_netifs[NET_IF_MAX_NUM];  // 分发线程的网卡
+static size_t shard_netif_num = 0;
+static shard_hook_t shard_setup_hook, shard_poll_hook;
+static atomic_bool shard_running;
+
+/**
+ * @brief 计算Toeplitz哈希，与网卡RSS一致
+ *
+ * @param data 哈希输入，如源ip、目的ip、源端口、目的端口依次拼接（网络字节序）
+ * @param len 输入长度，不超过36字节
+ * @return uint32_t 哈希值
+ */
+uint32_t shard_toeplitz(const uint8_t *data, size_t len) {
+  uint32_t hash = 0;
+  uint32_t window = (uint32_t) shard_rss_key[0] << 24 | (uint32_t) shard_rss_key[1] << 16 |
+                    (uint32_t) shard_rss_key[2] << 8 | shard_rss_key[3];
+  for (size_t i = 0; i < len && i + 4 < sizeof(shard_rss_key); i++) {
+    for (int bit = 7; bit >= 0; bit--) {
+      if (data[i] & (1 << bit))
+        hash ^= window;
+      window <<= 1;
+      if (shard_rss_key[i + 4] & (1 << bit))
+        window |= 1;
+    }
+  }
+  return hash;
+}
+
+/**
+ * @brief 为一个收到的帧选择分片。
+ *        tcp/udp按四元组哈希，其他ip包与ip分片按二元组哈希，
+ *        arp响应复制给所有分片以更新各自的arp表，其他帧交给0号分片
+ *
+ * @param frame 以太网帧
+ * @param len 帧长度
+ * @return size_t 分片序号，或SHARD_ALL
+ */
+size_t shard_steer(const uint8_t *frame, size_t len) {
+  if (shard_num <= 1 || len < sizeof(ether_hdr_t))
+    return 0;
+  const ether_hdr_t *eth = (const ether_hdr_t *) frame;
+  const uint8_t *payload = frame + sizeof(ether_hdr_t);
+  len -= sizeof(ether_hdr_t);
+  if (eth->protocol16 == constswap16(NET_PROTOCOL_ARP)) {
+    const arp_pkt_t *arp = (const arp_pkt_t *) payload;
+    if (len >= sizeof(arp_pkt_t) && arp->opcode16 == constswap16(ARP_REPLY))
+      return SHARD_ALL;
+    return 0;
+  }
+  if (eth->protocol16 != constswap16(NET_PROTOCOL_IP) || len < sizeof(ip_hdr_t))
+    return 0;
+  const ip_hdr_t *ip = (const ip_hdr_t *) payload;
+  size_t hdr_len = ip->hdr_len * IP_HDR_LEN_PER_BYTE;
+  uint8_t tuple[2 * NET_IP_LEN + 2 * sizeof(uint16_t)];
+  size_t tuple_len = 2 * NET_IP_LEN;
+  memcpy(tuple, ip->src_ip, NET_IP_LEN);
+  memcpy(tuple + NET_IP_LEN, ip->dst_ip, NET_IP_LEN);
+  if ((ip->protocol == NET_PROTOCOL_TCP || ip->protocol == NET_PROTOCOL_UDP) &&
+      !(swap16(ip->flags_fragment16) & (IP_MORE_FRAGMENT | 0x1fff)) &&
+      len >= hdr_len + 2 * sizeof(uint16_t)) {
+    // tcp和udp头部都以源端口、目的端口开头
+    memcpy(tuple + tuple_len, payload + hdr_len, 2 * sizeof(uint16_t));
+    tuple_len += 2 * sizeof(uint16_t);
+  }
+  return shard_reta[shard_toeplitz(tuple, tuple_len) & (SHARD_RETA_SIZE - 1)];
+}
+
+/**
+ * @brief 分片驱动：网卡已由分发线程打开，无需操作
+ *
+ */
+static int shard_driver_open(netif_t *netif) {
+  return 0;
+}
+
+/**
+ * @brief 分片驱动：从分发线程的接收队列取一帧
+ *
+ * @param netif 分片线程的网卡
+ * @param buf 收到的数据包
+ * @return int 数据包的长度，未收到为0
+ */
+static int shard_driver_recv(netif_t *netif, buf_t *buf) {
+  shard_t *shard = netif->priv;
+  shard_frame_t *frame = ring_dequeue(&shard->rx[netif - netif_get(0)]);
+  if (!frame)
+    return 0;
+  buf_init(buf, frame->len);
+  memcpy(buf->data, frame->data, frame->len);
+  ring_enqueue(&shard->rx_free, frame);
+  return buf->len;
+}
+
+/**
+ * @brief 分片驱动：把帧交给分发线程发送，发送帧耗尽时等待分发线程归还
+ *
+ * @param netif 分片线程的网卡
+ * @param buf 要发送的数据包
+ * @return int 成功为0，失败为-1
+ */
+static int shard_driver_send(netif_t *netif, buf_t *buf) {
+  shard_t *shard = netif->priv;
+  if (buf->len > SHARD_FRAME_LEN) {
+    Err("shard %zu: frame too large (%zu)", shard->index, buf->len);
+    return -1;
+  }
+  shard_frame_t *frame;
+  while ((frame = ring_dequeue(&shard->tx_free)) == NULL) {
+    if (!atomic_load(&shard_running))
+      return -1;
+    sched_yield();
+  }
+  frame->len = buf->len;
+  frame->netif = netif - netif_get(0);
+  memcpy(frame->data, buf->data, buf->len);
+  ring_enqueue(&shard->tx, frame);
+  return 0;
+}
+
+/**
+ * @brief 分片驱动：网卡由分发线程关闭，无需操作
+ *
+ */
+static void shard_driver_close(netif_t *netif) {
+}
+
+/**
+ * @brief 分片驱动操作表，分片线程的网卡通过环形队列与分发线程通信
+ *
+ */
+static const driver_ops_t shard_driver_ops = {
+    .name = "shard",
+    .open = shard_driver_open,
+    .recv = shard_driver_recv,
+    .send = shard_driver_send,
+    .close = shard_driver_close,
+};
+
+/**
+ * @brief 分片线程：建立自己的协议栈实例，然后不断轮询
+ *
+ * @param arg 分片
+ * @return void* NULL
+ */
+static void *shard_worker(void *arg) {
+  shard_t *shard = arg;
+  for (size_t i = 0; i < shard_netif_num; i++) {
+    netif_t *src = shard_netifs[i];
+    netif_t *netif = netif_add(src->name, src->ip, src->mac, &shard_driver_ops);
+    memcpy(netif->mask, src->mask, NET_IP_LEN);
+    netif->mtu = src->mtu;
+    netif->priv = shard;
+  }
+  net_stack_init();
+  if (shard_setup_hook)
+    shard_setup_hook();
+  Log("shard %zu: started", shard->index);
+  while (atomic_load(&shard_running)) {
+    size_t count = net_poll();
+    if (shard_poll_hook)
+      shard_poll_hook();
+    if (!count) {
+      struct timespec sleep_time = {0, SHARD_IDLE_NS};
+      nanosleep(&sleep_time, NULL);
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief 分发线程：把一帧放入分片的接收队列，队列满则丢弃
+ *
+ * @param shard 目标分片
+ * @param netif 网卡序号
+ * @param data 帧数据
+ * @param len 帧长度
+ */
+static void shard_deliver(shard_t *shard, size_t netif, const uint8_t *data, size_t len) {
+  shard_frame_t *frame = ring_dequeue(&shard->rx_free);
+  if (!frame) {
+    shard->rx_drop++;
+    return;
+  }
+  frame->len = len;
+  frame->netif = netif;
+  memcpy(frame->data, data, len);
+  ring_enqueue(&shard->rx[netif], frame);
+}
+
+/**
+ * @brief 启动分片模式，需在net_init之后调用。
+ *        每个分片线程拥有独立的协议栈实例，分发线程按RSS把连接固定到同一分片。
+ *        收发的每一帧都拷贝两次：分发线程拷入shard_frame，分片再拷入自己的缓冲，发送方向相反。
+ *        主动打开的连接不会被引回发起的分片，对端的回复按哈希落到任意分片，因此只在单分片时可靠
+ *
+ * @param num 分片数
+ * @param setup 在每个分片线程中调用一次，用于注册应用，如udp_open、tcp_open
+ * @param poll 在每个分片线程每次轮询后调用，可为NULL
+ * @return int 成功为0，失败为-1
+ */
+int shard_start(size_t num, shard_hook_t setup, shard_hook_t poll) {
+  if (num == 0 || num > SHARD_MAX_NUM) {
+    Err("shard: invalid shard number %zu", num);
+    return -1;
+  }
+  netif_t *netif;
+  for (shard_netif_num = 0; (netif = netif_get(shard_netif_num)) != NULL; shard_netif_num++)
+    shard_netifs[shard_netif_num] = netif;
+  for (size_t i = 0; i < SHARD_RETA_SIZE; i++)
+    shard_reta[i] = i % num;
+  shard_setup_hook = setup;
+  shard_poll_hook = poll;
+  shard_num = num;
+  atomic_store(&shard_running, true);
+
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, SHARD_STACK_SIZE);
+  for (size_t i = 0; i < num; i++) {
+    shard_t *shard = &shards[i];
+    memset(shard, 0, sizeof(shard_t));
+    shard->index = i;
+    shard->frames = malloc(2 * SHARD_RING_SIZE * sizeof(shard_frame_t));
+    Assert(shard->frames, "shard: cannot allocate frames");
+    int ret = 0;
+    for (size_t j = 0; j < shard_netif_num; j++)
+      ret |= ring_init(&shard->rx[j], SHARD_RING_SIZE);
+    ret |= ring_init(&shard->rx_free, SHARD_RING_SIZE);
+    ret |= ring_init(&shard->tx, SHARD_RING_SIZE);
+    ret |= ring_init(&shard->tx_free, SHARD_RING_SIZE);
+    Assert(ret == 0, "shard: cannot init ring");
+    for (size_t j = 0; j < SHARD_RING_SIZE; j++) {
+      ring_enqueue(&shard->rx_free, &shard->frames[j]);
+      ring_enqueue(&shard->tx_free, &shard->frames[SHARD_RING_SIZE + j]);
+    }
+    if (pthread_create(&shard->thread, &attr, shard_worker, shard) != 0) {
+      Err("shard: cannot create thread %zu", i);
+      shard_num = i;
+      pthread_attr_destroy(&attr);
+      shard_stop();
+      return -1;
+    }
+  }
+  pthread_attr_destroy(&attr);
+  Log("shard: %zu shards started", num);
+  return 0;
+}
+
+/**
+ * @brief 分发线程的一次轮询：从网卡收帧并分发给分片，再发送分片交来的帧
+ *
+ * @return size_t 本次处理的帧数，为0时调用者可休眠
+ */
+size_t shard_poll() {
+  size_t moved = 0;
+  for (size_t i = 0; i < shard_netif_num; i++) {
+    netif_t *netif = shard_netifs[i];
+    for (size_t n = 0; n < SHARD_BURST; n++) {
+      if (driver_recv(netif, &netif->rxbuf) <= 0)
+        break;
+      buf_t *buf = &netif->rxbuf;
+      moved++;
+      if (buf->len > SHARD_FRAME_LEN) {
+        Err("shard: frame too large (%zu), drop", buf->len);
+        continue;
+      }
+      size_t target = shard_steer(buf->data, buf->len);
+      if (target == SHARD_ALL) {
+        for (size_t s = 0; s < shard_num; s++)
+          shard_deliver(&shards[s], i, buf->data, buf->len);
+      } else {
+        shard_deliver(&shards[target], i, buf->data, buf->len);
+      }
+    }
+  }
+  for (size_t s = 0; s < shard_num; s++) {
+    shard_frame_t *frames[SHARD_BURST];
+    size_t n;
+    while ((n = ring_dequeue_burst(&shards[s].tx, (void **) frames, SHARD_BURST)) != 0) {
+      for (size_t i = 0; i < n; i++) {
+        netif_t *netif = shard_netifs[frames[i]->netif];
+        buf_init(&netif->txbuf, frames[i]->len);
+        memcpy(netif->txbuf.data, frames[i]->data, frames[i]->len);
+        driver_send(netif, &netif->txbuf);
+      }
+      ring_enqueue_burst(&shards[s].tx_free, (void *const *) frames, n);
+      moved += n;
+    }
+  }
+  return moved;
+}
+
+/**
+ * @brief 停止所有分片线程并释放资源
+ *
+ */
+void shard_stop() {
+  atomic_store(&shard_running, false);
+  for (size_t i = 0; i < shard_num; i++) {
+    shard_t *shard = &shards[i];
+    pthread_join(shard->thread, NULL);
+    Log("shard %zu: stopped, %zu frames dropped", i, shard->rx_drop);
+    for (size_t j = 0; j < shard_netif_num; j++)
+      ring_free(&shard->rx[j]);
+    ring_free(&shard->rx_free);
+    ring_free(&shard->tx);
+    ring_free(&shard->tx_free);
+    free(shard->frames);
+  }
+  shard_num = 0;
+}
+
+#endif
@@ -0,0 +1,91 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "stats.h"
+
+typedef struct net_stats_block //每个线程一个的计数器块，线程退出后保留，计数不丢失
+{
+  net_stats_t stats;              // 必须为首个成员
+  thread_block_t link;            // 挂在所有计数器块组成的链表上，供快照遍历；线程序号按首次计数的顺序分配
+} net_stats_block_t;
+
+NET_THREAD_LOCAL net_stats_t *net_stats_self;
+static thread_block_list_t net_stats_blocks;
+
+static const char *net_stats_names[NET_STATS_NUM] = {
+#define NET_STATS_NAME(id, name) name,
+    NET_STATS_COUNTERS(NET_STATS_NAME)
+#undef NET_STATS_NAME
+};
+
+/**
+ * @brief 为当前线程分配计数器块并挂入全局链表
+ *
+ * @return net_stats_t* 计数器，分配失败时返回一个共享的备用块，计数可能不准确
+ */
+net_stats_t *net_stats_attach() {
+  static net_stats_t fallback;
+  net_stats_block_t *block = thread_block_attach(&net_stats_blocks, sizeof(net_stats_block_t),
+                                                 offsetof(net_stats_block_t, link));
+  if (!block)
+    return &fallback;
+  net_stats_self = &block->stats;
+  return net_stats_self;
+}
+
+/**
+ * @brief 计数器的名字
+ *
+ * @param counter 计数器
+ * @return const char* 名字，形如ip.drop.bad_checksum
+ */
+const char *net_stats_name(net_stats_counter_t counter) {
+  return counter < NET_STATS_NUM ? net_stats_names[counter] : "unknown";
+}
+
+/**
+ * @brief 读取计数器的快照
+ *
+ * @param out 快照
+ * @param thread 线程序号，为-1时汇总所有线程
+ * @return size_t 汇总的线程数，指定的线程不存在时为0
+ */
+size_t net_stats_snapshot(net_stats_t *out, int thread) {
+  memset(out, 0, sizeof(*out));
+  size_t count = 0;
+  for (thread_block_t *link = atomic_load(&net_stats_blocks.head); link; link = link->next) {
+    if (thread >= 0 && link->thread != (uint32_t) thread)
+      continue;
+    net_stats_block_t *block = thread_block_of(link, net_stats_block_t, link);
+    const volatile uint64_t *counter = block->stats.counter;
+    for (size_t i = 0; i < NET_STATS_NUM; i++)
+      out->counter[i] += counter[i];
+    count++;
+  }
+  return count;
+}
+
+/**
+ * @brief 计算两个快照之间的增量
+ *
+ * @param out 增量，可以与now或before相同
+ * @param now 较新的快照
+ * @param before 较旧的快照
+ */
+void net_stats_diff(net_stats_t *out, const net_stats_t *now, const net_stats_t *before) {
+  for (size_t i = 0; i < NET_STATS_NUM; i++)
+    out->counter[i] = now->counter[i] - before->counter[i];
+}
+
+/**
+ * @brief 以每行"名字 值"的格式输出计数器
+ *
+ * @param f 输出文件
+ * @param stats 快照或增量
+ * @param all 为0时省略值为0的计数器
+ */
+void net_stats_dump(FILE *f, const net_stats_t *stats, int all) {
+  for (size_t i = 0; i < NET_STATS_NUM; i++)
+    if (all || stats->counter[i])
+      fprintf(f, "%s %llu\n", net_stats_names[i], (unsigned long long) stats->counter[i]);
+}
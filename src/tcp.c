@@ -1,7 +1,15 @@
 #include "map.h"
 #include "tcp.h"
 #include "ip.h"
-#include "debug_macros.h"
+#include "log.h"
+#include "stats.h"
+#include "latency.h"
+#include "recorder.h"
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 // static void panic(const char *msg, int line) {
 //   printf("panic %s! at line %d\n", msg, line);
@@ -22,14 +30,16 @@ static void display_flags(tcp_flags_t flags) {
 }
 
 // map: dst-port -> handler
-static map_t tcp_table;
+static NET_THREAD_LOCAL map_t tcp_table;
 
 // tcp_key_t[IP, src port, dst port] -> tcp_connect_t
 
 /* Connect_table放置了一堆TCP连接，
     KEY为[IP，src port，dst port], 即tcp_key_t，VALUE为tcp_connect_t。
 */
-static map_t connect_table;
+static NET_THREAD_LOCAL map_t connect_table;
+static NET_THREAD_LOCAL uint32_t connect_generation; // 上一个连接的代号
+static NET_THREAD_LOCAL uint16_t ephemeral_port;      // 下一个尝试的主动打开的本地端口
 
 /**
  * @brief 生成一个用于 connect_table 的 key
@@ -71,6 +81,30 @@ int tcp_open(uint16_t port, tcp_handler_t handler) {
   return map_set(&tcp_table, &port, &handler);
 }
 
+/**
+ * @brief 在连接表中新建一个TCP_LISTEN状态的连接，分配新的代号
+ *
+ * @param key 连接表的键
+ * @param ip 对端ip
+ * @param handler 本地端口的处理程序，指向tcp_table
+ * @param netif 连接所在的网卡
+ * @return tcp_connect_t* 连接表中的连接，连接表已满时为NULL
+ */
+static tcp_connect_t *new_tcp_connect(tcp_key_t *key, const uint8_t *ip, tcp_handler_t *handler, netif_t *netif) {
+  tcp_connect_t connect = CONNECT_LISTEN;
+  memcpy(connect.ip, ip, NET_IP_LEN);
+  connect.handler = handler;
+  connect.netif = netif;
+  if (map_set(&connect_table, key, &connect) != 0)
+    return NULL;
+  tcp_connect_t *entry = (tcp_connect_t *) map_get(&connect_table, key);
+  // 0表示已释放，回绕时跳过
+  if (++connect_generation == 0)
+    connect_generation = 1;
+  entry->generation = connect_generation;
+  return entry;
+}
+
 /**
  * @brief 完成了缓存分配工作，状态也会切换为TCP_SYN_RCVD
  *        rx_buf和tx_buf在触及边界时会把数据重新移动到头部，防止溢出。
@@ -88,21 +122,63 @@ static void init_tcp_connect_rcvd(tcp_connect_t *connect) {
   connect->state = TCP_SYN_RCVD;
 }
 
+/**
+ * @brief 对端确认了映射中的数据，全部确认后解除映射
+ *
+ * @param connect
+ * @param len 确认的字节数
+ */
+static void tcp_map_consume(tcp_connect_t *connect, size_t len) {
+  if (!connect->tx_map_len)
+    return;
+  connect->tx_map += len;
+  connect->tx_map_len -= len;
+  if (connect->tx_map_len)
+    return;
+#ifndef _WIN32
+  munmap(connect->tx_map_base, connect->tx_map_size);
+#endif
+  connect->tx_map = connect->tx_map_base = NULL;
+  connect->tx_map_size = 0;
+}
+
 /**
  * @brief 释放TCP连接，这会释放分配的空间，并把状态变回LISTEN。
- *        一般这个后边都会跟个map_delete(&connect_table, &key)把状态变回CLOSED
+ *        一般这个后边都会跟个map_delete(&connect_table, &key)把状态变回CLOSED。
+ *        应用收到过TCP_CONN_CONNECTED的连接，释放前以TCP_CONN_CLOSED通知，使其丢弃对连接的引用
  *
  * @param connect
  */
 static void release_tcp_connect(tcp_connect_t *connect) {
-  if (connect->state == TCP_LISTEN)
+  tcp_state_t state = connect->state;
+  if (state == TCP_LISTEN)
     return;
+  connect->state = TCP_LISTEN;
+  if ((state >= TCP_ESTABLISHED || state == TCP_SYN_SEND) && connect->handler)
+    (*connect->handler)(connect, TCP_CONN_CLOSED);
+  connect->generation = 0;
   free(connect->rx_buf);
   free(connect->tx_buf);
-  connect->state = TCP_LISTEN;
+  tcp_map_consume(connect, connect->tx_map_len);
+  if (connect->active) {
+    // 主动打开时注册的本地端口
+    map_delete(&tcp_table, &connect->local_port);
+    connect->active = 0;
+  }
 }
 
-static uint16_t tcp_checksum(buf_t *buf, uint8_t *src_ip, uint8_t *dst_ip) {
+/**
+ * @brief 计算tcp校验和，只读取伪首部与buf的前sum_len字节，其余负载的部分和已在拷贝时算出
+ *
+ * @param buf tcp报文段
+ * @param src_ip 源ip
+ * @param dst_ip 目的ip
+ * @param sum_len 需要读取的长度
+ * @param payload_sum 其余负载的部分和，没有时为0
+ * @return uint16_t 校验和
+ */
+static uint16_t tcp_checksum_partial(buf_t *buf, uint8_t *src_ip, uint8_t *dst_ip, size_t sum_len,
+                                     uint16_t payload_sum) {
   uint16_t len = (uint16_t) buf->len;
   tcp_peso_hdr_t *peso_hdr = (tcp_peso_hdr_t *) (buf->data - sizeof(tcp_peso_hdr_t));
   tcp_peso_hdr_t pre; //暂存被覆盖的IP头
@@ -112,16 +188,16 @@ static uint16_t tcp_checksum(buf_t *buf, uint8_t *src_ip, uint8_t *dst_ip) {
   peso_hdr->placeholder = 0;
   peso_hdr->protocol = NET_PROTOCOL_TCP;
   peso_hdr->total_len16 = swap16(len);
-  uint16_t checksum = checksum16((uint16_t *) peso_hdr, len + sizeof(tcp_peso_hdr_t));
+  uint16_t checksum = checksum16((uint16_t *) peso_hdr, sum_len + sizeof(tcp_peso_hdr_t));
   memcpy(peso_hdr, &pre, sizeof(tcp_peso_hdr_t));
-  return checksum;
+  return payload_sum ? (uint16_t) ~checksum16_add((uint16_t) ~checksum, payload_sum) : checksum;
 }
 
-#ifndef _MSC_VER
-static _Thread_local uint16_t delete_port;
-#else
-static uint16_t delete_port;
-#endif
+static uint16_t tcp_checksum(buf_t *buf, uint8_t *src_ip, uint8_t *dst_ip) {
+  return tcp_checksum_partial(buf, src_ip, dst_ip, buf->len, 0);
+}
+
+static NET_THREAD_LOCAL uint16_t delete_port;
 
 /**
  * @brief tcp_close使用这个函数来查找可以关闭的连接，使用thread-local变量delete_port传递端口号。
@@ -149,33 +225,112 @@ void tcp_close(uint16_t port) {
   map_delete(&tcp_table, &port);
 }
 
+static NET_THREAD_LOCAL size_t *state_count;
+
+static void count_state_fn(void *key, void *value, time_t *timestamp) {
+  tcp_connect_t *connect = value;
+  if (connect->state < TCP_STATE_NUM)
+    state_count[connect->state]++;
+}
+
+/**
+ * @brief 按状态统计当前线程的TCP连接，使用thread-local变量state_count传递计数数组
+ *
+ * @param count 每个状态的连接数
+ * @param capacity 连接表容量，可以为NULL
+ * @return size_t 连接总数
+ */
+size_t tcp_connect_count(size_t count[TCP_STATE_NUM], size_t *capacity) {
+  memset(count, 0, TCP_STATE_NUM * sizeof(size_t));
+  state_count = count;
+  map_foreach(&connect_table, count_state_fn);
+  if (capacity)
+    *capacity = connect_table.max_size;
+  return map_size(&connect_table);
+}
+
+/**
+ * @brief TCP状态的名字
+ *
+ * @param state
+ * @return const char* 小写名字，如established
+ */
+const char *tcp_state_name(tcp_state_t state) {
+  static const char *names[TCP_STATE_NUM] = {
+      "listen", "syn_send", "syn_rcvd", "established", "close_wait",
+      "last_ack", "fin_wait_1", "fin_wait_2", "closing", "time_wait",
+  };
+  return state < TCP_STATE_NUM ? names[state] : "unknown";
+}
+
 /**
- * @brief 从 buf 中读取数据到 connect->rx_buf
+ * @brief 从 buf 中读取数据到 connect->rx_buf。
+ *        应用不消费时(如映射发送的响应未确认时流水线发来的请求)rx_buf会一直增长，
+ *        放不下时整段丢弃且不确认，由对端按通告的窗口重传
  *
  * @param connect
  * @param buf
- * @return uint16_t 字节数
+ * @return int 字节数，放不下为-1
  */
-static uint16_t tcp_read_from_buf(tcp_connect_t *connect, buf_t *buf) {
-  uint8_t *dst = connect->rx_buf->data + connect->rx_buf->len;
-  buf_add_padding(connect->rx_buf, buf->len);
+static int tcp_read_from_buf(tcp_connect_t *connect, buf_t *buf) {
+  buf_t *rx_buf = connect->rx_buf;
+  // 应用从头部消费过的数据留下的空间，尾部不够时把未读的数据移回开头
+  if (rx_buf->data + rx_buf->len + buf->len >= rx_buf->end) {
+    memmove(rx_buf->payload, rx_buf->data, rx_buf->len);
+    rx_buf->data = rx_buf->payload;
+  }
+  uint8_t *dst = rx_buf->data + rx_buf->len;
+  if (buf_add_padding(rx_buf, buf->len) != 0) {
+    NET_STATS_INC(TCP_DROP_RX_FULL);
+    return -1;
+  }
   memcpy(dst, buf->data, buf->len);
   connect->ack += buf->len;
   return buf->len;
 }
 
 /**
- * @brief 把connect内tx_buf的数据写入到buf里面供tcp_send使用，buf原来的内容会无效。
+ * @brief 本端的接收窗口：rx_buf移回开头后还能放下的字节数
+ *
+ * @param connect
+ * @return uint16_t 窗口大小，尚未分配rx_buf时为0
+ */
+static uint16_t tcp_rx_window(tcp_connect_t *connect) {
+  buf_t *rx_buf = connect->rx_buf;
+  if (!rx_buf)
+    return 0;
+  // buf_add_padding要求结尾之前至少留一个字节
+  size_t space = rx_buf->end - rx_buf->payload - rx_buf->len - 1;
+  return space < UINT16_MAX ? space : UINT16_MAX;
+}
+
+/**
+ * @brief 把connect内tx_buf及其后映射中未发送的数据写入到buf里面供tcp_send使用，buf原来的内容会无效。
+ *        不超过TCP_MSS，已发送未确认的数据也占用对端窗口。拷贝时同时累加校验和
  *
  * @param connect
  * @param buf
+ * @param sum 输出负载的部分和
  * @return uint16_t 字节数
  */
-static uint16_t tcp_write_to_buf(tcp_connect_t *connect, buf_t *buf) {
-  uint16_t sent = connect->next_seq - connect->unack_seq;
-  uint16_t size = min32(connect->tx_buf->len - sent, connect->remote_win);
+static uint16_t tcp_write_to_buf(tcp_connect_t *connect, buf_t *buf, uint16_t *sum) {
+  uint32_t sent = connect->next_seq - connect->unack_seq;
+  size_t queued = connect->tx_buf->len + connect->tx_map_len;
+  uint32_t size = 0;
+  if (sent < queued && sent < connect->remote_win)
+    size = min32(min32(queued - sent, connect->remote_win - sent), TCP_MSS);
   buf_init(buf, size);
-  memcpy(buf->data, connect->tx_buf->data + sent, size);
+  // 先取tx_buf中的部分，不足时从映射中取
+  uint32_t head = sent < connect->tx_buf->len ? min32(connect->tx_buf->len - sent, size) : 0;
+  *sum = checksum16_copy(buf->data, connect->tx_buf->data + sent, head);
+  if (head < size) {
+    uint16_t map_sum = checksum16_copy(buf->data + head, connect->tx_map + (sent + head - connect->tx_buf->len),
+                                       size - head);
+    // 从奇数偏移开始的部分和高低字节互换
+    if (head & 1)
+      map_sum = swap16(map_sum);
+    *sum = checksum16_add(*sum, map_sum);
+  }
   connect->next_seq += size;
   return size;
 }
@@ -188,7 +343,7 @@ static uint16_t tcp_write_to_buf(tcp_connect_t *connect, buf_t *buf) {
  * @param connect
  * @param flags
  */
-static void tcp_send(buf_t *buf, tcp_connect_t *connect, tcp_flags_t flags) {
+static void tcp_send_summed(buf_t *buf, tcp_connect_t *connect, tcp_flags_t flags, int summed, uint16_t sum) {
   Dbg("tcp: send sz=%zu, flags=%x", buf->len, *((uint8_t *) &flags));
   // display_flags(flags);
   size_t prev_len = buf->len;
@@ -201,16 +356,55 @@ static void tcp_send(buf_t *buf, tcp_connect_t *connect, tcp_flags_t flags) {
   hdr->data_offset = sizeof(tcp_hdr_t) / sizeof(uint32_t);
   hdr->reserved = 0;
   hdr->flags = flags;
-  hdr->window_size16 = swap16(connect->remote_win);
+  hdr->window_size16 = swap16(tcp_rx_window(connect));
   hdr->chunksum16 = 0;
   hdr->urgent_pointer16 = 0;
-  hdr->chunksum16 = tcp_checksum(buf, connect->ip, net_if_ip);
-  ip_out(buf, connect->ip, NET_PROTOCOL_TCP);
+  hdr->chunksum16 = summed ? tcp_checksum_partial(buf, connect->ip, connect->netif->ip, sizeof(tcp_hdr_t), sum)
+                           : tcp_checksum(buf, connect->ip, connect->netif->ip);
+  NET_STATS_INC(TCP_TX_SEGMENTS);
+  NET_STATS_ADD(TCP_TX_BYTES, buf->len);
+  if (flags.rst)
+    NET_STATS_INC(TCP_TX_RESETS);
+  recorder_key(RECORDER_OUT, connect->ip, connect->remote_port, connect->local_port);
+  ip_out(connect->netif, buf, connect->ip, NET_PROTOCOL_TCP);
   if (flags.syn || flags.fin) {
     connect->next_seq += 1;
   }
 }
 
+static void tcp_send(buf_t *buf, tcp_connect_t *connect, tcp_flags_t flags) {
+  tcp_send_summed(buf, connect, flags, 0, 0);
+}
+
+/**
+ * @brief 把tx_buf与映射中未发送的数据按TCP_MSS分段发出，fin只加在最后一段上
+ *
+ * @param connect
+ * @param flags 报文段的标志
+ * @param force 没有数据可发时也发送一个不带数据的报文段，如ACK或FIN
+ * @return size_t 发出的字节数
+ */
+static size_t tcp_flush(tcp_connect_t *connect, tcp_flags_t flags, int force) {
+  buf_t *txbuf = &connect->netif->txbuf;
+  tcp_flags_t data_flags = flags;
+  data_flags.fin = 0;
+  size_t total = 0;
+  uint16_t size, sum;
+  while ((size = tcp_write_to_buf(connect, txbuf, &sum)) != 0) {
+    total += size;
+    if (connect->next_seq - connect->unack_seq == connect->tx_buf->len + connect->tx_map_len) {
+      tcp_send_summed(txbuf, connect, flags, 1, sum);
+      return total;
+    }
+    tcp_send_summed(txbuf, connect, data_flags, 1, sum);
+  }
+  if (force || flags.fin) {
+    buf_init(txbuf, 0);
+    tcp_send(txbuf, connect, flags);
+  }
+  return total;
+}
+
 /**
  * @brief 从外部关闭一个TCP连接, 会发送剩余数据
  *        供应用层使用
@@ -219,8 +413,7 @@ static void tcp_send(buf_t *buf, tcp_connect_t *connect, tcp_flags_t flags) {
  */
 void tcp_connect_close(tcp_connect_t *connect) {
   if (connect->state == TCP_ESTABLISHED) {
-    tcp_write_to_buf(connect, &txbuf);
-    tcp_send(&txbuf, connect, tcp_flags_ack_fin);
+    tcp_flush(connect, tcp_flags_ack_fin, 1);
     connect->state = TCP_FIN_WAIT_1;
     return;
   }
@@ -229,6 +422,81 @@ void tcp_connect_close(tcp_connect_t *connect) {
   map_delete(&connect_table, &key);
 }
 
+/**
+ * @brief 主动打开一个到ip:port的连接：选一个未使用的本地端口并注册handler，发出SYN，进入TCP_SYN_SEND。
+ *        收到SYN+ACK后以TCP_CONN_CONNECTED通知，之后与被动打开的连接相同；
+ *        对端拒绝或应用在握手完成前关闭时以TCP_CONN_CLOSED通知，连接释放时注销本地端口。
+ *        不能在处理程序的回调中调用
+ *        供应用层使用
+ *
+ * @param ip 对端ip
+ * @param port 对端端口
+ * @param handler 处理程序
+ * @return tcp_connect_t* 新的连接，本地端口或连接表用尽时为NULL
+ */
+tcp_connect_t *tcp_connect(const uint8_t *ip, uint16_t port, tcp_handler_t handler) {
+  uint16_t local_port = 0;
+  for (int i = 0; i <= UINT16_MAX - TCP_EPHEMERAL_MIN && !local_port; i++) {
+    if (ephemeral_port < TCP_EPHEMERAL_MIN)
+      ephemeral_port = TCP_EPHEMERAL_MIN;
+    uint16_t candidate = ephemeral_port++;
+    if (!map_get(&tcp_table, &candidate))
+      local_port = candidate;
+  }
+  if (!local_port || tcp_open(local_port, handler) != 0) {
+    Err("tcp: no local port for %s:%u", LOG_IP(ip), port);
+    return NULL;
+  }
+  tcp_key_t key = new_tcp_key((uint8_t *) ip, port, local_port);
+  tcp_connect_t *connect = new_tcp_connect(&key, ip, map_get(&tcp_table, &local_port), netif_route(ip));
+  if (!connect) {
+    Err("tcp: connection table full");
+    map_delete(&tcp_table, &local_port);
+    return NULL;
+  }
+  init_tcp_connect_rcvd(connect);
+  NET_STATS_INC(TCP_CONN_OPENED);
+  connect->state = TCP_SYN_SEND;
+  connect->active = 1;
+  connect->local_port = local_port;
+  connect->remote_port = port;
+  connect->unack_seq = rand() & UINT32_MAX;
+  connect->next_seq = connect->unack_seq;
+  connect->ack = 0;
+  // 对端的窗口未知，SYN上通告最大的窗口
+  connect->remote_win = UINT16_MAX;
+  buf_t *txbuf = &connect->netif->txbuf;
+  buf_init(txbuf, 0);
+  tcp_send(txbuf, connect, (tcp_flags_t) {.syn = 1});
+  return connect;
+}
+
+/**
+ * @brief 取得连接的句柄，应用需要在回调之外保存连接时使用
+ *        供应用层使用
+ *
+ * @param connect
+ * @return tcp_handle_t
+ */
+tcp_handle_t tcp_connect_handle(tcp_connect_t *connect) {
+  return (tcp_handle_t) {connect, connect->generation};
+}
+
+/**
+ * @brief 由句柄找回连接。连接表的槽位地址不变，释放时代号清零，复用时分配新的代号，
+ *        代号不同即说明句柄所指的连接已经释放
+ *        供应用层使用
+ *
+ * @param handle
+ * @return tcp_connect_t* 连接仍然存在时为连接，否则为NULL
+ */
+tcp_connect_t *tcp_handle_get(tcp_handle_t handle) {
+  if (!handle.connect || !handle.generation || handle.connect->generation != handle.generation ||
+      handle.connect->state == TCP_LISTEN)
+    return NULL;
+  return handle.connect;
+}
+
 /**
  * @brief 从 connect 中读取数据到 buf，返回成功的字节数。
  *        供应用层使用
@@ -239,18 +507,43 @@ void tcp_connect_close(tcp_connect_t *connect) {
  * @return size_t
  */
 size_t tcp_connect_read(tcp_connect_t *connect, uint8_t *data, size_t len) {
+  size_t size = min32(connect->rx_buf->len, len);
+  memcpy(data, connect->rx_buf->data, size);
+  tcp_connect_consume(connect, size);
+  return size;
+}
+
+/**
+ * @brief 不复制地查看rx_buf中已收到的数据，供应用层原地解析。
+ *        返回的指针在下一次收到数据或调用tcp_connect_consume、tcp_connect_read之前有效
+ *
+ * @param connect
+ * @param len 输出已收到的字节数
+ * @return const uint8_t* 数据的开头
+ */
+const uint8_t *tcp_connect_peek(tcp_connect_t *connect, size_t *len) {
+  *len = connect->rx_buf->len;
+  return connect->rx_buf->data;
+}
+
+/**
+ * @brief 丢弃rx_buf开头已处理的数据，取空时回到开头，之后收到的数据不必再搬移
+ *
+ * @param connect
+ * @param len 字节数，超过已收到的字节数时取已收到的字节数
+ */
+void tcp_connect_consume(tcp_connect_t *connect, size_t len) {
   buf_t *rx_buf = connect->rx_buf;
-  size_t size = min32(rx_buf->len, len);
-  memcpy(data, rx_buf->data, size);
-  if (buf_remove_header(rx_buf, size) != 0) {
-    memmove(rx_buf->payload, rx_buf->data, rx_buf->len);
+  buf_remove_header(rx_buf, min32(rx_buf->len, len));
+  if (!rx_buf->len)
     rx_buf->data = rx_buf->payload;
-  }
-  return size;
 }
 
 /**
- * @brief 往connect的tx_buf里面写东西，返回成功的字节数，这里要判断窗口够不够，否则图片显示不全。
+ * @brief 往connect的tx_buf里面写东西，返回成功的字节数，可能只写入一部分。
+ *        tx_buf中已发送未确认与未发送的数据合计不超过对端窗口，否则图片显示不全。
+ *        数据在tcp_connect_flush、收到数据回复ACK或关闭连接时发出。
+ *        tcp_connect_sendfile映射的数据全部确认之前不能写入，返回0。
  *        供应用层使用
  *
  * @param connect
@@ -258,42 +551,104 @@ size_t tcp_connect_read(tcp_connect_t *connect, uint8_t *data, size_t len) {
  * @param len
  */
 size_t tcp_connect_write(tcp_connect_t *connect, const uint8_t *data, size_t len) {
-  // printf("tcp_connect_write size: %zu\n", len);
   buf_t *tx_buf = connect->tx_buf;
-
-  uint8_t *dst = tx_buf->data + tx_buf->len;
-  size_t size = min32(&tx_buf->payload[BUF_MAX_LEN] - dst, len);
-
-  if (connect->next_seq - connect->unack_seq + len >= connect->remote_win) {
+  if (tx_buf->len >= connect->remote_win || connect->tx_map_len)
     return 0;
-  }
-  if (buf_add_padding(tx_buf, size) != 0) {
+  size_t size = min32(len, connect->remote_win - tx_buf->len);
+  if (tx_buf->data + tx_buf->len + size >= tx_buf->end) {
     memmove(tx_buf->payload, tx_buf->data, tx_buf->len);
     tx_buf->data = tx_buf->payload;
-    if (tcp_write_to_buf(connect, &txbuf)) {
-      tcp_send(&txbuf, connect, tcp_flags_ack);
-    }
-    return 0;
   }
-  memcpy(dst, data, size);
+  memcpy(tx_buf->data + tx_buf->len, data, size);
+  tx_buf->len += size;
   return size;
 }
 
+/**
+ * @brief 立即发出tx_buf中未发送的数据，不等待对端的下一个报文段
+ *        供应用层使用
+ *
+ * @param connect
+ * @return size_t 发出的字节数，对端窗口已满时为0，之后收到确认时以TCP_CONN_WRITABLE通知
+ */
+size_t tcp_connect_flush(tcp_connect_t *connect) {
+  if (connect->state != TCP_ESTABLISHED)
+    return 0;
+  return tcp_flush(connect, tcp_flags_ack, 0);
+}
+
+/**
+ * @brief 已写入或映射但尚未发出的字节数，对端窗口满时不为0
+ *        供应用层使用
+ *
+ * @param connect
+ * @return size_t 字节数
+ */
+size_t tcp_connect_unsent(tcp_connect_t *connect) {
+  return connect->tx_buf->len + connect->tx_map_len - (connect->next_seq - connect->unack_seq);
+}
+
+/**
+ * @brief 把文件的一段映射到内存，排在tx_buf中已有的数据之后发送。
+ *        分段时直接从映射中拷贝到网卡的发送缓冲并同时计算校验和，不经过tx_buf，
+ *        无论文件多大，每个连接只占用映射的地址空间。
+ *        映射的数据全部被确认前tcp_connect_write返回0，之后收到TCP_CONN_WRITABLE时tx_map_len为0。
+ *        调用后fd可以关闭。不支持发送途中截断文件：被截掉的页在访问时触发SIGBUS。供应用层使用
+ *
+ * @param connect
+ * @param fd 文件描述符
+ * @param offset 文件中的起始位置
+ * @param len 长度
+ * @return int 成功为0；已有未确认的映射、偏移为负、范围超出文件、映射失败或平台不支持时为-1，
+ *             应用应改用tcp_connect_write
+ */
+int tcp_connect_sendfile(tcp_connect_t *connect, int fd, off_t offset, size_t len) {
+#ifndef _WIN32
+  if (connect->state != TCP_ESTABLISHED || connect->tx_map_len || !len || offset < 0)
+    return -1;
+  // 超出文件末尾的页在访问时触发SIGBUS，映射前按文件当前大小检查范围
+  struct stat st;
+  if (fstat(fd, &st) != 0 || offset > st.st_size || len > (uint64_t) (st.st_size - offset)) {
+    Err("tcp: sendfile range out of file");
+    return -1;
+  }
+  off_t delta = offset % sysconf(_SC_PAGESIZE);
+  void *base = mmap(NULL, len + delta, PROT_READ, MAP_PRIVATE, fd, offset - delta);
+  if (base == MAP_FAILED) {
+    Err("tcp: sendfile mmap failed");
+    return -1;
+  }
+  connect->tx_map_base = base;
+  connect->tx_map_size = len + delta;
+  connect->tx_map = (const uint8_t *) base + delta;
+  connect->tx_map_len = len;
+  return 0;
+#else
+  return -1;
+#endif
+}
+
 /**
  * @brief 服务器端TCP收包
  *
+ * @param netif
  * @param buf
  * @param src_ip
  */
-void tcp_in(buf_t *buf, uint8_t *src_ip) {
-  Dbg("tcp: in from %s", iptos(src_ip));
+void tcp_in(netif_t *netif, buf_t *buf, uint8_t *src_ip) {
+  Dbg("tcp: in from %s", LOG_IP(src_ip));
+  buf_t *txbuf = &netif->txbuf;
 
   /*
   1、大小检查，检查buf长度是否小于tcp头部，如果是，则丢弃
   */
 
+  LATENCY_MARK(TRANSPORT_IN);
+  NET_STATS_INC(TCP_RX_SEGMENTS);
+  NET_STATS_ADD(TCP_RX_BYTES, buf->len);
   if (buf->len < sizeof(tcp_hdr_t)) {
     Log("tcp: too short (%zu)", buf->len);
+    NET_STATS_DROP(TCP_DROP_TOO_SHORT);
     return;
   }
 
@@ -305,9 +660,10 @@ void tcp_in(buf_t *buf, uint8_t *src_ip) {
 
   uint16_t checksum_expected = p->chunksum16;
   p->chunksum16 = 0;
-  uint16_t checksum_actual = tcp_checksum(buf, src_ip, net_if_ip);
+  uint16_t checksum_actual = tcp_checksum(buf, src_ip, netif->ip);
   if (checksum_actual != checksum_expected) {
     Err("tcp: checksum error, expected %x, actual %x", checksum_expected, checksum_actual);
+    NET_STATS_DROP(TCP_DROP_BAD_CHECKSUM);
     return;
   }
   p->chunksum16 = checksum_expected;
@@ -332,6 +688,7 @@ void tcp_in(buf_t *buf, uint8_t *src_ip) {
   tcp_handler_t *handler = (tcp_handler_t *) map_get(&tcp_table, &dst_port);
   if (!handler) {
     Err("tcp: no handler for port %d", dst_port);
+    NET_STATS_DROP(TCP_DROP_NO_HANDLER);
     return;
   }
 
@@ -340,7 +697,8 @@ void tcp_in(buf_t *buf, uint8_t *src_ip) {
   */
 
   tcp_key_t key = new_tcp_key(src_ip, src_port, dst_port);
-  Dbg("tcp: KEY = (src=%s, src_port=%d, dst_port=%d)", iptos(key.ip), key.src_port, key.dst_port);
+  recorder_key(RECORDER_IN, src_ip, src_port, dst_port);
+  Dbg("tcp: KEY = (src=%s, src_port=%d, dst_port=%d)", LOG_IP(key.ip), key.src_port, key.dst_port);
 
   /*
   6、调用map_get函数，根据key查找一个tcp_connect_t* connect，
@@ -350,22 +708,8 @@ void tcp_in(buf_t *buf, uint8_t *src_ip) {
   tcp_connect_t *connect = (tcp_connect_t *) map_get(&connect_table, &key);
   if (!connect) {
     // connect not found, create a new connect.
-    // NOTE that this `connect` is not the same location as the `connect` in the map.
-    connect = malloc(sizeof(tcp_connect_t));
-    memset(connect, 0, sizeof(tcp_connect_t));
-    connect->state = TCP_LISTEN;
-    // connect->local_port = dst_port;
-    // connect->remote_port = src_port;
-    memcpy(connect->ip, src_ip, NET_IP_LEN);
-    connect->handler = handler;
-    // connect->tx_buf = malloc(sizeof(buf_t));
-    // connect->rx_buf = malloc(sizeof(buf_t));
-    // buf_init(connect->tx_buf, TCP_BUF_SIZE_TX);
-    // buf_init(connect->rx_buf, TCP_BUF_SIZE_RX);
-    Assert(map_set(&connect_table, &key, connect) == 0, "Cannot insert connection table!");
-    free(connect);
-    // update pointer
-    connect = (tcp_connect_t *) map_get(&connect_table, &key);
+    connect = new_tcp_connect(&key, src_ip, handler, netif);
+    Assert(connect != NULL, "Cannot insert connection table!");
     Ok("tcp: create new connection %p", connect);
   } else {
     Dbg("tcp: using created connection %p", connect);
@@ -398,6 +742,7 @@ void tcp_in(buf_t *buf, uint8_t *src_ip) {
   if (connect->state == TCP_LISTEN) {
     if (flag.rst) {
       Err("tcp: close when TCP_LISTEN, flag RST recv");
+      NET_STATS_INC(TCP_RX_RESETS);
       display_flags(flag);
       tcp_connect_close(connect);
       return;
@@ -408,6 +753,7 @@ void tcp_in(buf_t *buf, uint8_t *src_ip) {
       goto reset_tcp;
     }
     init_tcp_connect_rcvd(connect);
+    NET_STATS_INC(TCP_CONN_OPENED);
     connect->local_port = dst_port;
     connect->remote_port = src_port;
     memcpy(connect->ip, src_ip, NET_IP_LEN);
@@ -415,8 +761,44 @@ void tcp_in(buf_t *buf, uint8_t *src_ip) {
     connect->next_seq = connect->unack_seq;
     connect->ack = got_seq + 1;
     connect->remote_win = window_size;
-    buf_init(&txbuf, 0);
-    tcp_send(&txbuf, connect, tcp_flags_ack_syn);
+    buf_init(txbuf, 0);
+    tcp_send(txbuf, connect, tcp_flags_ack_syn);
+    return;
+  }
+
+  /*
+  主动打开的连接在TCP_SYN_SEND状态等待SYN+ACK：
+      （1）确认号不是SYN的下一个序号，则reset_tcp复位通知
+      （2）收到确认了SYN的rst，说明对端拒绝连接，关闭连接
+      （3）收到SYN+ACK，记下对端的序号与窗口，进入ESTABLISHED，以TCP_CONN_CONNECTED通知应用，
+          回复的ACK带上应用在回调中写入的数据。不支持同时打开，只有SYN时不做处理
+  */
+
+  if (connect->state == TCP_SYN_SEND) {
+    if (flag.ack && got_ack != connect->next_seq) {
+      Err("tcp: reset when TCP_SYN_SEND, bad ack %u, expected %u", got_ack, connect->next_seq);
+      goto reset_tcp;
+    }
+    if (flag.rst) {
+      if (flag.ack) {
+        Err("tcp: connection refused by %s:%u", LOG_IP(src_ip), src_port);
+        NET_STATS_INC(TCP_RX_RESETS);
+        tcp_connect_close(connect);
+      }
+      return;
+    }
+    if (!flag.syn || !flag.ack) {
+      Err("tcp: when TCP_SYN_SEND, not a SYN+ACK, ignore");
+      return;
+    }
+    connect->unack_seq = got_ack;
+    connect->ack = got_seq + 1;
+    connect->remote_win = window_size;
+    connect->state = TCP_ESTABLISHED;
+    Ok("tcp: state -> TCP_ESTABLISHED (active), call handler %p", *connect->handler);
+    (*connect->handler)(connect, TCP_CONN_CONNECTED);
+    if (connect->state == TCP_ESTABLISHED)
+      tcp_flush(connect, tcp_flags_ack, 1);
     return;
   }
 
@@ -426,6 +808,9 @@ void tcp_in(buf_t *buf, uint8_t *src_ip) {
 
   if (got_seq != connect->ack) {
     Err("tcp: reset caused by got_seq(%u) != connect->ack(%u)", got_seq, connect->ack);
+    // 序号落后于已确认的位置，说明对端重传了已收到的段
+    if ((int32_t) (got_seq - connect->ack) < 0)
+      NET_STATS_INC(TCP_RX_RETRANSMITS);
     goto reset_tcp;
   }
 
@@ -435,6 +820,7 @@ void tcp_in(buf_t *buf, uint8_t *src_ip) {
 
   if (flag.rst) {
     Err("tcp: reset caused by RST flag received");
+    NET_STATS_INC(TCP_RX_RESETS);
     tcp_connect_close(connect);
     goto reset_tcp;
   }
@@ -466,6 +852,12 @@ void tcp_in(buf_t *buf, uint8_t *src_ip) {
         connect->state = TCP_ESTABLISHED;
         Ok("tcp: state -> TCP_ESTABLISHED, call handler %p", *connect->handler);
         (*connect->handler)(connect, TCP_CONN_CONNECTED);
+        // 主动打开的一方可以在这个ACK上带上数据
+        if (buf->len && connect->state == TCP_ESTABLISHED && tcp_read_from_buf(connect, buf) > 0) {
+          (*connect->handler)(connect, TCP_CONN_DATA_RECV);
+          if (connect->state == TCP_ESTABLISHED)
+            tcp_flush(connect, tcp_flags_ack, 1);
+        }
       }
       break;
     case TCP_ESTABLISHED:
@@ -483,18 +875,37 @@ void tcp_in(buf_t *buf, uint8_t *src_ip) {
             则调用buf_remove_header函数，去掉被对端接收确认的部分数据，并更新unack_seq值
 
         */
-        if (flag.ack && connect->unack_seq < got_ack && connect->next_seq > got_ack) {
-          buf_remove_header(connect->tx_buf, got_ack - connect->unack_seq);
+        int acked = 0;
+        if (flag.ack && (int32_t) (got_ack - connect->unack_seq) > 0 && (int32_t) (connect->next_seq - got_ack) >= 0) {
+          // 先确认tx_buf中的数据，其余在映射中
+          uint32_t acked_len = got_ack - connect->unack_seq;
+          uint32_t from_buf = min32(acked_len, connect->tx_buf->len);
+          buf_remove_header(connect->tx_buf, from_buf);
+          tcp_map_consume(connect, acked_len - from_buf);
           connect->unack_seq = got_ack;
+          acked = 1;
         } else {
           Dbg("tcp: when ESTABLISHED, no ACK or ..., ignore :: unack_seq=%u, got_seq=%u, ack=%u, next_seq=%u",
               connect->unack_seq, got_seq, got_ack, connect->next_seq);
         }
+        if (flag.ack) {
+          // 对端打开了窗口(如零窗口之后的窗口更新)，同样通知应用继续发送
+          if (window_size > connect->remote_win)
+            acked = 1;
+          connect->remote_win = window_size;
+        }
         /*
         16、然后接收数据
             调用tcp_read_from_buf函数，把buf放入rx_buf中
         */
-        uint16_t read_sz = tcp_read_from_buf(connect, buf);
+        if (buf->len && tcp_read_from_buf(connect, buf) < 0) {
+          // 放不下的段连同其中的FIN都不确认，回复的ACK带上当前窗口
+          buf_init(txbuf, 0);
+          tcp_send(txbuf, connect, tcp_flags_ack);
+          if (acked && connect->state == TCP_ESTABLISHED)
+            (*connect->handler)(connect, TCP_CONN_WRITABLE);
+          return;
+        }
         /*
         17、再然后，根据当前的标志位进一步处理
             （1）首先调用buf_init初始化txbuf
@@ -504,20 +915,26 @@ void tcp_in(buf_t *buf, uint8_t *src_ip) {
             （4）调用tcp_write_to_buf函数，看看是否有数据需要发送，如果有，同时发数据和ACK
             （5）没有收到数据，可能对方只发一个ACK，可以不响应
         */
-        buf_init(&txbuf, 0);
+        buf_init(txbuf, 0);
         if (flag.fin) {
           connect->state = TCP_LAST_ACK;
           connect->ack++;
-          tcp_send(&txbuf, connect, tcp_flags_ack_fin);
+          tcp_send(txbuf, connect, tcp_flags_ack_fin);
           return;
         } else {
           // if (read_sz > 0) {
           if (buf->len) {
             // connect->ack += read_sz;
+            LATENCY_PATH(TCP_DATA);
+            LATENCY_MARK(HANDLER);
             (*connect->handler)(connect, TCP_CONN_DATA_RECV);
-            tcp_write_to_buf(connect, &txbuf);
-            tcp_send(&txbuf, connect, tcp_flags_ack);
+            // 处理程序可能已关闭连接
+            if (connect->state == TCP_ESTABLISHED)
+              tcp_flush(connect, tcp_flags_ack, 1);
           }
+          // 对端确认了数据，通知应用继续写入
+          if (acked && connect->state == TCP_ESTABLISHED)
+            (*connect->handler)(connect, TCP_CONN_WRITABLE);
         }
       }
       break;
@@ -526,10 +943,13 @@ void tcp_in(buf_t *buf, uint8_t *src_ip) {
       break;
     case TCP_FIN_WAIT_1:
       /*
-      18、如果收到FIN && ACK，则close_tcp直接关闭TCP
+      18、如果收到FIN && ACK，则确认对端的FIN后close_tcp关闭TCP，否则对端停在LAST_ACK
           如果只收到ACK，则将状态转为TCP_FIN_WAIT_2
       */
       if (flag.fin && flag.ack) {
+        connect->ack++;
+        buf_init(txbuf, 0);
+        tcp_send(txbuf, connect, tcp_flags_ack);
         tcp_connect_close(connect);
       } else if (flag.ack) {
         connect->state = TCP_FIN_WAIT_2;
@@ -542,18 +962,17 @@ void tcp_in(buf_t *buf, uint8_t *src_ip) {
       */
       if (flag.fin) {
         connect->ack++;
-        buf_init(&txbuf, 0);
-        tcp_send(&txbuf, connect, tcp_flags_ack);
+        buf_init(txbuf, 0);
+        tcp_send(txbuf, connect, tcp_flags_ack);
         tcp_connect_close(connect);
       }
       break;
     case TCP_LAST_ACK:
       /*
       20、如果不是ACK，则不做处理
-          如果是，则调用handler函数，进入TCP_CONN_CLOSED状态，，再close_tcp关闭TCP
+          如果是，则close_tcp关闭TCP，释放连接时调用handler函数，进入TCP_CONN_CLOSED状态
       */
       if (flag.ack) {
-        (*handler)(connect, TCP_CONN_CLOSED);
         tcp_connect_close(connect);
       }
       break;
@@ -565,10 +984,14 @@ void tcp_in(buf_t *buf, uint8_t *src_ip) {
 
   reset_tcp:
   Err("!!! reset tcp !!!");
+  // 监听状态的连接尚未填写端口，复位报文要发回对方的端口
+  connect->local_port = dst_port;
+  connect->remote_port = src_port;
   connect->next_seq = 0;
   connect->ack = got_seq + 1;
-  buf_init(&txbuf, 0);
-  tcp_send(&txbuf, connect, tcp_flags_ack_rst);
+  buf_init(txbuf, 0);
+  tcp_send(txbuf, connect, tcp_flags_ack_rst);
+  recorder_trigger("tcp_reset");
   close_tcp:
   release_tcp_connect(connect);
   map_delete(&connect_table, &key);
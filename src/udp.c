@@ -2,13 +2,15 @@
 #include "udp.h"
 #include "ip.h"
 #include "icmp.h"
-#include "debug_macros.h"
+#include "log.h"
+#include "stats.h"
+#include "latency.h"
 
 /**
  * @brief udp处理程序表
  * 
  */
-map_t udp_table;
+NET_THREAD_LOCAL map_t udp_table;
 
 /**
  * @brief udp伪校验和计算
@@ -22,7 +24,6 @@ static uint16_t udp_checksum(buf_t *buf, uint8_t *src_ip, uint8_t *dst_ip) {
   // peso-header area in buf is mutable, must backup-restore it
   uint8_t backup_ip_header[sizeof(ip_hdr_t)];
   memcpy(backup_ip_header, buf->data - sizeof(ip_hdr_t), sizeof(ip_hdr_t));
-  ip_hdr_t *ip_header = (ip_hdr_t *) backup_ip_header;
   uint16_t udp_length = buf->len;
   // generate peso-header
   buf_add_header(buf, sizeof(udp_peso_hdr_t));
@@ -30,7 +31,8 @@ static uint16_t udp_checksum(buf_t *buf, uint8_t *src_ip, uint8_t *dst_ip) {
   memcpy(peso->src_ip, src_ip, NET_IP_LEN);
   memcpy(peso->dst_ip, dst_ip, NET_IP_LEN);
   peso->placeholder = 0;
-  peso->protocol = ip_header->protocol;
+  // 发送时ip头部尚未填写，不能从中读取协议号
+  peso->protocol = NET_PROTOCOL_UDP;
   peso->total_len16 = swap16(udp_length);
   bool has_one_padding = false;
   if (buf->len & 1) {
@@ -51,13 +53,18 @@ static uint16_t udp_checksum(buf_t *buf, uint8_t *src_ip, uint8_t *dst_ip) {
 /**
  * @brief 处理一个收到的udp数据包
  * 
+ * @param netif 收到数据包的网卡
  * @param buf 要处理的包
  * @param src_ip 源ip地址
  */
-void udp_in(buf_t *buf, uint8_t *src_ip) {
+void udp_in(netif_t *netif, buf_t *buf, uint8_t *src_ip) {
+  LATENCY_MARK(TRANSPORT_IN);
+  NET_STATS_INC(UDP_RX_PACKETS);
+  NET_STATS_ADD(UDP_RX_BYTES, buf->len);
   // check package length
   if (buf->len < sizeof(udp_hdr_t)) {
     Log("udp: too short package! len(%zu) < udp_header_size(%llu)", buf->len, sizeof(udp_hdr_t));
+    NET_STATS_DROP(UDP_DROP_TOO_SHORT);
     return;
   }
   uint8_t src_ip_copy[NET_IP_LEN];
@@ -66,11 +73,13 @@ void udp_in(buf_t *buf, uint8_t *src_ip) {
   uint16_t total_len = swap16(p->total_len16);
   if (buf->len < total_len) {
     Log("udp: too short package! len(%zu) < total_len(%d)", buf->len, total_len);
+    NET_STATS_DROP(UDP_DROP_TOO_SHORT);
     return;
   }
   uint16_t dst_port = swap16(p->dst_port16);
   if (dst_port != 60000) {
     Dbg("udp: ignored port %d", dst_port);
+    NET_STATS_DROP(UDP_DROP_NO_HANDLER);
     return;
   } else {
     Log("udp: recv target port package");
@@ -80,9 +89,10 @@ void udp_in(buf_t *buf, uint8_t *src_ip) {
     Log("udp: ignore checksum");
   } else {
     p->checksum16 = 0;
-    uint16_t checksum_actual = udp_checksum(buf, src_ip_copy, net_if_ip);
+    uint16_t checksum_actual = udp_checksum(buf, src_ip_copy, netif->ip);
     if (checksum_expected != checksum_actual) {
       Log("udp: checksum error! expected=%x, actual=%x", checksum_expected, checksum_actual);
+      NET_STATS_DROP(UDP_DROP_BAD_CHECKSUM);
       return;
     }
     p->checksum16 = checksum_expected;
@@ -91,21 +101,27 @@ void udp_in(buf_t *buf, uint8_t *src_ip) {
   udp_handler_t *handler = (udp_handler_t *) map_get(&udp_table, &dst_port);
   if (handler) {
     Log("udp: successfully call handler for port %d: %p", dst_port, handler);
-    (*handler)(buf->data + sizeof(udp_hdr_t), buf->len - sizeof(udp_hdr_t), src_ip_copy, swap16(p->src_port16));
+    LATENCY_PATH(UDP_ECHO);
+    LATENCY_MARK(HANDLER);
+    (*handler)(netif, buf->data + sizeof(udp_hdr_t), buf->len - sizeof(udp_hdr_t), src_ip_copy, swap16(p->src_port16));
   } else {
     Log("udp: no handler for port %d!", swap16(p->dst_port16));
+    NET_STATS_DROP(UDP_DROP_NO_HANDLER);
   }
 }
 
 /**
  * @brief 处理一个要发送的数据包
  * 
+ * @param netif 出口网卡，为NULL时按目的ip选择
  * @param buf 要处理的包
  * @param src_port 源端口号
  * @param dst_ip 目的ip地址
  * @param dst_port 目的端口号
  */
-void udp_out(buf_t *buf, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port) {
+void udp_out(netif_t *netif, buf_t *buf, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port) {
+  if (!netif)
+    netif = netif_route(dst_ip);
   // add udp header
   buf_add_header(buf, sizeof(udp_hdr_t));
   udp_hdr_t *p = (udp_hdr_t *) buf->data;
@@ -113,9 +129,11 @@ void udp_out(buf_t *buf, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port)
   p->dst_port16 = swap16(dst_port);
   p->total_len16 = swap16(buf->len);
   p->checksum16 = 0;
-  p->checksum16 = udp_checksum(buf, net_if_ip, dst_ip);
+  p->checksum16 = udp_checksum(buf, netif->ip, dst_ip);
+  NET_STATS_INC(UDP_TX_PACKETS);
+  NET_STATS_ADD(UDP_TX_BYTES, buf->len);
   // send to ip layer
-  ip_out(buf, dst_ip, NET_PROTOCOL_UDP);
+  ip_out(netif, buf, dst_ip, NET_PROTOCOL_UDP);
 }
 
 /**
@@ -152,14 +170,18 @@ void udp_close(uint16_t port) {
 /**
  * @brief 发送一个udp包
  * 
+ * @param netif 出口网卡，回复时传入处理程序收到的网卡，为NULL时按目的ip选择
  * @param data 要发送的数据
  * @param len 数据长度
  * @param src_port 源端口号
  * @param dst_ip 目的ip地址
  * @param dst_port 目的端口号
  */
-void udp_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port) {
-  buf_init(&txbuf, len);
-  memcpy(txbuf.data, data, len);
-  udp_out(&txbuf, src_port, dst_ip, dst_port);
+void udp_send(netif_t *netif, uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port) {
+  if (!netif)
+    netif = netif_route(dst_ip);
+  buf_t *txbuf = &netif->txbuf;
+  buf_init(txbuf, len);
+  memcpy(txbuf->data, data, len);
+  udp_out(netif, txbuf, src_port, dst_ip, dst_port);
 }
\ No newline at end of file
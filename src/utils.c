@@ -1,5 +1,6 @@
 #include "utils.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 /**
@@ -9,7 +10,7 @@
  * @return char* 生成的字符串
  */
 char *iptos(const uint8_t *ip) {
-  static char output[3 * 4 + 3 + 1];
+  static NET_THREAD_LOCAL char output[3 * 4 + 3 + 1];
   sprintf(output, "%d.%d.%d.%d", ip[0], ip[1], ip[2], ip[3]);
   return output;
 }
@@ -21,7 +22,7 @@ char *iptos(const uint8_t *ip) {
  * @return char* 生成的字符串
  */
 char *mactos(const uint8_t *mac) {
-  static char output[2 * 6 + 5 + 1];
+  static NET_THREAD_LOCAL char output[2 * 6 + 5 + 1];
   sprintf(output, "%02X-%02X-%02X-%02X-%02X-%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
   return output;
 }
@@ -33,7 +34,7 @@ char *mactos(const uint8_t *mac) {
  * @return char* 生成的字符串
  */
 char *timetos(time_t timestamp) {
-  static char output[20];
+  static NET_THREAD_LOCAL char output[20];
   struct tm *utc_time = gmtime(&timestamp);
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wformat-overflow"
@@ -79,4 +80,69 @@ uint16_t checksum16(uint16_t *data, size_t len) {
   if (len & 1) crc += *((uint8_t *) (data) + (len - 1));
   while (crc & 0xffff0000) crc = (crc & 0xffff) + (crc >> 16);
   return (uint16_t) (~crc);
-}
\ No newline at end of file
+}
+
+/**
+ * @brief 补全校验和卸载未完成的传输层校验和。
+ *        此时校验和字段中已是伪首部的部分和，只需再累加从校验起始位置到包尾的数据
+ * 
+ * @param data 校验起始位置，即传输层头部
+ * @param len 从校验起始位置到包尾的长度
+ * @param offset 校验和字段相对校验起始位置的偏移
+ */
+void checksum16_complete(uint8_t *data, size_t len, size_t offset) {
+  uint16_t checksum = checksum16((uint16_t *) data, len);
+  memcpy(data + offset, &checksum, sizeof(checksum));
+}
+
+/**
+ * @brief 拷贝数据的同时累加16位校验和，发送时省去单独计算校验和再读一遍负载。
+ *        按8字节读写，与checksum16一样以本机字节序累加
+ * 
+ * @param dst 目的地址
+ * @param src 源地址
+ * @param len 长度
+ * @return uint16_t 折叠后未取反的部分和，数据在校验范围内从奇数偏移开始时需交换高低字节
+ */
+uint16_t checksum16_copy(uint8_t *dst, const uint8_t *src, size_t len) {
+  uint64_t sum = 0;
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t word;
+    memcpy(&word, src + i, sizeof(word));
+    memcpy(dst + i, &word, sizeof(word));
+    sum += (word & 0xffffffff) + (word >> 32);
+  }
+  for (; i + 2 <= len; i += 2) {
+    uint16_t word;
+    memcpy(&word, src + i, sizeof(word));
+    memcpy(dst + i, &word, sizeof(word));
+    sum += word;
+  }
+  if (i < len) {
+    dst[i] = src[i];
+    sum += src[i];
+  }
+  while (sum >> 16)
+    sum = (sum & 0xffff) + (sum >> 16);
+  return (uint16_t) sum;
+}
+
+/**
+ * @brief 为当前线程分配一个清零的块，分配线程序号后挂入全局链表，块在进程结束前不释放
+ *
+ * @param list 链表
+ * @param size 块大小
+ * @param offset 块中thread_block_t链接的偏移
+ * @return void* 块，分配失败为NULL
+ */
+void *thread_block_attach(thread_block_list_t *list, size_t size, size_t offset) {
+  char *block = calloc(1, size);
+  if (!block)
+    return NULL;
+  thread_block_t *link = (thread_block_t *) (block + offset);
+  link->thread = atomic_fetch_add(&list->num, 1);
+  link->next = atomic_load(&list->head);
+  while (!atomic_compare_exchange_weak(&list->head, &link->next, link));
+  return block;
+}
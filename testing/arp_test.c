@@ -49,9 +49,10 @@ int main(int argc, char *argv[]) {
 
   Log("Test start");
   net_init();
+  netif_t *netif = netif_get(0);
   log_tab_buf();
   int i = 1;
-  while ((ret = driver_recv(&buf)) > 0) {
+  while ((ret = driver_recv(netif, &buf)) > 0) {
     Log("Feeding input %02d", i);
     fprintf(control_flow, "\nRound %02d -----------------------------\n", i++);
     if (memcmp(buf.data, my_mac, 6) && memcmp(buf.data, boardcast_mac, 6)) {
@@ -61,16 +62,16 @@ int main(int argc, char *argv[]) {
       buf_remove_header(&buf2, sizeof(ether_hdr_t));
       uint8_t *ip = buf.data + 30;
       // net_protocol_t pro = buf.data[13] ? NET_PROTOCOL_ARP : NET_PROTOCOL_IP;
-      arp_out(&buf2, ip);
+      arp_out(netif, &buf2, ip);
     } else {
-      ethernet_in(&buf);
+      ethernet_in(netif, &buf);
     }
     log_tab_buf();
   }
   if (ret < 0) {
     Err("Error occur on receive,exiting");
   }
-  driver_close();
+  driver_close(netif);
   Ok("Sample input all processed, checking output");
 
   fclose(control_flow);
@@ -33,16 +33,17 @@ int main(int argc, char *argv[]) {
 
   Log("Test start");
   net_init();
+  netif_t *netif = netif_get(0);
   int i = 1;
-  while ((ret = driver_recv(&buf)) > 0) {
+  while ((ret = driver_recv(netif, &buf)) > 0) {
     Log("Feeding input %02d", i);
     fprintf(control_flow, "\nRound %02d -----------------------------\n", i++);
-    ethernet_in(&buf);
+    ethernet_in(netif, &buf);
   }
   if (ret < 0) {
     Err("Error occur on loading input,exiting");
   }
-  driver_close();
+  driver_close(netif);
   Ok("Sample input all processed, checking output");
 
   fclose(ip_fout);
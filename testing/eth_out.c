@@ -35,8 +35,9 @@ int main(int argc, char *argv[]) {
 
   Log("Test start");
   net_init();
+  netif_t *netif = netif_get(0);
   int i = 1;
-  while ((ret = driver_recv(&buf)) > 0) {
+  while ((ret = driver_recv(netif, &buf)) > 0) {
     Log("Feeding input %02d", i);
     fprintf(control_flow, "\nRound %02d -----------------------------\n", i++);
     buf_copy(&buf2, &buf, 0);
@@ -45,12 +46,12 @@ int main(int argc, char *argv[]) {
     int proto = buf2.data[12];
     proto <<= 8;
     proto |= buf2.data[13];
-    ethernet_out(&buf, buf2.data, proto);
+    ethernet_out(netif, &buf, buf2.data, proto);
   }
   if (ret < 0) {
     Err("Error occur on loading input, exiting");
   }
-  driver_close();
+  driver_close(netif);
   Ok("Sample input all processed, checking output");
 
   fclose(control_flow);
@@ -13,8 +13,8 @@ char *print_mac(uint8_t *mac);
 
 void fprint_buf(FILE *f, buf_t *buf);
 
-map_t arp_table;
-map_t arp_buf;
+NET_THREAD_LOCAL map_t arp_table;
+NET_THREAD_LOCAL map_t arp_buf;
 
 // void arp_update(uint8_t *ip, uint8_t *mac, arp_state_t state)
 // {
@@ -24,13 +24,13 @@ map_t arp_buf;
 //         fprintf(arp_fout,"state:%d\n",state);
 // }
 
-void arp_in(buf_t *buf, uint8_t *src_mac) {
+void arp_in(netif_t *netif, buf_t *buf, uint8_t *src_mac) {
   fprintf(arp_fout, "arp_in:\n");
   fprintf(arp_fout, "\tmac:%s\n", print_mac(src_mac));
   fprint_buf(arp_fout, buf);
 }
 
-void arp_out(buf_t *buf, uint8_t *ip) {
+void arp_out(netif_t *netif, buf_t *buf, uint8_t *ip) {
   fprintf(arp_fout, "arp_out:\n");
   fprintf(arp_fout, "\tip:%s\n", print_ip(ip));
   fprint_buf(arp_fout, buf);
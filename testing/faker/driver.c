@@ -3,6 +3,7 @@
 #include <utils.h>
 #include "config.h"
 #include "buf.h"
+#include "driver.h"
 #include "debug_macros.h"
 
 static pcap_t *pcap;
@@ -34,7 +35,7 @@ BOOL LoadNpcapDlls() {
 
 #endif
 
-int driver_open() {
+static int driver_faker_open(netif_t *netif) {
 #ifdef _WIN32
   /* Load Npcap and its functions. */
   if (!LoadNpcapDlls()) {
@@ -58,7 +59,7 @@ int driver_open() {
   return 0;
 }
 
-int driver_recv(buf_t *buf) {
+static int driver_faker_recv(netif_t *netif, buf_t *buf) {
   struct pcap_pkthdr *pkt_hdr;
   const uint8_t *pkt_data;
   int ret = pcap_next_ex(pcap, &pkt_hdr, &pkt_data);
@@ -75,7 +76,7 @@ int driver_recv(buf_t *buf) {
   }
 }
 
-int driver_send(buf_t *buf) {
+static int driver_faker_send(netif_t *netif, buf_t *buf) {
   struct pcap_pkthdr header;
   memset(&header.ts, 0, sizeof(header.ts));
   header.caplen = buf->len;
@@ -84,8 +85,16 @@ int driver_send(buf_t *buf) {
   return 0;
 }
 
-void driver_close() {
+static void driver_faker_close(netif_t *netif) {
   fprintf(control_flow, "\ndriver closed\n");
   pcap_dump_close(pdump);
   pcap_close(pcap);
 }
+
+const driver_ops_t driver_pcap_ops = {
+    .name = "faker",
+    .open = driver_faker_open,
+    .recv = driver_faker_recv,
+    .send = driver_faker_send,
+    .close = driver_faker_close,
+};
@@ -14,7 +14,7 @@ void fprint_buf(FILE* f, buf_t* buf);
 //         fprint_buf(icmp_fout, req_buf);
 // }
 
-void icmp_in(buf_t *buf, uint8_t *src_ip)
+void icmp_in(netif_t *netif, buf_t *buf, uint8_t *src_ip)
 {
         fprintf(icmp_fout,"icmp_in:\n");
         fprintf(icmp_fout,"\tip: %s\n",print_ip(src_ip));
@@ -22,7 +22,7 @@ void icmp_in(buf_t *buf, uint8_t *src_ip)
 }
 
 
-void icmp_unreachable(buf_t *recv_buf, uint8_t *src_ip, icmp_code_t code)
+void icmp_unreachable(netif_t *netif, buf_t *recv_buf, uint8_t *src_ip, icmp_code_t code)
 {
         fprintf(icmp_fout,"icmp_unreachable:\n");
         fprintf(icmp_fout,"\tip: %s\n",src_ip ? print_ip(src_ip) : "null");
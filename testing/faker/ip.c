@@ -13,13 +13,14 @@ char *print_mac(uint8_t *mac);
 
 void fprint_buf(FILE *f, buf_t *buf);
 
-void ip_in(buf_t *buf, uint8_t *src_mac) {
+void ip_in(netif_t *netif, buf_t *buf, uint8_t *src_mac) {
   fprintf(ip_fout, "ip_in:\n");
   fprintf(ip_fout, "\tmac:%s\n", print_mac(src_mac));
   fprint_buf(ip_fout, buf);
 }
 
-void ip_fragment_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, uint16_t offset, int mf) {
+void ip_fragment_out(netif_t *netif, buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, uint16_t offset,
+                     int mf) {
   fprintf(ip_fout, "ip_fragment_out:\n");
   fprintf(ip_fout, "\tip: %s\n", print_ip(ip));
   fprintf(ip_fout, "\tprotocol: %d\n", protocol);
@@ -29,7 +30,7 @@ void ip_fragment_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, u
   fprint_buf(ip_fout, buf);
 }
 
-void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol) {
+void ip_out(netif_t *netif, buf_t *buf, uint8_t *ip, net_protocol_t protocol) {
   fprintf(ip_fout, "\tip_out:\n");
   fprintf(ip_fout, "\tip: %s\n", print_ip(ip));
   fprintf(ip_fout, "\tprotocol: %d\n", protocol);
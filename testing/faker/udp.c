@@ -11,7 +11,7 @@ char *print_ip(uint8_t *ip);
 
 void fprint_buf(FILE *f, buf_t *buf);
 
-void udp_out(buf_t *buf, uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port) {
+void udp_out(netif_t *netif, buf_t *buf, uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port) {
   fprintf(udp_fout, "udp_out:\n");
   fprintf(udp_fout, "\tsrc_port: %d\n", src_port);
   fprintf(udp_fout, "\tdest_ip: %s\n", print_ip(dest_ip));
@@ -34,7 +34,7 @@ void udp_close(uint16_t port) {
 }
 
 
-void udp_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port) {
+void udp_send(netif_t *netif, uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port) {
   fprintf(udp_fout, "udp_send:\n\tlen:%d\n", len);
   fprintf(udp_fout, "\tsrc_port:%d\n", src_port);
   fprintf(udp_fout, "\tdest_ip:%s\n", print_ip(dest_ip));
@@ -50,7 +50,7 @@ void udp_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dest_ip,
   }
 }
 
-void udp_in(buf_t *buf, uint8_t *src_ip) {
+void udp_in(netif_t *netif, buf_t *buf, uint8_t *src_ip) {
   fprintf(udp_fout, "udp_in:\n\tsrc_ip:%s\n", print_ip(src_ip));
   fprint_buf(udp_fout, buf);
   Log("udp: in, src_ip=%s, buf len=%zu", print_ip(src_ip), buf->len);
@@ -0,0 +1,111 @@
+#include <string.h>
+#include "fixture.h"
+#include "driver.h"
+#include "ethernet.h"
+#include "arp.h"
+#include "ip.h"
+#include "tcp.h"
+
+const uint8_t fixture_peer_ip[NET_IP_LEN] = {192, 168, 163, 10};
+const uint8_t fixture_peer_mac[NET_MAC_LEN] = {0x02, 0, 0, 0, 0, 0x10};
+buf_t fixture_frame;
+
+static int fixture_open(netif_t *netif) {
+  return 0;
+}
+
+static int fixture_recv(netif_t *netif, buf_t *buf) {
+  return 0;
+}
+
+static int fixture_send(netif_t *netif, buf_t *buf) {
+  return 0;
+}
+
+static void fixture_close(netif_t *netif) {
+}
+
+/**
+ * @brief 默认驱动，收不到帧，发出的帧直接丢弃；需要检查发出的帧时测试在netif_add中传入自己的驱动
+ *
+ */
+const driver_ops_t driver_pcap_ops = {"fixture", fixture_open, fixture_recv, fixture_send, fixture_close};
+
+/**
+ * @brief 构造对端发出的以太网帧，负载清零
+ *
+ * @param dst_mac 目的mac地址
+ * @param protocol 上层协议
+ * @param payload_len 负载长度
+ * @return uint8_t* 负载起始位置
+ */
+uint8_t *fixture_eth(const uint8_t *dst_mac, uint16_t protocol, size_t payload_len) {
+  buf_init(&fixture_frame, sizeof(ether_hdr_t) + payload_len);
+  memset(fixture_frame.data, 0, fixture_frame.len);
+  ether_hdr_t *eth = (ether_hdr_t *) fixture_frame.data;
+  memcpy(eth->dst, dst_mac, NET_MAC_LEN);
+  memcpy(eth->src, fixture_peer_mac, NET_MAC_LEN);
+  eth->protocol16 = swap16(protocol);
+  return (uint8_t *) (eth + 1);
+}
+
+/**
+ * @brief 构造对端发给网卡的ip包，头部校验和已填好，负载清零
+ *
+ * @param netif 收包的网卡，帧发往它的mac地址
+ * @param dst_ip 目的ip地址，通常为netif->ip
+ * @param protocol 上层协议
+ * @param payload_len 负载长度
+ * @return uint8_t* 负载起始位置
+ */
+uint8_t *fixture_ip(netif_t *netif, const uint8_t *dst_ip, uint8_t protocol, size_t payload_len) {
+  ip_hdr_t *ip = (ip_hdr_t *) fixture_eth(netif->mac, NET_PROTOCOL_IP, sizeof(ip_hdr_t) + payload_len);
+  ip->version = IP_VERSION_4;
+  ip->hdr_len = sizeof(ip_hdr_t) / IP_HDR_LEN_PER_BYTE;
+  ip->total_len16 = swap16(sizeof(ip_hdr_t) + payload_len);
+  ip->ttl = 64;
+  ip->protocol = protocol;
+  memcpy(ip->src_ip, fixture_peer_ip, NET_IP_LEN);
+  memcpy(ip->dst_ip, dst_ip, NET_IP_LEN);
+  ip->hdr_checksum16 = checksum16((uint16_t *) ip, sizeof(ip_hdr_t));
+  return (uint8_t *) (ip + 1);
+}
+
+/**
+ * @brief 对端广播arp请求询问网卡的地址并送入协议栈，协议栈应答并记录对端，之后发往对端时arp命中
+ *
+ * @param netif 收包的网卡
+ */
+void fixture_arp_request(netif_t *netif) {
+  arp_pkt_t *arp = (arp_pkt_t *) fixture_eth(net_broadcast_mac, NET_PROTOCOL_ARP, sizeof(arp_pkt_t));
+  arp->hw_type16 = swap16(ARP_HW_ETHER);
+  arp->pro_type16 = swap16(NET_PROTOCOL_IP);
+  arp->hw_len = NET_MAC_LEN;
+  arp->pro_len = NET_IP_LEN;
+  arp->opcode16 = swap16(ARP_REQUEST);
+  memcpy(arp->sender_mac, fixture_peer_mac, NET_MAC_LEN);
+  memcpy(arp->sender_ip, fixture_peer_ip, NET_IP_LEN);
+  memcpy(arp->target_ip, netif->ip, NET_IP_LEN);
+  ethernet_in(netif, &fixture_frame);
+}
+
+/**
+ * @brief 计算对端发出的tcp/udp报文的校验和，伪首部的源地址为对端
+ *
+ * @param dst_ip 目的ip地址
+ * @param protocol 上层协议
+ * @param hdr 传输层头部，校验和字段应为0
+ * @param len 传输层长度
+ * @return uint16_t 校验和
+ */
+uint16_t fixture_checksum(const uint8_t *dst_ip, uint8_t protocol, const uint8_t *hdr, size_t len) {
+  static uint8_t scratch[sizeof(tcp_peso_hdr_t) + ETHERNET_MAX_TRANSPORT_UNIT];
+  tcp_peso_hdr_t *peso = (tcp_peso_hdr_t *) scratch;
+  memcpy(peso->src_ip, fixture_peer_ip, NET_IP_LEN);
+  memcpy(peso->dst_ip, dst_ip, NET_IP_LEN);
+  peso->placeholder = 0;
+  peso->protocol = protocol;
+  peso->total_len16 = swap16(len);
+  memcpy(peso + 1, hdr, len);
+  return checksum16((uint16_t *) scratch, sizeof(tcp_peso_hdr_t) + len);
+}
@@ -0,0 +1,23 @@
+#ifndef FIXTURE_H
+#define FIXTURE_H
+
+#include "net.h"
+
+//
+// 协议栈测试共用的夹具：不在本地子网的对端、什么都不做的pcap驱动，以及从对端发来的帧的构造。
+// 构造的帧都放在fixture_frame中，下一次构造时覆盖
+//
+
+extern const uint8_t fixture_peer_ip[NET_IP_LEN];
+extern const uint8_t fixture_peer_mac[NET_MAC_LEN];
+extern buf_t fixture_frame;
+
+uint8_t *fixture_eth(const uint8_t *dst_mac, uint16_t protocol, size_t payload_len);
+
+uint8_t *fixture_ip(netif_t *netif, const uint8_t *dst_ip, uint8_t protocol, size_t payload_len);
+
+void fixture_arp_request(netif_t *netif);
+
+uint16_t fixture_checksum(const uint8_t *dst_ip, uint8_t protocol, const uint8_t *hdr, size_t len);
+
+#endif
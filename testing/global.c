@@ -6,7 +6,7 @@
 #include "map.h"
 #include "arp.h"
 #include "utils.h"
-#include "queue.h"
+#include "ring.h"
 #include "debug_macros.h"
 
 FILE *control_flow;
@@ -31,8 +31,8 @@ FILE *udp_fout;
 FILE *out_log;
 FILE *demo_log;
 
-extern map_t arp_table;
-extern map_t arp_buf;
+extern NET_THREAD_LOCAL map_t arp_table;
+extern NET_THREAD_LOCAL map_t arp_buf;
 
 // char* state[16] = {
 //         [ARP_PENDING] "pending",
@@ -162,16 +162,16 @@ void log_tab_buf() {
   for (size_t i = 0; i < arp_buf.max_size; i++) {
     uint8_t *entry = (uint8_t *) map_entry_get(&arp_buf, i);
     if (map_entry_valid(&arp_buf, entry)) {
-      queue_t *q = (queue_t *) (entry + arp_buf.key_len);
-      queue_node_t *node = q->head;
-      do {
+      ring_t *ring = *(ring_t **) (entry + arp_buf.key_len);
+      size_t head = atomic_load(&ring->head);
+      for (size_t k = atomic_load(&ring->tail); k != head; k++) {
         fprintf(arp_log_f, "%s -> ", print_ip(entry));
-        buf_t *buf = (buf_t *) node->item;
+        buf_t *buf = (buf_t *) ring->slots[k & (ring->size - 1)];
         for (size_t j = 0; j < buf->len; j++) {
           fprintf(arp_log_f, " %02x", buf->data[j]);
         }
         fputc('\n', arp_log_f);
-      } while ((node = node->next) != NULL);
+      }
     }
   }
 }
@@ -0,0 +1,92 @@
+//
+// 静态文件缓存测试：第二次请求命中缓存，文件修改后重新加载，正在发送的旧内容在引用释放前保持有效，
+// 过大与不存在的文件不缓存，检查文件时发现新加的预压缩版本
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "http_cache.h"
+
+static int write_file(const char *path, const char *content, size_t len) {
+  FILE *f = fopen(path, "wb");
+  if (!f) {
+    printf("%s: cannot write\n", path);
+    return -1;
+  }
+  fwrite(content, 1, len, f);
+  fclose(f);
+  return 0;
+}
+
+static int expect_body(http_cache_entry_t *entry, const char *name, const char *content) {
+  if (!entry || entry->body_len != strlen(content) || memcmp(entry->body, content, entry->body_len) != 0) {
+    printf("%s: wrong cached content\n", name);
+    return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  int failed = 0;
+  const char *path = argc > 1 ? argv[1] : "http_cache_test.html";
+  char big_path[256], gz_path[256];
+  snprintf(big_path, sizeof(big_path), "%s.big", path);
+  snprintf(gz_path, sizeof(gz_path), "%s.gz", path);
+  if (write_file(path, "first", 5) != 0)
+    return 1;
+
+  http_cache_entry_t *first = http_cache_get(path);
+  failed |= expect_body(first, "first load", "first");
+  if (first && first->encodings) {
+    printf("first load: unexpected compressed variant\n");
+    failed = 1;
+  }
+  if (write_file(gz_path, "gz", 2) != 0)
+    return 1;
+  http_cache_entry_t *again = http_cache_get(path);
+  if (again != first || http_cache_stats()->hits != 1 || http_cache_stats()->misses != 1) {
+    printf("second get: not a cache hit\n");
+    failed = 1;
+  }
+  if (!again || again->encodings != 1u << HTTP_ENCODING_GZIP) {
+    printf("second get: .gz variant not found\n");
+    failed = 1;
+  }
+  remove(gz_path);
+  http_cache_put(again);
+
+  // 修改后(大小不同)重新加载，已取得的旧项仍可读
+  if (write_file(path, "second version", 14) != 0)
+    return 1;
+  http_cache_entry_t *second = http_cache_get(path);
+  failed |= expect_body(second, "reload", "second version");
+  failed |= expect_body(first, "old reference", "first");
+  if (http_cache_stats()->reloads != 1 || http_cache_stats()->entries != 1 || http_cache_stats()->bytes != 14) {
+    printf("reload: %llu reloads, %zu entries, %zu bytes\n", (unsigned long long) http_cache_stats()->reloads,
+           http_cache_stats()->entries, http_cache_stats()->bytes);
+    failed = 1;
+  }
+  http_cache_put(first);
+  http_cache_put(second);
+
+  // 删除后不再返回
+  remove(path);
+  if (http_cache_get(path) || http_cache_stats()->entries != 0) {
+    printf("removed file still cached\n");
+    failed = 1;
+  }
+
+  // 过大的文件与不存在的文件
+  char *big = calloc(1, HTTP_CACHE_FILE_MAX + 1);
+  if (write_file(big_path, big, HTTP_CACHE_FILE_MAX + 1) != 0)
+    return 1;
+  free(big);
+  if (http_cache_get(big_path) || http_cache_get("no/such/file")) {
+    printf("uncacheable file returned\n");
+    failed = 1;
+  }
+  remove(big_path);
+  http_cache_clear();
+  return failed;
+}
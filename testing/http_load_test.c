@@ -0,0 +1,148 @@
+//
+// http压测客户端测试：驱动把发出的帧放回接收队列，压测客户端经tcp主动打开连接到同一协议栈上的http服务器；
+// 缓存的文件、映射发送的文件、分块的流式响应与404都被完整接收并按状态计数；
+// 超过每个连接的请求数上限后服务器关闭连接，客户端重新连接；限速时按计划时间发送；
+// 总时长超过HTTP_LOAD_TIMEOUT但持续有数据的慢速响应不算超时
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "driver.h"
+#include "tcp.h"
+#include "http.h"
+#include "http_load.h"
+
+#define LOOP_FRAMES 4096
+#define LOOP_FRAME_SIZE 1600
+
+static uint8_t loop_frames[LOOP_FRAMES][LOOP_FRAME_SIZE];
+static size_t loop_lens[LOOP_FRAMES];
+static size_t loop_head, loop_count;
+static useconds_t loop_delay; // 交给协议栈的每个超过1000字节的帧之前等待的微秒数，模拟慢速的响应
+static int loop_waited;
+
+static int loop_open(netif_t *netif) {
+  return 0;
+}
+
+/**
+ * @brief 取出一个发出的帧交给协议栈，设置了loop_delay时大帧先等待
+ *
+ */
+static int loop_recv(netif_t *netif, buf_t *buf) {
+  if (!loop_count)
+    return 0;
+  size_t len = loop_lens[loop_head];
+  // 等待后先结束本轮轮询，压测客户端在两帧之间检查超时
+  if (loop_delay && len > 1000 && !loop_waited) {
+    usleep(loop_delay);
+    loop_waited = 1;
+    return 0;
+  }
+  loop_waited = 0;
+  buf_init(buf, len);
+  memcpy(buf->data, loop_frames[loop_head], len);
+  loop_head = (loop_head + 1) % LOOP_FRAMES;
+  loop_count--;
+  return (int) len;
+}
+
+/**
+ * @brief 发出的帧排队，下次轮询时收到，回调中不会重入协议栈
+ *
+ */
+static int loop_send(netif_t *netif, buf_t *buf) {
+  if (loop_count == LOOP_FRAMES || buf->len > LOOP_FRAME_SIZE) {
+    printf("loopback queue overflow\n");
+    return -1;
+  }
+  size_t tail = (loop_head + loop_count++) % LOOP_FRAMES;
+  memcpy(loop_frames[tail], buf->data, buf->len);
+  loop_lens[tail] = buf->len;
+  return 0;
+}
+
+static void loop_close(netif_t *netif) {
+}
+
+const driver_ops_t driver_pcap_ops = {"loop", loop_open, loop_recv, loop_send, loop_close};
+
+/**
+ * @brief 分块响应的生产函数，每次一块，共三块，结束或连接释放时释放剩余块数
+ *
+ */
+static size_t stream_fill(void *arg, char *buf, size_t size) {
+  int *left = arg;
+  if (!buf || !*left) {
+    free(left);
+    return 0;
+  }
+  (*left)--;
+  memset(buf, 'x', size < 1000 ? size : 1000);
+  return size < 1000 ? size : 1000;
+}
+
+static void route_stream(http_conn_t *conn, const http_request_t *req, void *arg) {
+  int *left = malloc(sizeof(int));
+  *left = 3;
+  http_respond_stream(conn, "200 OK", "text/plain", stream_fill, left);
+}
+
+/**
+ * @brief 运行一轮压测直到结束
+ *
+ */
+static const http_load_stats_t *load(const char *path, size_t connections, uint64_t requests, double rate) {
+  http_load_config_t config = {.port = 62000, .path = path, .connections = connections, .rate = rate,
+                               .requests = requests};
+  memcpy(config.ip, netif_get(0)->ip, NET_IP_LEN);
+  if (http_load_start(&config) != 0) {
+    printf("%s: http_load_start failed\n", path);
+    return NULL;
+  }
+  for (size_t i = 0; i < 1000000; i++) {
+    net_poll();
+    http_server_run();
+    if (!http_load_run())
+      break;
+  }
+  http_load_stop();
+  http_load_report(stdout);
+  return http_load_stats();
+}
+
+static int check(const char *name, const http_load_stats_t *s, uint64_t ok, uint64_t other, uint64_t connects) {
+  if (!s || s->completed != ok + other || s->status_2xx != ok || s->status_other != other || s->connects != connects ||
+      s->errors || s->timeouts || s->connect_errors || s->latency.count != ok + other) {
+    printf("%s: failed\n", name);
+    return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  int failed = 0;
+  if (net_init() != 0 || http_server_open(62000) != 0 ||
+      http_route("/stream", HTTP_ROUTE_EXACT, route_stream, NULL) != 0)
+    return 1;
+  failed |= check("cached", load("/index.html", 4, 200, 0), 200, 0, 4);
+  failed |= check("mapped", load("/img1.jpg", 2, 10, 0), 10, 0, 2);
+  failed |= check("chunked", load("/stream", 2, 20, 0), 20, 0, 2);
+  // 响应的每个数据帧间隔HTTP_LOAD_TIMEOUT的0.6倍，整个响应超过HTTP_LOAD_TIMEOUT但一直有进展
+  loop_delay = HTTP_LOAD_TIMEOUT * 600000;
+  failed |= check("slow", load("/stream", 1, 1, 0), 1, 0, 1);
+  loop_delay = 0;
+  failed |= check("not found", load("/missing.html", 2, 20, 0), 0, 20, 2);
+  // 服务器在第HTTP_KEEPALIVE_MAX个响应后关闭连接
+  failed |= check("reconnect", load("/index.html", 1, HTTP_KEEPALIVE_MAX + 10, 0), HTTP_KEEPALIVE_MAX + 10, 0, 2);
+  // 50个请求每秒1000个，最后一个的计划时间在49ms之后
+  const http_load_stats_t *s = load("/style.css", 4, 50, 1000);
+  failed |= check("rate", s, 50, 0, 4);
+  if (s && s->seconds < 0.049) {
+    printf("rate: finished in %.3f s\n", s->seconds);
+    failed = 1;
+  }
+  return failed;
+}
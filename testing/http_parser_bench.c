@@ -0,0 +1,79 @@
+//
+// http请求解析器微基准：反复解析典型的请求，输出每秒请求数、每个请求的周期数与每周期字节数；
+// 分段模式下每个请求分两次到达，第二次从上次的位置继续
+// 用法: http_parser_bench [-n 重复次数]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "http_parser.h"
+#include "utils.h"
+
+static const char *const bench_requests[] = {
+    // 命令行客户端
+    "GET / HTTP/1.1\r\n"
+    "Host: 192.168.163.103\r\n"
+    "User-Agent: curl/8.0.1\r\n"
+    "Accept: */*\r\n"
+    "\r\n",
+    // 浏览器
+    "GET /img1.jpg HTTP/1.1\r\n"
+    "Host: 192.168.163.103\r\n"
+    "Connection: keep-alive\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0.0.0 "
+    "Safari/537.36\r\n"
+    "Accept: image/avif,image/webp,image/apng,image/svg+xml,image/*,*/*;q=0.8\r\n"
+    "Referer: http://192.168.163.103/\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+    "If-None-Match: \"46b6-6475ac80\"\r\n"
+    "If-Modified-Since: Tue, 30 May 2023 08:00:00 GMT\r\n"
+    "\r\n",
+};
+
+#define BENCH_REQUESTS (sizeof(bench_requests) / sizeof(bench_requests[0]))
+
+static double bench_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+  size_t repeat = 1000000;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:")) != -1) {
+    if (opt == 'n') {
+      repeat = strtoull(optarg, NULL, 10);
+    } else {
+      fprintf(stderr, "usage: %s [-n repeat]\n", argv[0]);
+      return 1;
+    }
+  }
+  http_parser_t parser;
+  for (int split = 0; split <= 1; split++) {
+    for (size_t i = 0; i < BENCH_REQUESTS; i++) {
+      const char *request = bench_requests[i];
+      size_t len = strlen(request);
+      size_t headers = 0;
+      double start = bench_seconds();
+      uint64_t start_cycles = cycles_now();
+      for (size_t n = 0; n < repeat; n++) {
+        size_t scan = 0;
+        if (split && http_parse_request(&parser, request, len / 2, &scan, 1024) != HTTP_PARSE_INCOMPLETE)
+          return 1;
+        if (http_parse_request(&parser, request, len, &scan, 1024) != (int) len)
+          return 1;
+        headers += parser.num_headers;
+      }
+      uint64_t cycles = cycles_now() - start_cycles;
+      double seconds = bench_seconds() - start;
+      printf("%-8s %4zu bytes %2zu headers: %10.0f req/s, %6.1f cycles/req, %5.2f bytes/cycle\n",
+             split ? "split" : "whole", len, headers / (repeat ? repeat : 1), repeat / seconds,
+             (double) cycles / repeat, (double) len * repeat / cycles);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,86 @@
+//
+// http请求解析器测试：完整请求的各片段，逐字节到达时从上次位置继续查找且只在最后一个字节完成，
+// 流水线请求只解析第一个，LF行尾与请求行前的空行，格式错误、过长与头部过多
+//
+
+#include <stdio.h>
+#include <string.h>
+#include "http_parser.h"
+
+static int failed;
+
+static void expect(int cond, const char *name) {
+  if (!cond) {
+    printf("%s: failed\n", name);
+    failed = 1;
+  }
+}
+
+static int parse(const char *request, size_t max, http_parser_t *parser) {
+  size_t scan = 0;
+  return http_parse_request(parser, request, strlen(request), &scan, max);
+}
+
+int main() {
+  http_parser_t parser;
+  const char *request = "GET /index.html?x=1 HTTP/1.1\r\n"
+                        "Host: example.com\r\n"
+                        "Accept-Encoding:   gzip, br  \r\n"
+                        "X-Long-Header-Name-Over-16: value\twith tab\r\n"
+                        "Empty:\r\n"
+                        "\r\n";
+  size_t len = strlen(request);
+  expect(parse(request, 1024, &parser) == (int) len, "full request");
+  expect(http_slice_is(parser.method, "GET"), "method");
+  expect(http_slice_is(parser.path, "/index.html?x=1"), "path");
+  expect(parser.minor_version == 1, "version");
+  expect(parser.num_headers == 4, "header count");
+  expect(http_slice_is(parser.headers[0].name, "Host") && http_slice_is(parser.headers[0].value, "example.com"),
+         "host");
+  expect(http_slice_is_nocase(parser.headers[1].name, "accept-encoding") &&
+         http_slice_is(parser.headers[1].value, "gzip, br"), "trimmed value");
+  expect(http_slice_is(parser.headers[2].value, "value\twith tab"), "tab in value");
+  expect(parser.headers[3].value.len == 0, "empty value");
+  expect(http_slice_has_token(parser.headers[1].value, "BR") && !http_slice_has_token(parser.headers[1].value, "b"),
+         "token");
+  expect(http_slice_find(parser.headers[0].value, "ample") == parser.headers[0].value.data + 2, "find");
+
+  // 逐字节到达：只有最后一个字节使请求完整，每次只查找新到的字节
+  size_t scan = 0;
+  int ret = HTTP_PARSE_INCOMPLETE;
+  for (size_t i = 1; i <= len; i++) {
+    ret = http_parse_request(&parser, request, i, &scan, 1024);
+    if (i < len && (ret != HTTP_PARSE_INCOMPLETE || scan + 2 < i)) {
+      printf("incremental: byte %zu returned %d, scan %zu\n", i, ret, scan);
+      failed = 1;
+      break;
+    }
+  }
+  expect(ret == (int) len && http_slice_is(parser.headers[0].value, "example.com"), "incremental");
+
+  // 流水线：只解析第一个请求
+  expect(parse("GET /a HTTP/1.0\r\n\r\nGET /b HTTP/1.1\r\n\r\n", 1024, &parser) == 19 &&
+         http_slice_is(parser.path, "/a") && parser.minor_version == 0 && parser.num_headers == 0, "pipelined");
+  expect(parse("\r\nGET / HTTP/1.1\nHost: a\n\n", 1024, &parser) == 26 && http_slice_is(parser.path, "/") &&
+         http_slice_is(parser.headers[0].value, "a"), "bare LF and leading empty line");
+
+  // 格式错误
+  expect(parse("GET / HTTP/1.1\r\nHost : a\r\n\r\n", 1024, &parser) == HTTP_PARSE_BAD, "space before colon");
+  expect(parse("GET / HTTP/1.1\r\nHost: a\r\n folded\r\n\r\n", 1024, &parser) == HTTP_PARSE_BAD, "folded line");
+  expect(parse("GET / HTTP/2.0\r\n\r\n", 1024, &parser) == HTTP_PARSE_BAD, "version");
+  expect(parse("GET /  HTTP/1.1\r\n\r\n", 1024, &parser) == HTTP_PARSE_BAD, "double space");
+  expect(parse("GET / HTTP/1.1\r\nHost: a\rb\r\n\r\n", 1024, &parser) == HTTP_PARSE_BAD, "bare CR");
+  expect(parse("GET / HTTP/1.1\r\nX: 0123456789abcdef\x01\r\n\r\n", 1024, &parser) == HTTP_PARSE_BAD,
+         "control character");
+  expect(parse("\r\n\r\n", 1024, &parser) == HTTP_PARSE_BAD, "empty request");
+
+  // 长度与头部数上限
+  expect(parse("GET / HTTP/1.1\r\nHost: a\r\n", 16, &parser) == HTTP_PARSE_TOO_LARGE, "too large");
+  expect(parse("GET / HTTP/1.1\r\nHost: a\r\n\r\n", 27, &parser) == 27, "exactly max");
+  char many[2048] = "GET / HTTP/1.1\r\n";
+  for (int i = 0; i <= HTTP_PARSER_HEADERS_MAX; i++)
+    strcat(many, "X: y\r\n");
+  strcat(many, "\r\n");
+  expect(parse(many, sizeof(many), &parser) == HTTP_PARSE_TOO_LARGE, "too many headers");
+  return failed;
+}
@@ -0,0 +1,718 @@
+//
+// http服务器测试：多个客户端交错进行，窗口很小且不确认的客户端与只发了半个请求的客户端
+// 不阻塞其他客户端；对端确认后继续发送；响应途中复位的连接被释放后不再被访问；
+// 持久连接上流水线发来的请求按序响应，空闲超时与请求数上限后关闭连接；
+// 响应未确认时流水线发来的请求超过接收缓存的段被丢弃且不确认，通告的窗口随之缩小，打开窗口后继续发送；
+// 超过缓存上限的文件经映射发送，内容与每个报文段的校验和正确，超出文件的映射范围被拒绝；
+// 验证器相同时为304，范围请求从缓存与映射发送请求的字节，不能满足的范围为416；
+// 接受gzip的客户端得到预压缩版本，所有文本响应带Vary；
+// 格式错误、过大与非GET的请求得到错误响应后关闭连接，响应头放不下时得到500；
+// 注册的路由精确匹配优先于最长前缀，流式响应在HTTP/1.1下分块发送并保持连接，在HTTP/1.0下以关闭连接结束，
+// 中途复位时生产函数得到通知；
+// 连接数已满时新连接排队，其请求在有空位后响应，队列满时得到503，排队时复位的连接被跳过
+//
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "driver.h"
+#include "ethernet.h"
+#include "arp.h"
+#include "ip.h"
+#include "tcp.h"
+#include "http.h"
+
+#define HTTP_TEST_PORT 62000
+#define HTTP_TEST_RX_MAX (64 * 1024)
+
+static const uint8_t peer_ip[NET_IP_LEN] = {192, 168, 163, 10};
+static const uint8_t peer_mac[NET_MAC_LEN] = {0x02, 0, 0, 0, 0, 0x10};
+
+typedef struct client //模拟的客户端
+{
+  uint16_t port;
+  uint16_t window;
+  uint32_t snd_nxt, rcv_nxt;
+  uint32_t acked;             // 服务器最近确认到的序号
+  uint16_t peer_win;          // 服务器最近通告的窗口
+  int fin, rst;
+  size_t len;
+  char data[HTTP_TEST_RX_MAX];
+} client_t;
+
+static client_t clients[20];
+static netif_t *netif;
+static buf_t frame;
+static int bad_checksums;
+
+/**
+ * @brief 协议栈发出的tcp报文段交给对应的客户端，只接受按序到达的数据
+ *
+ */
+static int http_test_send(netif_t *netif, buf_t *buf) {
+  ether_hdr_t *eth = (ether_hdr_t *) buf->data;
+  if (eth->protocol16 != constswap16(NET_PROTOCOL_IP))
+    return 0;
+  ip_hdr_t *ip = (ip_hdr_t *) (eth + 1);
+  if (ip->protocol != NET_PROTOCOL_TCP)
+    return 0;
+  tcp_hdr_t *tcp = (tcp_hdr_t *) ((uint8_t *) ip + ip->hdr_len * IP_HDR_LEN_PER_BYTE);
+  size_t seg_len = swap16(ip->total_len16) - ip->hdr_len * IP_HDR_LEN_PER_BYTE;
+  size_t len = seg_len - tcp->data_offset * sizeof(uint32_t);
+  // 带伪首部(含校验和字段)重新计算，结果为0
+  static uint8_t scratch[sizeof(tcp_peso_hdr_t) + ETHERNET_MAX_TRANSPORT_UNIT];
+  tcp_peso_hdr_t *peso = (tcp_peso_hdr_t *) scratch;
+  memcpy(peso->src_ip, ip->src_ip, NET_IP_LEN);
+  memcpy(peso->dst_ip, ip->dst_ip, NET_IP_LEN);
+  peso->placeholder = 0;
+  peso->protocol = NET_PROTOCOL_TCP;
+  peso->total_len16 = swap16(seg_len);
+  memcpy(peso + 1, tcp, seg_len);
+  if (checksum16((uint16_t *) scratch, sizeof(tcp_peso_hdr_t) + seg_len) != 0)
+    bad_checksums++;
+  for (size_t i = 0; i < sizeof(clients) / sizeof(clients[0]); i++) {
+    client_t *c = &clients[i];
+    if (c->port != swap16(tcp->dst_port16))
+      continue;
+    uint32_t seq = swap32(tcp->seq_number32);
+    c->acked = swap32(tcp->ack_number32);
+    c->peer_win = swap16(tcp->window_size16);
+    if (tcp->flags.rst)
+      c->rst = 1;
+    if (tcp->flags.syn) {
+      c->rcv_nxt = seq + 1;
+    } else if (seq == c->rcv_nxt) {
+      if (c->len + len <= HTTP_TEST_RX_MAX)
+        memcpy(c->data + c->len, (uint8_t *) tcp + tcp->data_offset * sizeof(uint32_t), len);
+      c->len += len;
+      c->rcv_nxt += len;
+      if (tcp->flags.fin) {
+        c->fin = 1;
+        c->rcv_nxt++;
+      }
+    }
+  }
+  return 0;
+}
+
+static int http_test_open(netif_t *netif) {
+  return 0;
+}
+
+static int http_test_recv(netif_t *netif, buf_t *buf) {
+  return 0;
+}
+
+static void http_test_close(netif_t *netif) {
+}
+
+const driver_ops_t driver_pcap_ops = {"http", http_test_open, http_test_recv, http_test_send, http_test_close};
+
+/**
+ * @brief 客户端发出一个报文段，随后运行一次http服务器
+ *
+ */
+static void client_send(client_t *c, tcp_flags_t flags, const char *data) {
+  size_t len = data ? strlen(data) : 0;
+  buf_init(&frame, sizeof(ether_hdr_t) + sizeof(ip_hdr_t) + sizeof(tcp_hdr_t) + len);
+  memset(frame.data, 0, frame.len);
+  ether_hdr_t *eth = (ether_hdr_t *) frame.data;
+  memcpy(eth->dst, netif->mac, NET_MAC_LEN);
+  memcpy(eth->src, peer_mac, NET_MAC_LEN);
+  eth->protocol16 = swap16(NET_PROTOCOL_IP);
+  ip_hdr_t *ip = (ip_hdr_t *) (eth + 1);
+  ip->version = IP_VERSION_4;
+  ip->hdr_len = sizeof(ip_hdr_t) / IP_HDR_LEN_PER_BYTE;
+  ip->total_len16 = swap16(sizeof(ip_hdr_t) + sizeof(tcp_hdr_t) + len);
+  ip->ttl = 64;
+  ip->protocol = NET_PROTOCOL_TCP;
+  memcpy(ip->src_ip, peer_ip, NET_IP_LEN);
+  memcpy(ip->dst_ip, netif->ip, NET_IP_LEN);
+  ip->hdr_checksum16 = checksum16((uint16_t *) ip, sizeof(ip_hdr_t));
+  tcp_hdr_t *tcp = (tcp_hdr_t *) (ip + 1);
+  tcp->src_port16 = swap16(c->port);
+  tcp->dst_port16 = swap16(HTTP_TEST_PORT);
+  tcp->seq_number32 = swap32(c->snd_nxt);
+  tcp->ack_number32 = flags.ack ? swap32(c->rcv_nxt) : 0;
+  tcp->data_offset = sizeof(tcp_hdr_t) / sizeof(uint32_t);
+  tcp->flags = flags;
+  tcp->window_size16 = swap16(c->window);
+  if (len)
+    memcpy(tcp + 1, data, len);
+  // 校验和的伪首部借用ip头部的最后12字节
+  tcp_peso_hdr_t *peso = (tcp_peso_hdr_t *) tcp - 1;
+  ip_hdr_t saved = *ip;
+  memcpy(peso->src_ip, peer_ip, NET_IP_LEN);
+  memcpy(peso->dst_ip, netif->ip, NET_IP_LEN);
+  peso->placeholder = 0;
+  peso->protocol = NET_PROTOCOL_TCP;
+  peso->total_len16 = swap16(sizeof(tcp_hdr_t) + len);
+  tcp->chunksum16 = checksum16((uint16_t *) peso, sizeof(tcp_peso_hdr_t) + sizeof(tcp_hdr_t) + len);
+  *ip = saved;
+  c->snd_nxt += len + flags.syn + flags.fin;
+  ethernet_in(netif, &frame);
+  http_server_run();
+}
+
+static void client_connect(client_t *c, uint16_t port, uint16_t window) {
+  memset(c, 0, sizeof(*c));
+  c->port = port;
+  c->window = window;
+  c->snd_nxt = 1000;
+  client_send(c, (tcp_flags_t) {.syn = 1}, NULL);
+  client_send(c, tcp_flags_ack, NULL);
+}
+
+/**
+ * @brief 检查分块的响应体
+ *
+ * @param p 第一个块的长度行
+ * @param end 收到的数据的结尾
+ * @param next 输出最后的空块之后的位置
+ * @return long 各块的总长度，格式错误或不完整时为-1
+ */
+static long client_chunked(const char *p, const char *end, const char **next) {
+  long total = 0;
+  for (;;) {
+    char *line_end;
+    long size = strtol(p, &line_end, 16);
+    if (line_end == p || line_end + 2 > end || memcmp(line_end, "\r\n", 2) != 0)
+      return -1;
+    p = line_end + 2 + size;
+    if (p + 2 > end || memcmp(p, "\r\n", 2) != 0)
+      return -1;
+    p += 2;
+    if (!size) {
+      *next = p;
+      return total;
+    }
+    total += size;
+  }
+}
+
+/**
+ * @brief 按Content-Length或分块依次切分收到的响应，304没有响应体，没有长度的响应体到连接关闭为止
+ *
+ * @param c 客户端
+ * @param status 各响应的状态码
+ * @param close 各响应是否带Connection: close
+ * @param max 最多切分的响应数
+ * @return int 完整的响应数，格式错误或有多余的字节时为-1
+ */
+static int client_responses(client_t *c, int *status, int *close, int max) {
+  int n = 0;
+  size_t len = c->len < HTTP_TEST_RX_MAX ? c->len : HTTP_TEST_RX_MAX - 1;
+  c->data[len] = '\0';
+  for (char *p = c->data; p < c->data + len; n++) {
+    char *body = strstr(p, "\r\n\r\n");
+    if (n == max || strncmp(p, "HTTP/1.1 ", 9) != 0 || !body)
+      return -1;
+    body[2] = '\0'; // 头部之内查找
+    char *length = strstr(p, "\r\nContent-Length: ");
+    int chunked = strstr(p, "\r\nTransfer-Encoding: chunked\r\n") != NULL;
+    status[n] = atoi(p + 9);
+    close[n] = strstr(p, "\r\nConnection: close\r\n") != NULL;
+    if ((!length && !chunked && status[n] != 304 && !close[n]) ||
+        (!close[n] && !strstr(p, "\r\nConnection: keep-alive\r\n")))
+      return -1;
+    body[2] = '\r';
+    const char *next;
+    if (length)
+      p = body + 4 + atoi(length + 18);
+    else if (chunked && client_chunked(body + 4, c->data + len, &next) >= 0)
+      p = (char *) next;
+    else if (chunked)
+      return -1;
+    else
+      p = status[n] == 304 ? body + 4 : c->data + len;
+    if (p > c->data + len)
+      return -1;
+  }
+  return n;
+}
+
+/**
+ * @brief 只有一个响应时，响应体与文件从offset开始的len字节一致，len为0时到文件结尾
+ *
+ */
+static int client_body_is(client_t *c, const char *name, const char *path, size_t offset, size_t len) {
+  static char content[HTTP_TEST_RX_MAX];
+  FILE *f = fopen(path, "rb");
+  size_t size = f ? fread(content, 1, sizeof(content), f) : 0;
+  if (f)
+    fclose(f);
+  if (offset > size || (len && offset + len > size)) {
+    printf("%s: %s too short\n", name, path);
+    return 1;
+  }
+  size = len ? len : size - offset;
+  char *body = strstr(c->data, "\r\n\r\n");
+  if (!size || !body || c->len - (body + 4 - c->data) != size || memcmp(body + 4, content + offset, size) != 0) {
+    printf("%s: body differs from %s\n", name, path);
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ * @brief 只有一个响应，状态码正确、带Connection: close，且之后连接被关闭
+ *
+ */
+static int client_check(client_t *c, const char *name, int status) {
+  int got, close;
+  if (!c->fin || client_responses(c, &got, &close, 1) != 1 || got != status || !close) {
+    printf("%s: bad response (%zu bytes, fin %d): %.40s\n", name, c->len, c->fin, c->data);
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ * @brief 新连接上发送一个要求关闭连接的请求，确认到对端关闭为止
+ *
+ */
+static void client_get(client_t *c, uint16_t port, const char *request) {
+  client_connect(c, port, UINT16_MAX);
+  client_send(c, (tcp_flags_t) {.ack = 1, .psh = 1}, request);
+  for (int i = 0; i < 100 && !c->fin; i++)
+    client_send(c, tcp_flags_ack, NULL);
+}
+
+/**
+ * @brief 响应头中某个头部的取值
+ *
+ * @return int 找到为0
+ */
+static int client_header(client_t *c, const char *name, char *value, size_t size) {
+  char *end = strstr(c->data, "\r\n\r\n");
+  for (char *p = strstr(c->data, "\r\n"); p && p < end; p = strstr(p + 2, "\r\n")) {
+    size_t len = strlen(name);
+    if (strncmp(p + 2, name, len) == 0 && p[2 + len] == ':') {
+      p += 2 + len + 2;
+      len = strcspn(p, "\r");
+      if (len >= size)
+        return -1;
+      memcpy(value, p, len);
+      value[len] = '\0';
+      return 0;
+    }
+  }
+  return -1;
+}
+
+static int stream_freed;
+
+/**
+ * @brief 流式响应：arg指向剩余的字节数，每次写满缓冲，写完或连接释放时记下
+ *
+ */
+static size_t route_stream_fill(void *arg, char *buf, size_t size) {
+  size_t *left = arg;
+  if (!buf || !*left) {
+    stream_freed++;
+    return 0;
+  }
+  size_t n = *left < size ? *left : size;
+  for (size_t i = 0; i < n; i++)
+    buf[i] = 'a' + (*left - i) % 26;
+  *left -= n;
+  return n;
+}
+
+static void route_stream(http_conn_t *conn, const http_request_t *req, void *arg) {
+  static size_t left;
+  left = 5000;
+  http_respond_stream(conn, "200 OK", "text/plain", route_stream_fill, &left);
+}
+
+static void route_echo(http_conn_t *conn, const http_request_t *req, void *arg) {
+  http_respond(conn, arg, "text/plain", req->query.data, req->query.len, NULL);
+}
+
+static void route_silent(http_conn_t *conn, const http_request_t *req, void *arg) {
+}
+
+/**
+ * @brief 只有一个响应时，响应体与给定内容一致
+ *
+ */
+static int client_body_equals(client_t *c, const char *name, const char *content) {
+  char *body = strstr(c->data, "\r\n\r\n");
+  if (!body || strcmp(body + 4, content) != 0) {
+    printf("%s: body \"%s\", expected \"%s\"\n", name, body ? body + 4 : "", content);
+    return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  int failed = 0;
+  static char huge_status[HTTP_OUT_SIZE] = "200 ";
+  memset(huge_status + 4, 'x', sizeof(huge_status) - 5);
+  if (net_init() != 0)
+    return -1;
+  netif = netif_get(0);
+  if (http_server_open(HTTP_TEST_PORT) != 0) {
+    printf("http_server_open failed\n");
+    return 1;
+  }
+  if (http_route("/api/", HTTP_ROUTE_PREFIX, route_stream, NULL) != 0 ||
+      http_route("/api/echo", HTTP_ROUTE_EXACT, route_echo, "200 OK") != 0 ||
+      http_route("/api/echo", HTTP_ROUTE_EXACT, route_echo, "201 Created") != 0 ||
+      http_route("/api/silent", HTTP_ROUTE_EXACT, route_silent, NULL) != 0 ||
+      http_route("/api/huge", HTTP_ROUTE_EXACT, route_echo, huge_status) != 0) {
+    printf("http_route failed\n");
+    return 1;
+  }
+  // 先让协议栈认识对端
+  buf_init(&frame, sizeof(ether_hdr_t) + sizeof(arp_pkt_t));
+  ether_hdr_t *eth = (ether_hdr_t *) frame.data;
+  memcpy(eth->dst, net_broadcast_mac, NET_MAC_LEN);
+  memcpy(eth->src, peer_mac, NET_MAC_LEN);
+  eth->protocol16 = swap16(NET_PROTOCOL_ARP);
+  arp_pkt_t *arp = (arp_pkt_t *) (eth + 1);
+  memset(arp, 0, sizeof(arp_pkt_t));
+  arp->hw_type16 = swap16(ARP_HW_ETHER);
+  arp->pro_type16 = swap16(NET_PROTOCOL_IP);
+  arp->hw_len = NET_MAC_LEN;
+  arp->pro_len = NET_IP_LEN;
+  arp->opcode16 = swap16(ARP_REQUEST);
+  memcpy(arp->sender_mac, peer_mac, NET_MAC_LEN);
+  memcpy(arp->sender_ip, peer_ip, NET_IP_LEN);
+  memcpy(arp->target_ip, netif->ip, NET_IP_LEN);
+  ethernet_in(netif, &frame);
+
+  client_t *slow = &clients[0], *partial = &clients[1], *fast = &clients[2], *reset = &clients[3];
+  // 窗口只有2000字节且不确认，响应发出一个窗口后停下
+  client_connect(slow, 40001, 2000);
+  client_send(slow, (tcp_flags_t) {.ack = 1, .psh = 1},
+              "GET /img1.jpg HTTP/1.1\r\nHost: test\r\nConnection: close\r\n\r\n");
+  if (slow->len == 0 || slow->len > 2000 || slow->fin) {
+    printf("slow: %zu bytes before any ack, expected one window\n", slow->len);
+    failed = 1;
+  }
+  // 请求头分两次到达
+  client_connect(partial, 40002, UINT16_MAX);
+  client_send(partial, (tcp_flags_t) {.ack = 1, .psh = 1}, "GET /style.css HTTP/1.1\r\n");
+  if (partial->len) {
+    printf("partial: response before the header ended\n");
+    failed = 1;
+  }
+  // 以上两个连接都未完成时，其他连接照常得到响应
+  client_connect(fast, 40003, UINT16_MAX);
+  client_send(fast, (tcp_flags_t) {.ack = 1, .psh = 1}, "GET /index.html HTTP/1.1\r\nConnection: close\r\n\r\n");
+  failed |= client_check(fast, "fast", 200);
+  client_send(partial, (tcp_flags_t) {.ack = 1, .psh = 1}, "Host: test\r\nConnection: Close\r\n\r\n");
+  failed |= client_check(partial, "partial", 200);
+  // 每次确认后继续发送一个窗口
+  for (int i = 0; i < 100 && !slow->fin; i++)
+    client_send(slow, tcp_flags_ack, NULL);
+  failed |= client_check(slow, "slow", 200);
+  failed |= client_body_is(slow, "slow", XHTTP_DOC_DIR "/img1.jpg", 0, 0);
+
+  // 映射的范围按文件当前大小检查，偏移为负或超出文件末尾时拒绝
+  FILE *img = fopen(XHTTP_DOC_DIR "/img1.jpg", "rb");
+  struct stat st;
+  if (img && fstat(fileno(img), &st) == 0) {
+    tcp_connect_t mapped = {.state = TCP_ESTABLISHED};
+    if (tcp_connect_sendfile(&mapped, fileno(img), -1, 1) == 0 ||
+        tcp_connect_sendfile(&mapped, fileno(img), st.st_size - 10, 11) == 0 ||
+        tcp_connect_sendfile(&mapped, fileno(img), st.st_size + 1, 1) == 0 ||
+        tcp_connect_sendfile(&mapped, fileno(img), 1, SIZE_MAX) == 0) {
+      printf("sendfile: range outside the file accepted\n");
+      failed = 1;
+    }
+    if (tcp_connect_sendfile(&mapped, fileno(img), st.st_size - 10, 10) != 0 || mapped.tx_map_len != 10) {
+      printf("sendfile: the tail of the file rejected\n");
+      failed = 1;
+    } else {
+      munmap(mapped.tx_map_base, mapped.tx_map_size);
+    }
+  } else {
+    printf("sendfile: cannot open img1.jpg\n");
+    failed = 1;
+  }
+  if (img)
+    fclose(img);
+
+  // 响应途中复位，连接释放后服务器不再访问它，同一端口的新连接正常
+  client_connect(reset, 40004, 2000);
+  client_send(reset, (tcp_flags_t) {.ack = 1, .psh = 1}, "GET /img2.jpg HTTP/1.1\r\nConnection: close\r\n\r\n");
+  client_send(reset, (tcp_flags_t) {.rst = 1}, NULL);
+  client_connect(reset, 40004, UINT16_MAX);
+  // HTTP/1.0默认不保持连接
+  client_send(reset, (tcp_flags_t) {.ack = 1, .psh = 1}, "GET /missing.html HTTP/1.0\r\n\r\n");
+  failed |= client_check(reset, "reset", 404);
+
+  // 一个报文段里流水线发来两个请求，按序响应且保持连接，之后的请求要求关闭
+  client_t *keep = &clients[5];
+  int status[HTTP_KEEPALIVE_MAX + 1], close[HTTP_KEEPALIVE_MAX + 1];
+  client_connect(keep, 40006, UINT16_MAX);
+  client_send(keep, (tcp_flags_t) {.ack = 1, .psh = 1},
+              "GET /img3.jpg HTTP/1.1\r\nHost: test\r\n\r\nGET /missing.html HTTP/1.1\r\nHost: test\r\n\r\n");
+  // 映射发送的响应被确认后才开始下一个响应
+  if (client_responses(keep, status, close, 3) != 1) {
+    printf("keep-alive: next response before the mapped file was acked\n");
+    failed = 1;
+  }
+  client_send(keep, tcp_flags_ack, NULL);
+  if (client_responses(keep, status, close, 3) != 2 || status[0] != 200 || status[1] != 404 || close[0] ||
+      close[1] || keep->fin) {
+    printf("keep-alive: pipelined responses wrong (%zu bytes, fin %d)\n", keep->len, keep->fin);
+    failed = 1;
+  }
+  client_send(keep, (tcp_flags_t) {.ack = 1, .psh = 1}, "GET /page1.html HTTP/1.1\r\nConnection: close\r\n\r\n");
+  if (client_responses(keep, status, close, 4) != 3 || status[2] != 200 || !close[2] || !keep->fin) {
+    printf("keep-alive: close request not honoured (%zu bytes, fin %d)\n", keep->len, keep->fin);
+    failed = 1;
+  }
+
+  // 达到请求数上限后关闭
+  client_t *many = &clients[6];
+  client_connect(many, 40007, UINT16_MAX);
+  for (int i = 0; i < HTTP_KEEPALIVE_MAX && !many->fin; i++)
+    client_send(many, (tcp_flags_t) {.ack = 1, .psh = 1}, "GET /missing.html HTTP/1.1\r\n\r\n");
+  int n = client_responses(many, status, close, HTTP_KEEPALIVE_MAX + 1);
+  if (n != HTTP_KEEPALIVE_MAX || close[n - 2] || !close[n - 1] || !many->fin) {
+    printf("keep-alive: %d responses before close, expected %d\n", n, HTTP_KEEPALIVE_MAX);
+    failed = 1;
+  }
+
+  // 映射发送的响应未确认时流水线发来的请求留在接收缓存中，通告的窗口随之缩小，
+  // 超过缓存的段整段丢弃且不确认，连接不受影响；打开窗口后响应照常发出
+  client_t *flood = &clients[4];
+  char requests[1500] = "";
+  while (strlen(requests) + 30 < ETHERNET_MAX_TRANSPORT_UNIT - sizeof(ip_hdr_t) - sizeof(tcp_hdr_t))
+    strcat(requests, "GET /missing.html HTTP/1.1\r\n\r\n");
+  client_connect(flood, 40009, 0);
+  client_send(flood, (tcp_flags_t) {.ack = 1, .psh = 1}, "GET /img1.jpg HTTP/1.1\r\n\r\n");
+  uint16_t first_win = flood->peer_win;
+  int segments = 0;
+  for (; segments < 200 && flood->acked == flood->snd_nxt; segments++)
+    client_send(flood, (tcp_flags_t) {.ack = 1, .psh = 1}, requests);
+  if (first_win != UINT16_MAX || segments * strlen(requests) < BUF_MAX_LEN || flood->peer_win >= strlen(requests) ||
+      flood->rst || flood->len) {
+    printf("rx full: %d segments sent, window %u -> %u\n", segments, first_win, flood->peer_win);
+    failed = 1;
+  }
+  flood->snd_nxt = flood->acked;
+  flood->window = UINT16_MAX;
+  for (int i = 0; i < 1000 && !flood->fin; i++)
+    client_send(flood, tcp_flags_ack, NULL);
+  n = client_responses(flood, status, close, HTTP_KEEPALIVE_MAX + 1);
+  if (n != HTTP_KEEPALIVE_MAX || status[0] != 200 || status[1] != 404 || !flood->fin) {
+    printf("rx full: %d responses after the window opened\n", n);
+    failed = 1;
+  }
+
+  // 不发请求的连接在空闲超时后被关闭
+  client_t *idle = &clients[7];
+  client_connect(idle, 40008, UINT16_MAX);
+  http_server_run();
+  if (idle->fin) {
+    printf("idle: closed before the timeout\n");
+    failed = 1;
+  }
+  sleep(HTTP_KEEPALIVE_TIMEOUT + 1);
+  http_server_run();
+  if (!idle->fin) {
+    printf("idle: not closed after %d seconds\n", HTTP_KEEPALIVE_TIMEOUT);
+    failed = 1;
+  }
+
+  // 条件请求：验证器与当前文件相同时为304，没有响应体
+  client_t *cond = &clients[8];
+  char etag[64], date[64], request[256];
+  client_get(cond, 40010, "GET /index.html HTTP/1.1\r\nConnection: close\r\n\r\n");
+  failed |= client_check(cond, "validators", 200);
+  if (client_header(cond, "ETag", etag, sizeof(etag)) || client_header(cond, "Last-Modified", date, sizeof(date)) ||
+      !strstr(cond->data, "\r\nAccept-Ranges: bytes\r\n")) {
+    printf("validators: missing ETag, Last-Modified or Accept-Ranges\n");
+    return 1;
+  }
+  snprintf(request, sizeof(request), "GET /index.html HTTP/1.1\r\nIf-None-Match: %s\r\nConnection: close\r\n\r\n",
+           etag);
+  client_get(cond, 40011, request);
+  failed |= client_check(cond, "if-none-match", 304);
+  if (strstr(cond->data, "Content-Length") || !strstr(cond->data, etag)) {
+    printf("if-none-match: 304 with Content-Length or without ETag\n");
+    failed = 1;
+  }
+  snprintf(request, sizeof(request), "GET /page1.html HTTP/1.1\r\nIf-Modified-Since: %s\r\nConnection: close\r\n\r\n",
+           date);
+  client_get(cond, 40012, request);
+  failed |= client_check(cond, "if-modified-since", 304);
+  client_get(cond, 40013, "GET /index.html HTTP/1.1\r\nIf-None-Match: \"0-0\"\r\nConnection: close\r\n\r\n");
+  failed |= client_check(cond, "stale etag", 200);
+  failed |= client_body_is(cond, "stale etag", XHTTP_DOC_DIR "/index.html", 0, 0);
+
+  // 范围请求：缓存的文件与映射发送的文件，奇数起点，最后n个字节，多个范围按整个文件响应
+  client_t *range = &clients[9];
+  client_get(range, 40014, "GET /index.html HTTP/1.1\r\nRange: bytes=11-110\r\nConnection: close\r\n\r\n");
+  failed |= client_check(range, "cached range", 206);
+  failed |= client_body_is(range, "cached range", XHTTP_DOC_DIR "/index.html", 11, 100);
+  if (!strstr(range->data, "\r\nContent-Range: bytes 11-110/502\r\n")) {
+    printf("cached range: bad Content-Range\n");
+    failed = 1;
+  }
+  client_get(range, 40015, "GET /img2.jpg HTTP/1.1\r\nRange: bytes=1001-\r\nConnection: close\r\n\r\n");
+  failed |= client_check(range, "mapped range", 206);
+  failed |= client_body_is(range, "mapped range", XHTTP_DOC_DIR "/img2.jpg", 1001, 0);
+  client_get(range, 40016, "GET /img2.jpg HTTP/1.1\r\nRange: bytes=-333\r\nConnection: close\r\n\r\n");
+  failed |= client_check(range, "suffix range", 206);
+  failed |= client_body_is(range, "suffix range", XHTTP_DOC_DIR "/img2.jpg", 20699 - 333, 0);
+  client_get(range, 40017, "GET /img2.jpg HTTP/1.1\r\nRange: bytes=0-0,5-9\r\nConnection: close\r\n\r\n");
+  failed |= client_check(range, "multiple ranges", 200);
+  failed |= client_body_is(range, "multiple ranges", XHTTP_DOC_DIR "/img2.jpg", 0, 0);
+  snprintf(request, sizeof(request), "GET /index.html HTTP/1.1\r\nRange: bytes=0-9\r\nIf-Range: \"0-0\"\r\n"
+                                     "Connection: close\r\n\r\n");
+  client_get(range, 40018, request);
+  failed |= client_check(range, "stale if-range", 200);
+  client_get(range, 40019, "GET /index.html HTTP/1.1\r\nRange: bytes=502-\r\nConnection: close\r\n\r\n");
+  failed |= client_check(range, "unsatisfiable range", 416);
+  if (!strstr(range->data, "\r\nContent-Range: bytes */502\r\n")) {
+    printf("unsatisfiable range: bad Content-Range\n");
+    failed = 1;
+  }
+
+  // 按Accept-Encoding协商：没有.br时用.gz，q=0不接受，图片不协商
+  client_t *gzip = &clients[10];
+  client_get(gzip, 40020, "GET / HTTP/1.1\r\nAccept-Encoding: br, gzip\r\nConnection: close\r\n\r\n");
+  failed |= client_check(gzip, "gzip", 200);
+  failed |= client_body_is(gzip, "gzip", XHTTP_DOC_DIR "/index.html.gz", 0, 0);
+  if (!strstr(gzip->data, "\r\nContent-Encoding: gzip\r\n") || !strstr(gzip->data, "\r\nVary: Accept-Encoding\r\n")) {
+    printf("gzip: missing Content-Encoding or Vary\n");
+    failed = 1;
+  }
+  client_get(gzip, 40021, "GET /page1.html HTTP/1.1\r\nAccept-Encoding: gzip;q=0.5\r\nRange: bytes=0-9\r\n"
+                          "Connection: close\r\n\r\n");
+  failed |= client_check(gzip, "gzip range", 206);
+  failed |= client_body_is(gzip, "gzip range", XHTTP_DOC_DIR "/page1.html.gz", 0, 10);
+  client_get(gzip, 40022, "GET /page1.html HTTP/1.1\r\nAccept-Encoding: gzip;q=0, deflate\r\n"
+                          "Connection: close\r\n\r\n");
+  failed |= client_check(gzip, "identity", 200);
+  failed |= client_body_is(gzip, "identity", XHTTP_DOC_DIR "/page1.html", 0, 0);
+  if (strstr(gzip->data, "Content-Encoding") || !strstr(gzip->data, "\r\nVary: Accept-Encoding\r\n")) {
+    printf("identity: Content-Encoding without gzip or missing Vary\n");
+    failed = 1;
+  }
+  client_get(gzip, 40023, "GET /img1.jpg HTTP/1.1\r\nAccept-Encoding: gzip\r\nConnection: close\r\n\r\n");
+  failed |= client_check(gzip, "image", 200);
+  if (strstr(gzip->data, "Content-Encoding") || strstr(gzip->data, "Vary")) {
+    printf("image: negotiated encoding\n");
+    failed = 1;
+  }
+
+  // 解析失败的请求
+  client_t *bad = &clients[11];
+  client_get(bad, 40024, "GET / HTTP/1.1\r\nHost : test\r\n\r\nGET / HTTP/1.1\r\n\r\n");
+  failed |= client_check(bad, "malformed", 400);
+  client_get(bad, 40025, "POST / HTTP/1.1\r\nContent-Length: 0\r\n\r\n");
+  failed |= client_check(bad, "post", 501);
+  static char large[HTTP_REQUEST_MAX + 64] = "GET / HTTP/1.1\r\nX: ";
+  memset(large + strlen(large), 'x', HTTP_REQUEST_MAX);
+  client_get(bad, 40026, large);
+  failed |= client_check(bad, "too large", 431);
+
+  // 路由：精确匹配优先，其次最长前缀，都不匹配的交给静态文件
+  client_t *route = &clients[12];
+  client_get(route, 40027, "GET /api/echo?x=42 HTTP/1.1\r\nConnection: close\r\n\r\n");
+  failed |= client_check(route, "exact route", 201);
+  failed |= client_body_equals(route, "exact route", "x=42");
+  client_get(route, 40028, "GET /healthz HTTP/1.1\r\nConnection: close\r\n\r\n");
+  failed |= client_check(route, "health", 200);
+  failed |= client_body_equals(route, "health", "ok\n");
+  client_get(route, 40029, "GET /api HTTP/1.1\r\nConnection: close\r\n\r\n");
+  failed |= client_check(route, "static fallback", 404);
+  client_get(route, 40030, "GET /api/silent HTTP/1.1\r\nConnection: close\r\n\r\n");
+  failed |= client_check(route, "no response", 500);
+  // 响应头放不下时回复500并关闭连接，不发出截断的响应头
+  client_get(route, 40034, "GET /api/huge?x=42 HTTP/1.1\r\n\r\n");
+  failed |= client_check(route, "head too long", 500);
+  failed |= client_body_equals(route, "head too long", "");
+  // 前缀路由的流式响应，多次调用生产函数，HTTP/1.0下结束后关闭连接
+  client_get(route, 40031, "GET /api/echo/more HTTP/1.0\r\n\r\n");
+  failed |= client_check(route, "stream", 200);
+  char *body = strstr(route->data, "\r\n\r\n");
+  if (!body || strstr(route->data, "Content-Length") || strstr(route->data, "chunked") ||
+      route->len - (body + 4 - route->data) != 5000 || body[4] != 'a' + 5000 % 26 || stream_freed != 1) {
+    printf("stream: bad streamed body\n");
+    failed = 1;
+  }
+  // HTTP/1.1下分块发送，连接保持，之后流水线上的请求照常响应
+  client_connect(route, 40033, UINT16_MAX);
+  client_send(route, (tcp_flags_t) {.ack = 1, .psh = 1},
+              "GET /api/stream HTTP/1.1\r\n\r\nGET /healthz HTTP/1.1\r\nConnection: close\r\n\r\n");
+  for (int i = 0; i < 100 && !route->fin; i++)
+    client_send(route, tcp_flags_ack, NULL);
+  const char *next;
+  body = strstr(route->data, "\r\n\r\n");
+  if (client_responses(route, status, close, 3) != 2 || close[0] || !close[1] || status[1] != 200 ||
+      !strstr(route->data, "\r\nTransfer-Encoding: chunked\r\n") ||
+      client_chunked(body + 4, route->data + route->len, &next) != 5000 || stream_freed != 2) {
+    printf("chunked: bad chunked response (%zu bytes, fin %d)\n", route->len, route->fin);
+    failed = 1;
+  }
+  // 流式响应途中复位，生产函数得到通知
+  client_connect(route, 40032, 2000);
+  client_send(route, (tcp_flags_t) {.ack = 1, .psh = 1}, "GET /api/stream HTTP/1.1\r\n\r\n");
+  client_send(route, (tcp_flags_t) {.rst = 1}, NULL);
+  http_server_run();
+  if (stream_freed != 3) {
+    printf("stream: producer not told about the reset\n");
+    failed = 1;
+  }
+
+  // 连接数已满时新连接排队，队列也满时得到503；排队时复位的连接不占位置，同一端口的新连接照常排队
+  client_t *busy = &clients[13], *queued = &clients[17], *dropped = &clients[18], *rejected = &clients[19];
+  for (int i = 0; i < HTTP_CONN_MAX; i++)
+    client_connect(&busy[i], 40040 + i, UINT16_MAX);
+  client_connect(queued, 40044, UINT16_MAX);
+  client_send(queued, (tcp_flags_t) {.ack = 1, .psh = 1}, "GET /healthz HTTP/1.1\r\nConnection: close\r\n\r\n");
+  client_connect(dropped, 40045, UINT16_MAX);
+  client_connect(rejected, 40046, UINT16_MAX);
+  failed |= client_check(rejected, "overload", 503);
+  client_send(dropped, (tcp_flags_t) {.rst = 1}, NULL);
+  client_connect(dropped, 40045, UINT16_MAX);
+  if (queued->len || dropped->len || dropped->fin) {
+    printf("overload: queued connections answered before a slot was free\n");
+    failed = 1;
+  }
+  // 有空位后按到达顺序接受，排队时收到的请求得到响应
+  for (int i = 0; i < HTTP_CONN_MAX; i++) {
+    client_send(&busy[i], (tcp_flags_t) {.ack = 1, .psh = 1}, "GET /healthz HTTP/1.1\r\nConnection: close\r\n\r\n");
+    for (int j = 0; j < 100 && !busy[i].fin; j++)
+      client_send(&busy[i], tcp_flags_ack, NULL);
+    failed |= client_check(&busy[i], "busy", 200);
+  }
+  for (int i = 0; i < 100 && !queued->fin; i++)
+    client_send(queued, tcp_flags_ack, NULL);
+  failed |= client_check(queued, "queued", 200);
+  client_send(dropped, (tcp_flags_t) {.ack = 1, .psh = 1}, "GET /healthz HTTP/1.1\r\nConnection: close\r\n\r\n");
+  for (int i = 0; i < 100 && !dropped->fin; i++)
+    client_send(dropped, tcp_flags_ack, NULL);
+  failed |= client_check(dropped, "requeued", 200);
+
+  // 只剩指标请求自己的连接
+  client_t *metrics = &clients[4];
+  client_connect(metrics, 40005, UINT16_MAX);
+  client_send(metrics, (tcp_flags_t) {.ack = 1, .psh = 1}, "GET /metrics HTTP/1.1\r\nConnection: close\r\n\r\n");
+  failed |= client_check(metrics, "metrics", 200);
+  if (!strstr(metrics->data, "\nhttp_connections 1\n")) {
+    printf("metrics: connections not released\n");
+    failed = 1;
+  }
+  if (!strstr(metrics->data, "\nhttp_accept_queue_used 0\n") ||
+      !strstr(metrics->data, "\nhttp_accept_queue_peak 2\n") ||
+      !strstr(metrics->data, "\nhttp_accept_rejected_total 1\n") ||
+      !strstr(metrics->data, "\nhttp_accept_dropped_total 1\n")) {
+    printf("metrics: accept queue not accounted\n");
+    failed = 1;
+  }
+  if (bad_checksums) {
+    printf("%d segments with bad checksum\n", bad_checksums);
+    failed = 1;
+  }
+  return failed;
+}
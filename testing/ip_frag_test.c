@@ -32,7 +32,10 @@ int main(int argc, char *argv[]) {
     buf.len++;
   }
   Log("Feeding input.");
-  ip_out(&buf, net_if_ip, NET_PROTOCOL_TCP);
+  uint8_t if_ip[] = NET_IF_IP;
+  uint8_t if_mac[] = NET_IF_MAC;
+  netif_t *netif = netif_add(NULL, if_ip, if_mac, NULL);
+  ip_out(netif, &buf, netif->ip, NET_PROTOCOL_TCP);
 
   fclose(in);
   fclose(control_flow);
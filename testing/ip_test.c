@@ -52,9 +52,10 @@ int main(int argc, char *argv[]) {
   arp_log_f = control_flow;
 
   net_init();
+  netif_t *netif = netif_get(0);
   log_tab_buf();
   int i = 1;
-  while ((ret = driver_recv(&buf)) > 0) {
+  while ((ret = driver_recv(netif, &buf)) > 0) {
     Log("Feeding input %02d", i);
     fprintf(control_flow, "\nRound %02d -----------------------------\n", i++);
     if (memcmp(buf.data, my_mac, 6) && memcmp(buf.data, boardcast_mac, 6)) {
@@ -68,16 +69,16 @@ int main(int argc, char *argv[]) {
       memset(buf2.data, 0, len);
       buf_remove_header(&buf2, len);
       // printf("ip_out: hd_len:%d\tip:%s\tpro:%d\n",len,print_ip(ip),pro);
-      ip_out(&buf2, ip, pro);
+      ip_out(netif, &buf2, ip, pro);
     } else {
-      ethernet_in(&buf);
+      ethernet_in(netif, &buf);
     }
     log_tab_buf();
   }
   if (ret < 0) {
     Err("Error occur on loading input,exiting");
   }
-  driver_close();
+  driver_close(netif);
   Ok("Sample input all processed, checking output");
 
   fclose(control_flow);
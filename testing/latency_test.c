@@ -0,0 +1,98 @@
+//
+// 延迟直方图测试：检查对数线性分桶的分位数误差，以及ping与udp回显经过协议栈时各层的打点
+//
+
+#include <stdio.h>
+#include "ethernet.h"
+#include "arp.h"
+#include "ip.h"
+#include "icmp.h"
+#include "udp.h"
+#include "latency.h"
+#include "fixture.h"
+
+#define LATENCY_TEST_NUM 10000
+
+static netif_t *netif;
+
+static void echo_handler(netif_t *netif, uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port) {
+  udp_send(netif, data, len, 60000, src_ip, src_port);
+}
+
+static int expect_count(latency_path_t path, latency_stage_t stage, uint64_t count) {
+  latency_hist_t hist;
+  latency_snapshot(&hist, path, stage);
+  if (hist.count == count)
+    return 0;
+  printf("%s %s: %llu samples, expected %llu\n", latency_path_name(path), latency_stage_name(stage),
+         (unsigned long long) hist.count, (unsigned long long) count);
+  return 1;
+}
+
+int main(int argc, char **argv) {
+  int failed = 0;
+  static latency_hist_t hist;
+  // 1..LATENCY_TEST_NUM各记录一次，分位数不小于真实值，且相对误差不超过1/16
+  for (uint64_t i = 1; i <= LATENCY_TEST_NUM; i++)
+    latency_hist_record(&hist, i * 1000);
+  double qs[] = {0.5, 0.99, 0.999, 1};
+  for (size_t i = 0; i < sizeof(qs) / sizeof(qs[0]); i++) {
+    uint64_t exact = (uint64_t) (qs[i] * LATENCY_TEST_NUM) * 1000;
+    uint64_t got = latency_hist_quantile(&hist, qs[i]);
+    printf("p%g: %llu (exact %llu)\n", qs[i] * 100, (unsigned long long) got, (unsigned long long) exact);
+    if (got < exact || got > exact + exact / 16) {
+      printf("  quantile out of bucket error\n");
+      failed = 1;
+    }
+  }
+  latency_hist_t small = {0};
+  latency_hist_record(&small, 3);
+  latency_hist_record(&small, (uint64_t) 1 << 50);
+  if (latency_hist_quantile(&small, 0.5) != 3 || latency_hist_quantile(&small, 1) != (uint64_t) 1 << 50) {
+    printf("small or overflowing values misplaced\n");
+    failed = 1;
+  }
+
+  if (net_init() != 0)
+    return -1;
+  netif = netif_get(0);
+  udp_open(60000, echo_handler);
+  // 先让协议栈认识对端，回复时arp命中
+  fixture_arp_request(netif);
+
+  for (int i = 0; i < 100; i++) {
+    icmp_hdr_t *icmp = (icmp_hdr_t *) fixture_ip(netif, netif->ip, NET_PROTOCOL_ICMP, sizeof(icmp_hdr_t));
+    icmp->type = ICMP_TYPE_ECHO_REQUEST;
+    icmp->checksum16 = checksum16((uint16_t *) icmp, sizeof(icmp_hdr_t));
+    ethernet_in(netif, &fixture_frame);
+    udp_hdr_t *udp = (udp_hdr_t *) fixture_ip(netif, netif->ip, NET_PROTOCOL_UDP, sizeof(udp_hdr_t) + 4);
+    udp->src_port16 = swap16(1234);
+    udp->dst_port16 = swap16(60000);
+    udp->total_len16 = swap16(sizeof(udp_hdr_t) + 4);
+    ethernet_in(netif, &fixture_frame);
+  }
+  // 目的端口没有处理程序的包没有回复，不计入
+  udp_hdr_t *udp = (udp_hdr_t *) fixture_ip(netif, netif->ip, NET_PROTOCOL_UDP, sizeof(udp_hdr_t));
+  udp->dst_port16 = swap16(60001);
+  udp->total_len16 = swap16(sizeof(udp_hdr_t));
+  ethernet_in(netif, &fixture_frame);
+
+  for (int stage = 0; stage < LATENCY_STAGE_NUM; stage++) {
+    failed |= expect_count(LATENCY_PATH_ICMP_ECHO, stage, 100);
+    failed |= expect_count(LATENCY_PATH_UDP_ECHO, stage, 100);
+    failed |= expect_count(LATENCY_PATH_TCP_DATA, stage, 0);
+  }
+  // 各打点相对ethernet_in入口，每个样本依次不减，分位数也不减
+  uint64_t prev = 0;
+  for (int stage = 0; stage < LATENCY_STAGE_NUM; stage++) {
+    latency_snapshot(&hist, LATENCY_PATH_UDP_ECHO, stage);
+    uint64_t p50 = latency_hist_quantile(&hist, 0.5);
+    if (p50 < prev) {
+      printf("udp_echo %s earlier than previous stage\n", latency_stage_name(stage));
+      failed = 1;
+    }
+    prev = p50;
+  }
+  latency_dump(stdout);
+  return failed;
+}
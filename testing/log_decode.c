@@ -0,0 +1,34 @@
+//
+// 离线解码main -l导出的二进制日志
+// 用法: log_decode log.bin [out.txt]
+//
+
+#include <stdio.h>
+#include "log.h"
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s log.bin [out.txt]\n", argv[0]);
+    return -1;
+  }
+  FILE *in = fopen(argv[1], "rb");
+  if (!in) {
+    fprintf(stderr, "log_decode: cannot read %s\n", argv[1]);
+    return -1;
+  }
+  FILE *out = stdout;
+  if (argc > 2 && !(out = fopen(argv[2], "w"))) {
+    fprintf(stderr, "log_decode: cannot write %s\n", argv[2]);
+    return -1;
+  }
+  long count = log_decode(in, out);
+  fclose(in);
+  if (out != stdout)
+    fclose(out);
+  if (count < 0) {
+    fprintf(stderr, "log_decode: %s is not a log dump\n", argv[1]);
+    return -1;
+  }
+  fprintf(stderr, "log_decode: %ld records\n", count);
+  return 0;
+}
@@ -0,0 +1,85 @@
+//
+// 环形缓冲日志测试：写入各类参数，导出后解码，检查格式化结果、覆盖与被过滤的日志点
+//
+
+#include <stdio.h>
+#include <string.h>
+#include "log.h"
+
+static char text[1 << 20];
+static int evaluated;
+
+static int side_effect() {
+  evaluated++;
+  return 1;
+}
+
+/**
+ * @brief 导出当前所有记录并解码到text
+ *
+ * @return long 解码的记录数
+ */
+static long dump_decode() {
+  FILE *dump = tmpfile(), *out = tmpfile();
+  int count = log_dump(dump);
+  rewind(dump);
+  long decoded = log_decode(dump, out);
+  rewind(out);
+  text[fread(text, 1, sizeof(text) - 1, out)] = '\0';
+  fclose(dump);
+  fclose(out);
+  return decoded == count ? decoded : -1;
+}
+
+static int expect(const char *want, int present) {
+  if (!strstr(text, want) == !present)
+    return 0;
+  fprintf(stderr, "log_test: %s \"%s\"\n", present ? "missing" : "unexpected", want);
+  return 1;
+}
+
+int main() {
+  int fail = 0;
+  uint8_t ip[] = {192, 168, 163, 103};
+  uint8_t mac[] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66};
+  char name[] = "eth0";
+  Log("ip %s mac %s", LOG_IP(ip), LOG_MAC(mac));
+  Err("if %s len=%zu seq=%u win=%d", name, (size_t) 1500, 4000000000u, -7);
+  name[0] = 'X'; // 写入时已复制字符串，之后的修改不影响记录
+  Ok("rate %.2f%%", 99.5);
+  Dbg("no args");
+  // 低于编译级别的日志点连同参数一起被去除
+#undef Dbg
+#define Dbg(...) LOG_UNUSED(__VA_ARGS__)
+  Dbg("filtered %d", side_effect());
+
+  if (dump_decode() != 4) {
+    fprintf(stderr, "log_test: expected 4 records\n");
+    return 1;
+  }
+  fail += expect(" INFO ", 1);
+  fail += expect("log_test.c:46: ip 192.168.163.103 mac 11-22-33-44-55-66\n", 1);
+  fail += expect(" ERR  ", 1);
+  fail += expect(": if eth0 len=1500 seq=4000000000 win=-7\n", 1);
+  fail += expect(": rate 99.50%\n", 1);
+  fail += expect(" DBG  ", 1);
+  fail += expect(": no args\n", 1);
+  fail += expect("filtered", 0);
+  fail += evaluated;
+
+  // 写满后覆盖最旧的记录
+  for (int i = 0; i < LOG_RING_SIZE + 4; i++)
+    Log("wrap %d", i);
+  if (dump_decode() != LOG_RING_SIZE) {
+    fprintf(stderr, "log_test: expected %d records\n", LOG_RING_SIZE);
+    return 1;
+  }
+  fail += expect(": no args\n", 0);
+  fail += expect(": wrap 3\n", 0);
+  fail += expect(": wrap 4\n", 1);
+  fail += expect(": wrap 4099\n", 1);
+  if (fail)
+    return 1;
+  printf("log_test: ok\n");
+  return 0;
+}
@@ -0,0 +1,114 @@
+//
+// map测试：查找只扫描到曾使用过的最高位置top；删除与超时清理空出的位置在top之下被复用，
+// 复用不抬高top，top之下的其他键仍能找到；填满时最后一个位置上的键也能找到；
+// 超时未清理的位置被复用前调用超时回调，size不重复计数
+//
+
+#include <stdio.h>
+#include <string.h>
+#include "map.h"
+
+#define MAP_TEST_SIZE 8
+
+static int failed;
+static int visited;
+
+static void expect(int cond, const char *name) {
+  if (!cond) {
+    printf("%s: failed\n", name);
+    failed = 1;
+  }
+}
+
+static void count_entry(void *key, void *value, time_t *timestamp) {
+  visited++;
+}
+
+static int stale_key;
+
+/**
+ * @brief 把stale_key的更新时间往前拨，使其超时
+ *
+ */
+static void age_entry(void *key, void *value, time_t *timestamp) {
+  if (*(int *) key == stale_key)
+    *timestamp -= 10;
+}
+
+static int expired;
+
+static void expire_entry(void *key, void *value, time_t *timestamp) {
+  expired = *(int *) key;
+}
+
+static int value_of(map_t *map, int key) {
+  int *value = map_get(map, &key);
+  return value ? *value : -1;
+}
+
+/**
+ * @brief 删除后在top之下复用
+ *
+ */
+static void test_delete_reuse() {
+  static map_t map;
+  map_init(&map, sizeof(int), sizeof(int), MAP_TEST_SIZE, 0, NULL);
+  for (int key = 1; key <= 5; key++) {
+    int value = key * 10;
+    map_set(&map, &key, &value);
+  }
+  expect(map.top == 5 && map_size(&map) == 5, "top after insert");
+  int key = 2, value = 90;
+  map_delete(&map, &key);
+  expect(value_of(&map, 2) == -1 && value_of(&map, 5) == 50, "delete");
+  key = 9;
+  map_set(&map, &key, &value);
+  expect(map.top == 5 && map_size(&map) == 5, "reuse below top");
+  expect(value_of(&map, 9) == 90 && value_of(&map, 1) == 10 && value_of(&map, 5) == 50, "get after reuse");
+  // 删除top处的键，top不回退，其下的键仍然可见
+  key = 5;
+  map_delete(&map, &key);
+  expect(value_of(&map, 5) == -1 && value_of(&map, 4) == 40, "delete top");
+  visited = 0;
+  map_foreach(&map, count_entry);
+  expect(visited == 4, "foreach");
+  // 填满后最后一个位置上的键也能找到
+  for (key = 10; map_size(&map) < MAP_TEST_SIZE; key++)
+    map_set(&map, &key, &key);
+  expect(map.top == MAP_TEST_SIZE && value_of(&map, key - 1) == key - 1, "full");
+  expect(map_set(&map, &key, &key) == -1, "overflow");
+}
+
+/**
+ * @brief 超时清理后在top之下复用
+ *
+ */
+static void test_expire_reuse() {
+  static map_t map;
+  map_init(&map, sizeof(int), sizeof(int), MAP_TEST_SIZE, 5, NULL);
+  map_on_expire(&map, expire_entry);
+  for (int key = 1; key <= 3; key++)
+    map_set(&map, &key, &key);
+  stale_key = 2;
+  map_foreach(&map, age_entry);
+  expect(value_of(&map, 2) == -1, "timed out entry hidden");
+  map_expire(&map);
+  expect(expired == 2 && map_size(&map) == 2, "expire");
+  int key = 7;
+  map_set(&map, &key, &key);
+  expect(map.top == 3 && map_size(&map) == 3, "reuse expired slot");
+  expect(value_of(&map, 7) == 7 && value_of(&map, 1) == 1 && value_of(&map, 3) == 3, "get after expire");
+  // 超时后没有清理就被复用，先调用回调释放旧值，size不重复计数
+  stale_key = 1;
+  map_foreach(&map, age_entry);
+  key = 8;
+  map_set(&map, &key, &key);
+  expect(expired == 1 && map_size(&map) == 3 && map.top == 3, "reuse unswept slot");
+  expect(value_of(&map, 8) == 8 && value_of(&map, 1) == -1, "get after reuse");
+}
+
+int main() {
+  test_delete_reuse();
+  test_expire_reuse();
+  return failed;
+}
@@ -0,0 +1,299 @@
+//
+// 离线回放pcap的全协议栈性能测试，日志在编译时去除
+// 用法: net_bench [-r 重复次数] [-i ip,mac] [-j 输出json文件] file.pcap...
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "driver.h"
+#include "ethernet.h"
+#include "ip.h"
+#include "udp.h"
+#include "tcp.h"
+#include "latency.h"
+
+#define BENCH_PCAP_MAGIC 0xa1b2c3d4      // pcap文件魔数，微秒时间戳
+#define BENCH_PCAP_MAGIC_NS 0xa1b23c4d   // pcap文件魔数，纳秒时间戳
+#define BENCH_LINKTYPE_ETHERNET 1
+
+typedef enum bench_proto { //按协议分类统计
+  BENCH_ARP,
+  BENCH_ICMP,
+  BENCH_UDP,
+  BENCH_TCP,
+  BENCH_OTHER,
+  BENCH_PROTO_NUM,
+} bench_proto_t;
+
+static const char *bench_proto_name[BENCH_PROTO_NUM] = {"arp", "icmp", "udp", "tcp", "other"};
+
+typedef struct bench_frame { //内存中的一帧
+  uint32_t len;
+  bench_proto_t proto;
+  uint8_t *data;
+} bench_frame_t;
+
+static bench_frame_t *frames;
+static size_t frame_num, frame_cap;
+static size_t frame_next;        // 下一个回放的帧
+static size_t tx_packets;
+
+static size_t alloc_count;       // malloc、calloc、realloc调用次数
+static int alloc_counting;       // 只统计回放期间的分配
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+  alloc_count += alloc_counting;
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size) {
+  alloc_count += alloc_counting;
+  return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+  alloc_count += alloc_counting;
+  return __real_realloc(ptr, size);
+}
+
+static uint32_t pcap_u32(uint32_t x, int swapped) {
+  return swapped ? swap32(x) : x;
+}
+
+/**
+ * @brief 根据以太网类型与ip协议号分类
+ *
+ */
+static bench_proto_t bench_classify(const uint8_t *data, size_t len) {
+  if (len < sizeof(ether_hdr_t))
+    return BENCH_OTHER;
+  const ether_hdr_t *eth = (const ether_hdr_t *) data;
+  if (eth->protocol16 == constswap16(NET_PROTOCOL_ARP))
+    return BENCH_ARP;
+  if (eth->protocol16 != constswap16(NET_PROTOCOL_IP) || len < sizeof(ether_hdr_t) + sizeof(ip_hdr_t))
+    return BENCH_OTHER;
+  switch (((const ip_hdr_t *) (data + sizeof(ether_hdr_t)))->protocol) {
+    case NET_PROTOCOL_ICMP:
+      return BENCH_ICMP;
+    case NET_PROTOCOL_UDP:
+      return BENCH_UDP;
+    case NET_PROTOCOL_TCP:
+      return BENCH_TCP;
+    default:
+      return BENCH_OTHER;
+  }
+}
+
+/**
+ * @brief 把pcap文件中的所有以太网帧读入内存
+ *
+ * @param path 文件路径
+ * @return int 成功为0，失败为-1
+ */
+static int bench_load(const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    fprintf(stderr, "net_bench: cannot open %s\n", path);
+    return -1;
+  }
+  uint32_t global[6];
+  if (fread(global, sizeof(global), 1, f) != 1) {
+    fprintf(stderr, "net_bench: %s is not a pcap file\n", path);
+    fclose(f);
+    return -1;
+  }
+  int swapped = global[0] == swap32(BENCH_PCAP_MAGIC) || global[0] == swap32(BENCH_PCAP_MAGIC_NS);
+  if (pcap_u32(global[0], swapped) != BENCH_PCAP_MAGIC && pcap_u32(global[0], swapped) != BENCH_PCAP_MAGIC_NS) {
+    fprintf(stderr, "net_bench: %s is not a pcap file\n", path);
+    fclose(f);
+    return -1;
+  }
+  if (pcap_u32(global[5], swapped) != BENCH_LINKTYPE_ETHERNET) {
+    fprintf(stderr, "net_bench: %s is not an ethernet capture\n", path);
+    fclose(f);
+    return -1;
+  }
+  uint32_t record[4];
+  while (fread(record, sizeof(record), 1, f) == 1) {
+    uint32_t caplen = pcap_u32(record[2], swapped);
+    if (frame_num == frame_cap) {
+      frame_cap = frame_cap ? frame_cap * 2 : 1024;
+      frames = realloc(frames, frame_cap * sizeof(bench_frame_t));
+    }
+    bench_frame_t *frame = &frames[frame_num];
+    frame->data = malloc(caplen);
+    if (fread(frame->data, 1, caplen, f) != caplen) {
+      free(frame->data);
+      break;
+    }
+    frame->len = caplen;
+    frame->proto = bench_classify(frame->data, caplen);
+    if (caplen <= ETHERNET_MAX_TRANSPORT_UNIT + sizeof(ether_hdr_t))
+      frame_num++;
+    else
+      free(frame->data);
+  }
+  fclose(f);
+  return 0;
+}
+
+static int bench_driver_open(netif_t *netif) {
+  return 0;
+}
+
+/**
+ * @brief 按顺序回放内存中的帧，与真实驱动一样拷贝到接收缓冲
+ *
+ */
+static int bench_driver_recv(netif_t *netif, buf_t *buf) {
+  if (frame_next == frame_num)
+    return 0;
+  bench_frame_t *frame = &frames[frame_next++];
+  buf_init(buf, frame->len);
+  memcpy(buf->data, frame->data, frame->len);
+  return frame->len;
+}
+
+/**
+ * @brief 丢弃发出的帧，只计数
+ *
+ */
+static int bench_driver_send(netif_t *netif, buf_t *buf) {
+  tx_packets++;
+  return 0;
+}
+
+static void bench_driver_close(netif_t *netif) {
+}
+
+const driver_ops_t driver_pcap_ops = {
+    .name = "bench",
+    .open = bench_driver_open,
+    .recv = bench_driver_recv,
+    .send = bench_driver_send,
+    .close = bench_driver_close,
+};
+
+static void bench_udp_handler(netif_t *netif, uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port) {
+  udp_send(netif, data, len, 60000, src_ip, src_port);
+}
+
+static void bench_tcp_handler(tcp_connect_t *connect, connect_state_t state) {
+  uint8_t buf[512];
+  size_t len = tcp_connect_read(connect, buf, sizeof(buf));
+  if (len)
+    tcp_connect_write(connect, buf, len);
+}
+
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[]) {
+  size_t repeat = 1;
+  const char *json_path = NULL;
+  uint8_t ip[NET_IP_LEN] = NET_IF_IP;
+  uint8_t mac[NET_MAC_LEN] = NET_IF_MAC;
+  int i;
+  for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+    if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+      repeat = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+      json_path = argv[++i];
+    } else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+      unsigned int a[NET_IP_LEN], m[NET_MAC_LEN];
+      if (sscanf(argv[++i], "%u.%u.%u.%u,%x:%x:%x:%x:%x:%x", &a[0], &a[1], &a[2], &a[3],
+                 &m[0], &m[1], &m[2], &m[3], &m[4], &m[5]) != NET_IP_LEN + NET_MAC_LEN)
+        break;
+      for (int j = 0; j < NET_IP_LEN; j++) ip[j] = a[j];
+      for (int j = 0; j < NET_MAC_LEN; j++) mac[j] = m[j];
+    } else {
+      break;
+    }
+  }
+  if (i >= argc || argv[i][0] == '-') {
+    fprintf(stderr, "usage: %s [-r repeat] [-i ip,mac] [-j out.json] file.pcap...\n", argv[0]);
+    return -1;
+  }
+  for (; i < argc; i++)
+    if (bench_load(argv[i]) != 0)
+      return -1;
+  if (!frame_num) {
+    fprintf(stderr, "net_bench: no frames loaded\n");
+    return -1;
+  }
+
+  netif_add("bench", ip, mac, &driver_pcap_ops);
+  net_init();
+  udp_open(60000, bench_udp_handler);
+  tcp_open(61000, bench_tcp_handler);
+  netif_t *netif = netif_get(0);
+
+  // 分协议用周期计时，结束时用总耗时把周期换算为纳秒
+  uint64_t proto_cycles[BENCH_PROTO_NUM] = {0};
+  size_t proto_packets[BENCH_PROTO_NUM] = {0};
+  size_t packets = 0;
+  tx_packets = 0;
+  alloc_count = 0;
+  alloc_counting = 1;
+  double start_ns = now_ns();
+  uint64_t start_cycles = cycles_now();
+  for (size_t r = 0; r < repeat; r++) {
+    for (frame_next = 0; frame_next < frame_num;) {
+      bench_proto_t proto = frames[frame_next].proto;
+      uint64_t t = cycles_now();
+      if (driver_recv(netif, &netif->rxbuf) <= 0)
+        break;
+      ethernet_in(netif, &netif->rxbuf);
+      proto_cycles[proto] += cycles_now() - t;
+      proto_packets[proto]++;
+      packets++;
+    }
+  }
+  uint64_t total_cycles = cycles_now() - start_cycles;
+  double total_ns = now_ns() - start_ns;
+  alloc_counting = 0;
+  double ns_per_cycle = total_cycles ? total_ns / total_cycles : 0;
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  FILE *out = stdout;
+  if (json_path && !(out = fopen(json_path, "w"))) {
+    fprintf(stderr, "net_bench: cannot write %s\n", json_path);
+    return -1;
+  }
+  fprintf(out, "{\n");
+  fprintf(out, "  \"frames\": %zu,\n  \"repeat\": %zu,\n  \"packets\": %zu,\n  \"tx_packets\": %zu,\n",
+          frame_num, repeat, packets, tx_packets);
+  fprintf(out, "  \"seconds\": %.6f,\n  \"pps\": %.0f,\n  \"ns_per_packet\": %.1f,\n", total_ns / 1e9,
+          packets / (total_ns / 1e9), total_ns / packets);
+  fprintf(out, "  \"cycles_per_packet\": %.1f,\n", (double) total_cycles / packets);
+  fprintf(out, "  \"allocs_per_packet\": %.3f,\n", (double) alloc_count / packets);
+  fprintf(out, "  \"peak_rss_kb\": %ld,\n", usage.ru_maxrss);
+  fprintf(out, "  \"protocols\": {");
+  const char *sep = "";
+  for (int p = 0; p < BENCH_PROTO_NUM; p++) {
+    if (!proto_packets[p])
+      continue;
+    fprintf(out, "%s\n    \"%s\": {\"packets\": %zu, \"ns_per_packet\": %.1f}", sep, bench_proto_name[p],
+            proto_packets[p], proto_cycles[p] * ns_per_cycle / proto_packets[p]);
+    sep = ",";
+  }
+  fprintf(out, "\n  }\n}\n");
+  if (out != stdout)
+    fclose(out);
+#ifdef NET_LATENCY
+  latency_dump(stderr);
+#endif
+  driver_close(netif);
+  return 0;
+}
@@ -0,0 +1,129 @@
+//
+// 多网卡测试：不在任何本地子网的对端经第二块网卡发来ping、udp与tcp SYN，
+// 回复都从收到的网卡发出，源ip是该网卡的ip，校验和按该ip计算；
+// 等不到arp响应的待发送包在ARP_MIN_INTERVAL后被丢弃，缓冲还回缓冲池
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "driver.h"
+#include "ethernet.h"
+#include "arp.h"
+#include "ip.h"
+#include "icmp.h"
+#include "udp.h"
+#include "tcp.h"
+#include "stats.h"
+#include "fixture.h"
+
+static int failed;
+static netif_t *if0, *if1;
+static int replies[NET_PROTOCOL_UDP + 1];
+
+static void expect(int cond, const char *name) {
+  if (!cond) {
+    printf("%s: failed\n", name);
+    failed = 1;
+  }
+}
+
+static int netif_test_open(netif_t *netif) {
+  return 0;
+}
+
+static int netif_test_recv(netif_t *netif, buf_t *buf) {
+  return 0;
+}
+
+/**
+ * @brief 检查发出的ip包：出口网卡、源ip与传输层校验和
+ *
+ */
+static int netif_test_send(netif_t *netif, buf_t *buf) {
+  ether_hdr_t *eth = (ether_hdr_t *) buf->data;
+  if (eth->protocol16 != constswap16(NET_PROTOCOL_IP))
+    return 0;
+  ip_hdr_t *ip = (ip_hdr_t *) (eth + 1);
+  size_t len = swap16(ip->total_len16) - sizeof(ip_hdr_t);
+  expect(netif == if1, "reply interface");
+  expect(memcmp(ip->src_ip, if1->ip, NET_IP_LEN) == 0, "source ip");
+  // 带伪首部重新计算，结果为0
+  static uint8_t scratch[sizeof(tcp_peso_hdr_t) + ETHERNET_MAX_TRANSPORT_UNIT];
+  tcp_peso_hdr_t *peso = (tcp_peso_hdr_t *) scratch;
+  memcpy(peso->src_ip, ip->src_ip, NET_IP_LEN);
+  memcpy(peso->dst_ip, ip->dst_ip, NET_IP_LEN);
+  peso->placeholder = 0;
+  peso->protocol = ip->protocol;
+  peso->total_len16 = swap16(len);
+  memcpy(peso + 1, ip + 1, len);
+  if (ip->protocol == NET_PROTOCOL_ICMP)
+    expect(checksum16((uint16_t *) (ip + 1), len) == 0, "icmp checksum");
+  else
+    expect(checksum16((uint16_t *) scratch, sizeof(tcp_peso_hdr_t) + len) == 0, "checksum");
+  if (ip->protocol <= NET_PROTOCOL_UDP)
+    replies[ip->protocol]++;
+  return 0;
+}
+
+static void netif_test_close(netif_t *netif) {
+}
+
+static const driver_ops_t netif_test_ops = {"netif", netif_test_open, netif_test_recv, netif_test_send,
+                                            netif_test_close};
+
+static void udp_echo(netif_t *netif, uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port) {
+  udp_send(netif, data, len, 60000, src_ip, src_port);
+}
+
+static void tcp_ignore(tcp_connect_t *connect, connect_state_t state) {
+}
+
+int main() {
+  uint8_t ip0[NET_IP_LEN] = {10, 0, 0, 1}, mac0[NET_MAC_LEN] = {0x02, 0, 0, 0, 0, 1};
+  uint8_t ip1[NET_IP_LEN] = {10, 1, 0, 1}, mac1[NET_MAC_LEN] = {0x02, 0, 0, 0, 0, 2};
+  if0 = netif_add("if0", ip0, mac0, &netif_test_ops);
+  if1 = netif_add("if1", ip1, mac1, &netif_test_ops);
+  if (net_init() != 0 || udp_open(60000, udp_echo) != 0 || tcp_open(61000, tcp_ignore) != 0)
+    return 1;
+
+  // 先让协议栈认识对端
+  fixture_arp_request(if1);
+
+  icmp_hdr_t *icmp = (icmp_hdr_t *) fixture_ip(if1, if1->ip, NET_PROTOCOL_ICMP, sizeof(icmp_hdr_t) + 8);
+  icmp->type = ICMP_TYPE_ECHO_REQUEST;
+  icmp->checksum16 = checksum16((uint16_t *) icmp, sizeof(icmp_hdr_t) + 8);
+  ethernet_in(if1, &fixture_frame);
+
+  udp_hdr_t *udp = (udp_hdr_t *) fixture_ip(if1, if1->ip, NET_PROTOCOL_UDP, sizeof(udp_hdr_t) + 5);
+  udp->src_port16 = swap16(5000);
+  udp->dst_port16 = swap16(60000);
+  udp->total_len16 = swap16(sizeof(udp_hdr_t) + 5);
+  memcpy(udp + 1, "hello", 5);
+  udp->checksum16 = fixture_checksum(if1->ip, NET_PROTOCOL_UDP, (uint8_t *) udp, sizeof(udp_hdr_t) + 5);
+  ethernet_in(if1, &fixture_frame);
+
+  tcp_hdr_t *tcp = (tcp_hdr_t *) fixture_ip(if1, if1->ip, NET_PROTOCOL_TCP, sizeof(tcp_hdr_t));
+  tcp->src_port16 = swap16(5001);
+  tcp->dst_port16 = swap16(61000);
+  tcp->seq_number32 = swap32(1000);
+  tcp->data_offset = sizeof(tcp_hdr_t) / sizeof(uint32_t);
+  tcp->flags = (tcp_flags_t) {.syn = 1};
+  tcp->window_size16 = swap16(UINT16_MAX);
+  tcp->chunksum16 = fixture_checksum(if1->ip, NET_PROTOCOL_TCP, (uint8_t *) tcp, sizeof(tcp_hdr_t));
+  ethernet_in(if1, &fixture_frame);
+
+  expect(replies[NET_PROTOCOL_ICMP] == 1 && replies[NET_PROTOCOL_UDP] == 1 && replies[NET_PROTOCOL_TCP] == 1,
+         "replies");
+
+  // 发往不应答的地址，缓冲池为空时分配的缓冲在待发送包超时后归还缓冲池
+  uint8_t silent_ip[NET_IP_LEN] = {10, 0, 0, 9};
+  size_t pool_free = arp_buf_pool_free();
+  for (int i = 0; i < 3; i++)
+    udp_send(if0, (uint8_t *) "lost", 4, 60000, silent_ip, 5000);
+  expect(arp_pending_size() == 1 && arp_buf_pool_free() == pool_free, "pending");
+  sleep(ARP_MIN_INTERVAL + 1);
+  expect(arp_pending_size() == 0 && arp_buf_pool_free() == pool_free + 3, "pending expired");
+  expect(net_stats_local()->counter[NET_STATS_ARP_DROP_PENDING_TIMEOUT] == 3, "pending timeout counted");
+  return failed;
+}
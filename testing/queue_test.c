@@ -3,7 +3,40 @@
 //
 
 #include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
 #include "queue.h"
+#include "ring.h"
+
+#define BENCH_NUM 1000000   //吞吐测试的元素个数
+#define BENCH_BATCH 32      //每轮入队后出队的元素个数
+#define BENCH_PRODUCERS 4   //多生产者测试的线程数
+
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void bench_report(const char *name, double start) {
+  double ns = now_ns() - start;
+  printf("%-24s %8.2f ns/op %10.2f Mops/s\n", name, ns / BENCH_NUM, BENCH_NUM / ns * 1e3);
+}
+
+typedef struct mp_producer_arg {
+  ring_t *ring;
+  uintptr_t id;
+} mp_producer_arg_t;
+
+//元素编码为 序号 * BENCH_PRODUCERS + 生产者编号，序号从1开始
+static void *mp_producer(void *arg) {
+  mp_producer_arg_t *p = arg;
+  for (uintptr_t i = 1; i <= BENCH_NUM / BENCH_PRODUCERS; i++)
+    while (ring_mp_enqueue(p->ring, (void *) (i * BENCH_PRODUCERS + p->id)) != 0)
+      sched_yield();
+  return NULL;
+}
 
 int main(int argc, char **argv) {
   int data[] = {1, 2, 3};
@@ -17,5 +50,78 @@ int main(int argc, char **argv) {
     printf("pop: %d\n", *d);
   }
   queue_free(q, false);
+
+  //单线程吞吐：每轮入队BENCH_BATCH个元素再全部出队
+  void *items[BENCH_BATCH];
+  for (size_t i = 0; i < BENCH_BATCH; i++)
+    items[i] = data;
+  double start = now_ns();
+  q = queue_new(data); // queue_t不能为空，保留一个元素
+  for (size_t i = 0; i < BENCH_NUM; i += BENCH_BATCH) {
+    for (size_t j = 0; j < BENCH_BATCH; j++)
+      queue_push(q, items[j]);
+    for (size_t j = 0; j < BENCH_BATCH; j++)
+      queue_pop(q);
+  }
+  bench_report("queue_t push/pop", start);
+  queue_free(q, false);
+
+  ring_t ring;
+  ring_init(&ring, 1024);
+  start = now_ns();
+  for (size_t i = 0; i < BENCH_NUM; i += BENCH_BATCH) {
+    for (size_t j = 0; j < BENCH_BATCH; j++)
+      ring_enqueue(&ring, items[j]);
+    for (size_t j = 0; j < BENCH_BATCH; j++)
+      ring_dequeue(&ring);
+  }
+  bench_report("ring_t enqueue/dequeue", start);
+
+  start = now_ns();
+  for (size_t i = 0; i < BENCH_NUM; i += BENCH_BATCH) {
+    ring_enqueue_burst(&ring, items, BENCH_BATCH);
+    ring_dequeue_burst(&ring, items, BENCH_BATCH);
+  }
+  bench_report("ring_t burst", start);
+
+  start = now_ns();
+  for (size_t i = 0; i < BENCH_NUM; i += BENCH_BATCH) {
+    ring_mp_enqueue_burst(&ring, items, BENCH_BATCH);
+    ring_dequeue_burst(&ring, items, BENCH_BATCH);
+  }
+  bench_report("ring_t mp burst", start);
+
+  //多生产者单消费者并发：检查每个生产者的元素都按顺序到达且总数正确
+  pthread_t producers[BENCH_PRODUCERS];
+  mp_producer_arg_t args[BENCH_PRODUCERS];
+  uintptr_t last[BENCH_PRODUCERS] = {0};
+  size_t received = 0;
+  start = now_ns();
+  for (size_t i = 0; i < BENCH_PRODUCERS; i++) {
+    args[i] = (mp_producer_arg_t) {&ring, i};
+    pthread_create(&producers[i], NULL, mp_producer, &args[i]);
+  }
+  while (received < BENCH_NUM / BENCH_PRODUCERS * BENCH_PRODUCERS) {
+    size_t n = ring_dequeue_burst(&ring, items, BENCH_BATCH);
+    if (!n) sched_yield();
+    for (size_t i = 0; i < n; i++) {
+      uintptr_t v = (uintptr_t) items[i];
+      if (v / BENCH_PRODUCERS != last[v % BENCH_PRODUCERS] + 1) {
+        printf("mpsc order broken: producer %zu got %zu after %zu\n", (size_t) (v % BENCH_PRODUCERS),
+               (size_t) (v / BENCH_PRODUCERS), (size_t) last[v % BENCH_PRODUCERS]);
+        return 1;
+      }
+      last[v % BENCH_PRODUCERS]++;
+    }
+    received += n;
+  }
+  for (size_t i = 0; i < BENCH_PRODUCERS; i++)
+    pthread_join(producers[i], NULL);
+  bench_report("ring_t mpsc threads", start);
+  if (ring_count(&ring) != 0) {
+    printf("ring not empty after mpsc test\n");
+    return 1;
+  }
+  ring_free(&ring);
   return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,183 @@
+//
+// 飞行记录仪测试：构造会被丢弃或复位的帧送入协议栈，检查导出的pcapng中的帧、截断长度与注释，
+// tcp复位时自动导出，以及环形缓冲覆盖最旧的帧
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "ethernet.h"
+#include "arp.h"
+#include "ip.h"
+#include "tcp.h"
+#include "recorder.h"
+#include "fixture.h"
+
+static netif_t *netif;
+
+/**
+ * @brief 构造一个只带ack的tcp段，监听状态收到时会复位
+ *
+ */
+static void frame_tcp_ack(uint16_t src_port, uint16_t dst_port) {
+  tcp_hdr_t *tcp = (tcp_hdr_t *) fixture_ip(netif, netif->ip, NET_PROTOCOL_TCP, sizeof(tcp_hdr_t));
+  tcp->src_port16 = swap16(src_port);
+  tcp->dst_port16 = swap16(dst_port);
+  tcp->seq_number32 = swap32(1000);
+  tcp->data_offset = sizeof(tcp_hdr_t) / sizeof(uint32_t);
+  tcp->flags = tcp_flags_ack;
+  tcp->window_size16 = swap16(1024);
+  tcp->chunksum16 = fixture_checksum(netif->ip, NET_PROTOCOL_TCP, (uint8_t *) tcp, sizeof(tcp_hdr_t));
+}
+
+static void tcp_handler(tcp_connect_t *connect, connect_state_t state) {
+}
+
+typedef struct capture //从pcapng中读出的帧
+{
+  int frames;
+  int inbound, outbound;
+  int truncated;              // 保存长度小于原始长度的帧数
+  char comments[4096];        // 所有注释，以换行分隔
+} capture_t;
+
+/**
+ * @brief 读取导出的pcapng，检查块结构
+ *
+ * @return int 成功为0
+ */
+static int capture_read(const char *path, capture_t *cap) {
+  memset(cap, 0, sizeof(*cap));
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    printf("%s: cannot open\n", path);
+    return -1;
+  }
+  static uint8_t data[1 << 20];
+  size_t size = fread(data, 1, sizeof(data), f);
+  fclose(f);
+  uint32_t word;
+  memcpy(&word, data, 4);
+  if (size < 28 || word != 0x0A0D0D0A) {
+    printf("%s: not a pcapng file\n", path);
+    return -1;
+  }
+  for (size_t off = 0; off < size;) {
+    uint32_t type, len, tail;
+    memcpy(&type, data + off, 4);
+    memcpy(&len, data + off + 4, 4);
+    if (len < 12 || len % 4 || off + len > size) {
+      printf("%s: bad block length %u at %zu\n", path, len, off);
+      return -1;
+    }
+    memcpy(&tail, data + off + len - 4, 4);
+    if (tail != len) {
+      printf("%s: block length mismatch at %zu\n", path, off);
+      return -1;
+    }
+    if (type == 6) {
+      uint32_t caplen, origlen;
+      memcpy(&caplen, data + off + 20, 4);
+      memcpy(&origlen, data + off + 24, 4);
+      cap->frames++;
+      cap->truncated += caplen < origlen;
+      size_t opt = off + 28 + (caplen + 3) / 4 * 4;
+      while (opt + 4 <= off + len - 4) {
+        uint16_t code, opt_len;
+        memcpy(&code, data + opt, 2);
+        memcpy(&opt_len, data + opt + 2, 2);
+        if (code == 0)
+          break;
+        if (code == 2) {
+          uint32_t flags;
+          memcpy(&flags, data + opt + 4, 4);
+          cap->inbound += (flags & 3) == RECORDER_IN;
+          cap->outbound += (flags & 3) == RECORDER_OUT;
+        } else if (code == 1 && strlen(cap->comments) + opt_len + 2 < sizeof(cap->comments)) {
+          strncat(cap->comments, (char *) data + opt + 4, opt_len);
+          strcat(cap->comments, "\n");
+        }
+        opt += 4 + (opt_len + 3) / 4 * 4;
+      }
+    }
+    off += len;
+  }
+  return 0;
+}
+
+static int expect_comment(const capture_t *cap, const char *comment) {
+  if (strstr(cap->comments, comment))
+    return 0;
+  printf("missing comment %s, got:\n%s", comment, cap->comments);
+  return 1;
+}
+
+int main(int argc, char **argv) {
+  int failed = 0;
+  const char *path = argc > 1 ? argv[1] : "recorder_test.pcapng";
+  char reset_path[256];
+  snprintf(reset_path, sizeof(reset_path), "%s.tcp_reset.0", path);
+  remove(reset_path);
+  if (net_init() != 0)
+    return -1;
+  netif = netif_get(0);
+  // 未开启时不记录
+  fixture_ip(netif, netif->ip, NET_PROTOCOL_UDP, 8);
+  ethernet_in(netif, &fixture_frame);
+  if (recorder_open(path) != 0)
+    return -1;
+  tcp_open(62000, tcp_handler);
+
+  // arp请求，回复并记录对端，之后的复位报文arp命中
+  fixture_arp_request(netif);
+  // ip头部校验和错误
+  fixture_ip(netif, netif->ip, NET_PROTOCOL_UDP, 8);
+  ((ip_hdr_t *) (fixture_frame.data + sizeof(ether_hdr_t)))->hdr_checksum16 ^= 0x1234;
+  ethernet_in(netif, &fixture_frame);
+  // 超过RECORDER_SNAPLEN的帧截断保存
+  fixture_ip(netif, netif->ip, NET_PROTOCOL_UDP, 1000);
+  ethernet_in(netif, &fixture_frame);
+  // 监听端口收到非syn段，复位并自动导出
+  frame_tcp_ack(1234, 62000);
+  ethernet_in(netif, &fixture_frame);
+
+  capture_t cap;
+  if (capture_read(reset_path, &cap) != 0)
+    return 1;
+  // arp请求、arp应答、校验和错误、截断、ack段、rst
+  if (cap.frames != 6 || cap.inbound != 4 || cap.outbound != 2 || cap.truncated != 1) {
+    printf("reset dump: %d frames (%d in, %d out, %d truncated), expected 6 (4 in, 2 out, 1 truncated)\n",
+           cap.frames, cap.inbound, cap.outbound, cap.truncated);
+    failed = 1;
+  }
+  failed |= expect_comment(&cap, "drop=ip.drop.bad_checksum\n");
+  failed |= expect_comment(&cap, "drop=udp.drop.no_handler\n");
+  failed |= expect_comment(&cap, "conn=192.168.163.10:1234->62000\n");
+  failed |= expect_comment(&cap, "conn=192.168.163.10:1234<-62000\n");
+
+  // 同一秒内的复位不再导出
+  frame_tcp_ack(1235, 62000);
+  ethernet_in(netif, &fixture_frame);
+  snprintf(reset_path, sizeof(reset_path), "%s.tcp_reset.1", path);
+  FILE *f = fopen(reset_path, "rb");
+  if (f) {
+    printf("reset dump not rate limited\n");
+    fclose(f);
+    failed = 1;
+  }
+
+  // 环形缓冲只保留最近RECORDER_SIZE帧
+  for (int i = 0; i < RECORDER_SIZE; i++) {
+    fixture_ip(netif, netif->ip, NET_PROTOCOL_UDP, 8);
+    ethernet_in(netif, &fixture_frame);
+  }
+  int count = recorder_dump(path);
+  if (count != RECORDER_SIZE || capture_read(path, &cap) != 0 || cap.frames != RECORDER_SIZE) {
+    printf("full dump: %d frames, expected %d\n", count, RECORDER_SIZE);
+    failed = 1;
+  }
+  if (strstr(cap.comments, "conn=")) {
+    printf("overwritten frames still in dump\n");
+    failed = 1;
+  }
+  return failed;
+}
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <pthread.h>
+#include <sched.h>
+#include "ring.h"
+#include "shard.h"
+#include "utils.h"
+
+#define RING_TEST_NUM 100000
+
+typedef struct toeplitz_case //微软RSS规范中的IPv4验证用例
+{
+  uint8_t src_ip[NET_IP_LEN];
+  uint8_t dst_ip[NET_IP_LEN];
+  uint16_t src_port;
+  uint16_t dst_port;
+  uint32_t ip_hash;
+  uint32_t tcp_hash;
+} toeplitz_case_t;
+
+static const toeplitz_case_t cases[] = {
+    {{66, 9, 149, 187}, {161, 142, 100, 80}, 2794, 1766, 0x323e8fc2, 0x51ccc178},
+    {{199, 92, 111, 2}, {65, 69, 140, 83}, 14230, 4739, 0xd718262a, 0xc626b0ea},
+    {{24, 19, 198, 95}, {12, 22, 207, 184}, 12898, 38024, 0xd2d0a5de, 0x5c2b394a},
+    {{38, 27, 205, 30}, {209, 142, 163, 6}, 48228, 2217, 0x82989176, 0xafc7327f},
+    {{153, 39, 163, 191}, {202, 188, 127, 2}, 44251, 1303, 0x5d1809c5, 0x10e828a2},
+};
+
+static void *ring_producer(void *arg) {
+  ring_t *ring = arg;
+  for (uintptr_t i = 1; i <= RING_TEST_NUM; i++)
+    while (ring_enqueue(ring, (void *) i) != 0)
+      sched_yield();
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  int failed = 0;
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    const toeplitz_case_t *c = &cases[i];
+    uint8_t input[12];
+    memcpy(input, c->src_ip, NET_IP_LEN);
+    memcpy(input + 4, c->dst_ip, NET_IP_LEN);
+    input[8] = c->src_port >> 8;
+    input[9] = c->src_port & 0xff;
+    input[10] = c->dst_port >> 8;
+    input[11] = c->dst_port & 0xff;
+    uint32_t ip_hash = shard_toeplitz(input, 8);
+    uint32_t tcp_hash = shard_toeplitz(input, 12);
+    printf("toeplitz %zu: ip %08x tcp %08x\n", i, ip_hash, tcp_hash);
+    if (ip_hash != c->ip_hash || tcp_hash != c->tcp_hash) {
+      printf("  expected ip %08x tcp %08x\n", c->ip_hash, c->tcp_hash);
+      failed = 1;
+    }
+  }
+
+  ring_t ring;
+  if (ring_init(&ring, 3) == 0) {
+    printf("ring_init accepted a size that is not a power of 2\n");
+    failed = 1;
+  }
+  ring_init(&ring, 4);
+  int data[] = {1, 2, 3, 4, 5};
+  for (int i = 0; i < 4; i++)
+    ring_enqueue(&ring, data + i);
+  if (ring_enqueue(&ring, data + 4) == 0 || ring_count(&ring) != 4) {
+    printf("ring overflow not detected\n");
+    failed = 1;
+  }
+  for (int i = 0; i < 4; i++) {
+    int *d = ring_dequeue(&ring);
+    if (!d || *d != data[i]) {
+      printf("ring order broken at %d\n", i);
+      failed = 1;
+    }
+  }
+  if (ring_dequeue(&ring) != NULL) {
+    printf("ring underflow not detected\n");
+    failed = 1;
+  }
+  ring_free(&ring);
+
+  //一个生产者线程与一个消费者线程并发收发，检查顺序与完整性
+  ring_init(&ring, 256);
+  pthread_t producer;
+  pthread_create(&producer, NULL, ring_producer, &ring);
+  for (uintptr_t expect = 1; expect <= RING_TEST_NUM;) {
+    void *item = ring_dequeue(&ring);
+    if (!item) {
+      sched_yield();
+      continue;
+    }
+    if ((uintptr_t) item != expect) {
+      printf("ring concurrent order broken: got %zu expected %zu\n", (size_t) (uintptr_t) item, (size_t) expect);
+      failed = 1;
+      break;
+    }
+    expect++;
+  }
+  pthread_join(producer, NULL);
+  ring_free(&ring);
+
+  printf(failed ? "shard test failed\n" : "shard test passed\n");
+  return failed;
+}
@@ -0,0 +1,157 @@
+//
+// 计数器测试：构造各种会被丢弃或应答的帧送入协议栈，检查对应丢弃点的计数，以及多线程汇总
+//
+
+#include <stdio.h>
+#include <pthread.h>
+#include "ethernet.h"
+#include "arp.h"
+#include "ip.h"
+#include "icmp.h"
+#include "udp.h"
+#include "tcp.h"
+#include "stats.h"
+#include "metrics.h"
+#include "fixture.h"
+
+#define STATS_THREAD_NUM 1000
+
+static netif_t *netif;
+
+static void *stats_thread(void *arg) {
+  for (int i = 0; i < STATS_THREAD_NUM; i++)
+    NET_STATS_INC(UDP_TX_PACKETS);
+  return NULL;
+}
+
+static int expect(const net_stats_t *stats, net_stats_counter_t counter, uint64_t value) {
+  if (stats->counter[counter] == value)
+    return 0;
+  printf("%s: %llu, expected %llu\n", net_stats_name(counter), (unsigned long long) stats->counter[counter],
+         (unsigned long long) value);
+  return 1;
+}
+
+int main(int argc, char **argv) {
+  int failed = 0;
+  if (net_init() != 0)
+    return -1;
+  netif = netif_get(0);
+  net_stats_t before, after;
+  net_stats_snapshot(&before, -1);
+
+  uint8_t other_mac[NET_MAC_LEN] = {0x02, 0, 0, 0, 0, 0x99};
+  uint8_t other_ip[NET_IP_LEN] = {192, 168, 163, 99};
+  // 目的mac不是本机
+  fixture_eth(other_mac, NET_PROTOCOL_IP, 46);
+  ethernet_in(netif, &fixture_frame);
+  // 目的ip不是本机
+  fixture_ip(netif, other_ip, NET_PROTOCOL_UDP, 8);
+  ethernet_in(netif, &fixture_frame);
+  // ip头部校验和错误
+  fixture_ip(netif, netif->ip, NET_PROTOCOL_UDP, 8);
+  ((ip_hdr_t *) (fixture_frame.data + sizeof(ether_hdr_t)))->hdr_checksum16 ^= 0x1234;
+  ethernet_in(netif, &fixture_frame);
+  // udp头部不完整
+  fixture_ip(netif, netif->ip, NET_PROTOCOL_UDP, 4);
+  ethernet_in(netif, &fixture_frame);
+  // udp端口没有处理程序
+  udp_hdr_t *udp = (udp_hdr_t *) fixture_ip(netif, netif->ip, NET_PROTOCOL_UDP, sizeof(udp_hdr_t));
+  udp->dst_port16 = swap16(60001);
+  udp->total_len16 = swap16(sizeof(udp_hdr_t));
+  ethernet_in(netif, &fixture_frame);
+  // tcp校验和错误
+  tcp_hdr_t *tcp = (tcp_hdr_t *) fixture_ip(netif, netif->ip, NET_PROTOCOL_TCP, sizeof(tcp_hdr_t));
+  tcp->chunksum16 = 0xdead;
+  ethernet_in(netif, &fixture_frame);
+  // 上层协议不支持，回复icmp不可达，对端尚未解析，arp未命中
+  fixture_ip(netif, netif->ip, 99, 8);
+  ethernet_in(netif, &fixture_frame);
+  // arp请求，回复并记录对端
+  fixture_arp_request(netif);
+  // ping，应答时arp命中
+  icmp_hdr_t *icmp = (icmp_hdr_t *) fixture_ip(netif, netif->ip, NET_PROTOCOL_ICMP, sizeof(icmp_hdr_t));
+  icmp->type = ICMP_TYPE_ECHO_REQUEST;
+  icmp->checksum16 = checksum16((uint16_t *) icmp, sizeof(icmp_hdr_t));
+  ethernet_in(netif, &fixture_frame);
+
+  net_stats_snapshot(&after, -1);
+  net_stats_diff(&after, &after, &before);
+  failed |= expect(&after, NET_STATS_ETH_RX_PACKETS, 9);
+  failed |= expect(&after, NET_STATS_ETH_DROP_NOT_MINE, 1);
+  failed |= expect(&after, NET_STATS_IP_RX_PACKETS, 7);
+  failed |= expect(&after, NET_STATS_IP_DROP_NOT_MINE, 1);
+  failed |= expect(&after, NET_STATS_IP_DROP_BAD_CHECKSUM, 1);
+  failed |= expect(&after, NET_STATS_IP_DROP_NO_HANDLER, 1);
+  failed |= expect(&after, NET_STATS_UDP_DROP_TOO_SHORT, 1);
+  failed |= expect(&after, NET_STATS_UDP_DROP_NO_HANDLER, 1);
+  failed |= expect(&after, NET_STATS_TCP_DROP_BAD_CHECKSUM, 1);
+  failed |= expect(&after, NET_STATS_ICMP_TX_UNREACH, 1);
+  failed |= expect(&after, NET_STATS_ICMP_TX_ECHO_REPLIES, 1);
+  failed |= expect(&after, NET_STATS_ARP_MISSES, 1);
+  failed |= expect(&after, NET_STATS_ARP_TX_REQUESTS, 1);
+  failed |= expect(&after, NET_STATS_ARP_TX_REPLIES, 1);
+  failed |= expect(&after, NET_STATS_ARP_HITS, 1);
+  // arp请求、arp应答、ping应答，icmp不可达仍在等待arp应答
+  failed |= expect(&after, NET_STATS_ETH_TX_PACKETS, 3);
+
+  // 每个线程各自计数，快照时汇总
+  net_stats_snapshot(&before, -1);
+  pthread_t threads[2];
+  for (int i = 0; i < 2; i++)
+    pthread_create(&threads[i], NULL, stats_thread, NULL);
+  for (int i = 0; i < 2; i++)
+    pthread_join(threads[i], NULL);
+  size_t thread_num = net_stats_snapshot(&after, -1);
+  if (thread_num != 3) {
+    printf("snapshot summed %zu threads, expected 3\n", thread_num);
+    failed = 1;
+  }
+  net_stats_diff(&after, &after, &before);
+  failed |= expect(&after, NET_STATS_UDP_TX_PACKETS, 2 * STATS_THREAD_NUM);
+  net_stats_snapshot(&after, 1);
+  failed |= expect(&after, NET_STATS_UDP_TX_PACKETS, STATS_THREAD_NUM);
+  if (net_stats_snapshot(&after, 3) != 0) {
+    printf("snapshot of a missing thread\n");
+    failed = 1;
+  }
+
+  net_stats_snapshot(&after, -1);
+  net_stats_dump(stdout, &after, 0);
+
+  // 指标以Prometheus文本格式渲染，丢弃计数按原因分标签
+  static char text[METRICS_BUF_SIZE];
+  size_t len = metrics_render(text, sizeof(text));
+  const char *want[] = {
+      "# TYPE net_ip_drops_total counter\n",
+      "net_ip_drops_total{reason=\"bad_checksum\"} 1\n",
+      "net_tcp_drops_total{reason=\"bad_checksum\"} 1\n",
+      "net_eth_rx_packets_total 9\n",
+      "net_arp_hits_total 1\n",
+      "net_tcp_connections{state=\"established\"} 0\n",
+      "net_arp_table_entries 1\n",
+      "net_arp_pending_addresses 1\n",
+  };
+  for (size_t i = 0; i < sizeof(want) / sizeof(want[0]); i++) {
+    if (!strstr(text, want[i])) {
+      printf("metrics: missing %s", want[i]);
+      failed = 1;
+    }
+  }
+  // 同一指标的TYPE行只能出现一次，否则Prometheus拒绝整次抓取
+  for (const char *type = strstr(text, "# TYPE "); type; type = strstr(type + 1, "# TYPE ")) {
+    const char *end = strchr(type + 7, ' ');
+    char name[80];
+    snprintf(name, sizeof(name), "# TYPE %.*s ", (int) (end - type - 7), type + 7);
+    if (strstr(type + 1, name)) {
+      printf("metrics: %s appears more than once\n", name);
+      failed = 1;
+      break;
+    }
+  }
+  if (len != strlen(text) || metrics_render(text, 64) != 63) {
+    printf("metrics: bad length\n");
+    failed = 1;
+  }
+  return failed;
+}
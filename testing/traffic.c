@@ -0,0 +1,812 @@
+//
+// 合成流量生成器：模拟一批主机与被测协议栈进行arp、ping、udp、tcp与http交互。
+// 与faker驱动一样在链接时替换pcap驱动，生成的帧直接交给协议栈，协议栈发出的帧
+// 直接回到生成器，可在进程内以远超真实网卡的速率压测，无需网络与root权限。
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "traffic.h"
+#include "driver.h"
+#include "ethernet.h"
+#include "arp.h"
+#include "ip.h"
+#include "icmp.h"
+#include "udp.h"
+#include "tcp.h"
+#include "log.h"
+
+#define TRAFFIC_FRAME_LEN (ETHERNET_MAX_TRANSPORT_UNIT + sizeof(ether_hdr_t))
+#define TRAFFIC_FRAME_MIN (ETHERNET_MIN_TRANSPORT_UNIT + sizeof(ether_hdr_t))
+#define TRAFFIC_IP_MAX_LEN UINT16_MAX
+#define TRAFFIC_UDP_MAX (ETHERNET_MAX_TRANSPORT_UNIT - sizeof(ip_hdr_t) - sizeof(udp_hdr_t))
+#define TRAFFIC_ICMP_MAX (ETHERNET_MAX_TRANSPORT_UNIT - sizeof(ip_hdr_t) - sizeof(icmp_hdr_t))
+#define TRAFFIC_MSS (ETHERNET_MAX_TRANSPORT_UNIT - sizeof(ip_hdr_t) - sizeof(tcp_hdr_t))
+#define TRAFFIC_REQUEST_MAX 512
+
+typedef struct traffic_frame //等待发往协议栈的帧
+{
+  uint16_t len;
+  uint8_t data[TRAFFIC_FRAME_LEN];
+} traffic_frame_t;
+
+typedef struct traffic_host //模拟的主机
+{
+  uint8_t ip[NET_IP_LEN];
+  uint8_t mac[NET_MAC_LEN];
+  int resolved;               // 是否已解析到协议栈的mac
+  uint64_t deadline;          // 下次发送arp请求的轮数
+  uint16_t ip_id;
+  uint8_t *frag;              // ip分片重组缓冲，收到第一个分片时分配
+  int frag_active;
+  uint16_t frag_id;
+  size_t frag_got, frag_total;
+} traffic_host_t;
+
+typedef enum flow_state {
+  FLOW_IDLE,        // 等待所在主机解析协议栈的mac
+  FLOW_WAIT,        // ping/udp请求已发出，等待回显
+  FLOW_SYN_SENT,    // 已发出SYN
+  FLOW_ESTABLISHED, // 已发出请求数据，等待确认与响应
+  FLOW_FIN_WAIT,    // 已发出FIN，等待对方的FIN
+  FLOW_DONE,        // 所有事务已结束
+} flow_state_t;
+
+typedef struct traffic_flow //一个并发流，依次完成config.count个事务
+{
+  size_t host;
+  flow_state_t state;
+  uint16_t port;              // 当前事务的本地端口，ping时作为id
+  size_t done;                // 已结束的事务数
+  uint16_t seq;               // ping序号
+  uint32_t iss;               // tcp初始序号
+  uint32_t snd_una, snd_nxt;  // 最早未确认的序号，下一发送序号
+  uint32_t rcv_nxt;           // 期望收到的对方序号
+  size_t received;            // 当前事务收到的应用层字节数
+  int status;                 // http响应状态码
+  size_t expect;              // http响应头与响应体的总长度，响应头未到时为0
+  size_t conn_done;           // 当前连接上已完成的http请求数
+  int retries;
+  uint64_t deadline;          // 超时的轮数
+} traffic_flow_t;
+
+static traffic_config_t config;
+static traffic_stats_t stats;
+
+static traffic_host_t *hosts;
+static size_t host_num;
+static int16_t host_index[256];             // ip最后一字节 -> 主机下标
+static uint8_t stack_mac[NET_MAC_LEN];
+
+static traffic_flow_t *flows;
+static size_t flows_active;
+static uint32_t flow_of_port[UINT16_MAX + 1]; // 本地端口 -> 流下标+1
+
+static char *path_buf;
+static char *paths[TRAFFIC_REQUEST_MAX / 2];
+static size_t path_num;
+
+static traffic_frame_t *queue;              // 发往协议栈的帧，全部送出后清空
+static size_t queue_len, queue_cap, queue_next;
+
+static uint64_t rng_state;
+static uint64_t last_progress;              // 最近一次有事务结束的轮数
+static uint8_t payload[TRAFFIC_FRAME_LEN];
+
+static void flow_start(traffic_flow_t *flow);
+
+static uint64_t traffic_rand() {
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static int traffic_chance(double p) {
+  return p > 0 && (traffic_rand() >> 11) * (1.0 / 9007199254740992.0) < p;
+}
+
+/**
+ * @brief 在发送队列尾部取一个空闲帧，由traffic_commit决定是否真正入队
+ *
+ */
+static traffic_frame_t *traffic_alloc() {
+  if (queue_len == queue_cap) {
+    queue_cap = queue_cap ? queue_cap * 2 : 256;
+    queue = realloc(queue, queue_cap * sizeof(traffic_frame_t));
+  }
+  return &queue[queue_len];
+}
+
+/**
+ * @brief 提交traffic_alloc取得的帧，按配置模拟丢包与乱序
+ *
+ * @param frame 帧
+ * @param len 帧长度，不足以太网最小帧长时补零
+ */
+static void traffic_commit(traffic_frame_t *frame, size_t len) {
+  if (len < TRAFFIC_FRAME_MIN) {
+    memset(frame->data + len, 0, TRAFFIC_FRAME_MIN - len);
+    len = TRAFFIC_FRAME_MIN;
+  }
+  frame->len = len;
+  if (traffic_chance(config.loss)) {
+    stats.tx_dropped++;
+    return;
+  }
+  queue_len++;
+  if (queue_len - queue_next >= 2 && traffic_chance(config.reorder)) {
+    traffic_frame_t tmp = queue[queue_len - 1];
+    queue[queue_len - 1] = queue[queue_len - 2];
+    queue[queue_len - 2] = tmp;
+    stats.reordered++;
+  }
+}
+
+static void traffic_ether(traffic_frame_t *frame, traffic_host_t *host, const uint8_t *dst, uint16_t protocol) {
+  ether_hdr_t *hdr = (ether_hdr_t *) frame->data;
+  memcpy(hdr->dst, dst, NET_MAC_LEN);
+  memcpy(hdr->src, host->mac, NET_MAC_LEN);
+  hdr->protocol16 = swap16(protocol);
+}
+
+/**
+ * @brief 从主机发出arp报文，目标ip总是协议栈
+ *
+ * @param host 主机
+ * @param opcode ARP_REQUEST或ARP_REPLY
+ * @param dst 以太网目的地址
+ */
+static void traffic_arp_out(traffic_host_t *host, uint16_t opcode, const uint8_t *dst) {
+  traffic_frame_t *frame = traffic_alloc();
+  traffic_ether(frame, host, dst, NET_PROTOCOL_ARP);
+  arp_pkt_t *p = (arp_pkt_t *) (frame->data + sizeof(ether_hdr_t));
+  p->hw_type16 = constswap16(ARP_HW_ETHER);
+  p->pro_type16 = constswap16(NET_PROTOCOL_IP);
+  p->hw_len = NET_MAC_LEN;
+  p->pro_len = NET_IP_LEN;
+  p->opcode16 = swap16(opcode);
+  memcpy(p->sender_mac, host->mac, NET_MAC_LEN);
+  memcpy(p->sender_ip, host->ip, NET_IP_LEN);
+  if (opcode == ARP_REPLY)
+    memcpy(p->target_mac, stack_mac, NET_MAC_LEN);
+  else
+    memset(p->target_mac, 0, NET_MAC_LEN);
+  memcpy(p->target_ip, config.ip, NET_IP_LEN);
+  traffic_commit(frame, sizeof(ether_hdr_t) + sizeof(arp_pkt_t));
+}
+
+/**
+ * @brief 填写以太网与ip头部
+ *
+ * @return uint8_t* ip负载的起始位置
+ */
+static uint8_t *traffic_ip_out(traffic_frame_t *frame, traffic_host_t *host, uint8_t protocol, size_t len) {
+  traffic_ether(frame, host, stack_mac, NET_PROTOCOL_IP);
+  ip_hdr_t *p = (ip_hdr_t *) (frame->data + sizeof(ether_hdr_t));
+  p->version = IP_VERSION_4;
+  p->hdr_len = sizeof(ip_hdr_t) / IP_HDR_LEN_PER_BYTE;
+  p->tos = 0;
+  p->total_len16 = swap16(sizeof(ip_hdr_t) + len);
+  p->id16 = swap16(host->ip_id++);
+  p->flags_fragment16 = 0;
+  p->ttl = IP_DEFALUT_TTL;
+  p->protocol = protocol;
+  p->hdr_checksum16 = 0;
+  memcpy(p->src_ip, host->ip, NET_IP_LEN);
+  memcpy(p->dst_ip, config.ip, NET_IP_LEN);
+  p->hdr_checksum16 = checksum16((uint16_t *) p, sizeof(ip_hdr_t));
+  return (uint8_t *) (p + 1);
+}
+
+/**
+ * @brief 计算udp/tcp带伪首部的校验和
+ *
+ */
+static uint16_t traffic_checksum(traffic_host_t *host, uint8_t protocol, const uint8_t *data, size_t len) {
+  static uint8_t scratch[sizeof(udp_peso_hdr_t) + TRAFFIC_FRAME_LEN];
+  udp_peso_hdr_t *peso = (udp_peso_hdr_t *) scratch;
+  memcpy(peso->src_ip, host->ip, NET_IP_LEN);
+  memcpy(peso->dst_ip, config.ip, NET_IP_LEN);
+  peso->placeholder = 0;
+  peso->protocol = protocol;
+  peso->total_len16 = swap16(len);
+  memcpy(scratch + sizeof(udp_peso_hdr_t), data, len);
+  return checksum16((uint16_t *) scratch, sizeof(udp_peso_hdr_t) + len);
+}
+
+/**
+ * @brief 从流所在主机发出一个tcp报文段，确认号总是rcv_nxt
+ *
+ */
+static void traffic_tcp_out(traffic_flow_t *flow, uint32_t seq, tcp_flags_t flags, const uint8_t *data, size_t len) {
+  traffic_host_t *host = &hosts[flow->host];
+  traffic_frame_t *frame = traffic_alloc();
+  uint8_t *seg = traffic_ip_out(frame, host, NET_PROTOCOL_TCP, sizeof(tcp_hdr_t) + len);
+  tcp_hdr_t *hdr = (tcp_hdr_t *) seg;
+  hdr->src_port16 = swap16(flow->port);
+  hdr->dst_port16 = swap16(config.port);
+  hdr->seq_number32 = swap32(seq);
+  hdr->ack_number32 = flags.ack ? swap32(flow->rcv_nxt) : 0;
+  hdr->reserved = 0;
+  hdr->data_offset = sizeof(tcp_hdr_t) / sizeof(uint32_t);
+  hdr->flags = flags;
+  hdr->window_size16 = swap16(UINT16_MAX);
+  hdr->chunksum16 = 0;
+  hdr->urgent_pointer16 = 0;
+  memcpy(seg + sizeof(tcp_hdr_t), data, len);
+  hdr->chunksum16 = traffic_checksum(host, NET_PROTOCOL_TCP, seg, sizeof(tcp_hdr_t) + len);
+  traffic_commit(frame, sizeof(ether_hdr_t) + sizeof(ip_hdr_t) + sizeof(tcp_hdr_t) + len);
+}
+
+/**
+ * @brief 当前http请求是否为连接上的最后一个，是则要求服务器响应后关闭连接
+ *
+ */
+static int flow_last_request(traffic_flow_t *flow) {
+  return flow->conn_done + 1 >= config.keepalive || flow->done + 1 >= config.count;
+}
+
+/**
+ * @brief 生成当前事务的tcp请求数据，tcp模式为固定负载，http模式为GET请求
+ *
+ * @return size_t 请求长度
+ */
+static size_t flow_request(traffic_flow_t *flow, uint8_t *buf) {
+  if (config.mode == TRAFFIC_TCP) {
+    memcpy(buf, payload, config.payload_len);
+    return config.payload_len;
+  }
+  const char *path = paths[(flow - flows + flow->done) % path_num];
+  return snprintf((char *) buf, TRAFFIC_REQUEST_MAX, "GET %s HTTP/1.1\r\nHost: %s\r\n%s\r\n", path,
+                  iptos(config.ip), flow_last_request(flow) ? "Connection: close\r\n" : "");
+}
+
+/**
+ * @brief 从响应的第一个报文段中取出响应头与响应体的总长度，服务器总是把整个响应头放在第一段
+ *
+ * @return size_t 总长度，没有完整的响应头或Content-Length时为0
+ */
+static size_t http_response_len(const uint8_t *data, size_t len) {
+  static const char length_name[] = "\r\nContent-Length: ";
+  size_t content_len = 0;
+  int has_length = 0;
+  for (size_t i = 0; i + 4 <= len; i++) {
+    if (memcmp(data + i, "\r\n\r\n", 4) == 0)
+      return has_length ? i + 4 + content_len : 0;
+    if (!has_length && i + sizeof(length_name) - 1 <= len &&
+        memcmp(data + i, length_name, sizeof(length_name) - 1) == 0) {
+      has_length = 1;
+      for (size_t j = i + sizeof(length_name) - 1; j < len && data[j] >= '0' && data[j] <= '9'; j++)
+        content_len = content_len * 10 + data[j] - '0';
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief 按流的当前状态发出(或重传)等待对方回应的报文
+ *
+ */
+static void flow_send(traffic_flow_t *flow) {
+  traffic_host_t *host = &hosts[flow->host];
+  switch (flow->state) {
+    case FLOW_WAIT:
+      if (config.mode == TRAFFIC_PING) {
+        traffic_frame_t *frame = traffic_alloc();
+        size_t len = sizeof(icmp_hdr_t) + config.payload_len;
+        icmp_hdr_t *hdr = (icmp_hdr_t *) traffic_ip_out(frame, host, NET_PROTOCOL_ICMP, len);
+        hdr->type = ICMP_TYPE_ECHO_REQUEST;
+        hdr->code = 0;
+        hdr->checksum16 = 0;
+        hdr->id16 = swap16(flow->port);
+        hdr->seq16 = swap16(flow->seq);
+        memcpy(hdr + 1, payload, config.payload_len);
+        hdr->checksum16 = checksum16((uint16_t *) hdr, len);
+        traffic_commit(frame, sizeof(ether_hdr_t) + sizeof(ip_hdr_t) + len);
+      } else {
+        traffic_frame_t *frame = traffic_alloc();
+        size_t len = sizeof(udp_hdr_t) + config.payload_len;
+        udp_hdr_t *hdr = (udp_hdr_t *) traffic_ip_out(frame, host, NET_PROTOCOL_UDP, len);
+        hdr->src_port16 = swap16(flow->port);
+        hdr->dst_port16 = swap16(config.port);
+        hdr->total_len16 = swap16(len);
+        hdr->checksum16 = 0;
+        memcpy(hdr + 1, payload, config.payload_len);
+        hdr->checksum16 = traffic_checksum(host, NET_PROTOCOL_UDP, (uint8_t *) hdr, len);
+        traffic_commit(frame, sizeof(ether_hdr_t) + sizeof(ip_hdr_t) + len);
+      }
+      break;
+    case FLOW_SYN_SENT:
+      traffic_tcp_out(flow, flow->iss, (tcp_flags_t) {.syn = 1}, NULL, 0);
+      break;
+    case FLOW_ESTABLISHED: {
+      uint8_t request[TRAFFIC_REQUEST_MAX > TRAFFIC_MSS ? TRAFFIC_REQUEST_MAX : TRAFFIC_MSS];
+      size_t len = flow_request(flow, request);
+      traffic_tcp_out(flow, flow->snd_nxt - len, (tcp_flags_t) {.ack = 1, .psh = 1}, request, len);
+      break;
+    }
+    case FLOW_FIN_WAIT:
+      traffic_tcp_out(flow, flow->snd_nxt - 1, tcp_flags_ack_fin, NULL, 0);
+      break;
+    default:
+      break;
+  }
+}
+
+/**
+ * @brief 结束当前事务并开始下一个
+ *
+ * @param flow 流
+ * @param ok 事务是否成功
+ */
+static void flow_finish(traffic_flow_t *flow, int ok) {
+  if (ok)
+    stats.completed++;
+  else
+    stats.failed++;
+  flow->done++;
+  last_progress = stats.rounds;
+  flow_start(flow);
+}
+
+/**
+ * @brief 开始流的下一个事务，每个事务使用新的本地端口，避免与协议栈中残留的连接冲突
+ *
+ */
+static void flow_start(traffic_flow_t *flow) {
+  size_t index = flow - flows;
+  flow_of_port[flow->port] = 0;
+  if (flow->done >= config.count) {
+    flow->state = FLOW_DONE;
+    flows_active--;
+    return;
+  }
+  flow->port = TRAFFIC_PORT_BASE + (index + flow->done * config.flows) % TRAFFIC_PORT_RANGE;
+  flow_of_port[flow->port] = index + 1;
+  flow->received = 0;
+  flow->status = 0;
+  flow->expect = 0;
+  flow->conn_done = 0;
+  flow->retries = 0;
+  flow->deadline = stats.rounds + config.rto;
+  if (config.mode == TRAFFIC_PING || config.mode == TRAFFIC_UDP) {
+    flow->seq = flow->done;
+    flow->state = FLOW_WAIT;
+  } else {
+    flow->iss = traffic_rand();
+    flow->snd_una = flow->iss;
+    flow->snd_nxt = flow->iss + 1;
+    flow->state = FLOW_SYN_SENT;
+  }
+  flow_send(flow);
+}
+
+static traffic_host_t *traffic_host_of(const uint8_t *ip) {
+  if (memcmp(ip, config.ip, NET_IP_LEN - 1) != 0 || host_index[ip[NET_IP_LEN - 1]] < 0)
+    return NULL;
+  return &hosts[host_index[ip[NET_IP_LEN - 1]]];
+}
+
+static traffic_flow_t *traffic_flow_of(traffic_host_t *host, uint16_t port) {
+  if (!flow_of_port[port])
+    return NULL;
+  traffic_flow_t *flow = &flows[flow_of_port[port] - 1];
+  return &hosts[flow->host] == host ? flow : NULL;
+}
+
+/**
+ * @brief 处理协议栈发给主机的arp报文，收到应答后开始该主机上的流
+ *
+ */
+static void traffic_arp_in(const uint8_t *data, size_t len) {
+  if (len < sizeof(arp_pkt_t))
+    return;
+  const arp_pkt_t *p = (const arp_pkt_t *) data;
+  traffic_host_t *host = traffic_host_of(p->target_ip);
+  if (!host || memcmp(p->sender_ip, config.ip, NET_IP_LEN) != 0)
+    return;
+  memcpy(stack_mac, p->sender_mac, NET_MAC_LEN);
+  if (p->opcode16 == constswap16(ARP_REQUEST)) {
+    traffic_arp_out(host, ARP_REPLY, stack_mac);
+  } else if (p->opcode16 == constswap16(ARP_REPLY) && !host->resolved) {
+    host->resolved = 1;
+    for (size_t i = host - hosts; i < config.flows; i += host_num)
+      flow_start(&flows[i]);
+  }
+}
+
+static void flow_http_status(traffic_flow_t *flow) {
+  if (flow->status >= 200 && flow->status < 300)
+    stats.http_2xx++;
+  else if (flow->status)
+    stats.http_other++;
+}
+
+/**
+ * @brief 持久连接上的响应已读完，在同一连接上发出下一个请求
+ *
+ */
+static void flow_next_request(traffic_flow_t *flow) {
+  flow_http_status(flow);
+  stats.completed++;
+  flow->done++;
+  flow->conn_done++;
+  last_progress = stats.rounds;
+  flow->received = 0;
+  flow->status = 0;
+  flow->expect = 0;
+  uint8_t request[TRAFFIC_REQUEST_MAX];
+  flow->snd_nxt += flow_request(flow, request);
+  flow->retries = 0;
+  flow->deadline = stats.rounds + config.rto;
+  flow_send(flow);
+}
+
+/**
+ * @brief 处理发给流的tcp报文段
+ *
+ */
+static void traffic_tcp_in(traffic_flow_t *flow, const uint8_t *seg, size_t len) {
+  const tcp_hdr_t *hdr = (const tcp_hdr_t *) seg;
+  size_t hdr_len = hdr->data_offset * sizeof(uint32_t);
+  if (len < sizeof(tcp_hdr_t) || len < hdr_len)
+    return;
+  const uint8_t *data = seg + hdr_len;
+  size_t data_len = len - hdr_len;
+  uint32_t seq = swap32(hdr->seq_number32);
+  uint32_t ack = swap32(hdr->ack_number32);
+  tcp_flags_t flags = hdr->flags;
+  if (flags.rst) {
+    stats.resets++;
+    if (flow->state != FLOW_WAIT)
+      flow_finish(flow, 0);
+    return;
+  }
+  if (flow->state == FLOW_SYN_SENT) {
+    if (!flags.syn || !flags.ack || ack != flow->iss + 1)
+      return;
+    // 完成三次握手，再单独发出请求：协议栈在SYN_RCVD状态下会忽略携带的数据
+    flow->rcv_nxt = seq + 1;
+    flow->snd_una = ack;
+    traffic_tcp_out(flow, flow->snd_nxt, tcp_flags_ack, NULL, 0);
+    uint8_t request[TRAFFIC_REQUEST_MAX > TRAFFIC_MSS ? TRAFFIC_REQUEST_MAX : TRAFFIC_MSS];
+    size_t request_len = flow_request(flow, request);
+    flow->snd_nxt += request_len;
+    flow->state = request_len ? FLOW_ESTABLISHED : FLOW_FIN_WAIT;
+    if (!request_len)
+      flow->snd_nxt++;
+    flow->retries = 0;
+    flow->deadline = stats.rounds + config.rto;
+    flow_send(flow);
+    return;
+  }
+  if (flow->state != FLOW_ESTABLISHED && flow->state != FLOW_FIN_WAIT)
+    return;
+  if (flags.ack && ack - flow->snd_una <= flow->snd_nxt - flow->snd_una && ack != flow->snd_una) {
+    flow->snd_una = ack;
+    flow->retries = 0;
+    if (flow->snd_una == flow->snd_nxt)
+      flow->deadline = stats.rounds + TRAFFIC_RESPONSE_ROUNDS;
+  }
+  if (seq != flow->rcv_nxt)
+    return; // 协议栈不会重传，乱序到达的数据只能等超时
+  if (data_len) {
+    if (!flow->received && data_len > 12 && memcmp(data, "HTTP/1.", 7) == 0) {
+      flow->status = atoi((const char *) data + 9);
+      flow->expect = http_response_len(data, data_len);
+    }
+    flow->received += data_len;
+    flow->rcv_nxt += data_len;
+    stats.bytes += data_len;
+  }
+  if (flags.fin) {
+    flow->rcv_nxt++;
+    if (flow->state == FLOW_ESTABLISHED) {
+      // 服务器先关闭，如http
+      traffic_tcp_out(flow, flow->snd_nxt++, tcp_flags_ack_fin, NULL, 0);
+    } else {
+      traffic_tcp_out(flow, flow->snd_nxt, tcp_flags_ack, NULL, 0);
+    }
+    if (config.mode == TRAFFIC_HTTP) {
+      flow_http_status(flow);
+      flow_finish(flow, flow->status != 0);
+    } else {
+      flow_finish(flow, flow->received >= config.payload_len);
+    }
+    return;
+  }
+  if (!data_len)
+    return;
+  if (config.mode == TRAFFIC_HTTP && flow->state == FLOW_ESTABLISHED && flow->expect &&
+      flow->received >= flow->expect && !flow_last_request(flow)) {
+    flow_next_request(flow);
+  } else if (config.mode == TRAFFIC_TCP && flow->state == FLOW_ESTABLISHED && flow->received >= config.payload_len) {
+    // 回显完整，客户端主动关闭
+    flow->snd_nxt++;
+    flow->state = FLOW_FIN_WAIT;
+    flow->retries = 0;
+    flow->deadline = stats.rounds + config.rto;
+    flow_send(flow);
+  } else {
+    traffic_tcp_out(flow, flow->snd_nxt, tcp_flags_ack, NULL, 0);
+  }
+}
+
+/**
+ * @brief 按协议分发一个完整的ip负载
+ *
+ */
+static void traffic_transport_in(traffic_host_t *host, uint8_t protocol, const uint8_t *data, size_t len) {
+  traffic_flow_t *flow;
+  switch (protocol) {
+    case NET_PROTOCOL_ICMP: {
+      const icmp_hdr_t *hdr = (const icmp_hdr_t *) data;
+      if (len < sizeof(icmp_hdr_t) || hdr->type != ICMP_TYPE_ECHO_REPLY)
+        return;
+      flow = traffic_flow_of(host, swap16(hdr->id16));
+      if (flow && flow->state == FLOW_WAIT && config.mode == TRAFFIC_PING && swap16(hdr->seq16) == flow->seq) {
+        stats.bytes += len - sizeof(icmp_hdr_t);
+        flow_finish(flow, 1);
+      }
+      break;
+    }
+    case NET_PROTOCOL_UDP: {
+      const udp_hdr_t *hdr = (const udp_hdr_t *) data;
+      if (len < sizeof(udp_hdr_t))
+        return;
+      flow = traffic_flow_of(host, swap16(hdr->dst_port16));
+      if (flow && flow->state == FLOW_WAIT && config.mode == TRAFFIC_UDP) {
+        stats.bytes += len - sizeof(udp_hdr_t);
+        flow_finish(flow, 1);
+      }
+      break;
+    }
+    case NET_PROTOCOL_TCP:
+      if (len < sizeof(tcp_hdr_t))
+        return;
+      flow = traffic_flow_of(host, swap16(((const tcp_hdr_t *) data)->dst_port16));
+      if (flow && (config.mode == TRAFFIC_TCP || config.mode == TRAFFIC_HTTP))
+        traffic_tcp_in(flow, data, len);
+      break;
+    default:
+      break;
+  }
+}
+
+/**
+ * @brief 处理协议栈发给主机的ip报文，分片在主机的重组缓冲中拼接
+ *
+ */
+static void traffic_ip_in(const uint8_t *data, size_t len) {
+  const ip_hdr_t *p = (const ip_hdr_t *) data;
+  if (len < sizeof(ip_hdr_t) || p->version != IP_VERSION_4)
+    return;
+  traffic_host_t *host = traffic_host_of(p->dst_ip);
+  size_t hdr_len = p->hdr_len * IP_HDR_LEN_PER_BYTE;
+  size_t total_len = swap16(p->total_len16);
+  if (!host || total_len > len || total_len < hdr_len)
+    return;
+  uint16_t fragment = swap16(p->flags_fragment16);
+  size_t offset = (fragment & (IP_MORE_FRAGMENT - 1)) * IP_HDR_OFFSET_PER_BYTE;
+  data += hdr_len;
+  len = total_len - hdr_len;
+  if (!offset && !(fragment & IP_MORE_FRAGMENT)) {
+    traffic_transport_in(host, p->protocol, data, len);
+    return;
+  }
+  if (offset + len > TRAFFIC_IP_MAX_LEN)
+    return;
+  if (!host->frag)
+    host->frag = malloc(TRAFFIC_IP_MAX_LEN);
+  if (!host->frag_active || host->frag_id != swap16(p->id16)) {
+    host->frag_active = 1;
+    host->frag_id = swap16(p->id16);
+    host->frag_got = 0;
+    host->frag_total = 0;
+  }
+  memcpy(host->frag + offset, data, len);
+  host->frag_got += len;
+  if (!(fragment & IP_MORE_FRAGMENT))
+    host->frag_total = offset + len;
+  if (host->frag_total && host->frag_got >= host->frag_total) {
+    host->frag_active = 0;
+    traffic_transport_in(host, p->protocol, host->frag, host->frag_total);
+  }
+}
+
+/**
+ * @brief 接收协议栈发出的帧
+ *
+ */
+static void traffic_in(const uint8_t *data, size_t len) {
+  stats.rx_frames++;
+  if (traffic_chance(config.loss)) {
+    stats.rx_dropped++;
+    return;
+  }
+  if (len < sizeof(ether_hdr_t))
+    return;
+  const ether_hdr_t *hdr = (const ether_hdr_t *) data;
+  if (hdr->protocol16 == constswap16(NET_PROTOCOL_ARP))
+    traffic_arp_in(data + sizeof(ether_hdr_t), len - sizeof(ether_hdr_t));
+  else if (hdr->protocol16 == constswap16(NET_PROTOCOL_IP))
+    traffic_ip_in(data + sizeof(ether_hdr_t), len - sizeof(ether_hdr_t));
+}
+
+/**
+ * @brief 进入下一轮：未解析的主机重发arp请求，处理各流的重传与超时
+ *
+ */
+static void traffic_step() {
+  stats.rounds++;
+  for (size_t i = 0; i < host_num; i++) {
+    traffic_host_t *host = &hosts[i];
+    if (!host->resolved && host->deadline <= stats.rounds) {
+      traffic_arp_out(host, ARP_REQUEST, ether_broadcast_mac);
+      host->deadline = stats.rounds + config.rto;
+    }
+  }
+  for (size_t i = 0; i < config.flows; i++) {
+    traffic_flow_t *flow = &flows[i];
+    if (flow->state == FLOW_IDLE || flow->state == FLOW_DONE || flow->deadline > stats.rounds)
+      continue;
+    int unacked = flow->state != FLOW_ESTABLISHED || flow->snd_una != flow->snd_nxt;
+    if (!unacked || flow->retries >= TRAFFIC_RETRY_MAX) {
+      flow_finish(flow, 0);
+      continue;
+    }
+    flow->retries++;
+    stats.retransmits++;
+    flow->deadline = stats.rounds + (config.rto << flow->retries);
+    flow_send(flow);
+  }
+  if (flows_active && stats.rounds - last_progress > TRAFFIC_STALL_ROUNDS) {
+    fprintf(stderr, "traffic: no transaction finished in %d rounds, the stack is stuck\n", TRAFFIC_STALL_ROUNDS);
+    traffic_print(stderr);
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void traffic_record(const traffic_frame_t *frame) {
+  uint32_t record[4] = {(uint32_t) stats.rounds, (uint32_t) (stats.tx_frames % 1000000), frame->len, frame->len};
+  fwrite(record, sizeof(record), 1, config.record);
+  fwrite(frame->data, 1, frame->len, config.record);
+}
+
+/**
+ * @brief 初始化流量生成器，之后由协议栈轮询驱动
+ *
+ * @param cfg 参数
+ * @return int 成功为0，参数错误为-1
+ */
+int traffic_init(const traffic_config_t *cfg) {
+  if (!cfg->flows || !cfg->count)
+    return -1;
+  config = *cfg;
+  if (!config.rto)
+    config.rto = TRAFFIC_RTO;
+  memset(&stats, 0, sizeof(stats));
+  last_progress = 0;
+  rng_state = config.seed * 0x9E3779B97F4A7C15ULL + 1;
+  size_t payload_max = config.mode == TRAFFIC_PING ? TRAFFIC_ICMP_MAX :
+                       config.mode == TRAFFIC_UDP ? TRAFFIC_UDP_MAX : TRAFFIC_MSS;
+  if (config.payload_len > payload_max)
+    config.payload_len = payload_max;
+  for (size_t i = 0; i < sizeof(payload); i++)
+    payload[i] = 'a' + i % 26;
+
+  free(path_buf);
+  path_buf = strdup(config.paths ? config.paths : "/");
+  path_num = 0;
+  for (char *p = strtok(path_buf, ","); p && path_num < sizeof(paths) / sizeof(paths[0]); p = strtok(NULL, ","))
+    paths[path_num++] = p;
+  if (!path_num)
+    paths[path_num++] = "/";
+
+  // 主机地址取协议栈所在/24网段中除协议栈外的地址
+  for (size_t i = 0; i < host_num; i++)
+    free(hosts[i].frag);
+  free(hosts);
+  host_num = config.flows < TRAFFIC_HOST_MAX ? config.flows : TRAFFIC_HOST_MAX;
+  hosts = calloc(host_num, sizeof(traffic_host_t));
+  memset(host_index, -1, sizeof(host_index));
+  for (size_t i = 0, last = 1; i < host_num; i++, last++) {
+    if (last == config.ip[NET_IP_LEN - 1])
+      last++;
+    memcpy(hosts[i].ip, config.ip, NET_IP_LEN);
+    hosts[i].ip[NET_IP_LEN - 1] = last;
+    hosts[i].mac[0] = 0x02; // 本地管理的单播地址
+    hosts[i].mac[4] = i >> 8;
+    hosts[i].mac[5] = i;
+    host_index[last] = i;
+  }
+
+  free(flows);
+  flows = calloc(config.flows, sizeof(traffic_flow_t));
+  memset(flow_of_port, 0, sizeof(flow_of_port));
+  for (size_t i = 0; i < config.flows; i++)
+    flows[i].host = i % host_num;
+  flows_active = config.flows;
+  queue_len = queue_next = 0;
+
+  if (config.record) {
+    uint32_t header[6] = {0xa1b2c3d4, 2 | (4 << 16), 0, 0, TRAFFIC_FRAME_LEN, 1};
+    fwrite(header, sizeof(header), 1, config.record);
+  }
+  return 0;
+}
+
+/**
+ * @brief 所有流的所有事务是否都已结束
+ *
+ */
+int traffic_done() {
+  return flows_active == 0;
+}
+
+const traffic_stats_t *traffic_stats() {
+  return &stats;
+}
+
+/**
+ * @brief 以json格式输出统计
+ *
+ */
+void traffic_print(FILE *f) {
+  fprintf(f, "{\n");
+  fprintf(f, "  \"rounds\": %llu,\n", (unsigned long long) stats.rounds);
+  fprintf(f, "  \"tx_frames\": %llu,\n", (unsigned long long) stats.tx_frames);
+  fprintf(f, "  \"rx_frames\": %llu,\n", (unsigned long long) stats.rx_frames);
+  fprintf(f, "  \"tx_dropped\": %llu,\n", (unsigned long long) stats.tx_dropped);
+  fprintf(f, "  \"rx_dropped\": %llu,\n", (unsigned long long) stats.rx_dropped);
+  fprintf(f, "  \"reordered\": %llu,\n", (unsigned long long) stats.reordered);
+  fprintf(f, "  \"retransmits\": %llu,\n", (unsigned long long) stats.retransmits);
+  fprintf(f, "  \"resets\": %llu,\n", (unsigned long long) stats.resets);
+  fprintf(f, "  \"completed\": %llu,\n", (unsigned long long) stats.completed);
+  fprintf(f, "  \"failed\": %llu,\n", (unsigned long long) stats.failed);
+  fprintf(f, "  \"http_2xx\": %llu,\n", (unsigned long long) stats.http_2xx);
+  fprintf(f, "  \"http_other\": %llu,\n", (unsigned long long) stats.http_other);
+  fprintf(f, "  \"bytes\": %llu\n", (unsigned long long) stats.bytes);
+  fprintf(f, "}\n");
+}
+
+static int traffic_driver_open(netif_t *netif) {
+  return 0;
+}
+
+/**
+ * @brief 取出下一个发往协议栈的帧，队列空时进入下一轮
+ *
+ */
+static int traffic_driver_recv(netif_t *netif, buf_t *buf) {
+  if (queue_next == queue_len) {
+    queue_next = queue_len = 0;
+    traffic_step();
+    if (!queue_len)
+      return 0;
+  }
+  traffic_frame_t *frame = &queue[queue_next++];
+  stats.tx_frames++;
+  if (config.record)
+    traffic_record(frame);
+  buf_init(buf, frame->len);
+  memcpy(buf->data, frame->data, frame->len);
+  return frame->len;
+}
+
+static int traffic_driver_send(netif_t *netif, buf_t *buf) {
+  traffic_in(buf->data, buf->len);
+  return 0;
+}
+
+static void traffic_driver_close(netif_t *netif) {
+}
+
+const driver_ops_t driver_pcap_ops = {
+    .name = "traffic",
+    .open = traffic_driver_open,
+    .recv = traffic_driver_recv,
+    .send = traffic_driver_send,
+    .close = traffic_driver_close,
+};
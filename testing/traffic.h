@@ -0,0 +1,65 @@
+#ifndef TRAFFIC_H
+#define TRAFFIC_H
+
+#include <stdio.h>
+#include "net.h"
+
+#define TRAFFIC_HOST_MAX 200          //最多模拟的主机数，地址取协议栈网卡所在的/24网段
+#define TRAFFIC_PORT_BASE 1024        //客户端端口(ping的id)起始值，每个新事务换一个端口
+#define TRAFFIC_PORT_RANGE 60000      //客户端端口数量
+#define TRAFFIC_RTO 8                 //重传超时的轮数，每次重传翻倍
+#define TRAFFIC_RTO_SHARD 256         //分片模式下的重传超时轮数，帧在分片线程中异步处理，回复晚若干轮才到
+#define TRAFFIC_RETRY_MAX 4           //单个报文最多重传次数，超过则事务失败
+#define TRAFFIC_RESPONSE_ROUNDS 4096  //请求已被确认后等待响应的最多轮数
+#define TRAFFIC_STALL_ROUNDS 100000   //连续这么多轮没有事务结束，认为协议栈卡死
+
+typedef enum traffic_mode {
+  TRAFFIC_PING, // icmp回显请求
+  TRAFFIC_UDP,  // udp回显
+  TRAFFIC_TCP,  // tcp三次握手，回显一段数据后关闭连接
+  TRAFFIC_HTTP, // tcp连接上发送GET请求，按Content-Length读完响应后发下一个请求，直到服务器关闭连接
+} traffic_mode_t;
+
+typedef struct traffic_config //流量生成参数
+{
+  traffic_mode_t mode;
+  uint8_t ip[NET_IP_LEN];     // 被测协议栈的ip地址
+  size_t flows;               // 并发的流数，轮流分配到各模拟主机上
+  size_t count;               // 每个流依次完成的事务数
+  size_t payload_len;         // ping/udp/tcp每个事务的负载长度
+  uint16_t port;              // 服务端口
+  const char *paths;          // http请求路径，多个路径用逗号分隔，各事务轮流请求
+  size_t keepalive;           // http每个连接上依次发送的请求数，大于1时使用持久连接，最后一个请求带Connection: close
+  double loss;                // 两个方向上各自的丢包率
+  double reorder;             // 发往协议栈的帧与前一帧交换顺序的概率
+  uint32_t seed;              // 随机数种子，相同参数与种子生成相同的流量
+  uint64_t rto;               // 重传超时的轮数，为0时取TRAFFIC_RTO
+  FILE *record;               // 非空时把发往协议栈的帧写成pcap，可再交给faker驱动或net_bench回放
+} traffic_config_t;
+
+typedef struct traffic_stats //流量生成统计
+{
+  uint64_t rounds;            // 轮数，发往协议栈的帧全部送出后进入下一轮
+  uint64_t tx_frames;         // 发往协议栈的帧数
+  uint64_t rx_frames;         // 从协议栈收到的帧数
+  uint64_t tx_dropped;        // 模拟丢弃的发往协议栈的帧数
+  uint64_t rx_dropped;        // 模拟丢弃的协议栈发出的帧数
+  uint64_t reordered;         // 交换了顺序的帧数
+  uint64_t retransmits;       // 重传次数
+  uint64_t resets;            // 收到的tcp复位数
+  uint64_t completed;         // 成功完成的事务数
+  uint64_t failed;            // 超时或被复位的事务数
+  uint64_t http_2xx;          // http 2xx响应数
+  uint64_t http_other;        // 其他http响应数
+  uint64_t bytes;             // 收到的应用层字节数
+} traffic_stats_t;
+
+int traffic_init(const traffic_config_t *config);
+
+int traffic_done();
+
+const traffic_stats_t *traffic_stats();
+
+void traffic_print(FILE *f);
+
+#endif
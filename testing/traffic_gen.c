@@ -0,0 +1,167 @@
+//
+// 进程内压测协议栈：流量生成器模拟一批客户端，与完整协议栈及main中的回显、http应用交互
+// 用法: traffic_gen [-m ping|udp|tcp|http] [-c 并发流数] [-n 每个流的事务数] [-l 负载长度]
+//                   [-p path[,path...]] [-k 每个连接的http请求数] [-L 丢包率] [-R 乱序率] [-S 种子] [-o 记录.pcap] [-j 输出json文件]
+//                   [-w 分片数]
+// 指定-w时协议栈运行在分片线程中，本线程只负责分发，依次用-w 1/2/4运行可比较每秒事务数随分片数的变化
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "traffic.h"
+#include "driver.h"
+#include "udp.h"
+#include "tcp.h"
+#include "http.h"
+#include "shard.h"
+
+#define TRAFFIC_UDP_PORT 60000
+#define TRAFFIC_TCP_PORT 61000
+#define TRAFFIC_HTTP_PORT 62000
+
+static void echo_udp_handler(netif_t *netif, uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port) {
+  udp_send(netif, data, len, TRAFFIC_UDP_PORT, src_ip, src_port);
+}
+
+static void echo_tcp_handler(tcp_connect_t *connect, connect_state_t state) {
+  uint8_t buf[ETHERNET_MAX_TRANSPORT_UNIT];
+  size_t len = tcp_connect_read(connect, buf, sizeof(buf));
+  if (len)
+    tcp_connect_write(connect, buf, len);
+}
+
+static void app_setup() {
+  udp_open(TRAFFIC_UDP_PORT, echo_udp_handler);
+  tcp_open(TRAFFIC_TCP_PORT, echo_tcp_handler);
+  http_server_open(TRAFFIC_HTTP_PORT);
+}
+
+static void app_poll() {
+  http_server_run();
+}
+
+static double now_sec() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+  traffic_config_t config = {
+      .mode = TRAFFIC_PING,
+      .ip = NET_IF_IP,
+      .flows = 16,
+      .count = 100,
+      .payload_len = 64,
+      .paths = "/",
+      .keepalive = 1,
+  };
+  uint8_t mac[NET_MAC_LEN] = NET_IF_MAC;
+  const char *json_path = NULL;
+  const char *record_path = NULL;
+  int port = 0;
+  size_t workers = 0;
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 >= argc)
+      goto usage;
+    const char *arg = argv[i + 1];
+    if (strcmp(argv[i], "-m") == 0) {
+      if (strcmp(arg, "ping") == 0) config.mode = TRAFFIC_PING;
+      else if (strcmp(arg, "udp") == 0) config.mode = TRAFFIC_UDP;
+      else if (strcmp(arg, "tcp") == 0) config.mode = TRAFFIC_TCP;
+      else if (strcmp(arg, "http") == 0) config.mode = TRAFFIC_HTTP;
+      else goto usage;
+    } else if (strcmp(argv[i], "-c") == 0) {
+      config.flows = strtoul(arg, NULL, 10);
+    } else if (strcmp(argv[i], "-n") == 0) {
+      config.count = strtoul(arg, NULL, 10);
+    } else if (strcmp(argv[i], "-l") == 0) {
+      config.payload_len = strtoul(arg, NULL, 10);
+    } else if (strcmp(argv[i], "-p") == 0) {
+      config.paths = arg;
+    } else if (strcmp(argv[i], "-k") == 0) {
+      config.keepalive = strtoul(arg, NULL, 10);
+    } else if (strcmp(argv[i], "-L") == 0) {
+      config.loss = atof(arg);
+    } else if (strcmp(argv[i], "-R") == 0) {
+      config.reorder = atof(arg);
+    } else if (strcmp(argv[i], "-S") == 0) {
+      config.seed = strtoul(arg, NULL, 10);
+    } else if (strcmp(argv[i], "-P") == 0) {
+      port = atoi(arg);
+    } else if (strcmp(argv[i], "-o") == 0) {
+      record_path = arg;
+    } else if (strcmp(argv[i], "-j") == 0) {
+      json_path = arg;
+    } else if (strcmp(argv[i], "-w") == 0) {
+      workers = strtoul(arg, NULL, 10);
+      if (!workers || workers > SHARD_MAX_NUM)
+        goto usage;
+      config.rto = TRAFFIC_RTO_SHARD;
+    } else {
+      goto usage;
+    }
+    i++;
+  }
+  config.port = port ? port : config.mode == TRAFFIC_UDP ? TRAFFIC_UDP_PORT :
+                              config.mode == TRAFFIC_TCP ? TRAFFIC_TCP_PORT : TRAFFIC_HTTP_PORT;
+  if (record_path && !(config.record = fopen(record_path, "wb"))) {
+    fprintf(stderr, "traffic_gen: cannot write %s\n", record_path);
+    return -1;
+  }
+  if (traffic_init(&config) != 0)
+    goto usage;
+
+  srand(config.seed);
+  netif_add("traffic", config.ip, mac, &driver_pcap_ops);
+  if (net_init() != 0)
+    return -1;
+  if (workers && shard_start(workers, app_setup, app_poll) != 0)
+    return -1;
+  if (!workers)
+    app_setup();
+
+  double start = now_sec();
+  while (!traffic_done()) {
+    if (workers) {
+      // 空闲时让出处理器，分片线程才能处理已分发的帧
+      if (!shard_poll()) {
+        struct timespec sleep_time = {0, SHARD_IDLE_NS};
+        nanosleep(&sleep_time, NULL);
+      }
+      continue;
+    }
+    net_poll();
+    app_poll();
+  }
+  double elapsed = now_sec() - start;
+  if (workers)
+    shard_stop();
+
+  const traffic_stats_t *stats = traffic_stats();
+  FILE *out = stdout;
+  if (json_path && !(out = fopen(json_path, "w"))) {
+    fprintf(stderr, "traffic_gen: cannot write %s\n", json_path);
+    return -1;
+  }
+  traffic_print(out);
+  fprintf(stderr, "traffic_gen: %zu workers, %llu/%llu transactions in %.3fs, %.0f transactions/s, %.0f frames/s\n",
+          workers, (unsigned long long) stats->completed, (unsigned long long) (config.flows * config.count),
+          elapsed, stats->completed / elapsed, (stats->tx_frames + stats->rx_frames) / elapsed);
+  if (out != stdout)
+    fclose(out);
+  if (config.record)
+    fclose(config.record);
+  // 没有模拟丢包与乱序时，所有事务都应成功
+  if (config.loss == 0 && config.reorder == 0 && stats->failed)
+    return 1;
+  return 0;
+
+usage:
+  fprintf(stderr, "usage: %s [-m ping|udp|tcp|http] [-c flows] [-n count] [-l payload] [-p path[,path...]] "
+                  "[-k requests/connection] [-L loss] [-R reorder] [-S seed] [-P port] [-o record.pcap] [-j out.json] "
+                  "[-w workers]\n", argv[0]);
+  return -1;
+}
@@ -0,0 +1,213 @@
+//
+// 虚拟链路测试：丢帧与乱序按种子确定，同样的种子重放得到同样的接收序列；延迟与带宽决定送达时间；
+// 两个线程各自运行一个协议栈，经虚拟链路由压测客户端对http服务器发请求，响应延迟不小于往返延迟，
+// 传输时间不小于响应字节数按带宽计的时间
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "driver.h"
+#include "tcp.h"
+#include "http.h"
+#include "http_load.h"
+
+#define FRAMES 1000
+
+static int failed;
+
+static void expect(int cond, const char *name) {
+  if (!cond) {
+    printf("%s: failed\n", name);
+    failed = 1;
+  }
+}
+
+static int stub_open(netif_t *netif) {
+  return -1;
+}
+
+const driver_ops_t driver_pcap_ops = {"stub", stub_open, NULL, NULL, NULL};
+
+static double now_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void wire_open(netif_t *a, netif_t *b, const char *name) {
+  memset(a, 0, sizeof(netif_t));
+  memset(b, 0, sizeof(netif_t));
+  strcpy(a->name, name);
+  strcpy(b->name, name);
+  a->ops = b->ops = &driver_wire_ops;
+  expect(driver_open(a) == 0 && driver_open(b) == 0, "open");
+}
+
+/**
+ * @brief 从a向b发送FRAMES个带序号的帧，收齐后返回收到的序号
+ *
+ * @return size_t 收到的帧数
+ */
+static size_t replay(const char *name, uint16_t *order, driver_wire_stats_t *stats) {
+  netif_t a, b;
+  buf_t buf;
+  wire_open(&a, &b, name);
+  for (uint16_t i = 0; i < FRAMES; i++) {
+    buf_init(&buf, 64);
+    memset(buf.data, 0, 64);
+    memcpy(buf.data, &i, sizeof(i));
+    driver_send(&a, &buf);
+  }
+  size_t count = 0;
+  // 最后一帧可能被扣下，WIRE_HOLD_NS后由发送端的轮询放出
+  for (double last = now_seconds(); now_seconds() - last < 0.02;) {
+    driver_recv(&a, &buf);
+    if (driver_recv(&b, &buf) > 0) {
+      memcpy(&order[count++], buf.data, sizeof(uint16_t));
+      last = now_seconds();
+    }
+  }
+  driver_wire_stats(&a, stats);
+  driver_close(&a);
+  driver_close(&b);
+  return count;
+}
+
+/**
+ * @brief 丢帧与乱序
+ *
+ */
+static void test_loss_reorder() {
+  driver_wire_config_t config = {.loss = 0.1, .reorder = 0.1, .seed = 7};
+  expect(driver_wire_config("lossy", &config) == 0, "config");
+  static uint16_t first[FRAMES], second[FRAMES];
+  driver_wire_stats_t stats, again;
+  size_t count = replay("lossy", first, &stats);
+  expect(stats.tx_frames == FRAMES && stats.lost > 50 && stats.lost < 150 && stats.reordered > 50 &&
+         !stats.overflow && count == FRAMES - stats.lost, "loss");
+  size_t inversions = 0;
+  for (size_t i = 1; i < count; i++)
+    inversions += first[i] < first[i - 1];
+  // 每个被扣下的帧被下一帧超过一次，最后一帧被扣下时没有帧超过它
+  expect(inversions == stats.reordered || inversions + 1 == stats.reordered, "reorder");
+  // 重新打开同名链路，同样的种子得到同样的序列
+  expect(replay("lossy", second, &again) == count && memcmp(first, second, count * sizeof(uint16_t)) == 0 &&
+         again.lost == stats.lost, "deterministic");
+
+  netif_t a, b, c;
+  wire_open(&a, &b, "busy");
+  strcpy(c.name, "busy");
+  c.ops = &driver_wire_ops;
+  expect(driver_open(&c) == -1, "third end");
+  driver_close(&a);
+  driver_close(&b);
+}
+
+/**
+ * @brief 2ms延迟，8Mbit/s带宽下10个1000字节的帧在12ms后收齐
+ *
+ */
+static void test_latency_bandwidth() {
+  driver_wire_config_t config = {.latency_ns = 2000000, .bandwidth = 8000000};
+  driver_wire_config("slow", &config);
+  netif_t a, b;
+  buf_t buf;
+  wire_open(&a, &b, "slow");
+  double start = now_seconds();
+  for (int i = 0; i < 10; i++) {
+    buf_init(&buf, 1000);
+    driver_send(&b, &buf);
+  }
+  expect(driver_recv(&a, &buf) == 0, "latency");
+  int count = 0;
+  while (count < 10 && now_seconds() - start < 1)
+    count += driver_recv(&a, &buf) > 0;
+  expect(count == 10 && now_seconds() - start >= 0.012, "bandwidth");
+  driver_close(&a);
+  driver_close(&b);
+}
+
+static atomic_int server_ready, server_stop;
+
+static void *server_thread(void *arg) {
+  uint8_t ip[NET_IP_LEN] = {10, 0, 0, 1}, mac[NET_MAC_LEN] = {2, 0, 0, 0, 0, 1};
+  netif_add("http", ip, mac, &driver_wire_ops);
+  if (net_init() != 0 || http_server_open(62000) != 0) {
+    printf("server: init failed\n");
+    failed = 1;
+    atomic_store(&server_ready, -1);
+    return NULL;
+  }
+  atomic_store(&server_ready, 1);
+  // 空闲时让出处理器，单核时另一个协议栈才能及时运行
+  while (!atomic_load(&server_stop)) {
+    if (!net_poll())
+      sched_yield();
+    http_server_run();
+  }
+  return NULL;
+}
+
+/**
+ * @brief 运行一轮压测直到结束
+ *
+ */
+static const http_load_stats_t *load(const char *path, uint64_t requests) {
+  http_load_config_t config = {.ip = {10, 0, 0, 1}, .port = 62000, .path = path, .connections = 4,
+                               .requests = requests};
+  if (http_load_start(&config) != 0)
+    return NULL;
+  double start = now_seconds();
+  while (http_load_run() && now_seconds() - start < 10)
+    if (!net_poll())
+      sched_yield();
+  http_load_stop();
+  http_load_report(stdout);
+  const http_load_stats_t *s = http_load_stats();
+  return s->completed == requests && s->status_2xx == requests && !s->errors && !s->timeouts ? s : NULL;
+}
+
+/**
+ * @brief 100us单向延迟，20Mbit/s带宽，两个协议栈之间的http
+ *
+ */
+static void *client_thread(void *arg) {
+  uint8_t ip[NET_IP_LEN] = {10, 0, 0, 2}, mac[NET_MAC_LEN] = {2, 0, 0, 0, 0, 2};
+  netif_add("http", ip, mac, &driver_wire_ops);
+  if (net_init() != 0) {
+    printf("client: init failed\n");
+    failed = 1;
+    return NULL;
+  }
+  const http_load_stats_t *s = load("/index.html", 200);
+  expect(s && latency_hist_quantile(&s->latency, 0) * latency_ns_per_cycle() >= 200000, "round trip");
+  s = load("/img1.jpg", 10);
+  expect(s && s->seconds >= s->bytes * 8 / 20e6, "throughput");
+  return NULL;
+}
+
+int main() {
+  test_loss_reorder();
+  test_latency_bandwidth();
+
+  driver_wire_config_t config = {.latency_ns = 100000, .bandwidth = 20000000};
+  driver_wire_config("http", &config);
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, SHARD_STACK_SIZE);
+  pthread_t server, client;
+  pthread_create(&server, &attr, server_thread, NULL);
+  while (!atomic_load(&server_ready));
+  if (atomic_load(&server_ready) > 0) {
+    pthread_create(&client, &attr, client_thread, NULL);
+    pthread_join(client, NULL);
+  }
+  atomic_store(&server_stop, 1);
+  pthread_join(server, NULL);
+  pthread_attr_destroy(&attr);
+  return failed;
+}